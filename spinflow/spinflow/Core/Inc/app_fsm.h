@@ -0,0 +1,94 @@
+/**
+ ******************************************************************************
+ * @file    app_fsm.h
+ *
+ * @author 	Marco Rolón Radcenco
+ *
+ * @brief   Application FSM header
+ *
+ * State logic of the application. The FSM reads the IMU API and its own timer,
+ * and returns an event for each step that needs an action. The actions
+ * (log, NeoPixels, LEDs, low-power idle) are taken by the caller, so the FSM
+ * has no HAL dependency and can be driven on the host with the IMU trace replay:
+ *
+ *     appFsm_Init();
+ *     while (!imuReplay_Done())
+ *     {
+ *         imuReplay_Advance(1);
+ *         imu_GetData();
+ *         event = appFsm_Tasks(imuReplay_Time(), true, true);
+ *         ...
+ *     }
+ ******************************************************************************
+ */
+
+#ifndef APP_FSM_H
+#define APP_FSM_H
+
+#include "imu_api.h"
+
+/**
+ * @enum appState_t
+ * @brief Enumerates the states of the application's finite state machine (FSM).
+ *
+ * This enumeration defines the various states that the application can be in
+ * at any given time. The FSM handles transitions between these states based on
+ * internal and external events.
+ */
+typedef enum
+{
+	APP_START, /**< Initial state of the application upon power-up or reset. */
+	APP_START_DELAY, /**< Delay state after start, before the application becomes fully active. */
+	APP_IDLE, /**< Idle state where the application is waiting for motion detection. */
+	APP_ACTIVE, /**< Active state indicating the application is currently processing tasks. */
+	APP_POS_SPIN, /**< State indicating the application is experiencing a positive spin. */
+	APP_NEG_SPIN, /**< State indicating the application is experiencing a negative spin. */
+	APP_DELAY, /**< Delay state for NeoPixels operation. */
+	APP_SLEEP /**< Blanking the NeoPixels before entering low-power idle. */
+} appState_t;
+
+/**
+ * @enum appEvent_t
+ * @brief Enumerates the events returned by the FSM, each one asks the caller for an action.
+ */
+typedef enum
+{
+	APP_EVENT_NONE, /**< Nothing to do. */
+	APP_EVENT_IMU_OK, /**< The IMU answered, the application starts. */
+	APP_EVENT_IMU_ERROR, /**< The IMU did not answer, the check is retried after APP_START_DELAY_MS. */
+	APP_EVENT_IDLE, /**< Idle evaluation without motion, the idle pattern is shown. */
+	APP_EVENT_SLEEP, /**< Idle for APP_SLEEP_DELAY_MS, the idle pattern is shown and the strip is blanked. */
+	APP_EVENT_STOP, /**< The strip is blank, the low-power idle is entered until the IMU detects motion. */
+	APP_EVENT_ACTIVE, /**< Motion detected. */
+	APP_EVENT_NO_SPIN, /**< The motion stopped. */
+	APP_EVENT_POS_SPIN, /**< Positive spin detected. */
+	APP_EVENT_NEG_SPIN, /**< Negative spin detected. */
+	APP_EVENT_POS_SPIN_SHOW, /**< The positive spin pattern is shown. */
+	APP_EVENT_NEG_SPIN_SHOW, /**< The negative spin pattern is shown. */
+	APP_EVENT_ERROR /**< Unexpected IMU or FSM state, see appFsm_State(). */
+} appEvent_t;
+
+/**
+ * @brief Initializes the FSM in APP_START.
+ */
+void appFsm_Init();
+
+/**
+ * @brief Runs a step of the FSM.
+ * @param now Current tick, in milliseconds.
+ * @param sleepAllowed Set when nothing else keeps the device awake (NeoPixels stream, USB host, trace).
+ * @param npxIdle Set when the NeoPixels are not sending a frame.
+ * @return appEvent_t Event of the step.
+ *
+ * This function is called repeatedly within the main loop. After APP_EVENT_STOP,
+ * the FSM continues in APP_IDLE, the caller returns once the device woke up.
+ */
+appEvent_t appFsm_Tasks(uint32_t now, bool_t sleepAllowed, bool_t npxIdle);
+
+/**
+ * @brief Gets the state of the FSM.
+ * @return appState_t Current state.
+ */
+appState_t appFsm_State();
+
+#endif
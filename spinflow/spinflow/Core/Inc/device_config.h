@@ -11,10 +11,23 @@
 #ifndef DEVICE_CONFIG_H_
 #define DEVICE_CONFIG_H_
 
+/**
+ * @def DEVICE_IMU_REPLAY
+ * @brief Host build replaying IMU traces instead of reading the sensor.
+ *
+ * Set to 1 from the compiler command line (-DDEVICE_IMU_REPLAY=1) to build the IMU
+ * API on a host, with imu_replay.c in place of imu_port.c. The HAL is not included.
+ */
+#ifndef DEVICE_IMU_REPLAY
+#define DEVICE_IMU_REPLAY 0
+#endif
+
 #include <stdio.h>
+#if !DEVICE_IMU_REPLAY
 #include "stm32f4xx_hal.h"
 #include "stm32f4xx_hal_msp.h"
 #include "stm32f4xx_nucleo_144.h"
+#endif
 
 /**
  * @def DEVICE_NAME
@@ -44,6 +57,168 @@
  */
 #define DEVICE_IMU_SPIN_THRESHOLD 90
 
+/**
+ * @def DEVICE_IMU_SPIN_EXIT_THRESHOLD
+ * @brief Threshold value for the end of an IMU spin or motion, in degrees per second.
+ *
+ * Lower than DEVICE_IMU_SPIN_THRESHOLD, so readings close to the threshold do not make the state flicker.
+ */
+#define DEVICE_IMU_SPIN_EXIT_THRESHOLD 60
+
+/**
+ * @def DEVICE_IMU_SPIN_DWELL_MS
+ * @brief Time a new IMU spin or motion state must hold before it is reported, in milliseconds.
+ */
+#define DEVICE_IMU_SPIN_DWELL_MS 30
+
+/**
+ * @def DEVICE_IMU_RPM_TAU_MS
+ * @brief Time constant of the rotation speed smoothing, in milliseconds. 0 reports the raw speed.
+ */
+#define DEVICE_IMU_RPM_TAU_MS 100
+
+/**
+ * @def DEVICE_IMU_RPM_DEADBAND_DPS
+ * @brief Rate below which the rotation is not integrated, in degrees per second.
+ *
+ * Keeps the residual gyroscope bias from adding up to revolutions while the device is still.
+ */
+#define DEVICE_IMU_RPM_DEADBAND_DPS 1
+
+/**
+ * @def DEVICE_IMU_WOM_THRESHOLD_MG
+ * @brief Acceleration change that wakes the device from low-power idle, in milli-g (4 to 1020).
+ */
+#define DEVICE_IMU_WOM_THRESHOLD_MG 80
+
+/**
+ * @def DEVICE_IMU_SPI
+ * @brief Select the IMU transport: SPI3 (1) or I2C1 (0).
+ *
+ * On I2C at 400 kHz, a 21-byte sample takes about 0.5 ms to read. On SPI the registers
+ * are accessed at up to 1 MHz and the FIFO is read by DMA at up to 20 MHz, a full FIFO
+ * in about 0.25 ms.
+ */
+#define DEVICE_IMU_SPI 0
+
+/**
+ * @def DEVICE_IMU_BUS_TIMEOUT_MS
+ * @brief Longest IMU register access, in milliseconds. A bus that hangs longer is recovered.
+ */
+#define DEVICE_IMU_BUS_TIMEOUT_MS 5
+
+/**
+ * @def DEVICE_IMU_COUNT
+ * @brief Number of MPU-9250 sensors on the IMU bus (1 or 2).
+ *
+ * The second one has its AD0 pin high (address 0x69) on I2C, or its own chip select
+ * on SPI. Only the INT pin of the first one is wired: each batch reads the FIFOs of
+ * all sensors back to back. On I2C, with two sensors and the magnetometers at 1 kHz,
+ * the bus is close to its 400 kHz limit.
+ */
+#define DEVICE_IMU_COUNT 1
+
+/**
+ * @def DEVICE_IMU_SAMPLE_RATE_HZ
+ * @brief IMU output data rate at start-up, in Hz (4 to 1000).
+ *
+ * It can be changed at run time with imu_SetConfig(). Samples are queued in the sensor FIFO and read by DMA in batches.
+ */
+#define DEVICE_IMU_SAMPLE_RATE_HZ 1000
+
+/**
+ * @def DEVICE_IMU_DLPF
+ * @brief IMU digital low-pass filter bandwidth (imuDlpf_t).
+ */
+#define DEVICE_IMU_DLPF IMU_DLPF_184HZ
+
+/**
+ * @def DEVICE_IMU_ACC_FSR
+ * @brief IMU accelerometer full scale range (imuAccFsr_t).
+ */
+#define DEVICE_IMU_ACC_FSR ACC_FSR_4G
+
+/**
+ * @def DEVICE_IMU_GYRO_FSR
+ * @brief IMU gyroscope full scale range (imuGyroFsr_t).
+ */
+#define DEVICE_IMU_GYRO_FSR GYR_FSR_500DPS
+
+/**
+ * @def DEVICE_IMU_FIFO_BATCH
+ * @brief Number of IMU samples read from the sensor FIFO in each burst (1 to 24), at DEVICE_IMU_SAMPLE_RATE_HZ.
+ *
+ * The FIFO holds 24 samples with the magnetometer data, the rest is margin for the bus latency.
+ * The batch is scaled with the sample rate when it is changed at run time.
+ */
+#define DEVICE_IMU_FIFO_BATCH 16
+
+/**
+ * @def DEVICE_IMU_RING_SIZE
+ * @brief Number of IMU samples buffered between the interrupt and the application. Must be a power of two.
+ */
+#define DEVICE_IMU_RING_SIZE 128
+
+/**
+ * @def DEVICE_IMU_AHRS_BETA
+ * @brief Gain of the IMU orientation filter.
+ *
+ * Higher values follow the accelerometer faster, at the cost of more noise on the orientation.
+ */
+#define DEVICE_IMU_AHRS_BETA 0.05f
+
+/**
+ * @def DEVICE_IMU_FILTER_LOWPASS_HZ
+ * @brief Cutoff frequency of the gyroscope low-pass filter, in Hz. 0 disables it.
+ *
+ * Removes vibration from the angular velocity used for spin and motion detection.
+ */
+#define DEVICE_IMU_FILTER_LOWPASS_HZ 20
+
+/**
+ * @def DEVICE_IMU_FILTER_STAGES
+ * @brief Number of biquad stages of the gyroscope low-pass filter (1 to 4), the filter order is twice this value.
+ */
+#define DEVICE_IMU_FILTER_STAGES 2
+
+/**
+ * @def DEVICE_IMU_FILTER_TAPS
+ * @brief Length of the gyroscope moving average (2 to 16), used when the low-pass filter is disabled. 0 disables it.
+ */
+#define DEVICE_IMU_FILTER_TAPS 0
+
+/**
+ * @def DEVICE_IMU_TRACE_ENABLE
+ * @brief Enable or disable the IMU trace recording over the USB virtual COM port.
+ *
+ * When enabled (1), the raw IMU samples are streamed as a binary trace while a host
+ * has the device configured. The trace can be replayed with a DEVICE_IMU_REPLAY build.
+ */
+#define DEVICE_IMU_TRACE_ENABLE 0
+
+/**
+ * @def DEVICE_IMU_TRACE_BUFFER
+ * @brief Size of the IMU trace buffer, in bytes. Records that do not fit are dropped.
+ */
+#define DEVICE_IMU_TRACE_BUFFER 2048
+
+/**
+ * @def DEVICE_IMU_VIB_SIZE
+ * @brief Length of the accelerometer vibration analysis windows, in samples. A power of two from 32 to 512, 0 disables the analysis.
+ *
+ * The spectrum resolution is the sample rate divided by this length: about 3.9 Hz with 256 samples at 1 kHz.
+ */
+#define DEVICE_IMU_VIB_SIZE 256
+
+/**
+ * @def DEVICE_IMU_GESTURE_ENABLE
+ * @brief Enable or disable the gesture recognition.
+ *
+ * Controls whether the IMU samples are fed to the gesture engine (1) or not (0). Its templates
+ * are trained with Tools/imu_gesture.py.
+ */
+#define DEVICE_IMU_GESTURE_ENABLE 1
+
 /**
  * @def DEVICE_NEOPIXEL_QUANTITY
  * @brief Number of NeoPixels in the device.
@@ -61,16 +236,46 @@
 
 /**
  * @def APP_IDLE_DELAY_MS
- * @brief Delay duration between consecutive readings in idle state, in milliseconds.
+ * @brief Delay duration between consecutive state evaluations in idle state, in milliseconds. IMU samples are taken at DEVICE_IMU_SAMPLE_RATE_HZ.
  */
 #define APP_IDLE_DELAY_MS 50
 
+/**
+ * @def APP_SLEEP_DELAY_MS
+ * @brief Time without motion in idle state before entering low-power idle, in milliseconds.
+ */
+#define APP_SLEEP_DELAY_MS 10000
+
+/**
+ * @def APP_SLEEP_BLANK_MS
+ * @brief Time given to the NeoPixels to show the blank frame before entering low-power idle, in milliseconds.
+ */
+#define APP_SLEEP_BLANK_MS 50
+
 /**
  * @def APP_CONFIG_DELAY_MS
  * @brief Delay duration between consecutive readings in active state, used for NeoPixel configuration operations, in milliseconds.
  */
 #define APP_CONFIG_DELAY_MS 100
 
+/**
+ * @def APP_VIB_LOG_MS
+ * @brief Time between two vibration reports in the log, in milliseconds. 0 disables them.
+ */
+#define APP_VIB_LOG_MS 0
+
+/**
+ * @def APP_ROTATION_LOG_MS
+ * @brief Time between two rotation reports in the log while active, in milliseconds. 0 disables them.
+ */
+#define APP_ROTATION_LOG_MS 0
+
+/**
+ * @def APP_TIMING_LOG_MS
+ * @brief Time between two reports of the IMU sample interval jitter in the log, in milliseconds. 0 disables them.
+ */
+#define APP_TIMING_LOG_MS 0
+
 /**
  * @def DEVICE_LOG_ENABLE
  * @brief Enable or disable logging feature.
@@ -87,4 +292,36 @@
  */
 #define DEVICE_NEOPIXEL_INITIAL_SEQUENCE 1
 
+/**
+ * @def DEVICE_USB_STREAM_ENABLE
+ * @brief Enable or disable pixel frame streaming over the USB virtual COM port.
+ *
+ * Controls whether the USB CDC device is started (1) or not (0).
+ */
+#define DEVICE_USB_STREAM_ENABLE 1
+
+/**
+ * @def DEVICE_USB_RX_PACKETS
+ * @brief Number of 64 byte USB packets buffered before the host is throttled. Must be a power of two.
+ */
+#define DEVICE_USB_RX_PACKETS 8
+
+/**
+ * @def DEVICE_NEOPIXEL_STREAM_TIMEOUT_MS
+ * @brief Time without streamed frames after which the application takes back the NeoPixels, in milliseconds.
+ */
+#define DEVICE_NEOPIXEL_STREAM_TIMEOUT_MS 1000
+
+/**
+ * @def DEVICE_NEOPIXEL_SEGMENTS
+ * @brief Maximum number of NeoPixels segments, each one with its own effect, brightness and update rate.
+ */
+#define DEVICE_NEOPIXEL_SEGMENTS 4
+
+/**
+ * @def DEVICE_NEOPIXEL_PARTICLES
+ * @brief Size of the NeoPixels particle pool.
+ */
+#define DEVICE_NEOPIXEL_PARTICLES 128
+
 #endif /* DEVICE_CONFIG_H_ */
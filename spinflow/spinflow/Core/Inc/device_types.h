@@ -13,9 +13,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#if !DEVICE_IMU_REPLAY
 #include "stm32f4xx_hal.h"
 #include "stm32f4xx_hal_msp.h"
 #include "stm32f4xx_nucleo_144.h"
+#endif
 
 /**
  * @brief bool_t Boolean type
@@ -20,6 +20,23 @@
 ///* Private defines -----------------------------------------------------------*/
 #define USER_Btn_Pin GPIO_PIN_13
 #define USER_Btn_GPIO_Port GPIOC
+#define IMU_INT_Pin GPIO_PIN_2
+#define IMU_INT_GPIO_Port GPIOE
+#define IMU_INT_EXTI_IRQn EXTI2_IRQn
+#define IMU_SCL_Pin GPIO_PIN_6
+#define IMU_SCL_GPIO_Port GPIOB
+#define IMU_SDA_Pin GPIO_PIN_9
+#define IMU_SDA_GPIO_Port GPIOB
+#define IMU_SCK_Pin GPIO_PIN_10
+#define IMU_SCK_GPIO_Port GPIOC
+#define IMU_MISO_Pin GPIO_PIN_11
+#define IMU_MISO_GPIO_Port GPIOC
+#define IMU_MOSI_Pin GPIO_PIN_12
+#define IMU_MOSI_GPIO_Port GPIOC
+#define IMU_CS0_Pin GPIO_PIN_14
+#define IMU_CS0_GPIO_Port GPIOD
+#define IMU_CS1_Pin GPIO_PIN_15
+#define IMU_CS1_GPIO_Port GPIOD
 #define MCO_Pin GPIO_PIN_0
 #define MCO_GPIO_Port GPIOH
 #define RMII_MDC_Pin GPIO_PIN_1
@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * @file    app_fsm.c
+ *
+ * @author 	Marco Rolón Radcenco
+ *
+ * @brief   Application FSM
+ ******************************************************************************
+ */
+
+#include "app_fsm.h"
+
+/**
+ * @struct appFsmTimer_t
+ * @brief Non-blocking timer of the FSM, with the same behaviour as API_delay on the given tick.
+ */
+typedef struct
+{
+	uint32_t startTime; /*!< Tick when the timer started */
+	uint32_t duration; /*!< Duration, in milliseconds */
+	bool_t running; /*!< Timer started */
+} appFsmTimer_t;
+
+/**
+ * @var fsmState
+ * @brief Holds the current state of the application's finite state machine (FSM).
+ */
+static appState_t fsmState;
+
+/**
+ * @var fsmTimer
+ * @brief Timer of the delays and periodic evaluations of the FSM.
+ */
+static appFsmTimer_t fsmTimer;
+
+/**
+ * @var fsmIdleCount
+ * @brief Consecutive idle state evaluations without motion.
+ */
+static uint32_t fsmIdleCount;
+
+/**
+ * @brief Sets the duration of the FSM timer.
+ * @param duration Duration, in milliseconds. The timer starts on its next read.
+ */
+static void appFsm_timerWrite(uint32_t duration);
+
+/**
+ * @brief Reads the FSM timer, starting it if stopped.
+ * @param now Current tick, in milliseconds.
+ * @return bool_t Returns true once the duration elapsed, the timer is then stopped.
+ */
+static bool_t appFsm_timerRead(uint32_t now);
+
+/**
+ * Application FSM Functions
+ */
+
+void appFsm_Init()
+{
+	fsmState = APP_START;
+	fsmIdleCount = 0;
+	fsmTimer.running = false;
+	appFsm_timerWrite(APP_START_DELAY_MS);
+}
+
+appEvent_t appFsm_Tasks(uint32_t now, bool_t sleepAllowed, bool_t npxIdle)
+{
+	appEvent_t event = APP_EVENT_NONE;
+
+	switch (fsmState)
+	{
+	case APP_START:
+		if (imu_Check())
+		{
+			event = APP_EVENT_IMU_OK;
+			fsmState = APP_IDLE;
+			appFsm_timerWrite(APP_IDLE_DELAY_MS);
+		}
+		else
+		{
+			event = APP_EVENT_IMU_ERROR;
+			fsmState = APP_START_DELAY;
+		}
+		break;
+
+	case APP_START_DELAY:
+		if (appFsm_timerRead(now))
+		{
+			fsmState = APP_START;
+		}
+		break;
+
+	case APP_IDLE:
+		if (appFsm_timerRead(now))
+		{
+			switch (imu_State())
+			{
+			case IMU_IDLE:
+				event = APP_EVENT_IDLE;
+
+				// nothing moved for a while, blank the strip and sleep
+				fsmIdleCount++;
+				if ((fsmIdleCount >= APP_SLEEP_DELAY_MS / APP_IDLE_DELAY_MS)
+						&& sleepAllowed)
+				{
+					event = APP_EVENT_SLEEP;
+					fsmState = APP_SLEEP;
+					appFsm_timerWrite(APP_SLEEP_BLANK_MS);
+				}
+				break;
+
+			case IMU_ACTIVE:
+				event = APP_EVENT_ACTIVE;
+				fsmIdleCount = 0;
+				fsmState = APP_ACTIVE;
+				break;
+
+			default:
+				event = APP_EVENT_ERROR;
+				break;
+			}
+		}
+		break;
+
+	case APP_ACTIVE:
+		switch (imu_SpinDirection())
+		{
+		case IMU_NO_SPIN:
+			event = APP_EVENT_NO_SPIN;
+			fsmState = APP_IDLE;
+			appFsm_timerWrite(APP_IDLE_DELAY_MS);
+			break;
+
+		case IMU_POS_SPIN:
+			event = APP_EVENT_POS_SPIN;
+			fsmState = APP_POS_SPIN;
+			break;
+
+		case IMU_NEG_SPIN:
+			event = APP_EVENT_NEG_SPIN;
+			fsmState = APP_NEG_SPIN;
+			break;
+
+		default:
+			event = APP_EVENT_ERROR;
+			break;
+		}
+		break;
+
+	case APP_POS_SPIN:
+		event = APP_EVENT_POS_SPIN_SHOW;
+		fsmState = APP_DELAY;
+		appFsm_timerWrite(APP_CONFIG_DELAY_MS);
+		break;
+
+	case APP_NEG_SPIN:
+		event = APP_EVENT_NEG_SPIN_SHOW;
+		fsmState = APP_DELAY;
+		appFsm_timerWrite(APP_CONFIG_DELAY_MS);
+		break;
+
+	case APP_DELAY:
+		if (appFsm_timerRead(now))
+		{
+			fsmState = APP_ACTIVE;
+		}
+		break;
+
+	case APP_SLEEP:
+		// the blank frame must be on the strip before the clocks stop
+		if (appFsm_timerRead(now) && npxIdle)
+		{
+			event = APP_EVENT_STOP;
+			fsmIdleCount = 0;
+			fsmState = APP_IDLE;
+			appFsm_timerWrite(APP_IDLE_DELAY_MS);
+		}
+		break;
+
+	default:
+		event = APP_EVENT_ERROR;
+		break;
+	}
+
+	return event;
+}
+
+appState_t appFsm_State()
+{
+	return fsmState;
+}
+
+static void appFsm_timerWrite(uint32_t duration)
+{
+	fsmTimer.duration = duration;
+}
+
+static bool_t appFsm_timerRead(uint32_t now)
+{
+	if (!fsmTimer.running)
+	{
+		fsmTimer.startTime = now;
+		fsmTimer.running = true;
+		return false;
+	}
+
+	if ((now - fsmTimer.startTime) >= fsmTimer.duration)
+	{
+		fsmTimer.running = false;
+		return true;
+	}
+
+	return false;
+}
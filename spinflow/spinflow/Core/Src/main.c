@@ -10,54 +10,64 @@
 
 //* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "app_fsm.h"
 #include "imu_api.h"
 #include "npx_api.h"
+#include "usb_cdc.h"
 
 #include "log_api.h"
 #include "API_delay.h"
 
+#include <stdio.h>
+
 /* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/**
+ * @var appWakeUs
+ * @brief Time from the wake-up to the switch to the PLL, then to the first frame, in microseconds.
+ */
+static uint32_t appWakeUs;
 
 /**
- * @enum appState_t
- * @brief Enumerates the states of the application's finite state machine (FSM).
- *
- * This enumeration defines the various states that the application can be in
- * at any given time. The FSM handles transitions between these states based on
- * internal and external events.
+ * @var appWakeFrames
+ * @brief NeoPixels frame count when the device woke up.
  */
-typedef enum
-{
-	APP_START, /**< Initial state of the application upon power-up or reset. */
-	APP_START_DELAY, /**< Delay state after start, before the application becomes fully active. */
-	APP_IDLE, /**< Idle state where the application is waiting for motion detection. */
-	APP_ACTIVE, /**< Active state indicating the application is currently processing tasks. */
-	APP_POS_SPIN, /**< State indicating the application is experiencing a positive spin. */
-	APP_NEG_SPIN, /**< State indicating the application is experiencing a negative spin. */
-	APP_DELAY /**< Delay state for NeoPixels operation. */
-} appState_t;
+static uint32_t appWakeFrames;
 
-/* Private define ------------------------------------------------------------*/
-/* Private macro -------------------------------------------------------------*/
-/* Private variables ---------------------------------------------------------*/
 /**
- * @var appTimer
- * @brief Timer structure for managing application-specific timings.
- *
- * This timer is used throughout the application to manage delays, timeouts, and intervals in various
- * processes and state transitions. It is a structure containing the start time, duration, and a flag
- * indicating whether the timer is currently running.
+ * @var appWakePending
+ * @brief Set from the wake-up until the first frame is sent.
  */
-static delay_t appTimer =
-{ .startTime = 0, .duration = 0, .running = false };
+static bool_t appWakePending;
 
 /**
- * @var appState
- * @brief Holds the current state of the application's finite state machine (FSM).
- *
- * This static variable is used internally to keep track of the current state of the application's FSM.
+ * @var appBusRecoveries
+ * @brief IMU bus recoveries already reported.
+ */
+static uint32_t appBusRecoveries;
+
+/**
+ * @var appVibTimer
+ * @brief Timer of the vibration reports.
+ */
+static delay_t appVibTimer =
+{ .startTime = 0, .duration = APP_VIB_LOG_MS, .running = false };
+
+/**
+ * @var appRotationTimer
+ * @brief Timer of the rotation reports.
+ */
+static delay_t appRotationTimer =
+{ .startTime = 0, .duration = APP_ROTATION_LOG_MS, .running = false };
+
+/**
+ * @var appTimingTimer
+ * @brief Timer of the IMU sample interval reports.
  */
-static appState_t appState;
+static delay_t appTimingTimer =
+{ .startTime = 0, .duration = APP_TIMING_LOG_MS, .running = false };
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -73,12 +83,19 @@ static void app_Init();
 /**
  * @brief Updates the Application FSM based on system events and state changes.
  *
- * This function is called repeatedly within the main loop and is responsible for handling
- * transitions and actions within the application's FSM. It checks for system events, updates the state
- * of the FSM as required, and executes actions based on the current state of the application.
+ * This function is called repeatedly within the main loop. It runs a step of the FSM (see app_fsm.h)
+ * and executes the action of the returned event: logging, NeoPixels patterns, LEDs and low-power idle.
  */
 static void app_Tasks();
 
+/**
+ * @brief Forwards pixel frames received over USB to the NeoPixels.
+ *
+ * This function is called repeatedly within the main loop. It drains the USB packets
+ * received since the last call, so the host is only throttled while frames are being encoded.
+ */
+static void app_StreamTasks();
+
 /**
  * @brief Handles the application logic when no spin is detected.
  *
@@ -105,6 +122,71 @@ static void app_positiveSpinDetected();
  */
 static void app_negativeSpinDetected();
 
+/**
+ * @brief Enters low-power idle until the IMU detects motion.
+ *
+ * Sets the IMU in wake-on-motion mode and the MCU in STOP mode. On wake-up, the
+ * clocks are restored and the IMU acquisition restarts. The time from the wake-up
+ * to the first NeoPixels frame is measured with the cycle counter and reported by
+ * app_wakeTasks().
+ */
+static void app_Sleep();
+
+/**
+ * @brief Reports the wake-up latency once the first frame after a wake-up is sent.
+ *
+ * This function is called repeatedly within the main loop.
+ */
+static void app_wakeTasks();
+
+/**
+ * @brief Reports the IMU bus recoveries.
+ *
+ * This function is called repeatedly within the main loop. The recoveries run in the
+ * IMU driver without blocking, the NeoPixels keep being refreshed meanwhile.
+ */
+static void app_busTasks();
+
+/**
+ * @brief Records an IMU trace while a host has the USB device configured.
+ *
+ * This function is called repeatedly within the main loop.
+ */
+static void app_traceTasks();
+
+/**
+ * @brief Runs the IMU vibration analysis and reports its results.
+ *
+ * This function is called repeatedly within the main loop. Each call runs a single
+ * bounded analysis step, so the NeoPixels refresh is not delayed. The results are
+ * logged every APP_VIB_LOG_MS.
+ */
+static void app_vibrationTasks();
+
+/**
+ * @brief Passes the rotation angle to the NeoPixels and reports the rotation speed.
+ *
+ * This function is called repeatedly within the main loop. While active, the speed
+ * and revolutions are logged every APP_ROTATION_LOG_MS.
+ */
+static void app_rotationTasks();
+
+/**
+ * @brief Reports the statistics of the IMU sample intervals.
+ *
+ * This function is called repeatedly within the main loop. The statistics are logged
+ * every APP_TIMING_LOG_MS, then cleared.
+ */
+static void app_timingTasks();
+
+/**
+ * @brief Switches modes on the gestures recognised by the IMU.
+ *
+ * This function is called repeatedly within the main loop. A double tap switches
+ * the idle pattern and a shake clears the rotation count. Every gesture is logged.
+ */
+static void app_gestureTasks();
+
 /**
  * @brief System Clock Configuration
  * @retval None
@@ -154,7 +236,17 @@ int main(void)
 	/* Infinite loop */
 	while (1)
 	{
+		imu_GetData();
 		app_Tasks();
+		app_StreamTasks();
+		npx_Tasks();
+		app_wakeTasks();
+		app_busTasks();
+		app_traceTasks();
+		app_vibrationTasks();
+		app_rotationTasks();
+		app_timingTasks();
+		app_gestureTasks();
 	}
 }
 
@@ -165,119 +257,122 @@ static void app_Init()
 	imu_Init();
 	log_Init();
 
+	if (DEVICE_USB_STREAM_ENABLE || DEVICE_IMU_TRACE_ENABLE)
+	{
+		if (!usbCdc_Init())
+		{
+			log_SendString(LOG_APP_ERROR, "USB init error");
+		}
+	}
+
 	// start app
-	appState = APP_START;
+	appFsm_Init();
 	log_SendString(LOG_APP_INFO, "App start");
-	delayInit(&appTimer, APP_START_DELAY_MS);
 }
 
 static void app_Tasks()
 {
-	switch (appState)
+	appEvent_t event;
+	bool_t sleepAllowed;
+
+	sleepAllowed = !npx_IsStreaming()
+			&& !(DEVICE_USB_STREAM_ENABLE && usbCdc_IsConfigured())
+			&& !imu_TraceRecording();
+	event = appFsm_Tasks(HAL_GetTick(), sleepAllowed, npx_IsIdle());
+
+	switch (event)
 	{
-	case APP_START:
-		if (imu_Check())
-		{
-			log_SendString(LOG_APP_INFO, "IMU ok");
-			BSP_LED_Off(LED_IMU); // reset LED to indicate success
+	case APP_EVENT_NONE:
+		break;
 
-			appState = APP_IDLE;
-			delayWrite(&appTimer, APP_IDLE_DELAY_MS);
-		}
-		else
-		{
-			log_SendString(LOG_APP_INFO, "IMU error");
-			BSP_LED_On(LED_IMU); // set LED to indicate error
+	case APP_EVENT_IMU_OK:
+		log_SendString(LOG_APP_INFO, "IMU ok");
+		BSP_LED_Off(LED_IMU); // reset LED to indicate success
+		break;
 
-			appState = APP_START_DELAY;
-		}
+	case APP_EVENT_IMU_ERROR:
+		log_SendString(LOG_APP_INFO, "IMU error");
+		BSP_LED_On(LED_IMU); // set LED to indicate error
 		break;
 
-	case APP_START_DELAY:
-		if (delayRead(&appTimer))
+	case APP_EVENT_IDLE:
+	case APP_EVENT_SLEEP:
+		log_SendString(LOG_APP_INFO, "Idle");
+		app_noSpinDetected();
+
+		if (event == APP_EVENT_SLEEP)
 		{
-			appState = APP_START;
+			log_SendString(LOG_APP_INFO, "Sleep");
+			npx_Clear();
 		}
 		break;
 
-	case APP_IDLE:
-		if (delayRead(&appTimer))
-		{
-			imu_GetData();
-			switch (imu_State())
-			{
-			case IMU_IDLE:
-				log_SendString(LOG_APP_INFO, "Idle");
-				//appState = APP_IDLE;
-				app_noSpinDetected();
-				break;
-
-			case IMU_ACTIVE:
-				log_SendString(LOG_APP_INFO, "Active");
-				appState = APP_ACTIVE;
-				break;
-
-			default:
-				log_SendString(LOG_APP_ERROR, "IMU state error");
-				Error_Handler();
-				break;
-			}
-		}
+	case APP_EVENT_STOP:
+		app_Sleep();
+
+		log_SendString(LOG_APP_INFO, "Wake up");
+		app_noSpinDetected();
 		break;
 
-	case APP_ACTIVE:
-		switch (imu_SpinDirection())
-		{
-		case IMU_NO_SPIN:
-			log_SendString(LOG_APP_INFO, "No spin detected");
-			appState = APP_IDLE;
-			delayWrite(&appTimer, APP_IDLE_DELAY_MS);
-			break;
+	case APP_EVENT_ACTIVE:
+		log_SendString(LOG_APP_INFO, "Active");
+		break;
 
-		case IMU_POS_SPIN:
-			log_SendString(LOG_APP_INFO, "Positive spin detected");
-			appState = APP_POS_SPIN;
-			break;
+	case APP_EVENT_NO_SPIN:
+		log_SendString(LOG_APP_INFO, "No spin detected");
+		break;
 
-		case IMU_NEG_SPIN:
-			log_SendString(LOG_APP_INFO, "Negative spin detected");
-			appState = APP_NEG_SPIN;
-			break;
+	case APP_EVENT_POS_SPIN:
+		log_SendString(LOG_APP_INFO, "Positive spin detected");
+		break;
 
-		default:
-			log_SendString(LOG_APP_ERROR, "IMU spin error");
-			Error_Handler();
-			break;
-		}
+	case APP_EVENT_NEG_SPIN:
+		log_SendString(LOG_APP_INFO, "Negative spin detected");
 		break;
 
-	case APP_POS_SPIN:
+	case APP_EVENT_POS_SPIN_SHOW:
 		app_positiveSpinDetected();
-		appState = APP_DELAY;
-		delayWrite(&appTimer, APP_CONFIG_DELAY_MS);
 		break;
 
-	case APP_NEG_SPIN:
+	case APP_EVENT_NEG_SPIN_SHOW:
 		app_negativeSpinDetected();
-		appState = APP_DELAY;
-		delayWrite(&appTimer, APP_CONFIG_DELAY_MS);
 		break;
 
-	case APP_DELAY:
-		if (delayRead(&appTimer))
+	default:
+		switch (appFsm_State())
 		{
-			appState = APP_ACTIVE;
-			imu_GetData();
-		}
-		break;
+		case APP_IDLE:
+			log_SendString(LOG_APP_ERROR, "IMU state error");
+			break;
 
-	default:
-		log_SendString(LOG_APP_ERROR, "App unknown state!");
+		case APP_ACTIVE:
+			log_SendString(LOG_APP_ERROR, "IMU spin error");
+			break;
+
+		default:
+			log_SendString(LOG_APP_ERROR, "App unknown state!");
+			break;
+		}
 		Error_Handler();
 		break;
 	}
 }
 
+static void app_StreamTasks()
+{
+	const uint8_t *data;
+	uint16_t len;
+
+	if (DEVICE_USB_STREAM_ENABLE)
+	{
+		while (usbCdc_GetPacket(&data, &len))
+		{
+			npx_StreamWrite(data, len);
+			usbCdc_ReleasePacket();
+		}
+	}
+}
+
 static void app_noSpinDetected()
 {
 	npx_SetIdle();
@@ -286,16 +381,218 @@ static void app_noSpinDetected()
 
 static void app_positiveSpinDetected()
 {
+	npx_SetSpinRate(imu_SpinRate());
 	npx_SetPositive();
 	BSP_LED_Toggle(LED_NPX); // toggle LED to indicate activity
 }
 
 static void app_negativeSpinDetected()
 {
+	npx_SetSpinRate(imu_SpinRate());
 	npx_SetNegative();
 	BSP_LED_Toggle(LED_NPX); // toggle LED to indicate activity
 }
 
+static void app_Sleep()
+{
+	uint32_t cycles;
+
+	if (!imu_Sleep())
+	{
+		log_SendString(LOG_APP_ERROR, "IMU sleep error");
+		imu_Wake();
+		return;
+	}
+
+	// the cycle counter only runs while the core is clocked
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	HAL_SuspendTick();
+	do
+	{
+		// with interrupts masked the pending interrupt still ends WFI, but its
+		// handler only runs once they are unmasked, after the start is taken
+		__disable_irq();
+		HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+		DWT->CYCCNT = 0;
+		__enable_irq();
+
+		// other interrupts also wake the MCU, only motion leaves the low-power idle
+	} while (!imu_MotionWake());
+
+	// the MCU wakes up running from HSI with the PLL settings kept: restart HSE
+	// and the PLL, still counting at HSI, then switch to the PLL and count at
+	// SystemCoreClock from the switch on
+	__HAL_RCC_HSE_CONFIG(RCC_HSE_BYPASS);
+	while (__HAL_RCC_GET_FLAG(RCC_FLAG_HSERDY) == RESET)
+	{
+	}
+	__HAL_RCC_PLL_ENABLE();
+	while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY) == RESET)
+	{
+	}
+	cycles = DWT->CYCCNT;
+	__HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_PLLCLK);
+	DWT->CYCCNT = 0;
+	while (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK)
+	{
+	}
+	SystemCoreClockUpdate();
+	appWakeUs = cycles / (HSI_VALUE / 1000000U);
+	HAL_ResumeTick();
+
+	if (!imu_Wake())
+	{
+		log_SendString(LOG_APP_ERROR, "IMU wake error");
+	}
+
+	appWakeFrames = npx_FrameCount();
+	appWakePending = true;
+}
+
+static void app_wakeTasks()
+{
+	char msg[48];
+
+	if (appWakePending && (npx_FrameCount() != appWakeFrames))
+	{
+		appWakePending = false;
+		appWakeUs += DWT->CYCCNT / (SystemCoreClock / 1000000U);
+
+		snprintf(msg, sizeof(msg), "Wake to first frame: %lu us",
+				(unsigned long) appWakeUs);
+		log_SendString(LOG_APP_INFO, msg);
+	}
+}
+
+static void app_busTasks()
+{
+	char msg[48];
+
+	if (imu_BusRecoveries() != appBusRecoveries)
+	{
+		appBusRecoveries = imu_BusRecoveries();
+
+		snprintf(msg, sizeof(msg), "IMU bus recovered, %lu errors",
+				(unsigned long) imu_BusErrors());
+		log_SendString(LOG_APP_ERROR, msg);
+	}
+}
+
+static void app_traceTasks()
+{
+	if (DEVICE_IMU_TRACE_ENABLE)
+	{
+		if (usbCdc_IsConfigured() && !imu_TraceRecording())
+		{
+			if (imu_TraceStart(usbCdc_Send, USB_CDC_PACKET_SIZE))
+			{
+				log_SendString(LOG_APP_INFO, "Trace start");
+			}
+		}
+		else if (!usbCdc_IsConfigured() && imu_TraceRecording())
+		{
+			imu_TraceStop();
+			log_SendString(LOG_APP_INFO, "Trace stop");
+		}
+
+		imu_TraceTasks();
+	}
+}
+
+static void app_vibrationTasks()
+{
+	imuVibResult_t vib;
+	char msg[80];
+
+	imu_VibrationTasks();
+
+	if ((APP_VIB_LOG_MS > 0) && delayRead(&appVibTimer)
+			&& imu_GetVibration(&vib))
+	{
+		snprintf(msg, sizeof(msg),
+				"Vibration %d mg rms, peak %d mg at %d Hz, %lu cycles",
+				(int) vib.rms, (int) vib.peakAmplitude, (int) vib.peakHz,
+				(unsigned long) imu_VibrationCycles(NULL));
+		log_SendString(LOG_APP_INFO, msg);
+	}
+}
+
+static void app_rotationTasks()
+{
+	char msg[48];
+
+	npx_SetRotation((uint16_t) imu_RotationAngle());
+
+	if ((APP_ROTATION_LOG_MS > 0) && (appFsm_State() == APP_ACTIVE)
+			&& delayRead(&appRotationTimer))
+	{
+		snprintf(msg, sizeof(msg), "%d rpm, %ld revolutions", (int) imu_Rpm(),
+				(long) imu_Revolutions());
+		log_SendString(LOG_APP_INFO, msg);
+	}
+}
+
+static void app_timingTasks()
+{
+	imuTiming_t timing;
+	char msg[80];
+
+	if ((APP_TIMING_LOG_MS > 0) && delayRead(&appTimingTimer))
+	{
+		imu_GetTiming(&timing);
+		imu_ResetTiming();
+
+		snprintf(msg, sizeof(msg),
+				"IMU interval %lu-%lu us, jitter %d us, %lu missed",
+				(unsigned long) timing.minUs, (unsigned long) timing.maxUs,
+				(int) (timing.jitterUs + 0.5f), (unsigned long) timing.missed);
+		log_SendString(LOG_APP_INFO, msg);
+	}
+}
+
+static void app_gestureTasks()
+{
+	imuGestureEvent_t event;
+	char msg[48];
+
+	while (imu_GetGesture(&event))
+	{
+		switch (event.type)
+		{
+		case IMU_GESTURE_SHAKE:
+			imu_ResetRotation();
+			snprintf(msg, sizeof(msg), "Gesture shake, rotation cleared");
+			break;
+
+		case IMU_GESTURE_FLICK:
+			snprintf(msg, sizeof(msg), "Gesture flick, axis %d",
+					event.direction);
+			break;
+
+		case IMU_GESTURE_DOUBLE_TAP:
+			npx_NextIdleMode();
+			snprintf(msg, sizeof(msg), "Gesture double tap, idle mode");
+			break;
+
+		case IMU_GESTURE_TILT_HOLD:
+			snprintf(msg, sizeof(msg), "Gesture tilt, axis %d down",
+					event.direction);
+			break;
+
+		case IMU_GESTURE_TEMPLATE:
+			snprintf(msg, sizeof(msg), "Gesture %s, score %u",
+					imu_GestureName(event.index), event.score);
+			break;
+
+		default:
+			continue;
+		}
+		log_SendString(LOG_APP_INFO, msg);
+	}
+}
+
 /**
  * System
  */
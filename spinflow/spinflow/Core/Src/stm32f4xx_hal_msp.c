@@ -22,10 +22,14 @@
 #include "main.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "device_config.h"
 /* USER CODE END Includes */
 extern DMA_HandleTypeDef hdma_tim1_ch1;
 
+#if !DEVICE_IMU_SPI
+extern DMA_HandleTypeDef hdma_i2c1_rx;
+#endif
+
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN TD */
 
@@ -93,6 +97,7 @@ void HAL_MspInit(void)
 	/* USER CODE END MspInit 1 */
 }
 
+#if !DEVICE_IMU_SPI
 /**
  * @brief I2C MSP Initialization
  * This function configures the hardware resources used in this example
@@ -123,6 +128,31 @@ void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c)
 
 		/* Peripheral clock enable */
 		__HAL_RCC_I2C1_CLK_ENABLE();
+
+		/* I2C1 DMA Init */
+		/* I2C1_RX Init */
+		hdma_i2c1_rx.Instance = DMA1_Stream0;
+		hdma_i2c1_rx.Init.Channel = DMA_CHANNEL_1;
+		hdma_i2c1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+		hdma_i2c1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+		hdma_i2c1_rx.Init.MemInc = DMA_MINC_ENABLE;
+		hdma_i2c1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+		hdma_i2c1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+		hdma_i2c1_rx.Init.Mode = DMA_NORMAL;
+		hdma_i2c1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+		hdma_i2c1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+		if (HAL_DMA_Init(&hdma_i2c1_rx) != HAL_OK)
+		{
+			Error_Handler();
+		}
+
+		__HAL_LINKDMA(hi2c, hdmarx, hdma_i2c1_rx);
+
+		/* I2C1 interrupt Init */
+		HAL_NVIC_SetPriority(I2C1_EV_IRQn, 1, 0);
+		HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+		HAL_NVIC_SetPriority(I2C1_ER_IRQn, 1, 0);
+		HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
 		/* USER CODE BEGIN I2C1_MspInit 1 */
 
 		/* USER CODE END I2C1_MspInit 1 */
@@ -154,12 +184,19 @@ void HAL_I2C_MspDeInit(I2C_HandleTypeDef *hi2c)
 
 		HAL_GPIO_DeInit(GPIOB, GPIO_PIN_9);
 
+		/* I2C1 DMA DeInit */
+		HAL_DMA_DeInit(hi2c->hdmarx);
+
+		/* I2C1 interrupt DeInit */
+		HAL_NVIC_DisableIRQ(I2C1_EV_IRQn);
+		HAL_NVIC_DisableIRQ(I2C1_ER_IRQn);
 		/* USER CODE BEGIN I2C1_MspDeInit 1 */
 
 		/* USER CODE END I2C1_MspDeInit 1 */
 	}
 
 }
+#endif
 
 /**
  * @brief TIM_Base MSP Initialization
@@ -200,6 +237,11 @@ void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim_base)
 
 		/* USER CODE END TIM1_MspInit 1 */
 	}
+	else if (htim_base->Instance == TIM2)
+	{
+		/* Peripheral clock enable, IMU timestamps */
+		__HAL_RCC_TIM2_CLK_ENABLE();
+	}
 
 }
 
@@ -252,6 +294,11 @@ void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim_base)
 
 		/* USER CODE END TIM1_MspDeInit 1 */
 	}
+	else if (htim_base->Instance == TIM2)
+	{
+		/* Peripheral clock disable */
+		__HAL_RCC_TIM2_CLK_DISABLE();
+	}
 
 }
 
@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * @file    imu_ahrs.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU orientation filter (AHRS)
+ *
+ * Madgwick gradient descent filter. The orientation is kept as a quaternion
+ * that rotates sensor (body) frame vectors into the earth frame, with Z up.
+ * Single precision float only, so every operation maps to the M4 FPU.
+ * The module only depends on the C standard library, so the same sources can be
+ * built on the host side.
+ ******************************************************************************
+ */
+
+#ifndef IMU_AHRS_H
+#define IMU_AHRS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @struct imuAhrs_t
+ * @brief Filter state.
+ */
+typedef struct
+{
+	float q0; /**< Quaternion scalar part. */
+	float q1; /**< Quaternion X part. */
+	float q2; /**< Quaternion Y part. */
+	float q3; /**< Quaternion Z part. */
+	float beta; /**< Filter gain, trades gyro drift correction against accelerometer noise. */
+} imuAhrs_t;
+
+/**
+ * @struct imuEuler_t
+ * @brief Orientation as Euler angles (aerospace sequence Z-Y-X), in degrees.
+ */
+typedef struct
+{
+	float roll; /**< Rotation about X. */
+	float pitch; /**< Rotation about Y. */
+	float yaw; /**< Rotation about Z. */
+} imuEuler_t;
+
+/**
+ * @brief Resets the orientation to identity.
+ * @param ahrs Filter state.
+ * @param beta Filter gain (0.033 to 0.1 are typical values).
+ */
+void imuAhrs_Init(imuAhrs_t *ahrs, float beta);
+
+/**
+ * @brief Updates the orientation with a gyroscope and accelerometer sample.
+ * @param ahrs Filter state.
+ * @param gx Angular velocity about X, in rad/s.
+ * @param gy Angular velocity about Y, in rad/s.
+ * @param gz Angular velocity about Z, in rad/s.
+ * @param ax Acceleration along X, any unit.
+ * @param ay Acceleration along Y, any unit.
+ * @param az Acceleration along Z, any unit.
+ * @param dt Time since the previous update, in seconds.
+ *
+ * The accelerometer is ignored when it reads zero.
+ */
+void imuAhrs_UpdateImu(imuAhrs_t *ahrs, float gx, float gy, float gz, float ax,
+		float ay, float az, float dt);
+
+/**
+ * @brief Updates the orientation with a gyroscope, accelerometer and magnetometer sample.
+ * @param ahrs Filter state.
+ * @param gx Angular velocity about X, in rad/s.
+ * @param gy Angular velocity about Y, in rad/s.
+ * @param gz Angular velocity about Z, in rad/s.
+ * @param ax Acceleration along X, any unit.
+ * @param ay Acceleration along Y, any unit.
+ * @param az Acceleration along Z, any unit.
+ * @param mx Magnetic field along X, any unit, in the gyroscope axes.
+ * @param my Magnetic field along Y, any unit, in the gyroscope axes.
+ * @param mz Magnetic field along Z, any unit, in the gyroscope axes.
+ * @param dt Time since the previous update, in seconds.
+ *
+ * Falls back to imuAhrs_UpdateImu() when the magnetometer reads zero.
+ */
+void imuAhrs_Update(imuAhrs_t *ahrs, float gx, float gy, float gz, float ax,
+		float ay, float az, float mx, float my, float mz, float dt);
+
+/**
+ * @brief Gets the orientation as Euler angles.
+ * @param ahrs Filter state.
+ * @param euler Euler angles, in degrees.
+ */
+void imuAhrs_GetEuler(const imuAhrs_t *ahrs, imuEuler_t *euler);
+
+/**
+ * @brief Gets the angular velocity about an earth frame axis.
+ * @param ahrs Filter state.
+ * @param gx Angular velocity about sensor X, any unit.
+ * @param gy Angular velocity about sensor Y, any unit.
+ * @param gz Angular velocity about sensor Z, any unit.
+ * @param ex Earth frame axis, X component.
+ * @param ey Earth frame axis, Y component.
+ * @param ez Earth frame axis, Z component. The axis must be a unit vector.
+ * @return Angular velocity about the axis, in the unit of the inputs.
+ *
+ * With the axis (0, 0, 1), this is the rotation about the vertical, whatever
+ * the tilt or mounting of the sensor.
+ */
+float imuAhrs_AxisRate(const imuAhrs_t *ahrs, float gx, float gy, float gz,
+		float ex, float ey, float ez);
+
+#endif
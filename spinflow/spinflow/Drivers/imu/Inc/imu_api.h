@@ -13,6 +13,13 @@
 
 #include "device_config.h"
 #include "device_types.h"
+#include "imu_port.h"
+#include "imu_trace.h"
+#include "imu_ahrs.h"
+#include "imu_filter.h"
+#include "imu_vib.h"
+#include "imu_rotation.h"
+#include "imu_gesture.h"
 
 /**
  * @def IMU_SPIN_THRESHOLD
@@ -24,6 +31,66 @@
  */
 #define IMU_SPIN_THRESHOLD			DEVICE_IMU_SPIN_THRESHOLD
 
+/**
+ * @def IMU_SPIN_EXIT_THRESHOLD
+ * @brief Defines the threshold value below which a spin or motion ends, in degrees per second.
+ */
+#define IMU_SPIN_EXIT_THRESHOLD		DEVICE_IMU_SPIN_EXIT_THRESHOLD
+
+/**
+ * @def IMU_SPIN_DWELL_MS
+ * @brief Defines the time a new spin or motion state must hold before it is reported, in milliseconds.
+ */
+#define IMU_SPIN_DWELL_MS			DEVICE_IMU_SPIN_DWELL_MS
+
+/**
+ * @def IMU_AHRS_BETA
+ * @brief Gain of the orientation filter.
+ */
+#define IMU_AHRS_BETA				DEVICE_IMU_AHRS_BETA
+
+/**
+ * @def IMU_FILTER_LOWPASS_HZ
+ * @brief Default cutoff frequency of the gyroscope low-pass filter, in Hz.
+ */
+#define IMU_FILTER_LOWPASS_HZ		DEVICE_IMU_FILTER_LOWPASS_HZ
+
+/**
+ * @def IMU_FILTER_STAGES
+ * @brief Default number of biquad stages of the gyroscope low-pass filter.
+ */
+#define IMU_FILTER_STAGES			DEVICE_IMU_FILTER_STAGES
+
+/**
+ * @def IMU_FILTER_TAPS
+ * @brief Default length of the gyroscope moving average.
+ */
+#define IMU_FILTER_TAPS				DEVICE_IMU_FILTER_TAPS
+
+/**
+ * @def IMU_RPM_TAU_MS
+ * @brief Time constant of the rotation speed smoothing, in milliseconds.
+ */
+#define IMU_RPM_TAU_MS				DEVICE_IMU_RPM_TAU_MS
+
+/**
+ * @def IMU_RPM_DEADBAND_DPS
+ * @brief Rate below which the rotation is not integrated, in degrees per second.
+ */
+#define IMU_RPM_DEADBAND_DPS		DEVICE_IMU_RPM_DEADBAND_DPS
+
+/**
+ * @def IMU_VIB_SIZE
+ * @brief Length of the vibration analysis windows, in samples. 0 disables the analysis.
+ */
+#define IMU_VIB_SIZE				DEVICE_IMU_VIB_SIZE
+
+/**
+ * @def IMU_GESTURE_ENABLE
+ * @brief Set to feed the samples to the gesture engine.
+ */
+#define IMU_GESTURE_ENABLE			DEVICE_IMU_GESTURE_ENABLE
+
 /**
  * @enum imuState_t
  * @brief Defines the operational state of the IMU.
@@ -64,13 +131,39 @@ bool imu_Init();
  */
 bool imu_Check();
 
+/**
+ * @brief Sets the IMU in wake-on-motion mode.
+ *
+ * Stops the acquisition and leaves only the accelerometer running in low power mode.
+ * Motion above DEVICE_IMU_WOM_THRESHOLD_MG pulses the INT pin, which wakes the MCU
+ * from STOP mode.
+ *
+ * @return bool Returns true if the IMU was configured, false otherwise.
+ */
+bool imu_Sleep();
+
+/**
+ * @brief Checks if the IMU detected motion since imu_Sleep().
+ *
+ * @return bool Returns true if motion woke the IMU, false otherwise.
+ */
+bool imu_MotionWake();
+
+/**
+ * @brief Leaves wake-on-motion mode and restarts the acquisition.
+ *
+ * @return bool Returns true if the IMU was configured, false otherwise.
+ */
+bool imu_Wake();
+
 /**
  * @brief Retrieves the latest sensor data from the IMU.
  *
- * Updates the global IMU data structure with the latest readings from the
- * accelerometer, gyro, and magnetometer.
+ * Processes every sample acquired since the previous call. Samples are taken at
+ * DEVICE_IMU_SAMPLE_RATE_HZ by the sensor, so this function is called repeatedly
+ * within the main loop.
  *
- * @return bool Returns true if data was successfully retrieved, false otherwise.
+ * @return bool Returns true if at least one new sample was processed, false otherwise.
  */
 bool imu_GetData();
 
@@ -78,6 +171,9 @@ bool imu_GetData();
  * @brief Retrieves the current state of the IMU.
  *
  * This function is used to check whether the IMU is currently active or idle.
+ * The IMU becomes active when the angular velocity magnitude across all axes
+ * stays above IMU_SPIN_THRESHOLD for IMU_SPIN_DWELL_MS, and idle when it stays
+ * below IMU_SPIN_EXIT_THRESHOLD for the same time.
  *
  * @return imuState_t The current state of the IMU (either IMU_IDLE or IMU_ACTIVE).
  */
@@ -87,11 +183,273 @@ imuState_t imu_State();
  * @brief Determines the current spin direction of the IMU.
  *
  * This function checks the gyroscope data to determine the direction
- * of spin.
+ * of spin. A spin starts when the rate about the spin axis stays beyond
+ * IMU_SPIN_THRESHOLD for IMU_SPIN_DWELL_MS, and ends when it stays below
+ * IMU_SPIN_EXIT_THRESHOLD for the same time.
+ *
+ * The detection latency is bounded by IMU_SPIN_DWELL_MS, plus the group delay of
+ * the gyroscope filter and one FIFO batch (DEVICE_IMU_FIFO_BATCH samples).
  *
  * @return imuSpin_t The current spin direction of the IMU, indicating no spin,
  * positive spin, or negative spin.
  */
 imuSpin_t imu_SpinDirection();
 
+/**
+ * @brief Gets the current spin rate of the IMU.
+ *
+ * @return int16_t Angular velocity about the spin axis, in degrees per second.
+ * The sign gives the spin direction.
+ */
+int16_t imu_SpinRate();
+
+/**
+ * @brief Gets the smoothed rotation speed about the spin axis.
+ *
+ * Unlike imu_SpinDirection(), the speed is reported continuously, smoothed with a
+ * time constant of IMU_RPM_TAU_MS.
+ *
+ * @return float Rotation speed, in revolutions per minute. The sign gives the direction.
+ */
+float imu_Rpm();
+
+/**
+ * @brief Gets the number of revolutions about the spin axis since the last reset.
+ *
+ * @return int32_t Whole revolutions, the negative ones subtracted from the positive ones.
+ */
+int32_t imu_Revolutions();
+
+/**
+ * @brief Gets the angle within the current revolution.
+ *
+ * Together with imu_Revolutions(), gives the accumulated rotation about the spin axis.
+ *
+ * @return float Angle, in degrees, from 0 to 360.
+ */
+float imu_RotationAngle();
+
+/**
+ * @brief Clears the rotation speed, angle and revolutions.
+ */
+void imu_ResetRotation();
+
+/**
+ * @brief Gets the data-ready time of the last processed sample.
+ *
+ * The time is captured from a free-running microsecond timer when the sensor
+ * signals the sample, so it does not depend on when the main loop reads it.
+ *
+ * @return uint32_t Time, in microseconds. Wraps every 71 minutes.
+ */
+uint32_t imu_SampleTime();
+
+/**
+ * @brief Gets the statistics of the intervals between two sensor samples.
+ *
+ * @param timing Pointer to imuTiming_t where the statistics will be stored.
+ */
+void imu_GetTiming(imuTiming_t *timing);
+
+/**
+ * @brief Clears the statistics of the sample intervals.
+ */
+void imu_ResetTiming();
+
+/**
+ * @brief Gets the latency of the last spin direction change.
+ *
+ * @return uint32_t Time from the acquisition of the first sample of the new spin
+ * direction to its report, in milliseconds.
+ */
+uint32_t imu_SpinLatency();
+
+/**
+ * @brief Gets the number of failed or timed out IMU bus accesses.
+ *
+ * @return uint32_t Bus errors since start-up.
+ */
+uint32_t imu_BusErrors();
+
+/**
+ * @brief Gets the number of IMU bus recoveries.
+ *
+ * A hung bus is cleared and the sensor restarted without blocking, so the
+ * application keeps running meanwhile.
+ *
+ * @return uint32_t Completed recoveries since start-up.
+ */
+uint32_t imu_BusRecoveries();
+
+/**
+ * @brief Sets the spin axis.
+ *
+ * The axis is fixed to the earth frame, so the spin rate does not depend on the
+ * tilt or mounting orientation of the sensor. The default axis is the vertical
+ * (0, 0, 1).
+ *
+ * @param x Axis X component.
+ * @param y Axis Y component.
+ * @param z Axis Z component.
+ * @return bool Returns true if the axis was set, false if it is a null vector.
+ */
+bool imu_SetSpinAxis(float x, float y, float z);
+
+/**
+ * @brief Sets the sensor output data rate, bandwidth and full scale ranges.
+ *
+ * Trades noise against latency without rebuilding: a lower bandwidth is quieter and
+ * slower. The samples acquired with the previous configuration are dropped, and the
+ * gyroscope filter is designed again for the new rate.
+ *
+ * @param config New configuration.
+ * @return bool Returns true if the IMU was configured, false if a parameter is out of range,
+ * the gyroscope low-pass cutoff is not below half the new rate or the sensor did not respond.
+ */
+bool imu_SetConfig(const imuConfig_t *config);
+
+/**
+ * @brief Gets the sensor configuration in use.
+ *
+ * @param config Pointer to imuConfig_t where the configuration will be stored.
+ */
+void imu_GetConfig(imuConfig_t *config);
+
+/**
+ * @brief Sets a Butterworth low-pass filter on the gyroscope.
+ *
+ * @param cutoffHz Cutoff frequency, in Hz. 0 disables the filter.
+ * @param stages Number of biquad stages, the filter order is twice this value.
+ * @return bool Returns true if the filter was set, false if a parameter is out of range.
+ */
+bool imu_SetLowPassFilter(float cutoffHz, uint8_t stages);
+
+/**
+ * @brief Sets a moving average on the gyroscope.
+ *
+ * @param taps Number of averaged samples. 0 disables the filter.
+ * @return bool Returns true if the filter was set, false if a parameter is out of range.
+ */
+bool imu_SetAverageFilter(uint8_t taps);
+
+/**
+ * @brief Gets the current orientation of the IMU.
+ *
+ * @param euler Roll, pitch and yaw, in degrees.
+ */
+void imu_Orientation(imuEuler_t *euler);
+
+/**
+ * @brief Checks if a sensor is on the bus.
+ *
+ * @param id Sensor.
+ * @return bool Returns true if the sensor answered at start-up, false otherwise.
+ */
+bool imu_Present(imuId_t id);
+
+/**
+ * @brief Takes the oldest sample of another sensor on the bus.
+ *
+ * The orientation, spin and motion come from IMU_PRIMARY. The samples of the other
+ * sensors are acquired in the same batches and converted with their own calibration;
+ * they must be read at the sample rate, or the oldest ones are dropped.
+ *
+ * @param id Sensor, other than IMU_PRIMARY.
+ * @param snapshot Pointer to imuSnapshot_t where the sample will be stored.
+ * @return bool Returns true if a new sample was available, false otherwise.
+ */
+bool imu_ReadDevice(imuId_t id, imuSnapshot_t *snapshot);
+
+/**
+ * @brief Sets the frequency bands of the vibration analysis.
+ *
+ * The default bands are 2-10, 10-50, 50-100, 100-200 and 200-500 Hz. The bands are
+ * kept when the sample rate changes; the parts above half the rate stay empty.
+ *
+ * @param edgesHz Band limits, bands + 1 values in increasing order, in Hz.
+ * @param bands Number of bands, up to IMU_VIB_MAX_BANDS.
+ * @return bool Returns true if the bands were set, false if a parameter is out of range.
+ */
+bool imu_SetVibrationBands(const float *edgesHz, uint8_t bands);
+
+/**
+ * @brief Gets the vibration of the last analysed window.
+ *
+ * The magnitude of the acceleration is collected in windows of IMU_VIB_SIZE samples,
+ * so the results do not depend on the mounting orientation. Gravity is removed with
+ * the mean of each window. Amplitudes are in milli-g.
+ *
+ * @param result Pointer to imuVibResult_t where the results will be stored.
+ * @return bool Returns true if a window was analysed, false otherwise or if the analysis is disabled.
+ */
+bool imu_GetVibration(imuVibResult_t *result);
+
+/**
+ * @brief Runs one step of the vibration analysis. Call it from the main loop.
+ *
+ * Each step is bounded: the windowing, one FFT stage or the spectrum. A window takes
+ * log2(IMU_VIB_SIZE) + 1 steps, well within the time it takes to collect the next one.
+ */
+void imu_VibrationTasks();
+
+/**
+ * @brief Gets the cost of the vibration analysis, measured with the cycle counter.
+ *
+ * @param step Pointer where the longest step, in CPU cycles, will be stored. Can be NULL.
+ * @return uint32_t CPU cycles spent on the last analysed window, 0 before the first one.
+ */
+uint32_t imu_VibrationCycles(uint32_t *step);
+
+/**
+ * @brief Takes the oldest gesture recognised by the gesture engine (see imu_gesture.h).
+ *
+ * The engine is fed with every sample by imu_GetData(), before the gyroscope filter, as
+ * the templates are trained on the unfiltered samples of the traces.
+ *
+ * @param event Pointer to imuGestureEvent_t where the gesture will be stored.
+ * @return bool Returns true if a gesture was recognised, false otherwise.
+ */
+bool imu_GetGesture(imuGestureEvent_t *event);
+
+/**
+ * @brief Gets the name of a gesture template.
+ * @param index Template index, from an IMU_GESTURE_TEMPLATE gesture.
+ * @return const char* Name of the template, "?" if there is none at this index.
+ */
+const char* imu_GestureName(uint8_t index);
+
+/**
+ * @brief Starts recording the raw samples as a trace (see imu_trace.h).
+ *
+ * The header holds the configuration and calibration in use, so the trace can be
+ * replayed offline. A change of configuration needs a new trace.
+ *
+ * @param sink Destination of the trace, called from imu_TraceTasks().
+ * @param chunk Largest number of bytes passed to the sink at once.
+ * @return bool Returns true if the recording started, false otherwise.
+ */
+bool imu_TraceStart(imuTraceSink_t sink, uint16_t chunk);
+
+/**
+ * @brief Stops the trace recording.
+ */
+void imu_TraceStop();
+
+/**
+ * @brief Checks if a trace is being recorded.
+ * @return bool Returns true while recording, false otherwise.
+ */
+bool imu_TraceRecording();
+
+/**
+ * @brief Passes the recorded bytes to the sink. Call it from the main loop.
+ */
+void imu_TraceTasks();
+
+/**
+ * @brief Gets the number of samples missing from the trace.
+ * @return uint32_t Samples dropped because the sink did not keep up.
+ */
+uint32_t imu_TraceDropped();
+
 #endif
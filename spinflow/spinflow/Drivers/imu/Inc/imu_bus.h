@@ -0,0 +1,125 @@
+/**
+ ******************************************************************************
+ * @file    imu_bus.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU bus
+ *
+ * Transport between the IMU port and the sensors, selected at compile time with
+ * DEVICE_IMU_SPI: I2C1 at 400 kHz (imu_bus_i2c.c) or SPI3 (imu_bus_spi.c), where
+ * the registers are accessed at up to 1 MHz and the samples are read at up to
+ * 20 MHz, as allowed by the MPU-9250.
+ *
+ * Register accesses block for at most IMU_BUS_TIMEOUT_MS. The FIFO batch reads
+ * are made by DMA, their completion is reported from interrupt context through
+ * the callbacks below, implemented by the port.
+ ******************************************************************************
+ */
+
+#ifndef IMU_BUS_H
+#define IMU_BUS_H
+
+#include "imu_port.h"
+
+/**
+ * @def IMU_BUS_TIMEOUT_MS
+ * @brief Longest register access, in milliseconds.
+ */
+#define IMU_BUS_TIMEOUT_MS		DEVICE_IMU_BUS_TIMEOUT_MS
+
+/**
+ * @def IMU_BUS_MAX_READ
+ * @brief Longest asynchronous read, the whole sensor FIFO.
+ */
+#define IMU_BUS_MAX_READ		512
+
+#if DEVICE_IMU_SPI
+/**
+ * @def IMU_BUS_READ_MS
+ * @brief Duration of the longest asynchronous read, in milliseconds.
+ */
+#define IMU_BUS_READ_MS			1
+#else
+#define IMU_BUS_READ_MS			15
+#endif
+
+/**
+ * @brief Initializes the bus peripheral and its DMA.
+ */
+void imuBus_Init();
+
+/**
+ * @brief Reads registers of a sensor.
+ * @param id Sensor.
+ * @param reg First register address.
+ * @param buffer Destination.
+ * @param length Number of registers.
+ * @return bool Returns true if the read was made, false on a bus error or timeout.
+ */
+bool imuBus_Read(imuId_t id, uint8_t reg, uint8_t *buffer, uint16_t length);
+
+/**
+ * @brief Writes a register of a sensor.
+ * @param id Sensor.
+ * @param reg Register address.
+ * @param value Value to write.
+ * @return bool Returns true if the write was made, false on a bus error or timeout.
+ */
+bool imuBus_Write(imuId_t id, uint8_t reg, uint8_t value);
+
+/**
+ * @brief Starts a read of sensor registers by DMA.
+ * @param id Sensor.
+ * @param reg First register address.
+ * @param length Number of registers, up to IMU_BUS_MAX_READ.
+ * @return bool Returns true if the read started, false if the bus is busy.
+ * @note imuBus_ReadCallback() or imuBus_ErrorCallback() follows.
+ */
+bool imuBus_ReadAsync(imuId_t id, uint8_t reg, uint16_t length);
+
+/**
+ * @brief Starts a write of a sensor register.
+ * @param id Sensor.
+ * @param reg Register address.
+ * @param value Value to write.
+ * @return bool Returns true if the write started, false if the bus is busy.
+ * @note imuBus_WriteCallback() or imuBus_ErrorCallback() follows.
+ */
+bool imuBus_WriteAsync(imuId_t id, uint8_t reg, uint8_t value);
+
+/**
+ * @brief Checks if an asynchronous transfer is in progress.
+ * @return bool Returns true while the bus is busy, false otherwise.
+ */
+bool imuBus_Busy();
+
+/**
+ * @brief Aborts the transfer in progress and resets the bus peripheral.
+ * @return bool Returns true if the bus is usable again, false otherwise.
+ *
+ * On I2C, SCL is clocked until the sensors release SDA and a STOP is sent first.
+ * Bounded time, well below a millisecond.
+ */
+bool imuBus_Recover();
+
+/**
+ * @brief Asynchronous read complete.
+ * @param data Registers read, valid until the next transfer starts.
+ * @note Called from interrupt context, a new transfer can be started from it.
+ */
+void imuBus_ReadCallback(const uint8_t *data);
+
+/**
+ * @brief Asynchronous write complete.
+ * @note Called from interrupt context, a new transfer can be started from it.
+ */
+void imuBus_WriteCallback();
+
+/**
+ * @brief Asynchronous transfer failed.
+ * @note Called from interrupt context.
+ */
+void imuBus_ErrorCallback();
+
+#endif
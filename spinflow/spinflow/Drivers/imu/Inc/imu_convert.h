@@ -0,0 +1,245 @@
+/**
+ ******************************************************************************
+ * @file    imu_convert.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU sample conversion
+ *
+ * Fixed-point conversion of the raw MPU-9250 and AK8963 readings to milli-g,
+ * centi-degrees/s, centi-degrees Celsius and milli-gauss. The scales are Q16
+ * reciprocals of the sensor sensitivities, applied with a 32 x 32 -> 64 bit
+ * product and rounding.
+ *
+ * Shared by the device port and the trace replay, so a replayed trace is
+ * converted exactly as the live samples were. The module only depends on the
+ * C standard library, so the same sources can be built on the host side.
+ ******************************************************************************
+ */
+
+#ifndef IMU_CONVERT_H
+#define IMU_CONVERT_H
+
+#include "imu_port.h"
+
+/**
+ * @def IMU_Q16
+ * @brief Converts a constant to Q16 fixed point at compile time.
+ */
+#define IMU_Q16(x) ((int32_t) ((x) * 65536.0 + 0.5))
+
+/**
+ * @def IMU_GYRO_CAL_FRAC_BITS
+ * @brief Fractional bits of the gyroscope offsets, averaging many readings resolves less than a count.
+ */
+#define IMU_GYRO_CAL_FRAC_BITS	8
+
+/**
+ * @def IMU_BIAS_STILL_CDPS
+ * @brief Largest angular velocity of every axis for a sample to be stationary, in centi-degrees/s.
+ */
+#define IMU_BIAS_STILL_CDPS		100
+
+/**
+ * @def IMU_BIAS_STILL_SAMPLES
+ * @brief Consecutive stationary samples before the gyroscope offsets are tracked, half a second.
+ */
+#define IMU_BIAS_STILL_SAMPLES(rateHz)	((rateHz) / 2)
+
+/**
+ * @def IMU_BIAS_TRACK_SHIFT
+ * @brief Time constant of the gyroscope offset tracking, as a power of two of samples (8 s at 1 kHz).
+ */
+#define IMU_BIAS_TRACK_SHIFT	13
+
+/**
+ * @def IMU_BIAS_TEMPCO_CDEG
+ * @brief Temperature change between two updates of the gyroscope offset temperature coefficients, in centi-degrees Celsius.
+ */
+#define IMU_BIAS_TEMPCO_CDEG	200
+
+/**
+ * @def IMU_BIAS_TEMPCO_SHIFT
+ * @brief Weight of a new temperature coefficient estimate, as a right shift.
+ */
+#define IMU_BIAS_TEMPCO_SHIFT	2
+
+/**
+ * @brief Scale factor for accelerometer at ±2g, ±4g, ±8g or ±16g full-scale range.
+ *
+ * This values arre used to convert raw accelerometer outputs to g when the sensor is set to
+ * ±2g, ±4g, ±8g or ±16g full-scale range.
+ */
+#define ACC_FSR_2G_FACTOR 16384.0
+#define ACC_FSR_4G_FACTOR 8192.0
+#define ACC_FSR_8G_FACTOR 4096.0
+#define ACC_FSR_16G_FACTOR 2048.0
+
+/**
+ * @brief Scale factor for gyroscope at ±250°/s, ±500°/s, ±1000°/s or ±2000°/s full-scale range.
+ *
+ * Defines the conversion factor for raw gyroscope data when the sensor is configured to a full-scale range of
+ * ±250°/s, ±500°/s, ±1000°/s or ±2000°/s.
+ */
+#define GYR_FSR_250DPS_FACTOR 131.0
+#define GYR_FSR_500DPS_FACTOR 65.5
+#define GYR_FSR_1000DPS_FACTOR 32.8
+#define GYR_FSR_2000DPS_FACTOR 16.4
+
+/**
+ * @brief Temperature sensitivity and offset.
+ *
+ * Temperature in degrees Celsius = raw / TEMP_SENSITIVITY + TEMP_OFFSET.
+ */
+#define TEMP_SENSITIVITY 333.87
+#define TEMP_OFFSET 21.0
+
+/**
+ * @brief Reciprocal scales from raw accelerometer data to milli-g (Q16).
+ */
+#define ACC_FSR_2G_SCALE IMU_Q16(1000.0 / ACC_FSR_2G_FACTOR)
+#define ACC_FSR_4G_SCALE IMU_Q16(1000.0 / ACC_FSR_4G_FACTOR)
+#define ACC_FSR_8G_SCALE IMU_Q16(1000.0 / ACC_FSR_8G_FACTOR)
+#define ACC_FSR_16G_SCALE IMU_Q16(1000.0 / ACC_FSR_16G_FACTOR)
+
+/**
+ * @brief Reciprocal scales from raw gyroscope data to centi-degrees/s (Q16).
+ */
+#define GYR_FSR_250DPS_SCALE IMU_Q16(100.0 / GYR_FSR_250DPS_FACTOR)
+#define GYR_FSR_500DPS_SCALE IMU_Q16(100.0 / GYR_FSR_500DPS_FACTOR)
+#define GYR_FSR_1000DPS_SCALE IMU_Q16(100.0 / GYR_FSR_1000DPS_FACTOR)
+#define GYR_FSR_2000DPS_SCALE IMU_Q16(100.0 / GYR_FSR_2000DPS_FACTOR)
+
+/**
+ * @brief Reciprocal scale and offset from raw temperature data to centi-degrees Celsius.
+ */
+#define TEMP_SCALE IMU_Q16(100.0 / TEMP_SENSITIVITY)
+#define TEMP_OFFSET_CDEG ((int32_t) (TEMP_OFFSET * 100.0))
+
+/**
+ * @brief Magnetometer sensitivity in 16-bit mode and reciprocal scale to milli-gauss (Q16).
+ *
+ * 0.15 uT per count, 1 uT = 10 mG.
+ */
+#define MAGN_SENSITIVITY_MG 1.5
+#define MAGN_SCALE IMU_Q16(MAGN_SENSITIVITY_MG)
+
+/**
+ * @struct imuGyroBias_t
+ * @brief Online tracking of the gyroscope offsets.
+ *
+ * While the device is stationary, the offsets slowly follow the readings. The offset
+ * change with temperature is learned from the offsets found at different temperatures,
+ * and compensates the temperature drift while the device moves.
+ */
+typedef struct
+{
+	int32_t track[3]; /**< Offset estimate of each axis, in counts (Q16). */
+	int32_t refTemp; /**< Temperature of the offset estimate, in centi-degrees Celsius (Q8). */
+	int32_t tempco[3]; /**< Offset change of each axis, in counts per degree Celsius (Q8). */
+	int32_t anchorOffset[3]; /**< Offset of each axis at the last temperature coefficient update (Q8). */
+	int16_t anchorTemp; /**< Temperature at the last temperature coefficient update, in centi-degrees Celsius. */
+	uint16_t still; /**< Consecutive stationary samples. */
+	bool_t init; /**< Set once the tracking started from the calibrated offsets. */
+} imuGyroBias_t;
+
+/**
+ * @brief Applies a Q16 scale with rounding.
+ * @param value Value to scale.
+ * @param scale Scale (Q16).
+ * @return int32_t Scaled value.
+ */
+int32_t imuConvert_Scale(int32_t value, int32_t scale);
+
+/**
+ * @brief Applies a Q16 scale with rounding to a Q8 value.
+ * @param value Value to scale (Q8).
+ * @param scale Scale (Q16).
+ * @return int32_t Scaled value, integer.
+ */
+int32_t imuConvert_ScaleQ8(int32_t value, int32_t scale);
+
+/**
+ * @brief Gets the accelerometer scale of a full scale range.
+ * @param fsr Full scale range. Out of range values give the ±4g scale.
+ * @return int32_t Reciprocal scale from raw data to milli-g (Q16).
+ */
+int32_t imuConvert_AccScale(imuAccFsr_t fsr);
+
+/**
+ * @brief Gets the gyroscope scale of a full scale range.
+ * @param fsr Full scale range. Out of range values give the ±500°/s scale.
+ * @return int32_t Reciprocal scale from raw data to centi-degrees/s (Q16).
+ */
+int32_t imuConvert_GyroScale(imuGyroFsr_t fsr);
+
+/**
+ * @brief Converts the accelerometer data of a raw sample.
+ * @param raw Raw sample.
+ * @param scale Accelerometer scale (Q16), from imuConvert_AccScale().
+ * @param acc Pointer to acc_t where the acceleration will be stored, in milli-g.
+ */
+void imuConvert_Acc(const imuRaw_t *raw, int32_t scale, acc_t *acc);
+
+/**
+ * @brief Converts the temperature data of a raw sample.
+ * @param raw Raw temperature.
+ * @return int16_t Temperature, in centi-degrees Celsius.
+ */
+int16_t imuConvert_Temp(int16_t raw);
+
+/**
+ * @brief Converts the gyroscope data of a raw sample, removing the offsets.
+ * @param raw Raw sample.
+ * @param offset Offsets of the X, Y and Z axes, in counts (Q8).
+ * @param scale Gyroscope scale (Q16), from imuConvert_GyroScale().
+ * @param gyro Pointer to gyro_t where the angular velocity will be stored, in centi-degrees/s.
+ */
+void imuConvert_Gyro(const imuRaw_t *raw, const int32_t *offset, int32_t scale,
+		gyro_t *gyro);
+
+/**
+ * @brief Gets the gyroscope offsets compensated for the temperature.
+ * @param bias Offset tracking.
+ * @param cal Calibrated offsets of the X, Y and Z axes, in counts (Q8).
+ * @param temp Temperature, in centi-degrees Celsius.
+ * @param offset Offsets at the temperature, in counts (Q8).
+ */
+void imuConvert_GyroOffset(const imuGyroBias_t *bias, const int32_t *cal,
+		int16_t temp, int32_t *offset);
+
+/**
+ * @brief Updates the stationary detection and tracks the gyroscope offsets with a sample.
+ * @param bias Offset tracking, starts from the calibrated offsets when not initialised.
+ * @param cal Calibrated offsets of the X, Y and Z axes, in counts (Q8), updated while stationary.
+ * @param raw Raw sample.
+ * @param temp Temperature of the sample, in centi-degrees Celsius.
+ * @param offset Offsets at the temperature, from imuConvert_GyroOffset().
+ * @param scale Gyroscope scale (Q16), from imuConvert_GyroScale().
+ * @param rateHz Output data rate, in Hz.
+ * @note Constant cost per sample. Shared by the device port and the trace replay,
+ * so a replayed trace follows the offsets the device tracked.
+ */
+void imuConvert_GyroBiasUpdate(imuGyroBias_t *bias, int32_t *cal,
+		const imuRaw_t *raw, int16_t temp, const int32_t *offset, int32_t scale,
+		uint16_t rateHz);
+
+/**
+ * @brief Applies the factory sensitivity adjustment to the magnetometer data of a raw sample.
+ * @param raw Raw sample.
+ * @param asa Sensitivity adjustment of each axis (Q16).
+ * @param m Adjusted readings of the AK8963 X, Y and Z axes, in counts.
+ */
+void imuConvert_MagnAdjust(const imuRaw_t *raw, const int32_t *asa, int32_t *m);
+
+/**
+ * @brief Applies the hard-iron and soft-iron calibration to adjusted magnetometer readings.
+ * @param m Adjusted readings, from imuConvert_MagnAdjust().
+ * @param cal Magnetometer calibration, in the AK8963 axes.
+ * @param magn Pointer to magn_t where the field will be stored, in milli-gauss, aligned
+ * with the accelerometer and gyroscope axes.
+ */
+void imuConvert_MagnCorrect(const int32_t *m, const magnCal_t *cal,
+		magn_t *magn);
+
+#endif
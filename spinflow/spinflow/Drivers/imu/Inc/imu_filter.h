@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * @file    imu_filter.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU digital filters
+ *
+ * Single channel filter, either a cascade of biquad IIR sections (direct form I)
+ * or a short FIR moving average. The configuration can be changed at run time.
+ *
+ * Biquad coefficients use the CMSIS-DSP layout, {b0, b1, b2, a1, a2} per stage
+ * with the feedback coefficients negated:
+ * y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2].
+ * When IMU_FILTER_CMSIS_DSP is defined to 1 (with CMSIS-DSP added to the build),
+ * the cascade runs on arm_biquad_cascade_df1_f32(). Otherwise a portable
+ * implementation with the same results is used, which also builds on the host.
+ ******************************************************************************
+ */
+
+#ifndef IMU_FILTER_H
+#define IMU_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef IMU_FILTER_CMSIS_DSP
+#define IMU_FILTER_CMSIS_DSP	0
+#endif
+
+#if IMU_FILTER_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+/**
+ * @def IMU_FILTER_MAX_STAGES
+ * @brief Maximum number of biquad stages of a filter.
+ */
+#define IMU_FILTER_MAX_STAGES	4
+
+/**
+ * @def IMU_FILTER_MAX_TAPS
+ * @brief Maximum length of the moving average.
+ */
+#define IMU_FILTER_MAX_TAPS		16
+
+/**
+ * @enum imuFilterType_t
+ * @brief Filter types.
+ */
+typedef enum
+{
+	IMU_FILTER_NONE, /**< Output equals the input. */
+	IMU_FILTER_BIQUAD, /**< Cascade of biquad sections. */
+	IMU_FILTER_AVERAGE /**< Moving average. */
+} imuFilterType_t;
+
+/**
+ * @struct imuFilter_t
+ * @brief Filter configuration and state.
+ */
+typedef struct
+{
+	imuFilterType_t type; /**< Filter type. */
+	uint8_t stages; /**< Number of biquad stages. */
+	float coeffs[5 * IMU_FILTER_MAX_STAGES]; /**< Biquad coefficients, CMSIS-DSP layout. */
+	float state[4 * IMU_FILTER_MAX_STAGES]; /**< Biquad state {x[n-1], x[n-2], y[n-1], y[n-2]} per stage. */
+#if IMU_FILTER_CMSIS_DSP
+	arm_biquad_casd_df1_inst_f32 instance; /**< CMSIS-DSP instance. */
+#endif
+	float window[IMU_FILTER_MAX_TAPS]; /**< Moving average input history. */
+	float sum; /**< Moving average running sum. */
+	uint8_t taps; /**< Moving average length. */
+	uint8_t index; /**< Oldest input of the moving average. */
+} imuFilter_t;
+
+/**
+ * @brief Initializes a filter as a pass-through.
+ * @param filter Filter.
+ */
+void imuFilter_Init(imuFilter_t *filter);
+
+/**
+ * @brief Configures a Butterworth low-pass filter.
+ * @param filter Filter.
+ * @param cutoffHz Cutoff frequency (-3 dB), in Hz. Must be below half the sample rate.
+ * @param sampleRateHz Sample rate, in Hz.
+ * @param stages Number of biquad stages, the filter order is twice this value.
+ * @return bool Returns true if the filter was configured, false if a parameter is out of range.
+ */
+bool imuFilter_SetLowPass(imuFilter_t *filter, float cutoffHz,
+		float sampleRateHz, uint8_t stages);
+
+/**
+ * @brief Configures a cascade of biquad sections from its coefficients.
+ * @param filter Filter.
+ * @param coeffs 5 coefficients per stage, CMSIS-DSP layout.
+ * @param stages Number of stages.
+ * @return bool Returns true if the filter was configured, false if a parameter is out of range.
+ */
+bool imuFilter_SetBiquad(imuFilter_t *filter, const float *coeffs,
+		uint8_t stages);
+
+/**
+ * @brief Configures a moving average.
+ * @param filter Filter.
+ * @param taps Number of averaged inputs.
+ * @return bool Returns true if the filter was configured, false if a parameter is out of range.
+ */
+bool imuFilter_SetAverage(imuFilter_t *filter, uint8_t taps);
+
+/**
+ * @brief Clears the filter history, keeping its configuration.
+ * @param filter Filter.
+ */
+void imuFilter_Reset(imuFilter_t *filter);
+
+/**
+ * @brief Filters one input sample.
+ * @param filter Filter.
+ * @param x Input.
+ * @return float Output.
+ */
+float imuFilter_Apply(imuFilter_t *filter, float x);
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ ******************************************************************************
+ * @file    imu_gesture.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU gesture recognition
+ *
+ * Fixed-point gesture engine fed with every calibrated sample. The samples are
+ * averaged into frames at IMU_GESTURE_FRAME_HZ, whatever the sample rate. A frame
+ * holds the angular velocity and the dynamic acceleration (gravity removed with a
+ * slow low-pass filter), and the last IMU_GESTURE_WINDOW frames are kept in a ring.
+ *
+ * Built-in gestures are found from windowed features:
+ * - shake: repeated reversals of a strong acceleration within the window,
+ * - flick: a short burst of angular velocity, then rest,
+ * - double tap: two short acceleration spikes, while not rotating,
+ * - tilt and hold: the sensor Z axis tilted beyond IMU_GESTURE_TILT_DEG and held still.
+ * Taps are detected on every sample, as a spike lasts less than a frame.
+ *
+ * Other gestures are matched against templates stored in flash, with a streaming
+ * subsequence dynamic time warping (SPRING): each frame updates one column of the
+ * warping matrix of each template, so the cost per frame is bounded by
+ * IMU_GESTURE_MAX_TEMPLATES x IMU_GESTURE_MAX_LENGTH cells. Templates are trained
+ * from recorded traces with Tools/imu_gesture.py, which uses the same frames.
+ *
+ * The module only depends on the C standard library, so the same sources can be
+ * built on the host side.
+ ******************************************************************************
+ */
+
+#ifndef IMU_GESTURE_H
+#define IMU_GESTURE_H
+
+#include "imu_port.h"
+
+/**
+ * @def IMU_GESTURE_FRAME_HZ
+ * @brief Frame rate, in Hz. Sample rates that are not a multiple of it give slightly slower frames.
+ */
+#define IMU_GESTURE_FRAME_HZ		50
+
+/**
+ * @def IMU_GESTURE_WINDOW
+ * @brief Frames kept in the ring, 640 ms. Must be a power of two.
+ */
+#define IMU_GESTURE_WINDOW			32
+
+/**
+ * @def IMU_GESTURE_CHANNELS
+ * @brief Channels of a frame: angular velocity X, Y, Z, then dynamic acceleration X, Y, Z.
+ */
+#define IMU_GESTURE_CHANNELS		6
+
+/**
+ * @def IMU_GESTURE_MAX_TEMPLATES
+ * @brief Most templates matched at once.
+ */
+#define IMU_GESTURE_MAX_TEMPLATES	8
+
+/**
+ * @def IMU_GESTURE_MAX_LENGTH
+ * @brief Longest template, in frames.
+ */
+#define IMU_GESTURE_MAX_LENGTH		32
+
+/**
+ * @def IMU_GESTURE_GYRO_DPS_LSB
+ * @brief Template unit of the angular velocity, in degrees per second.
+ */
+#define IMU_GESTURE_GYRO_DPS_LSB	8
+
+/**
+ * @def IMU_GESTURE_ACC_MG_LSB
+ * @brief Template unit of the dynamic acceleration, in milli-g.
+ */
+#define IMU_GESTURE_ACC_MG_LSB		16
+
+/**
+ * @def IMU_GESTURE_QUEUE
+ * @brief Detected gestures waiting to be taken. Must be a power of two.
+ */
+#define IMU_GESTURE_QUEUE			4
+
+/**
+ * @brief Thresholds of the built-in gestures, can be overridden from the compiler command line.
+ */
+#ifndef IMU_GESTURE_SHAKE_MG
+#define IMU_GESTURE_SHAKE_MG		600		/**< Dynamic acceleration of a shake stroke, in milli-g */
+#endif
+#ifndef IMU_GESTURE_SHAKE_REVERSALS
+#define IMU_GESTURE_SHAKE_REVERSALS	4		/**< Stroke reversals within the window that make a shake */
+#endif
+#ifndef IMU_GESTURE_FLICK_DPS
+#define IMU_GESTURE_FLICK_DPS		300		/**< Angular velocity of a flick, in degrees per second */
+#endif
+#ifndef IMU_GESTURE_FLICK_END_DPS
+#define IMU_GESTURE_FLICK_END_DPS	60		/**< Angular velocity that ends a flick, in degrees per second */
+#endif
+#ifndef IMU_GESTURE_FLICK_REST_MS
+#define IMU_GESTURE_FLICK_REST_MS	60		/**< Rest that ends a flick, a back and forth twist goes through 0 quicker */
+#endif
+#ifndef IMU_GESTURE_FLICK_MAX_MS
+#define IMU_GESTURE_FLICK_MAX_MS	200		/**< Longest flick, longer bursts are turns */
+#endif
+#ifndef IMU_GESTURE_TAP_MG
+#define IMU_GESTURE_TAP_MG			1500	/**< Dynamic acceleration of a tap, in milli-g */
+#endif
+#ifndef IMU_GESTURE_TAP_MAX_MS
+#define IMU_GESTURE_TAP_MAX_MS		40		/**< Longest tap spike */
+#endif
+#ifndef IMU_GESTURE_TAP_MAX_DPS
+#define IMU_GESTURE_TAP_MAX_DPS		200		/**< Angular velocity above which no tap is detected, in degrees per second */
+#endif
+#ifndef IMU_GESTURE_TAP_GAP_MIN_MS
+#define IMU_GESTURE_TAP_GAP_MIN_MS	80		/**< Shortest time between the two taps of a double tap */
+#endif
+#ifndef IMU_GESTURE_TAP_GAP_MAX_MS
+#define IMU_GESTURE_TAP_GAP_MAX_MS	500		/**< Longest time between the two taps of a double tap */
+#endif
+#ifndef IMU_GESTURE_TILT_DEG
+#define IMU_GESTURE_TILT_DEG		45		/**< Tilt of the Z axis from the vertical, in degrees */
+#endif
+#ifndef IMU_GESTURE_HOLD_DPS
+#define IMU_GESTURE_HOLD_DPS		30		/**< Angular velocity below which a tilt is held, in degrees per second */
+#endif
+#ifndef IMU_GESTURE_HOLD_MS
+#define IMU_GESTURE_HOLD_MS			1000	/**< Time a tilt must be held */
+#endif
+
+/**
+ * @enum imuGestureType_t
+ * @brief Gestures.
+ */
+typedef enum
+{
+	IMU_GESTURE_NONE, /**< No gesture. */
+	IMU_GESTURE_SHAKE, /**< Back and forth strokes. */
+	IMU_GESTURE_FLICK, /**< Short burst of rotation. The direction is the rotation axis and sense. */
+	IMU_GESTURE_DOUBLE_TAP, /**< Two taps in a row. */
+	IMU_GESTURE_TILT_HOLD, /**< Tilted and held still. The direction is the axis pointing down the most. */
+	IMU_GESTURE_TEMPLATE /**< Match of a trained template. */
+} imuGestureType_t;
+
+/**
+ * @struct imuGestureEvent_t
+ * @brief Detected gesture.
+ */
+typedef struct
+{
+	imuGestureType_t type; /**< Gesture. */
+	int8_t direction; /**< Signed axis, 1 for +X, -2 for -Y, 3 for +Z. 0 when not applicable. */
+	uint8_t index; /**< Template index, IMU_GESTURE_TEMPLATE only. */
+	uint16_t score; /**< Mean distance per frame of a template match, lower is closer. */
+	uint32_t timestamp; /**< Time of the detection, in milliseconds. */
+} imuGestureEvent_t;
+
+/**
+ * @struct imuGestureTemplate_t
+ * @brief Trained gesture, stored in flash.
+ */
+typedef struct
+{
+	const char *name; /**< Name, for the log. */
+	uint8_t length; /**< Number of frames, up to IMU_GESTURE_MAX_LENGTH. */
+	uint16_t threshold; /**< Largest mean distance per frame of a match. */
+	const int8_t (*frames)[IMU_GESTURE_CHANNELS]; /**< Frames, in IMU_GESTURE_GYRO_DPS_LSB and IMU_GESTURE_ACC_MG_LSB units. */
+} imuGestureTemplate_t;
+
+/**
+ * @struct imuGestureMatch_t
+ * @brief Streaming warping state of a template.
+ */
+typedef struct
+{
+	uint32_t distance[IMU_GESTURE_MAX_LENGTH + 1]; /**< Cost of the best warping path ending at each template frame. */
+	uint32_t start[IMU_GESTURE_MAX_LENGTH + 1]; /**< First frame of each of these paths. */
+	uint32_t best; /**< Cost of the candidate match. */
+	uint32_t end; /**< Last frame of the candidate match. */
+	bool pending; /**< Set while a candidate match may still be improved. */
+} imuGestureMatch_t;
+
+/**
+ * @struct imuGesture_t
+ * @brief Engine configuration and state.
+ */
+typedef struct
+{
+	uint16_t decimation; /**< Samples per frame. */
+	uint16_t frameMs; /**< Frame period, in milliseconds. */
+	uint32_t tiltCos2; /**< Squared cosine of IMU_GESTURE_TILT_DEG (Q16). */
+	int32_t accSum[3]; /**< Acceleration sum of the frame being collected, in milli-g. */
+	int32_t gyroSum[3]; /**< Angular velocity sum of the frame being collected, in centi-degrees/s. */
+	uint16_t count; /**< Samples in the frame being collected. */
+	uint32_t frameCount; /**< Frames since the start. */
+	int32_t gravityQ4[3]; /**< Low-pass filtered acceleration, in milli-g (Q4). */
+	bool gravityValid; /**< Set once the first frame initialized the gravity. */
+	int16_t ring[IMU_GESTURE_WINDOW][IMU_GESTURE_CHANNELS]; /**< Last frames, in degrees per second and milli-g. */
+	uint8_t reversals[IMU_GESTURE_WINDOW]; /**< Shake stroke reversals of each frame of the ring. */
+	uint16_t head; /**< Ring index of the next frame. */
+	uint16_t windowReversals; /**< Stroke reversals within the ring. */
+	int32_t windowRotation; /**< Sum of the strongest angular velocity of each frame of the ring, in degrees per second. */
+	int8_t strokeSign[3]; /**< Sign of the last strong stroke of each axis, 0 if none. */
+	uint16_t flickFrames; /**< Frames since the start of the burst in progress, 0 when there is none. */
+	uint16_t flickRest; /**< Frames at rest since the last strong rotation of the burst. */
+	int8_t flickDirection; /**< Signed axis of the strongest rotation of the burst. */
+	int16_t flickPeak; /**< Strongest rotation of the burst, in degrees per second. */
+	bool tapActive; /**< Set during a spike. */
+	uint32_t tapStart; /**< Time the spike started, in milliseconds. */
+	uint32_t tapLast; /**< Time of the first tap of a double tap, in milliseconds. */
+	bool tapPending; /**< Set after a first tap. */
+	uint16_t holdFrames; /**< Frames the tilt was held. */
+	bool holdReported; /**< Set once the held tilt was reported, until the tilt ends. */
+	const imuGestureTemplate_t *templates; /**< Templates, in flash. */
+	uint8_t templateCount; /**< Number of templates. */
+	imuGestureMatch_t match[IMU_GESTURE_MAX_TEMPLATES]; /**< Warping state of each template. */
+	imuGestureEvent_t queue[IMU_GESTURE_QUEUE]; /**< Detected gestures. */
+	uint8_t queueHead; /**< Index of the next detected gesture. */
+	uint8_t queueTail; /**< Index of the oldest detected gesture. */
+} imuGesture_t;
+
+/**
+ * @var imuGestureTemplates
+ * @brief Default templates, generated by Tools/imu_gesture.py (imu_gesture_templates.c).
+ */
+extern const imuGestureTemplate_t imuGestureTemplates[];
+
+/**
+ * @var imuGestureTemplateCount
+ * @brief Number of default templates.
+ */
+extern const uint8_t imuGestureTemplateCount;
+
+/**
+ * @brief Initializes an engine.
+ * @param gesture Engine.
+ * @param sampleRateHz Sample rate, in Hz.
+ * @param templates Templates, kept by reference. Can be NULL.
+ * @param count Number of templates, up to IMU_GESTURE_MAX_TEMPLATES.
+ * @return bool Returns true if the engine was initialized, false if a parameter is out of range.
+ */
+bool imuGesture_Init(imuGesture_t *gesture, uint16_t sampleRateHz,
+		const imuGestureTemplate_t *templates, uint8_t count);
+
+/**
+ * @brief Clears the frames and the gestures in progress, after a gap in the samples.
+ * @param gesture Engine.
+ */
+void imuGesture_Reset(imuGesture_t *gesture);
+
+/**
+ * @brief Adds a sample.
+ * @param gesture Engine.
+ * @param acc Acceleration, in milli-g.
+ * @param gyro Angular velocity, in centi-degrees/s.
+ * @param timestamp Acquisition time, in milliseconds.
+ */
+void imuGesture_Add(imuGesture_t *gesture, const acc_t *acc,
+		const gyro_t *gyro, uint32_t timestamp);
+
+/**
+ * @brief Takes the oldest detected gesture.
+ * @param gesture Engine.
+ * @param event Pointer to imuGestureEvent_t where the gesture will be stored.
+ * @return bool Returns true if a gesture was detected, false otherwise.
+ * @note The oldest gestures are dropped when they are not taken in time.
+ */
+bool imuGesture_Get(imuGesture_t *gesture, imuGestureEvent_t *event);
+
+#endif
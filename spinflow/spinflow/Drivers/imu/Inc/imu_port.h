@@ -12,31 +12,55 @@
 #define IMU_PORT_H
 
 #include <stdio.h>
+#include "device_config.h"
+#include "device_types.h"
+
+#if !DEVICE_IMU_REPLAY
 #include "stm32f4xx_hal.h"
 #include "stm32f4xx_nucleo_144.h"
+#else
+/**
+ * @brief Gets the replay time, in milliseconds. Stands for the HAL tick in replay builds.
+ * @return Time of the replay clock.
+ */
+uint32_t HAL_GetTick(void);
+#endif
 
-#include "device_config.h"
-#include "device_types.h"
+/**
+ * @def IMU_DEVICES
+ * @brief Number of sensors on the bus.
+ */
+#define IMU_DEVICES		DEVICE_IMU_COUNT
+
+/**
+ * @enum imuId_t
+ * @brief Sensors on the bus, below IMU_DEVICES.
+ */
+typedef enum
+{
+	IMU_PRIMARY = 0, /**< Address 0x68 or IMU_CS0, its INT pin paces the acquisition. */
+	IMU_SECONDARY /**< Address 0x69 or IMU_CS1. */
+} imuId_t;
 
 /**
  * @struct acc_t
  * @brief Structure to hold accelerometer data.
  *
- * This structure is used to hold the raw data from the accelerometer, including
- * measurements along the X, Y, and Z axes.
+ * This structure is used to hold the data from the accelerometer, including
+ * measurements along the X, Y, and Z axes, in milli-g.
  */
 typedef struct
 {
-	int16_t ax; /**< Acceleration along the X-axis. */
-	int16_t ay; /**< Acceleration along the Y-axis. */
-	int16_t az; /**< Acceleration along the Z-axis. */
+	int16_t ax; /**< Acceleration along the X-axis, in milli-g. */
+	int16_t ay; /**< Acceleration along the Y-axis, in milli-g. */
+	int16_t az; /**< Acceleration along the Z-axis, in milli-g. */
 } acc_t;
 
 /**
  * @typedef temp_t
  * @brief Type definition for temperature measurements.
  *
- * Represents the temperature data measured in degrees Celsius, using
+ * Represents the temperature data measured in centi-degrees Celsius, using
  * a 16-bit signed integer to accommodate the range and precision.
  */
 typedef int16_t temp_t;
@@ -45,36 +69,169 @@ typedef int16_t temp_t;
  * @struct gyro_t
  * @brief Structure to hold gyroscope data.
  *
- * This structure contains raw data from the gyroscope, with measurements for
- * angular velocity along the X, Y, and Z axes.
+ * This structure contains data from the gyroscope, with measurements for
+ * angular velocity along the X, Y, and Z axes, in centi-degrees per second.
+ * ±2000°/s does not fit in 16 bits at this resolution.
  */
 typedef struct
 {
-	int16_t gx; /**< Angular velocity along the X-axis. */
-	int16_t gy; /**< Angular velocity along the Y-axis. */
-	int16_t gz; /**< Angular velocity along the Z-axis. */
+	int32_t gx; /**< Angular velocity along the X-axis, in centi-degrees/s. */
+	int32_t gy; /**< Angular velocity along the Y-axis, in centi-degrees/s. */
+	int32_t gz; /**< Angular velocity along the Z-axis, in centi-degrees/s. */
 } gyro_t;
 
 /**
  * @struct magn_t
  * @brief Structure to hold magnetometer data.
  *
- * Used to store raw magnetometer data which measures magnetic fields along
- * the X, Y, and Z axes.
+ * Used to store calibrated magnetometer data which measures magnetic fields along
+ * the X, Y, and Z axes of the accelerometer and gyroscope, in milli-gauss.
  */
 typedef struct
 {
-	int16_t mx; /**< Magnetic field strength along the X-axis. */
-	int16_t my; /**< Magnetic field strength along the Y-axis. */
-	int16_t mz; /**< Magnetic field strength along the Z-axis. */
+	int16_t mx; /**< Magnetic field strength along the X-axis, in milli-gauss. */
+	int16_t my; /**< Magnetic field strength along the Y-axis, in milli-gauss. */
+	int16_t mz; /**< Magnetic field strength along the Z-axis, in milli-gauss. */
 } magn_t;
 
+/**
+ * @struct imuRaw_t
+ * @brief Raw sample, as read from the sensor.
+ */
+typedef struct
+{
+	int16_t ax; /**< Raw accelerometer X-axis data. */
+	int16_t ay; /**< Raw accelerometer Y-axis data. */
+	int16_t az; /**< Raw accelerometer Z-axis data. */
+	int16_t gx; /**< Raw gyroscope X-axis data. */
+	int16_t gy; /**< Raw gyroscope Y-axis data. */
+	int16_t gz; /**< Raw gyroscope Z-axis data. */
+	int16_t mx; /**< Raw magnetometer X-axis data, AK8963 axes. */
+	int16_t my; /**< Raw magnetometer Y-axis data, AK8963 axes. */
+	int16_t mz; /**< Raw magnetometer Z-axis data, AK8963 axes. */
+	int16_t temp; /**< Raw temperature data. */
+	bool_t magn; /**< Magnetometer data valid. */
+	uint32_t timestamp; /**< Acquisition tick, in milliseconds. */
+	uint32_t timestampUs; /**< Data-ready time, in microseconds. */
+} imuRaw_t;
+
+/**
+ * @struct imuRawCal_t
+ * @brief Calibration needed to convert raw samples, besides the full scale ranges.
+ */
+typedef struct
+{
+	int32_t gyroOffset[3]; /**< Gyroscope offsets in use, in counts (Q8). */
+	int32_t magnAsa[3]; /**< Magnetometer factory sensitivity adjustment (Q16). */
+} imuRawCal_t;
+
+/**
+ * @struct magnCal_t
+ * @brief Magnetometer calibration, in the AK8963 axes.
+ *
+ * The hard-iron offset is subtracted from the readings, then the soft-iron matrix
+ * is applied: m' = matrix * (m - offset).
+ */
+typedef struct
+{
+	int16_t offset[3]; /**< Hard-iron offset of each axis, in counts. */
+	int32_t matrix[3][3]; /**< Soft-iron correction matrix (Q16), identity is 65536 on the diagonal. */
+} magnCal_t;
+
+/**
+ * @enum imuAccFsr_t
+ * @brief Accelerometer full scale ranges.
+ */
+typedef enum
+{
+	ACC_FSR_2G, /**< Full scale range ±2g */
+	ACC_FSR_4G, /**< Full scale range ±4g */
+	ACC_FSR_8G, /**< Full scale range ±8g */
+	ACC_FSR_16G /**< Full scale range ±16g */
+} imuAccFsr_t;
+
+/**
+ * @enum imuGyroFsr_t
+ * @brief Gyroscope full scale ranges.
+ */
+typedef enum
+{
+	GYR_FSR_250DPS, /**< Full scale range ±250 degrees per second */
+	GYR_FSR_500DPS, /**< Full scale range ±500 degrees per second */
+	GYR_FSR_1000DPS, /**< Full scale range ±1000 degrees per second */
+	GYR_FSR_2000DPS /**< Full scale range ±2000 degrees per second */
+} imuGyroFsr_t;
+
+/**
+ * @enum imuDlpf_t
+ * @brief Bandwidth of the gyroscope and accelerometer digital low-pass filters.
+ *
+ * The accelerometer bandwidth is close to the gyroscope one. Lower bandwidths
+ * reduce the noise and add delay, from about 3 ms at 184 Hz to 33 ms at 5 Hz.
+ */
+typedef enum
+{
+	IMU_DLPF_184HZ = 1, /**< Gyro 184 Hz, accelerometer 218 Hz */
+	IMU_DLPF_92HZ, /**< Gyro 92 Hz, accelerometer 99 Hz */
+	IMU_DLPF_41HZ, /**< Gyro 41 Hz, accelerometer 45 Hz */
+	IMU_DLPF_20HZ, /**< Gyro 20 Hz, accelerometer 21 Hz */
+	IMU_DLPF_10HZ, /**< Gyro 10 Hz, accelerometer 10 Hz */
+	IMU_DLPF_5HZ /**< Gyro 5 Hz, accelerometer 5 Hz */
+} imuDlpf_t;
+
+/**
+ * @struct imuConfig_t
+ * @brief Sensor output data rate, bandwidth and full scale ranges.
+ */
+typedef struct
+{
+	uint16_t rateHz; /**< Output data rate, in Hz (4 to 1000). 1000 Hz divided by an integer. */
+	imuDlpf_t dlpf; /**< Digital low-pass filter bandwidth. */
+	imuAccFsr_t accFsr; /**< Accelerometer full scale range. */
+	imuGyroFsr_t gyroFsr; /**< Gyroscope full scale range. */
+} imuConfig_t;
+
+/**
+ * @struct imuSnapshot_t
+ * @brief Accelerometer, temperature and gyroscope readings of the same sample.
+ *
+ * All the fields come from a single sensor sample, so they are coherent in time.
+ */
+typedef struct
+{
+	uint32_t timestamp; /**< Acquisition time, in milliseconds (HAL tick). */
+	uint32_t timestampUs; /**< Data-ready time, in microseconds, from a free-running timer that wraps every 71 minutes. */
+	acc_t acc; /**< Accelerometer data. */
+	temp_t temp; /**< Temperature data. */
+	gyro_t gyro; /**< Gyroscope data. */
+	magn_t magn; /**< Magnetometer data, zero when not available. */
+} imuSnapshot_t;
+
+/**
+ * @struct imuTiming_t
+ * @brief Statistics of the intervals between two data-ready interrupts.
+ *
+ * The sensor clock deviates from its nominal rate by up to a few percent, so the
+ * jitter is measured around the mean interval.
+ */
+typedef struct
+{
+	uint32_t intervals; /**< Intervals measured. */
+	uint32_t missed; /**< Intervals longer than 1.5 periods, where a data-ready interrupt was missed. Not in the other statistics. */
+	uint32_t periodUs; /**< Nominal interval at the configured rate, in microseconds. */
+	uint32_t minUs; /**< Shortest interval, in microseconds. */
+	uint32_t maxUs; /**< Longest interval, in microseconds. */
+	float meanUs; /**< Mean interval, in microseconds. */
+	float jitterUs; /**< Standard deviation of the intervals, in microseconds. */
+} imuTiming_t;
+
 /**
  * @brief Initializes the IMU port.
  * @return True if initialization is successful, False otherwise.
  *
  * This function sets up the IMU hardware, ensuring it is ready for data
- * collection and processing.
+ * collection and processing. It succeeds when IMU_PRIMARY answers, the other
+ * sensors are optional (see imuPort_Present()).
  */
 bool imuPort_Init();
 
@@ -82,52 +239,280 @@ bool imuPort_Init();
  * @brief Checks the IMU device status.
  * @return True if the device is functioning correctly, False otherwise.
  *
- * Performs a basic status check of the IMU to ensure it is operational.
+ * Performs a basic status check of every present sensor to ensure it is operational.
  */
 bool imuPort_Check();
 
+/**
+ * @brief Checks if a sensor answered at start-up.
+ * @param id Sensor.
+ * @return True if the sensor is acquired, False otherwise.
+ *
+ * Each present sensor has its own ring buffer and calibration. Its samples must be
+ * consumed with imuPort_NextSample(), or they are dropped once its ring buffer is full.
+ */
+bool imuPort_Present(imuId_t id);
+
+/**
+ * @brief Takes the oldest acquired sample as the current one.
+ * @param id Sensor.
+ * @return True if a new sample was available, False otherwise.
+ *
+ * The sensor queues its samples in its FIFO. Every DEVICE_IMU_FIFO_BATCH data-ready
+ * interrupts of IMU_PRIMARY, the FIFO content of every present sensor is read by DMA,
+ * in a single burst each and back to back, and queued in the ring buffer of the
+ * sensor. The read functions below return the current sample of the sensor.
+ */
+bool imuPort_NextSample(imuId_t id);
+
+/**
+ * @brief Takes the oldest acquired sample as a snapshot of all channels.
+ * @param id Sensor.
+ * @param snapshot Pointer to imuSnapshot_t where the sample will be stored.
+ * @return True if a new sample was available, False otherwise.
+ *
+ * Each sample is read from the sensor in a single burst, so the snapshot costs no
+ * bus transaction by itself. The sample also becomes the current one.
+ */
+bool imuPort_ReadSnapshot(imuId_t id, imuSnapshot_t *snapshot);
+
+/**
+ * @brief Takes up to max acquired samples, oldest first.
+ * @param id Sensor.
+ * @param acc Array of at least max elements where the accelerometer data will be stored, or NULL.
+ * @param gyro Array of at least max elements where the gyroscope data will be stored, or NULL.
+ * @param max Maximum number of samples.
+ * @return Number of samples stored. The last one becomes the current sample.
+ */
+uint16_t imuPort_ReadBatch(imuId_t id, acc_t *acc, gyro_t *gyro,
+		uint16_t max);
+
+/**
+ * @brief Gets the number of samples lost since the acquisition started.
+ * @param id Sensor.
+ * @return Samples lost because the ring buffer was full.
+ */
+uint32_t imuPort_DroppedSamples(imuId_t id);
+
+/**
+ * @brief Gets the number of sensor FIFO overflows since the acquisition started.
+ * @param id Sensor.
+ * @return FIFO overflows. The FIFO content is dropped and the FIFO reset on each of them.
+ */
+uint32_t imuPort_FifoOverflows(imuId_t id);
+
+/**
+ * @brief Gets the statistics of the data-ready intervals of IMU_PRIMARY.
+ * @param timing Pointer to imuTiming_t where the statistics will be stored.
+ *
+ * The statistics are cleared when the configuration changes.
+ */
+void imuPort_GetTiming(imuTiming_t *timing);
+
+/**
+ * @brief Clears the statistics of the data-ready intervals.
+ */
+void imuPort_ResetTiming();
+
+/**
+ * @brief Reads the raw data of the current sample.
+ * @param id Sensor.
+ * @param raw Pointer to imuRaw_t where the raw sample will be stored.
+ * @return True if data is successfully read, False otherwise.
+ */
+bool imuPort_RawReadData(imuId_t id, imuRaw_t *raw);
+
+/**
+ * @brief Gets the calibration applied to the raw samples.
+ * @param id Sensor.
+ * @param cal Pointer to imuRawCal_t where the calibration will be stored.
+ *
+ * The gyroscope offsets are the calibrated ones, without the temperature compensation.
+ */
+void imuPort_GetRawCalibration(imuId_t id, imuRawCal_t *cal);
+
+/**
+ * @brief Gets the number of failed or timed out bus accesses.
+ * @return Bus errors since start-up.
+ *
+ * Every access is bounded by DEVICE_IMU_BUS_TIMEOUT_MS. After a few consecutive
+ * errors, or when no data arrives for several batches, the bus is recovered: on I2C,
+ * SCL is clocked until the sensor releases SDA, the bus peripheral is reset and the
+ * sensor is reset and configured again. The sensor restart is waited for without blocking,
+ * while imuPort_NextSample() returns false.
+ */
+uint32_t imuPort_BusErrors();
+
+/**
+ * @brief Gets the number of completed bus recoveries.
+ * @return Recoveries since start-up.
+ */
+uint32_t imuPort_BusRecoveries();
+
+/**
+ * @brief Checks if a bus recovery is in progress.
+ * @return True while the sensor restarts, False otherwise.
+ */
+bool imuPort_Recovering();
+
 /**
  * @brief Reads data from the accelerometer.
+ * @param id Sensor.
  * @param acc Pointer to acc_t structure where accelerometer data will be stored.
  * @return True if data is successfully read, False otherwise.
  *
- * Fetches the latest readings from the accelerometer and stores them in the provided acc_t structure.
+ * Copies the accelerometer readings of the current sample into the provided acc_t structure.
  */
-bool imuPort_AccReadData(acc_t *acc);
+bool imuPort_AccReadData(imuId_t id, acc_t *acc);
 
 /**
  * @brief Reads temperature data.
+ * @param id Sensor.
  * @param temp Pointer to temp_t where temperature data will be stored.
  * @return True if data is successfully read, False otherwise.
  *
- * Retrieves the current temperature data from the IMU and stores it in the provided temp_t variable.
+ * Copies the temperature of the current sample into the provided temp_t variable.
  */
-bool imuPort_TempReadData(temp_t *temp);
+bool imuPort_TempReadData(imuId_t id, temp_t *temp);
 
 /**
  * @brief Reads data from the gyroscope.
+ * @param id Sensor.
  * @param gyro Pointer to gyro_t structure where gyroscope data will be stored.
  * @return True if data is successfully read, False otherwise.
  *
- * Captures the latest gyroscope measurements and stores them in the specified gyro_t structure.
+ * Copies the gyroscope readings of the current sample into the specified gyro_t structure.
  */
-bool imuPort_GyroReadData(gyro_t *gyro);
+bool imuPort_GyroReadData(imuId_t id, gyro_t *gyro);
 
 /**
  * @brief Reads data from the magnetometer.
+ * @param id Sensor.
  * @param magn Pointer to magn_t structure where magnetometer data will be stored.
  * @return True if data is successfully read, False otherwise.
  *
- * Retrieves magnetometer readings and fills the provided magn_t structure with these values.
+ * The MPU-9250 auxiliary I2C master reads the AK8963 into its external sensor
+ * registers, which are queued in the FIFO with the rest of the sample. Copies the
+ * magnetometer readings of the current sample into the provided magn_t structure.
+ * Returns false when the AK8963 is not present or the reading overflowed.
+ */
+bool imuPort_MagnReadData(imuId_t id, magn_t *magn);
+
+/**
+ * @brief Sets the magnetometer calibration.
+ * @param id Sensor.
+ * @param cal Hard-iron offset and soft-iron matrix.
  */
-bool imuPort_MagnReadData(magn_t *magn);
+void imuPort_MagnSetCalibration(imuId_t id, const magnCal_t *cal);
+
+/**
+ * @brief Gets the magnetometer calibration.
+ * @param id Sensor.
+ * @param cal Pointer to magnCal_t where the calibration will be stored.
+ */
+void imuPort_MagnGetCalibration(imuId_t id, magnCal_t *cal);
+
+/**
+ * @brief Starts collecting magnetometer calibration data.
+ * @param id Sensor.
+ *
+ * The extremes of each axis are tracked as the samples are consumed, while the
+ * device is rotated through all orientations.
+ */
+void imuPort_MagnCalibrationStart(imuId_t id);
+
+/**
+ * @brief Stops collecting magnetometer calibration data and applies the result.
+ * @param id Sensor.
+ * @return True if every axis covered enough range, False otherwise (the calibration is not changed).
+ *
+ * The hard-iron offset is the centre of the readings. The soft-iron matrix is diagonal
+ * and scales every axis to the average radius.
+ */
+bool imuPort_MagnCalibrationStop(imuId_t id);
 
 /**
  * @brief Calibrates the gyroscope.
+ * @param id Sensor.
  *
- * Executes a calibration routine for the gyroscope to ensure accuracy in its readings.
- * Typically involves offsetting drift and other systematic errors.
+ * Starts a calibration of the gyroscope offsets, which runs on the acquired samples
+ * as they are consumed, so it does not block. The readings are averaged while the
+ * device stays still, and the calibration restarts whenever it moves or the readings
+ * are too noisy. The previous offsets stay in use until it completes. It is started
+ * by imuPort_Init().
+ */
+void imuPort_calibrateGyro(imuId_t id);
+
+/**
+ * @brief Stops the acquisition and sets the sensor in wake-on-motion mode.
+ * @param thresholdMg Acceleration change that wakes the sensor, in milli-g (4 to 1020).
+ * @return True if the sensor was configured, False otherwise.
+ *
+ * Only the accelerometer of IMU_PRIMARY runs, in low power mode at 31.25 Hz, the
+ * magnetometers are powered down and the other sensors sleep. The INT pin pulses when the acceleration changes more than the
+ * threshold between two samples, which can wake the MCU from STOP mode.
+ */
+bool imuPort_EnterWakeOnMotion(uint16_t thresholdMg);
+
+/**
+ * @brief Checks if motion was detected in wake-on-motion mode.
+ * @return True if the sensor detected motion since imuPort_EnterWakeOnMotion(), False otherwise.
+ */
+bool imuPort_MotionWake();
+
+/**
+ * @brief Leaves wake-on-motion mode and restarts the acquisition.
+ * @return True if the sensor was configured, False otherwise.
+ */
+bool imuPort_ExitWakeOnMotion();
+
+/**
+ * @brief Checks if the device is stationary.
+ * @param id Sensor.
+ * @return True if the angular velocity stayed close to zero for half a second, False otherwise.
+ *
+ * While the device is stationary, the gyroscope offsets are slowly updated in the
+ * background. Their temperature coefficients are learned meanwhile, so the offsets
+ * also follow the sensor temperature while the device moves.
+ */
+bool imuPort_Stationary(imuId_t id);
+
+/**
+ * @brief Checks if the gyroscope calibration completed.
+ * @param id Sensor.
+ * @return True if the offsets come from a completed calibration and none is running, False otherwise.
+ */
+bool imuPort_GyroCalibrated(imuId_t id);
+
+/**
+ * @brief Gets the number of gyroscope calibration restarts caused by motion or noise.
+ * @param id Sensor.
+ * @return Restarts since the calibration was started.
+ */
+uint32_t imuPort_GyroCalRestarts(imuId_t id);
+
+/**
+ * @brief Sets the sensor output data rate, bandwidth and full scale ranges.
+ * @param config New configuration. The rate is rounded to the closest one the sensor supports.
+ * @return True if the sensor was configured, False if a parameter is out of range or a register write failed.
+ *
+ * The acquisition is paused while the registers and the conversion scales change, and
+ * the samples queued with the previous configuration are dropped, so every sample is
+ * converted with the scale it was acquired with. The gyroscope offsets are converted to
+ * the new range. Not available in wake-on-motion mode.
+ */
+bool imuPort_SetConfig(const imuConfig_t *config);
+
+/**
+ * @brief Gets the sensor configuration in use.
+ * @param config Pointer to imuConfig_t where the configuration will be stored.
+ */
+void imuPort_GetConfig(imuConfig_t *config);
+
+/**
+ * @brief Gets the sensor output data rate in use.
+ * @return Output data rate, in Hz.
  */
-void imuPort_calibrateGyro();
+uint16_t imuPort_SampleRate();
 
 #endif
@@ -0,0 +1,72 @@
+/**
+ ******************************************************************************
+ * @file    imu_replay.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU trace replay
+ *
+ * Implementation of the IMU port that plays back a trace recorded with
+ * imu_trace.h instead of reading the sensor, for host builds with
+ * DEVICE_IMU_REPLAY set to 1. The IMU API runs unchanged on top of it.
+ *
+ * The replay runs on its own clock, which also stands for the HAL tick. A sample
+ * becomes available once the clock reaches its timestamp, so the trace can be
+ * stepped through faster than real time with imuReplay_Advance():
+ *
+ *     imuReplay_Open(trace, length);
+ *     imu_Init();
+ *     while (!imuReplay_Done())
+ *     {
+ *         imuReplay_Advance(1);
+ *         imu_GetData();
+ *         ...
+ *     }
+ *
+ * The samples are converted with the full scale ranges and the gyroscope offsets
+ * of the trace header. The gyroscope calibration, its online tracking and the bus
+ * recovery of the device port are not replayed. A trace holds the samples of
+ * IMU_PRIMARY only.
+ ******************************************************************************
+ */
+
+#ifndef IMU_REPLAY_H
+#define IMU_REPLAY_H
+
+#include "imu_trace.h"
+
+/**
+ * @brief Opens a trace for replay.
+ * @param trace Trace, it must stay valid during the replay.
+ * @param length Trace length, in bytes.
+ * @return bool Returns true if the trace header is valid, false otherwise.
+ *
+ * The clock is set to the start of the trace.
+ */
+bool imuReplay_Open(const uint8_t *trace, uint32_t length);
+
+/**
+ * @brief Advances the replay clock.
+ * @param ms Time step, in milliseconds.
+ */
+void imuReplay_Advance(uint32_t ms);
+
+/**
+ * @brief Gets the replay clock.
+ * @return uint32_t Time, in milliseconds. It starts at the tick of the first recorded sample.
+ */
+uint32_t imuReplay_Time();
+
+/**
+ * @brief Checks if every sample of the trace was consumed.
+ * @return bool Returns true at the end of the trace, false otherwise.
+ */
+bool imuReplay_Done();
+
+/**
+ * @brief Gets the header of the open trace.
+ * @param header Pointer to imuTraceHeader_t where the header will be stored.
+ */
+void imuReplay_GetHeader(imuTraceHeader_t *header);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ ******************************************************************************
+ * @file    imu_rotation.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU rotation estimator
+ *
+ * Integrates the angular velocity about the spin axis into an accumulated angle,
+ * kept as whole revolutions plus the angle within the current revolution so its
+ * precision does not degrade as the revolutions add up. The rotation speed is
+ * smoothed with a first-order low-pass filter and reported in RPM.
+ *
+ * Each sample is integrated over the time since the previous one, taken from the
+ * data-ready timestamps, so missing samples are accounted for. A long gap (a bus
+ * recovery or a wake-up) is skipped.
+ ******************************************************************************
+ */
+
+#ifndef IMU_ROTATION_H
+#define IMU_ROTATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @def IMU_ROTATION_MAX_GAP_US
+ * @brief Longest gap between two samples that is integrated, in microseconds.
+ */
+#define IMU_ROTATION_MAX_GAP_US		100000UL
+
+/**
+ * @struct imuRotation_t
+ * @brief Estimator configuration and state.
+ */
+typedef struct
+{
+	float tauS; /**< Time constant of the speed smoothing, in seconds. */
+	float deadbandDps; /**< Rate below which the sensor is taken as still, in degrees per second. */
+	float rpm; /**< Smoothed rotation speed, in RPM. The sign gives the direction. */
+	float angle; /**< Angle within the current revolution, in degrees, from 0 to 360. */
+	int32_t revolutions; /**< Whole revolutions, negative ones subtracted. */
+	uint32_t lastTimestampUs; /**< Timestamp of the previous sample, in microseconds. */
+	bool started; /**< Set once a sample was integrated. */
+} imuRotation_t;
+
+/**
+ * @brief Initializes an estimator at rest.
+ * @param rot Estimator.
+ * @param tauS Time constant of the speed smoothing, in seconds. 0 disables the smoothing.
+ * @param deadbandDps Rate below which nothing is integrated, in degrees per second, so
+ * the residual gyroscope bias does not add up while the sensor is still.
+ */
+void imuRotation_Init(imuRotation_t *rot, float tauS, float deadbandDps);
+
+/**
+ * @brief Clears the speed, angle and revolutions.
+ * @param rot Estimator.
+ */
+void imuRotation_Reset(imuRotation_t *rot);
+
+/**
+ * @brief Integrates a sample.
+ * @param rot Estimator.
+ * @param dps Angular velocity about the spin axis, in degrees per second.
+ * @param timestampUs Data-ready time of the sample, in microseconds.
+ */
+void imuRotation_Update(imuRotation_t *rot, float dps, uint32_t timestampUs);
+
+/**
+ * @brief Gets the smoothed rotation speed.
+ * @param rot Estimator.
+ * @return float Rotation speed, in RPM. The sign gives the direction.
+ */
+float imuRotation_Rpm(const imuRotation_t *rot);
+
+/**
+ * @brief Gets the accumulated angle.
+ * @param rot Estimator.
+ * @param revolutions Pointer where the whole revolutions will be stored. Can be NULL.
+ * @return float Angle within the current revolution, in degrees, from 0 to 360.
+ */
+float imuRotation_Angle(const imuRotation_t *rot, int32_t *revolutions);
+
+#endif
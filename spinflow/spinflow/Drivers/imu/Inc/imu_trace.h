@@ -0,0 +1,169 @@
+/**
+ ******************************************************************************
+ * @file    imu_trace.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU trace recording
+ *
+ * Binary trace of raw IMU samples, so recorded motion can be replayed offline
+ * through the IMU API (see imu_replay.c). All fields are little endian.
+ *
+ * The trace starts with a header of IMU_TRACE_HEADER_SIZE bytes:
+ * magic "SFTR", version, flags (bit 0: magnetometer present), output data rate
+ * (uint16), DLPF, accelerometer and gyroscope full scale ranges, a reserved byte,
+ * the gyroscope offsets (3 x int32, Q8 counts), the magnetometer sensitivity
+ * adjustment (3 x int32, Q16) and the tick of the first sample (uint32).
+ *
+ * Each sample follows as a record: a tag byte, with the magnetometer flag in
+ * bit 7 and the time since the previous sample in milliseconds in bits 0 to 6
+ * (127 means the time follows as a uint16), the time since the previous data
+ * ready in microseconds (uint16, 65535 when longer or not known, the first record
+ * holds the millisecond time), then the raw accelerometer, temperature and
+ * gyroscope data (7 x int16) and, when flagged, the raw magnetometer data
+ * (3 x int16). A record takes 17 bytes, 23 with the magnetometer.
+ *
+ * The module only depends on the C standard library, so the same sources can be
+ * built on the host side.
+ ******************************************************************************
+ */
+
+#ifndef IMU_TRACE_H
+#define IMU_TRACE_H
+
+#include "imu_port.h"
+
+/**
+ * @def IMU_TRACE_MAGIC
+ * @brief First bytes of a trace, "SFTR".
+ */
+#define IMU_TRACE_MAGIC			0x52544653UL
+
+/**
+ * @def IMU_TRACE_VERSION
+ * @brief Version of the trace format.
+ */
+#define IMU_TRACE_VERSION		2
+
+/**
+ * @def IMU_TRACE_HEADER_SIZE
+ * @brief Length of the trace header, in bytes.
+ */
+#define IMU_TRACE_HEADER_SIZE	40
+
+/**
+ * @def IMU_TRACE_MAX_RECORD
+ * @brief Longest sample record, in bytes.
+ */
+#define IMU_TRACE_MAX_RECORD	25
+
+/**
+ * @def IMU_TRACE_BUFFER_SIZE
+ * @brief Size of the recording buffer, in bytes.
+ */
+#define IMU_TRACE_BUFFER_SIZE	DEVICE_IMU_TRACE_BUFFER
+
+/**
+ * @struct imuTraceHeader_t
+ * @brief Sensor settings of a trace, needed to convert its raw samples.
+ */
+typedef struct
+{
+	uint8_t version; /**< Trace format version. */
+	bool magn; /**< Magnetometer present. */
+	imuConfig_t config; /**< Output data rate, bandwidth and full scale ranges. */
+	imuRawCal_t cal; /**< Gyroscope offsets and magnetometer sensitivity adjustment. */
+	uint32_t start; /**< Tick of the first sample, in milliseconds. */
+} imuTraceHeader_t;
+
+/**
+ * @typedef imuTraceSink_t
+ * @brief Destination of the trace.
+ * @param data Bytes to send.
+ * @param length Number of bytes.
+ * @return True if the bytes were taken, False to retry later.
+ */
+typedef bool (*imuTraceSink_t)(const uint8_t *data, uint16_t length);
+
+/**
+ * @brief Encodes a trace header.
+ * @param header Header.
+ * @param buffer Destination, at least IMU_TRACE_HEADER_SIZE bytes.
+ * @return uint16_t Encoded length.
+ */
+uint16_t imuTrace_EncodeHeader(const imuTraceHeader_t *header, uint8_t *buffer);
+
+/**
+ * @brief Decodes a trace header.
+ * @param buffer Trace.
+ * @param length Trace length.
+ * @param header Decoded header.
+ * @return uint16_t Decoded length, 0 if the trace is too short or not a supported trace.
+ */
+uint16_t imuTrace_DecodeHeader(const uint8_t *buffer, uint32_t length,
+		imuTraceHeader_t *header);
+
+/**
+ * @brief Encodes a sample record.
+ * @param raw Raw sample.
+ * @param previous Timestamp of the previous sample, or the start of the trace.
+ * @param previousUs Data-ready time of the previous sample, in microseconds.
+ * @param buffer Destination, at least IMU_TRACE_MAX_RECORD bytes.
+ * @return uint16_t Encoded length.
+ */
+uint16_t imuTrace_EncodeSample(const imuRaw_t *raw, uint32_t previous,
+		uint32_t previousUs, uint8_t *buffer);
+
+/**
+ * @brief Decodes a sample record.
+ * @param buffer Record.
+ * @param length Bytes left in the trace.
+ * @param previous Timestamp of the previous sample, or the start of the trace.
+ * @param previousUs Data-ready time of the previous sample, in microseconds, or
+ * the start of the trace times 1000.
+ * @param raw Decoded sample.
+ * @return uint16_t Decoded length, 0 if the record is truncated.
+ */
+uint16_t imuTrace_DecodeSample(const uint8_t *buffer, uint32_t length,
+		uint32_t previous, uint32_t previousUs, imuRaw_t *raw);
+
+/**
+ * @brief Starts a recording.
+ * @param header Header of the trace, its start is the tick of the first sample to be recorded.
+ * @param sink Destination of the trace.
+ * @param chunk Largest number of bytes passed to the sink at once.
+ * @return bool Returns true if the recording started, false if a parameter is invalid.
+ */
+bool imuTrace_Start(const imuTraceHeader_t *header, imuTraceSink_t sink,
+		uint16_t chunk);
+
+/**
+ * @brief Stops the recording. The bytes not sent yet are discarded.
+ */
+void imuTrace_Stop();
+
+/**
+ * @brief Checks if a recording is running.
+ * @return bool Returns true while recording, false otherwise.
+ */
+bool imuTrace_Recording();
+
+/**
+ * @brief Adds a sample to the recording.
+ * @param raw Raw sample.
+ * @return bool Returns true if the sample was buffered, false if it was dropped.
+ */
+bool imuTrace_Record(const imuRaw_t *raw);
+
+/**
+ * @brief Passes the buffered bytes to the sink, until it is empty or the sink is busy.
+ */
+void imuTrace_Flush();
+
+/**
+ * @brief Gets the number of samples dropped because the buffer was full.
+ * @return uint32_t Dropped samples since the recording started.
+ */
+uint32_t imuTrace_Dropped();
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ ******************************************************************************
+ * @file    imu_vib.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU vibration analysis
+ *
+ * Spectrum of a single channel, for condition monitoring. Samples are collected
+ * in windows of a power of two length. A full window is analysed while the next
+ * one is collected: the mean is removed, a Hann window is applied and a real FFT
+ * gives the power spectrum, from which the RMS, the RMS of each frequency band
+ * and the strongest component are extracted.
+ *
+ * The analysis runs incrementally, one bounded step per imuVib_Step() call: the
+ * windowing, each radix-2 stage of the FFT, then the spectrum. A window that
+ * fills up while the previous one is still being analysed is dropped.
+ *
+ * When IMU_VIB_CMSIS_DSP is defined to 1 (with CMSIS-DSP added to the build),
+ * the FFT runs on arm_rfft_fast_f32() in a single step. Otherwise a portable
+ * implementation with the same output layout is used, which also builds on the host.
+ ******************************************************************************
+ */
+
+#ifndef IMU_VIB_H
+#define IMU_VIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef IMU_VIB_CMSIS_DSP
+#define IMU_VIB_CMSIS_DSP		0
+#endif
+
+#if IMU_VIB_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+/**
+ * @def IMU_VIB_MIN_SIZE
+ * @brief Shortest window, in samples.
+ */
+#define IMU_VIB_MIN_SIZE		32
+
+/**
+ * @def IMU_VIB_MAX_SIZE
+ * @brief Longest window, in samples. Sizes the buffers of each analyser.
+ */
+#ifndef IMU_VIB_MAX_SIZE
+#define IMU_VIB_MAX_SIZE		512
+#endif
+
+/**
+ * @def IMU_VIB_MAX_BANDS
+ * @brief Maximum number of frequency bands.
+ */
+#define IMU_VIB_MAX_BANDS		8
+
+/**
+ * @enum imuVibStage_t
+ * @brief Next step of the analysis.
+ */
+typedef enum
+{
+	IMU_VIB_IDLE, /**< Waiting for a full window. */
+	IMU_VIB_WINDOW, /**< Removing the mean and applying the Hann window. */
+	IMU_VIB_FFT, /**< Running an FFT stage. */
+	IMU_VIB_SPECTRUM /**< Extracting the results from the spectrum. */
+} imuVibStage_t;
+
+/**
+ * @struct imuVibResult_t
+ * @brief Results of the last analysed window, in the units of the input.
+ */
+typedef struct
+{
+	float rms; /**< RMS of the window, mean removed. */
+	float peakHz; /**< Frequency of the strongest component, interpolated between bins, in Hz. */
+	float peakAmplitude; /**< Amplitude of the strongest component. */
+	float bandRms[IMU_VIB_MAX_BANDS]; /**< RMS of each frequency band. */
+	uint8_t bands; /**< Number of frequency bands. */
+	float resolutionHz; /**< Spacing of the spectrum bins, in Hz. */
+	uint32_t windows; /**< Windows analysed since the start, 0 while no result is available. */
+	uint32_t overruns; /**< Windows dropped because the previous one was still being analysed. */
+} imuVibResult_t;
+
+/**
+ * @struct imuVib_t
+ * @brief Analyser configuration and state.
+ */
+typedef struct
+{
+	uint16_t size; /**< Window length, in samples. */
+	float sampleRateHz; /**< Sample rate, in Hz. */
+	float bandEdgesHz[IMU_VIB_MAX_BANDS + 1]; /**< Band limits, in Hz, in increasing order. */
+	uint8_t bands; /**< Number of frequency bands. */
+	float buffers[2][IMU_VIB_MAX_SIZE]; /**< Window being collected and window being analysed. */
+	float *collect; /**< Window being collected. */
+	float *analyse; /**< Window being analysed, then its spectrum. */
+	uint16_t fill; /**< Samples in the window being collected. */
+	float cosTable[IMU_VIB_MAX_SIZE / 2]; /**< cos(2 pi k / size), for the twiddles and the Hann window. */
+	float sinTable[IMU_VIB_MAX_SIZE / 2]; /**< sin(2 pi k / size), for the twiddles. */
+#if IMU_VIB_CMSIS_DSP
+	arm_rfft_fast_instance_f32 instance; /**< CMSIS-DSP instance. */
+	float spectrum[IMU_VIB_MAX_SIZE]; /**< CMSIS-DSP output. */
+#endif
+	imuVibStage_t stage; /**< Next step of the analysis. */
+	uint16_t span; /**< Butterfly span of the next FFT stage. */
+	float rms; /**< RMS of the window being analysed. */
+	imuVibResult_t result; /**< Results of the last analysed window. */
+} imuVib_t;
+
+/**
+ * @brief Initializes an analyser without frequency bands.
+ * @param vib Analyser.
+ * @param size Window length, a power of two from IMU_VIB_MIN_SIZE to IMU_VIB_MAX_SIZE.
+ * @param sampleRateHz Sample rate, in Hz.
+ * @return bool Returns true if the analyser was initialized, false if a parameter is out of range.
+ */
+bool imuVib_Init(imuVib_t *vib, uint16_t size, float sampleRateHz);
+
+/**
+ * @brief Sets the frequency bands.
+ * @param vib Analyser.
+ * @param edgesHz Band limits, bands + 1 values in increasing order, in Hz. Band i spans [edgesHz[i], edgesHz[i + 1]).
+ * @param bands Number of bands, up to IMU_VIB_MAX_BANDS.
+ * @return bool Returns true if the bands were set, false if a parameter is out of range.
+ */
+bool imuVib_SetBands(imuVib_t *vib, const float *edgesHz, uint8_t bands);
+
+/**
+ * @brief Drops the windows being collected and analysed, keeping the last results.
+ * @param vib Analyser.
+ */
+void imuVib_Reset(imuVib_t *vib);
+
+/**
+ * @brief Adds a sample to the window being collected.
+ * @param vib Analyser.
+ * @param x Sample.
+ */
+void imuVib_Add(imuVib_t *vib, float x);
+
+/**
+ * @brief Runs the next step of the analysis.
+ * @param vib Analyser.
+ * @return bool Returns true if the step completed a window, whose results are then available.
+ */
+bool imuVib_Step(imuVib_t *vib);
+
+/**
+ * @brief Checks if a window is being analysed.
+ * @param vib Analyser.
+ * @return bool Returns true while steps are pending, false otherwise.
+ */
+bool imuVib_Busy(const imuVib_t *vib);
+
+/**
+ * @brief Gets the results of the last analysed window.
+ * @param vib Analyser.
+ * @param result Pointer to imuVibResult_t where the results will be stored.
+ */
+void imuVib_GetResult(const imuVib_t *vib, imuVibResult_t *result);
+
+#endif
@@ -0,0 +1,294 @@
+/**
+ ******************************************************************************
+ * @file    imu_ahrs.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU orientation filter (AHRS)
+ ******************************************************************************
+ */
+
+#include "imu_ahrs.h"
+#include <math.h>
+
+/**
+ * @def IMU_AHRS_RAD_TO_DEG
+ * @brief Radians to degrees.
+ */
+#define IMU_AHRS_RAD_TO_DEG		57.29577951f
+
+/**
+ * @brief Inverse square root.
+ * @param x Value, greater than zero.
+ * @return 1 / sqrt(x).
+ *
+ * sqrtf() compiles to a single VSQRT.F32 on the M4 with the hard float ABI.
+ */
+static inline float imuAhrs_invSqrt(float x);
+
+void imuAhrs_Init(imuAhrs_t *ahrs, float beta)
+{
+	ahrs->q0 = 1.0f;
+	ahrs->q1 = 0.0f;
+	ahrs->q2 = 0.0f;
+	ahrs->q3 = 0.0f;
+	ahrs->beta = beta;
+}
+
+void imuAhrs_UpdateImu(imuAhrs_t *ahrs, float gx, float gy, float gz, float ax,
+		float ay, float az, float dt)
+{
+	float q0 = ahrs->q0;
+	float q1 = ahrs->q1;
+	float q2 = ahrs->q2;
+	float q3 = ahrs->q3;
+	float recipNorm;
+	float s0, s1, s2, s3;
+	float qDot1, qDot2, qDot3, qDot4;
+
+	// Rate of change of quaternion from gyroscope
+	qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+	qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+	qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+	qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+	// Feedback from the accelerometer, unless it is invalid
+	if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+	{
+		recipNorm = imuAhrs_invSqrt(ax * ax + ay * ay + az * az);
+		ax *= recipNorm;
+		ay *= recipNorm;
+		az *= recipNorm;
+
+		// Gradient descent corrective step
+		float _2q0 = 2.0f * q0;
+		float _2q1 = 2.0f * q1;
+		float _2q2 = 2.0f * q2;
+		float _2q3 = 2.0f * q3;
+		float _4q0 = 4.0f * q0;
+		float _4q1 = 4.0f * q1;
+		float _4q2 = 4.0f * q2;
+		float _8q1 = 8.0f * q1;
+		float _8q2 = 8.0f * q2;
+		float q0q0 = q0 * q0;
+		float q1q1 = q1 * q1;
+		float q2q2 = q2 * q2;
+		float q3q3 = q3 * q3;
+
+		s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+		s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1
+				+ _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+		s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2
+				+ _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+		s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+		recipNorm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+		if (recipNorm > 0.0f)
+		{
+			recipNorm = imuAhrs_invSqrt(recipNorm);
+			qDot1 -= ahrs->beta * s0 * recipNorm;
+			qDot2 -= ahrs->beta * s1 * recipNorm;
+			qDot3 -= ahrs->beta * s2 * recipNorm;
+			qDot4 -= ahrs->beta * s3 * recipNorm;
+		}
+	}
+
+	// Integrate and normalise
+	q0 += qDot1 * dt;
+	q1 += qDot2 * dt;
+	q2 += qDot3 * dt;
+	q3 += qDot4 * dt;
+
+	recipNorm = imuAhrs_invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	ahrs->q0 = q0 * recipNorm;
+	ahrs->q1 = q1 * recipNorm;
+	ahrs->q2 = q2 * recipNorm;
+	ahrs->q3 = q3 * recipNorm;
+}
+
+void imuAhrs_Update(imuAhrs_t *ahrs, float gx, float gy, float gz, float ax,
+		float ay, float az, float mx, float my, float mz, float dt)
+{
+	float q0 = ahrs->q0;
+	float q1 = ahrs->q1;
+	float q2 = ahrs->q2;
+	float q3 = ahrs->q3;
+	float recipNorm;
+	float s0, s1, s2, s3;
+	float qDot1, qDot2, qDot3, qDot4;
+
+	if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f))
+	{
+		imuAhrs_UpdateImu(ahrs, gx, gy, gz, ax, ay, az, dt);
+		return;
+	}
+
+	// Rate of change of quaternion from gyroscope
+	qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+	qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+	qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+	qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+	// Feedback from the accelerometer and magnetometer, unless invalid
+	if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+	{
+		recipNorm = imuAhrs_invSqrt(ax * ax + ay * ay + az * az);
+		ax *= recipNorm;
+		ay *= recipNorm;
+		az *= recipNorm;
+
+		recipNorm = imuAhrs_invSqrt(mx * mx + my * my + mz * mz);
+		mx *= recipNorm;
+		my *= recipNorm;
+		mz *= recipNorm;
+
+		float _2q0mx = 2.0f * q0 * mx;
+		float _2q0my = 2.0f * q0 * my;
+		float _2q0mz = 2.0f * q0 * mz;
+		float _2q1mx = 2.0f * q1 * mx;
+		float _2q0 = 2.0f * q0;
+		float _2q1 = 2.0f * q1;
+		float _2q2 = 2.0f * q2;
+		float _2q3 = 2.0f * q3;
+		float _2q0q2 = 2.0f * q0 * q2;
+		float _2q2q3 = 2.0f * q2 * q3;
+		float q0q0 = q0 * q0;
+		float q0q1 = q0 * q1;
+		float q0q2 = q0 * q2;
+		float q0q3 = q0 * q3;
+		float q1q1 = q1 * q1;
+		float q1q2 = q1 * q2;
+		float q1q3 = q1 * q3;
+		float q2q2 = q2 * q2;
+		float q2q3 = q2 * q3;
+		float q3q3 = q3 * q3;
+
+		// Reference direction of the earth magnetic field
+		float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1
+				+ _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+		float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2
+				- my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+		float _2bx = sqrtf(hx * hx + hy * hy);
+		float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3
+				- mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+		float _4bx = 2.0f * _2bx;
+		float _4bz = 2.0f * _2bz;
+
+		// Gradient descent corrective step
+		s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax)
+				+ _2q1 * (2.0f * q0q1 + _2q2q3 - ay)
+				- _2bz * q2
+						* (_2bx * (0.5f - q2q2 - q3q3)
+								+ _2bz * (q1q3 - q0q2) - mx)
+				+ (-_2bx * q3 + _2bz * q1)
+						* (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+				+ _2bx * q2
+						* (_2bx * (q0q2 + q1q3)
+								+ _2bz * (0.5f - q1q1 - q2q2) - mz);
+		s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax)
+				+ _2q0 * (2.0f * q0q1 + _2q2q3 - ay)
+				- 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az)
+				+ _2bz * q3
+						* (_2bx * (0.5f - q2q2 - q3q3)
+								+ _2bz * (q1q3 - q0q2) - mx)
+				+ (_2bx * q2 + _2bz * q0)
+						* (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+				+ (_2bx * q3 - _4bz * q1)
+						* (_2bx * (q0q2 + q1q3)
+								+ _2bz * (0.5f - q1q1 - q2q2) - mz);
+		s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax)
+				+ _2q3 * (2.0f * q0q1 + _2q2q3 - ay)
+				- 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az)
+				+ (-_4bx * q2 - _2bz * q0)
+						* (_2bx * (0.5f - q2q2 - q3q3)
+								+ _2bz * (q1q3 - q0q2) - mx)
+				+ (_2bx * q1 + _2bz * q3)
+						* (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+				+ (_2bx * q0 - _4bz * q2)
+						* (_2bx * (q0q2 + q1q3)
+								+ _2bz * (0.5f - q1q1 - q2q2) - mz);
+		s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax)
+				+ _2q2 * (2.0f * q0q1 + _2q2q3 - ay)
+				+ (-_4bx * q3 + _2bz * q1)
+						* (_2bx * (0.5f - q2q2 - q3q3)
+								+ _2bz * (q1q3 - q0q2) - mx)
+				+ (-_2bx * q0 + _2bz * q2)
+						* (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my)
+				+ _2bx * q1
+						* (_2bx * (q0q2 + q1q3)
+								+ _2bz * (0.5f - q1q1 - q2q2) - mz);
+
+		recipNorm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+		if (recipNorm > 0.0f)
+		{
+			recipNorm = imuAhrs_invSqrt(recipNorm);
+			qDot1 -= ahrs->beta * s0 * recipNorm;
+			qDot2 -= ahrs->beta * s1 * recipNorm;
+			qDot3 -= ahrs->beta * s2 * recipNorm;
+			qDot4 -= ahrs->beta * s3 * recipNorm;
+		}
+	}
+
+	// Integrate and normalise
+	q0 += qDot1 * dt;
+	q1 += qDot2 * dt;
+	q2 += qDot3 * dt;
+	q3 += qDot4 * dt;
+
+	recipNorm = imuAhrs_invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	ahrs->q0 = q0 * recipNorm;
+	ahrs->q1 = q1 * recipNorm;
+	ahrs->q2 = q2 * recipNorm;
+	ahrs->q3 = q3 * recipNorm;
+}
+
+void imuAhrs_GetEuler(const imuAhrs_t *ahrs, imuEuler_t *euler)
+{
+	float q0 = ahrs->q0;
+	float q1 = ahrs->q1;
+	float q2 = ahrs->q2;
+	float q3 = ahrs->q3;
+	float sinp = 2.0f * (q0 * q2 - q3 * q1);
+
+	// clamp to avoid NaN close to +-90 degrees of pitch
+	if (sinp > 1.0f)
+	{
+		sinp = 1.0f;
+	}
+	else if (sinp < -1.0f)
+	{
+		sinp = -1.0f;
+	}
+
+	euler->roll = atan2f(2.0f * (q0 * q1 + q2 * q3),
+			1.0f - 2.0f * (q1 * q1 + q2 * q2)) * IMU_AHRS_RAD_TO_DEG;
+	euler->pitch = asinf(sinp) * IMU_AHRS_RAD_TO_DEG;
+	euler->yaw = atan2f(2.0f * (q0 * q3 + q1 * q2),
+			1.0f - 2.0f * (q2 * q2 + q3 * q3)) * IMU_AHRS_RAD_TO_DEG;
+}
+
+float imuAhrs_AxisRate(const imuAhrs_t *ahrs, float gx, float gy, float gz,
+		float ex, float ey, float ez)
+{
+	float q0 = ahrs->q0;
+	float q1 = ahrs->q1;
+	float q2 = ahrs->q2;
+	float q3 = ahrs->q3;
+
+	// The angular velocity is rotated into the earth frame (v' = q v q*),
+	// then projected on the axis
+	float wx = (1.0f - 2.0f * (q2 * q2 + q3 * q3)) * gx
+			+ 2.0f * (q1 * q2 - q0 * q3) * gy + 2.0f * (q1 * q3 + q0 * q2) * gz;
+	float wy = 2.0f * (q1 * q2 + q0 * q3) * gx
+			+ (1.0f - 2.0f * (q1 * q1 + q3 * q3)) * gy
+			+ 2.0f * (q2 * q3 - q0 * q1) * gz;
+	float wz = 2.0f * (q1 * q3 - q0 * q2) * gx + 2.0f * (q2 * q3 + q0 * q1) * gy
+			+ (1.0f - 2.0f * (q1 * q1 + q2 * q2)) * gz;
+
+	return wx * ex + wy * ey + wz * ez;
+}
+
+static inline float imuAhrs_invSqrt(float x)
+{
+	return 1.0f / sqrtf(x);
+}
@@ -11,6 +11,37 @@
 #include "imu_api.h"
 #include "imu_port.h"
 #include <stdlib.h>
+#include <math.h>
+
+/**
+ * @def IMU_SPIN_THRESHOLD_CDPS
+ * @brief Spin threshold in the gyroscope resolution, centi-degrees per second.
+ */
+#define IMU_SPIN_THRESHOLD_CDPS		((int32_t) IMU_SPIN_THRESHOLD * 100)
+
+/**
+ * @def IMU_SPIN_EXIT_THRESHOLD_CDPS
+ * @brief Spin exit threshold in the gyroscope resolution, centi-degrees per second.
+ */
+#define IMU_SPIN_EXIT_THRESHOLD_CDPS	((int32_t) IMU_SPIN_EXIT_THRESHOLD * 100)
+
+/**
+ * @def IMU_SPIN_DWELL_SAMPLES
+ * @brief Number of consecutive samples a new state must hold before it is reported.
+ */
+#define IMU_SPIN_DWELL_SAMPLES		((IMU_SPIN_DWELL_MS * sampleRate + 999) / 1000)
+
+/**
+ * @def IMU_CDPS_TO_RADS
+ * @brief Centi-degrees per second to radians per second.
+ */
+#define IMU_CDPS_TO_RADS			(3.14159265f / 18000.0f)
+
+/**
+ * @def IMU_AHRS_DT
+ * @brief Time between samples, in seconds. Samples come from the sensor FIFO at a fixed rate.
+ */
+#define IMU_AHRS_DT					(1.0f / (float) sampleRate)
 
 /**
  * @struct imu_t
@@ -20,23 +51,155 @@
  */
 typedef struct
 {
-	int16_t ax; /**< Accelerometer X-axis reading */
-	int16_t ay; /**< Accelerometer Y-axis reading */
-	int16_t az; /**< Accelerometer Z-axis reading */
+	int16_t ax; /**< Accelerometer X-axis reading, in milli-g */
+	int16_t ay; /**< Accelerometer Y-axis reading, in milli-g */
+	int16_t az; /**< Accelerometer Z-axis reading, in milli-g */
+
+	int32_t gx; /**< Gyroscope X-axis reading, in centi-degrees/s */
+	int32_t gy; /**< Gyroscope Y-axis reading, in centi-degrees/s */
+	int32_t gz; /**< Gyroscope Z-axis reading, in centi-degrees/s */
 
-	int16_t gx; /**< Gyroscope X-axis reading */
-	int16_t gy; /**< Gyroscope Y-axis reading */
-	int16_t gz; /**< Gyroscope Z-axis reading */
+	int16_t mx; /**< Magnetometer X-axis reading, in milli-gauss */
+	int16_t my; /**< Magnetometer Y-axis reading, in milli-gauss */
+	int16_t mz; /**< Magnetometer Z-axis reading, in milli-gauss */
 
-	int16_t mx; /**< Magnetometer X-axis reading */
-	int16_t my; /**< Magnetometer Y-axis reading */
-	int16_t mz; /**< Magnetometer Z-axis reading */
+	int16_t temp; /**< Temperature reading, in centi-degrees Celsius */
 
-	int16_t temp; /**< Temperature reading */
+	uint32_t timestamp; /**< Acquisition time of the readings, in milliseconds */
+	uint32_t timestampUs; /**< Data-ready time of the readings, in microseconds */
+
+	int32_t spin; /**< Angular velocity about the spin axis, in centi-degrees/s */
 } imu_t;
 
 static imu_t imu;
 
+/**
+ * @struct imuDebounce_t
+ * @brief Reported state of a classifier, changed only after a new state holds for the dwell time.
+ */
+typedef struct
+{
+	uint8_t state; /**< Reported state */
+	uint8_t candidate; /**< State waiting for the dwell time */
+	uint16_t count; /**< Consecutive samples of the candidate */
+	uint32_t start; /**< Acquisition time of the first sample of the candidate, in milliseconds */
+	uint32_t latency; /**< Latency of the last state change, in milliseconds */
+} imuDebounce_t;
+
+/**
+ * @var spinState
+ * @brief Spin direction classifier (imuSpin_t states).
+ */
+static imuDebounce_t spinState;
+
+/**
+ * @var motionState
+ * @brief Motion classifier (imuState_t states).
+ */
+static imuDebounce_t motionState;
+
+/**
+ * @var ahrs
+ * @brief Orientation filter state.
+ */
+static imuAhrs_t ahrs;
+
+/**
+ * @var gyroFilter
+ * @brief Filters of the gyroscope X, Y and Z axes.
+ */
+static imuFilter_t gyroFilter[3];
+
+/**
+ * @var sampleRate
+ * @brief Sensor output data rate, in Hz.
+ */
+static uint16_t sampleRate = DEVICE_IMU_SAMPLE_RATE_HZ;
+
+/**
+ * @var lowPassHz
+ * @brief Cutoff frequency of the gyroscope low-pass filter, in Hz, 0 when it is not in use.
+ *
+ * Kept to design the filter again when the sample rate changes.
+ */
+static float lowPassHz;
+
+/**
+ * @var lowPassStages
+ * @brief Number of biquad stages of the gyroscope low-pass filter.
+ */
+static uint8_t lowPassStages;
+
+/**
+ * @var spinAxis
+ * @brief Spin axis in the earth frame, unit vector.
+ */
+static float spinAxis[3] =
+{ 0.0f, 0.0f, 1.0f };
+
+/**
+ * @var rotation
+ * @brief Rotation estimator about the spin axis.
+ */
+static imuRotation_t rotation;
+
+/**
+ * @var vib
+ * @brief Vibration analyser of the acceleration magnitude.
+ */
+static imuVib_t vib;
+
+/**
+ * @var vibEnabled
+ * @brief True when the vibration analyser is initialized.
+ */
+static bool vibEnabled;
+
+/**
+ * @var vibEdges
+ * @brief Limits of the vibration frequency bands, in Hz.
+ *
+ * Kept to set the bands again when the sample rate changes.
+ */
+static float vibEdges[IMU_VIB_MAX_BANDS + 1] =
+{ 2.0f, 10.0f, 50.0f, 100.0f, 200.0f, 500.0f };
+
+/**
+ * @var vibBands
+ * @brief Number of vibration frequency bands.
+ */
+static uint8_t vibBands = 5;
+
+/**
+ * @var vibCycles
+ * @brief CPU cycles spent on the window being analysed.
+ */
+static uint32_t vibCycles;
+
+/**
+ * @var vibWindowCycles
+ * @brief CPU cycles spent on the last analysed window.
+ */
+static uint32_t vibWindowCycles;
+
+/**
+ * @var vibStepCycles
+ * @brief CPU cycles of the longest analysis step.
+ */
+static uint32_t vibStepCycles;
+
+/**
+ * @var gesture
+ * @brief Gesture engine.
+ */
+static imuGesture_t gesture;
+
+/**
+ * @var gestureEnabled
+ * @brief True when the gesture engine is initialized.
+ */
+static bool gestureEnabled;
+
 /**
  * @brief Clears the stored data from the IMU sensor.
  *
@@ -48,11 +211,10 @@ static void imu_ClearData();
 /**
  * @brief Reads data from the IMU sensor.
  *
- * Retrieves the latest data from the IMU sensor and stores it in a globally accessible
- * structure or buffer. This function is called periodically to update the sensor readings.
+ * Takes the oldest sample acquired by the port, with all its channels read in the
+ * same bus transaction, and stores it in a globally accessible structure.
  *
- * @return bool Returns true if the data was successfully read, false if there was an error
- * in reading the data.
+ * @return bool Returns true if a new sample was read, false if there was none.
  */
 static bool imu_ReadData();
 
@@ -68,6 +230,39 @@ static bool imu_ReadData();
  */
 static bool imu_ProcessData();
 
+/**
+ * @brief Sets the default gyroscope filter.
+ */
+static void imu_InitFilter();
+
+/**
+ * @brief Initializes the vibration analyser for the sample rate in use.
+ */
+static void imu_InitVibration();
+
+/**
+ * @brief Initializes the gesture engine for the sample rate in use.
+ */
+static void imu_InitGesture();
+
+/**
+ * @brief Reads the CPU cycle counter.
+ * @return uint32_t Cycle count, 0 on the host.
+ */
+static inline uint32_t imu_Cycles();
+
+/**
+ * @brief Classifies the current sample into a spin direction and a motion state.
+ */
+static void imu_ClassifyData();
+
+/**
+ * @brief Feeds the state of a sample to a classifier.
+ * @param debounce Classifier.
+ * @param target State of the current sample.
+ */
+static void imu_Debounce(imuDebounce_t *debounce, uint8_t target);
+
 /**
  * @brief Checks if the IMU detected motion.
  *
@@ -82,7 +277,14 @@ bool imu_Init()
 
 	if (imuPort_Init())
 	{
+		sampleRate = imuPort_SampleRate();
 		imu_ClearData();
+		imuAhrs_Init(&ahrs, IMU_AHRS_BETA);
+		imuRotation_Init(&rotation, (float) IMU_RPM_TAU_MS / 1000.0f,
+				(float) IMU_RPM_DEADBAND_DPS);
+		imu_InitFilter();
+		imu_InitVibration();
+		imu_InitGesture();
 		return true;
 	}
 	else
@@ -96,12 +298,98 @@ bool imu_Check()
 	return imuPort_Check();
 }
 
+bool imu_Sleep()
+{
+	return imuPort_EnterWakeOnMotion(DEVICE_IMU_WOM_THRESHOLD_MG);
+}
+
+bool imu_MotionWake()
+{
+	return imuPort_MotionWake();
+}
+
+bool imu_Wake()
+{
+	bool retVal = imuPort_ExitWakeOnMotion();
+
+	// the readings before the sleep are stale
+	imu_ClearData();
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		imuFilter_Reset(&gyroFilter[i]);
+	}
+	imuVib_Reset(&vib);
+	imuGesture_Reset(&gesture);
+
+	return retVal;
+}
+
+bool imu_SetConfig(const imuConfig_t *config)
+{
+	bool retVal;
+
+	// the low-pass filter must stay below half the new rate
+	if ((lowPassHz > 0.0f) && (2.0f * lowPassHz >= (float) config->rateHz))
+		return false;
+
+	retVal = imuPort_SetConfig(config);
+	sampleRate = imuPort_SampleRate();
+
+	// the pending samples were dropped, the filters start again at the new rate
+	imu_ClearData();
+	if (lowPassHz > 0.0f)
+	{
+		imu_SetLowPassFilter(lowPassHz, lowPassStages);
+	}
+	else
+	{
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			imuFilter_Reset(&gyroFilter[i]);
+		}
+	}
+	imu_InitVibration();
+	imu_InitGesture();
+
+	return retVal;
+}
+
+void imu_GetConfig(imuConfig_t *config)
+{
+	imuPort_GetConfig(config);
+}
+
 bool imu_GetData()
 {
-	bool retVal = true;
+	bool retVal = false;
+	acc_t acc;
+	gyro_t gyro;
+
+	// consume every sample acquired since the previous call
+	while (imu_ReadData())
+	{
+		// the gesture templates are trained on unfiltered samples
+		if (gestureEnabled)
+		{
+			acc.ax = imu.ax;
+			acc.ay = imu.ay;
+			acc.az = imu.az;
+			gyro.gx = imu.gx;
+			gyro.gy = imu.gy;
+			gyro.gz = imu.gz;
+			imuGesture_Add(&gesture, &acc, &gyro, imu.timestamp);
+		}
 
-	retVal &= imu_ReadData();
-	retVal &= imu_ProcessData();
+		imu_ProcessData();
+		imu_ClassifyData();
+		if (vibEnabled)
+		{
+			imuVib_Add(&vib,
+					sqrtf((float) imu.ax * imu.ax + (float) imu.ay * imu.ay
+							+ (float) imu.az * imu.az));
+		}
+		retVal = true;
+	}
 
 	return retVal;
 }
@@ -120,21 +408,251 @@ imuState_t imu_State()
 
 imuSpin_t imu_SpinDirection()
 {
-	if ((abs(imu.gz) < IMU_SPIN_THRESHOLD))
+	return (imuSpin_t) spinState.state;
+}
+
+float imu_Rpm()
+{
+	return imuRotation_Rpm(&rotation);
+}
+
+int32_t imu_Revolutions()
+{
+	int32_t revolutions;
+
+	imuRotation_Angle(&rotation, &revolutions);
+
+	return revolutions;
+}
+
+float imu_RotationAngle()
+{
+	return imuRotation_Angle(&rotation, NULL);
+}
+
+void imu_ResetRotation()
+{
+	imuRotation_Reset(&rotation);
+}
+
+uint32_t imu_SampleTime()
+{
+	return imu.timestampUs;
+}
+
+void imu_GetTiming(imuTiming_t *timing)
+{
+	imuPort_GetTiming(timing);
+}
+
+void imu_ResetTiming()
+{
+	imuPort_ResetTiming();
+}
+
+uint32_t imu_SpinLatency()
+{
+	return spinState.latency;
+}
+
+uint32_t imu_BusErrors()
+{
+	return imuPort_BusErrors();
+}
+
+uint32_t imu_BusRecoveries()
+{
+	return imuPort_BusRecoveries();
+}
+
+int16_t imu_SpinRate()
+{
+	return (int16_t) (imu.spin / 100);
+}
+
+bool imu_SetSpinAxis(float x, float y, float z)
+{
+	float norm = sqrtf(x * x + y * y + z * z);
+
+	if (norm == 0.0f)
 	{
-		return IMU_NO_SPIN;
+		return false;
 	}
-	else
+
+	spinAxis[0] = x / norm;
+	spinAxis[1] = y / norm;
+	spinAxis[2] = z / norm;
+
+	return true;
+}
+
+bool imu_SetLowPassFilter(float cutoffHz, uint8_t stages)
+{
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		// each filter is set in place, CMSIS-DSP keeps pointers to its buffers
+		if (cutoffHz == 0.0f)
+		{
+			imuFilter_Init(&gyroFilter[i]);
+		}
+		else if (!imuFilter_SetLowPass(&gyroFilter[i], cutoffHz,
+				(float) sampleRate, stages))
+		{
+			return false;
+		}
+	}
+
+	lowPassHz = cutoffHz;
+	lowPassStages = stages;
+
+	return true;
+}
+
+bool imu_SetAverageFilter(uint8_t taps)
+{
+	for (uint8_t i = 0; i < 3; i++)
 	{
-		if (imu.gz > 0)
+		if (taps == 0)
 		{
-			return IMU_POS_SPIN;
+			imuFilter_Init(&gyroFilter[i]);
 		}
-		else
+		else if (!imuFilter_SetAverage(&gyroFilter[i], taps))
 		{
-			return IMU_NEG_SPIN;
+			return false;
 		}
 	}
+
+	lowPassHz = 0.0f;
+
+	return true;
+}
+
+bool imu_Present(imuId_t id)
+{
+	return imuPort_Present(id);
+}
+
+bool imu_ReadDevice(imuId_t id, imuSnapshot_t *snapshot)
+{
+	// the primary sensor samples are consumed by imu_GetData()
+	if (id == IMU_PRIMARY)
+		return false;
+
+	return imuPort_ReadSnapshot(id, snapshot);
+}
+
+bool imu_SetVibrationBands(const float *edgesHz, uint8_t bands)
+{
+	if (!imuVib_SetBands(&vib, edgesHz, bands))
+		return false;
+
+	for (uint8_t i = 0; (i <= bands) && (bands > 0); i++)
+	{
+		vibEdges[i] = edgesHz[i];
+	}
+	vibBands = bands;
+
+	return true;
+}
+
+bool imu_GetVibration(imuVibResult_t *result)
+{
+	if (!vibEnabled)
+		return false;
+
+	imuVib_GetResult(&vib, result);
+
+	return (result->windows > 0);
+}
+
+void imu_VibrationTasks()
+{
+	uint32_t start;
+	uint32_t cycles;
+	bool done;
+
+	if (!vibEnabled || !imuVib_Busy(&vib))
+		return;
+
+	start = imu_Cycles();
+	done = imuVib_Step(&vib);
+	cycles = imu_Cycles() - start;
+
+	vibCycles += cycles;
+	if (cycles > vibStepCycles)
+	{
+		vibStepCycles = cycles;
+	}
+	if (done)
+	{
+		vibWindowCycles = vibCycles;
+		vibCycles = 0;
+	}
+}
+
+uint32_t imu_VibrationCycles(uint32_t *step)
+{
+	if (step != NULL)
+	{
+		*step = vibStepCycles;
+	}
+
+	return vibWindowCycles;
+}
+
+bool imu_GetGesture(imuGestureEvent_t *event)
+{
+	if (!gestureEnabled)
+		return false;
+
+	return imuGesture_Get(&gesture, event);
+}
+
+const char* imu_GestureName(uint8_t index)
+{
+	if (index >= imuGestureTemplateCount)
+		return "?";
+
+	return imuGestureTemplates[index].name;
+}
+
+bool imu_TraceStart(imuTraceSink_t sink, uint16_t chunk)
+{
+	imuTraceHeader_t header;
+
+	header.version = IMU_TRACE_VERSION;
+	imuPort_GetConfig(&header.config);
+	imuPort_GetRawCalibration(IMU_PRIMARY, &header.cal);
+	// the sensitivity adjustment is only read from a present magnetometer
+	header.magn = (header.cal.magnAsa[0] != 0);
+	header.start = HAL_GetTick();
+
+	return imuTrace_Start(&header, sink, chunk);
+}
+
+void imu_TraceStop()
+{
+	imuTrace_Stop();
+}
+
+bool imu_TraceRecording()
+{
+	return imuTrace_Recording();
+}
+
+void imu_TraceTasks()
+{
+	imuTrace_Flush();
+}
+
+uint32_t imu_TraceDropped()
+{
+	return imuTrace_Dropped();
+}
+
+void imu_Orientation(imuEuler_t *euler)
+{
+	imuAhrs_GetEuler(&ahrs, euler);
 }
 
 static void imu_ClearData()
@@ -156,17 +674,47 @@ static void imu_ClearData()
 
 	// temperature
 	imu.temp = 0;
+
+	imu.timestamp = 0;
+	imu.timestampUs = 0;
+
+	imu.spin = 0;
+
+	spinState.state = IMU_NO_SPIN;
+	spinState.count = 0;
+	spinState.latency = 0;
+	motionState.state = IMU_IDLE;
+	motionState.count = 0;
+	motionState.latency = 0;
 }
 
 static bool imu_ReadData()
 {
-	gyro_t gyroData;
+	imuSnapshot_t snapshot;
+	imuRaw_t raw;
 
-	if (imuPort_GyroReadData(&gyroData))
+	if (imuPort_ReadSnapshot(IMU_PRIMARY, &snapshot))
 	{
-		imu.gx = gyroData.gx;
-		imu.gy = gyroData.gy;
-		imu.gz = gyroData.gz;
+		if (imuTrace_Recording() && imuPort_RawReadData(IMU_PRIMARY, &raw))
+		{
+			imuTrace_Record(&raw);
+		}
+
+		imu.ax = snapshot.acc.ax;
+		imu.ay = snapshot.acc.ay;
+		imu.az = snapshot.acc.az;
+
+		imu.gx = snapshot.gyro.gx;
+		imu.gy = snapshot.gyro.gy;
+		imu.gz = snapshot.gyro.gz;
+
+		imu.mx = snapshot.magn.mx;
+		imu.my = snapshot.magn.my;
+		imu.mz = snapshot.magn.mz;
+
+		imu.temp = snapshot.temp;
+		imu.timestamp = snapshot.timestamp;
+		imu.timestampUs = snapshot.timestampUs;
 
 		return true;
 	}
@@ -178,12 +726,153 @@ static bool imu_ReadData()
 
 static bool imu_ProcessData()
 {
-	// todo: implement function
+	float gx;
+	float gy;
+	float gz;
+	float spin;
+
+	// remove vibration before the orientation and spin detection
+	imu.gx = (int32_t) imuFilter_Apply(&gyroFilter[0], (float) imu.gx);
+	imu.gy = (int32_t) imuFilter_Apply(&gyroFilter[1], (float) imu.gy);
+	imu.gz = (int32_t) imuFilter_Apply(&gyroFilter[2], (float) imu.gz);
+
+	gx = (float) imu.gx * IMU_CDPS_TO_RADS;
+	gy = (float) imu.gy * IMU_CDPS_TO_RADS;
+	gz = (float) imu.gz * IMU_CDPS_TO_RADS;
+
+	// the accelerometer and magnetometer are normalised by the filter, units do not matter
+	imuAhrs_Update(&ahrs, gx, gy, gz, (float) imu.ax, (float) imu.ay,
+			(float) imu.az, (float) imu.mx, (float) imu.my, (float) imu.mz,
+			IMU_AHRS_DT);
+
+	spin = imuAhrs_AxisRate(&ahrs, (float) imu.gx, (float) imu.gy,
+			(float) imu.gz, spinAxis[0], spinAxis[1], spinAxis[2]);
+	if (!isfinite(spin))
+	{
+		// recover from a corrupt sample
+		imuAhrs_Init(&ahrs, IMU_AHRS_BETA);
+		imu.spin = 0;
+		return false;
+	}
+
+	imu.spin = (int32_t) spin;
+	imuRotation_Update(&rotation, spin / 100.0f, imu.timestampUs);
+
 	return true;
 }
 
+static void imu_InitFilter()
+{
+#if IMU_FILTER_LOWPASS_HZ > 0
+	imu_SetLowPassFilter((float) IMU_FILTER_LOWPASS_HZ, IMU_FILTER_STAGES);
+#else
+	imu_SetAverageFilter(IMU_FILTER_TAPS);
+#endif
+}
+
+static void imu_InitVibration()
+{
+	// the windows and results at the previous rate are dropped
+	vibEnabled = imuVib_Init(&vib, IMU_VIB_SIZE, (float) sampleRate);
+	imuVib_SetBands(&vib, vibEdges, vibBands);
+	vibCycles = 0;
+
+#if !DEVICE_IMU_REPLAY
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+static void imu_InitGesture()
+{
+	// the frames and gestures in progress at the previous rate are dropped
+	gestureEnabled = IMU_GESTURE_ENABLE
+			&& imuGesture_Init(&gesture, sampleRate, imuGestureTemplates,
+					imuGestureTemplateCount);
+}
+
+static inline uint32_t imu_Cycles()
+{
+#if DEVICE_IMU_REPLAY
+	return 0;
+#else
+	return DWT->CYCCNT;
+#endif
+}
+
+static void imu_ClassifyData()
+{
+	int64_t magnitude;
+	imuSpin_t spin;
+	imuState_t motion;
+
+	// Spin: a started spin holds until the rate drops below the exit threshold
+	switch (spinState.state)
+	{
+	case IMU_POS_SPIN:
+		spin = (imu.spin > IMU_SPIN_EXIT_THRESHOLD_CDPS) ? IMU_POS_SPIN :
+				((imu.spin <= -IMU_SPIN_THRESHOLD_CDPS) ?
+						IMU_NEG_SPIN : IMU_NO_SPIN);
+		break;
+
+	case IMU_NEG_SPIN:
+		spin = (imu.spin < -IMU_SPIN_EXIT_THRESHOLD_CDPS) ? IMU_NEG_SPIN :
+				((imu.spin >= IMU_SPIN_THRESHOLD_CDPS) ?
+						IMU_POS_SPIN : IMU_NO_SPIN);
+		break;
+
+	default:
+		spin = (imu.spin >= IMU_SPIN_THRESHOLD_CDPS) ? IMU_POS_SPIN :
+				((imu.spin <= -IMU_SPIN_THRESHOLD_CDPS) ?
+						IMU_NEG_SPIN : IMU_NO_SPIN);
+		break;
+	}
+	imu_Debounce(&spinState, spin);
+
+	// Motion: angular velocity magnitude across all axes, either direction
+	magnitude = (int64_t) imu.gx * imu.gx + (int64_t) imu.gy * imu.gy
+			+ (int64_t) imu.gz * imu.gz;
+	if (motionState.state == IMU_ACTIVE)
+	{
+		motion = (magnitude
+				> (int64_t) IMU_SPIN_EXIT_THRESHOLD_CDPS
+						* IMU_SPIN_EXIT_THRESHOLD_CDPS) ?
+				IMU_ACTIVE : IMU_IDLE;
+	}
+	else
+	{
+		motion = (magnitude
+				>= (int64_t) IMU_SPIN_THRESHOLD_CDPS * IMU_SPIN_THRESHOLD_CDPS) ?
+				IMU_ACTIVE : IMU_IDLE;
+	}
+	imu_Debounce(&motionState, motion);
+}
+
+static void imu_Debounce(imuDebounce_t *debounce, uint8_t target)
+{
+	if (target == debounce->state)
+	{
+		debounce->count = 0;
+		return;
+	}
+
+	// a different candidate restarts the dwell time
+	if ((debounce->count == 0) || (target != debounce->candidate))
+	{
+		debounce->candidate = target;
+		debounce->count = 0;
+		debounce->start = imu.timestamp;
+	}
+
+	if (++debounce->count >= IMU_SPIN_DWELL_SAMPLES)
+	{
+		debounce->state = target;
+		debounce->count = 0;
+		debounce->latency = HAL_GetTick() - debounce->start;
+	}
+}
+
 static bool imu_IsActive()
 {
-	return ((imu.gx > IMU_SPIN_THRESHOLD) || (imu.gy > IMU_SPIN_THRESHOLD)
-			|| (imu.gz > IMU_SPIN_THRESHOLD));
+	return (motionState.state == IMU_ACTIVE);
 }
@@ -0,0 +1,284 @@
+/**
+ ******************************************************************************
+ * @file    imu_bus_i2c.c
+ * @author 	Marco Rolon
+ * @brief   IMU bus on I2C1
+ ******************************************************************************
+ */
+
+#include "imu_bus.h"
+
+#if !DEVICE_IMU_REPLAY && !DEVICE_IMU_SPI
+
+#include "main.h"
+
+/**
+ * I2C defines
+ */
+#define MPU_9250_ADDRESS		0x68
+#define MPU_9250_ADDRESS_AD0	0x69	/*!< Second sensor, AD0 pin high */
+#define IMU_BUS_CLEAR_PULSES	9		/*!< SCL pulses that complete any byte a slave is sending */
+#define IMU_BUS_CLEAR_HALF_US	5		/*!< SCL half period while clearing the bus, 100 kHz */
+
+/**
+ * @var imuAddresses
+ * @brief I2C address of each sensor, selected by its AD0 pin.
+ */
+static const uint8_t imuAddresses[] =
+{ MPU_9250_ADDRESS, MPU_9250_ADDRESS_AD0 };
+
+/**
+ * @var hi2c1
+ * @brief Handle for I2C1 used to communicate with the IMU.
+ */
+I2C_HandleTypeDef hi2c1;
+
+/**
+ * @var hdma_i2c1_rx
+ * @brief DMA handle for the I2C1 reception, used to read the samples without CPU intervention.
+ */
+DMA_HandleTypeDef hdma_i2c1_rx;
+
+/**
+ * @var dmaBuffer
+ * @brief Destination of the DMA transfers.
+ */
+static uint8_t dmaBuffer[IMU_BUS_MAX_READ];
+
+/**
+ * @var ctrlBuffer
+ * @brief Source of the register writes made from interrupt context.
+ */
+static uint8_t ctrlBuffer;
+
+/**
+ * @brief Initializes I2C1 interface for IMU communication.
+ * @note This function configures the I2C1 hardware settings and must be called before any IMU communication.
+ * @param None
+ * @retval None
+ */
+static void I2C1_Init(void);
+
+/**
+ * @brief Initializes the DMA controller used by the I2C1 reception.
+ */
+static void DMA_Init(void);
+
+/**
+ * @brief Releases a slave holding SDA low by clocking SCL, then sends a STOP.
+ * @return True if SDA is released, False otherwise.
+ */
+static bool imuBus_busClear();
+
+/**
+ * @brief Waits half an SCL period while clearing the bus.
+ */
+static void imuBus_busDelay();
+
+/**
+ * @brief  This function is executed in case of error occurrence.
+ * @param  None
+ * @retval None
+ */
+static void Error_Handler(void);
+
+/**
+ * IMU Bus Functions
+ */
+
+void imuBus_Init()
+{
+	DMA_Init();
+	I2C1_Init();
+}
+
+bool imuBus_Read(imuId_t id, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+	return (HAL_I2C_Mem_Read(&hi2c1, imuAddresses[id] << 1, reg, 1, buffer,
+			length, IMU_BUS_TIMEOUT_MS) == HAL_OK);
+}
+
+bool imuBus_Write(imuId_t id, uint8_t reg, uint8_t value)
+{
+	return (HAL_I2C_Mem_Write(&hi2c1, imuAddresses[id] << 1, reg, 1, &value, 1,
+			IMU_BUS_TIMEOUT_MS) == HAL_OK);
+}
+
+bool imuBus_ReadAsync(imuId_t id, uint8_t reg, uint16_t length)
+{
+	return (HAL_I2C_Mem_Read_DMA(&hi2c1, imuAddresses[id] << 1, reg, 1,
+			dmaBuffer, length) == HAL_OK);
+}
+
+bool imuBus_WriteAsync(imuId_t id, uint8_t reg, uint8_t value)
+{
+	ctrlBuffer = value;
+
+	return (HAL_I2C_Mem_Write_IT(&hi2c1, imuAddresses[id] << 1, reg, 1,
+			&ctrlBuffer, 1) == HAL_OK);
+}
+
+bool imuBus_Busy()
+{
+	return (HAL_I2C_GetState(&hi2c1) != HAL_I2C_STATE_READY);
+}
+
+bool imuBus_Recover()
+{
+	bool retVal;
+
+	// Abort the transfer in progress and release the pins
+	HAL_I2C_DeInit(&hi2c1);
+	retVal = imuBus_busClear();
+
+	// Reset the peripheral, its state machine may be stuck as well
+	__HAL_RCC_I2C1_FORCE_RESET();
+	__HAL_RCC_I2C1_RELEASE_RESET();
+	if ((HAL_I2C_Init(&hi2c1) != HAL_OK)
+			|| (HAL_I2CEx_ConfigAnalogFilter(&hi2c1, I2C_ANALOGFILTER_ENABLE)
+					!= HAL_OK)
+			|| (HAL_I2CEx_ConfigDigitalFilter(&hi2c1, 0) != HAL_OK))
+	{
+		retVal = false;
+	}
+
+	return retVal;
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c->Instance == I2C1)
+	{
+		imuBus_ReadCallback(dmaBuffer);
+	}
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c->Instance == I2C1)
+	{
+		imuBus_WriteCallback();
+	}
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	if (hi2c->Instance == I2C1)
+	{
+		imuBus_ErrorCallback();
+	}
+}
+
+/**
+ * Private functions
+ */
+
+static bool imuBus_busClear()
+{
+	GPIO_InitTypeDef GPIO_InitStruct =
+	{ 0 };
+	uint8_t i;
+
+	HAL_GPIO_WritePin(IMU_SCL_GPIO_Port, IMU_SCL_Pin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(IMU_SDA_GPIO_Port, IMU_SDA_Pin, GPIO_PIN_SET);
+
+	GPIO_InitStruct.Pin = IMU_SCL_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(IMU_SCL_GPIO_Port, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = IMU_SDA_Pin;
+	HAL_GPIO_Init(IMU_SDA_GPIO_Port, &GPIO_InitStruct);
+	imuBus_busDelay();
+
+	// A slave in the middle of a read holds SDA low until its byte is clocked out
+	for (i = 0; (i < IMU_BUS_CLEAR_PULSES)
+			&& (HAL_GPIO_ReadPin(IMU_SDA_GPIO_Port, IMU_SDA_Pin) == GPIO_PIN_RESET);
+			i++)
+	{
+		HAL_GPIO_WritePin(IMU_SCL_GPIO_Port, IMU_SCL_Pin, GPIO_PIN_RESET);
+		imuBus_busDelay();
+		HAL_GPIO_WritePin(IMU_SCL_GPIO_Port, IMU_SCL_Pin, GPIO_PIN_SET);
+		imuBus_busDelay();
+	}
+
+	// STOP: SDA rises while SCL is high
+	HAL_GPIO_WritePin(IMU_SCL_GPIO_Port, IMU_SCL_Pin, GPIO_PIN_RESET);
+	imuBus_busDelay();
+	HAL_GPIO_WritePin(IMU_SDA_GPIO_Port, IMU_SDA_Pin, GPIO_PIN_RESET);
+	imuBus_busDelay();
+	HAL_GPIO_WritePin(IMU_SCL_GPIO_Port, IMU_SCL_Pin, GPIO_PIN_SET);
+	imuBus_busDelay();
+	HAL_GPIO_WritePin(IMU_SDA_GPIO_Port, IMU_SDA_Pin, GPIO_PIN_SET);
+	imuBus_busDelay();
+
+	return (HAL_GPIO_ReadPin(IMU_SDA_GPIO_Port, IMU_SDA_Pin) == GPIO_PIN_SET);
+}
+
+static void imuBus_busDelay()
+{
+	// about 4 cycles per iteration
+	volatile uint32_t n = (SystemCoreClock / 1000000U) * IMU_BUS_CLEAR_HALF_US
+			/ 4;
+
+	while (n > 0)
+	{
+		n--;
+	}
+}
+
+static void DMA_Init(void)
+{
+
+	/* DMA controller clock enable */
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	/* DMA interrupt init */
+	/* DMA1_Stream0_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Stream0_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+
+}
+
+static void I2C1_Init(void)
+{
+
+	hi2c1.Instance = I2C1;
+	hi2c1.Init.ClockSpeed = 400000;
+	hi2c1.Init.DutyCycle = I2C_DUTYCYCLE_2;
+	hi2c1.Init.OwnAddress1 = 0;
+	hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+	hi2c1.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+	hi2c1.Init.OwnAddress2 = 0;
+	hi2c1.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+	hi2c1.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
+	if (HAL_I2C_Init(&hi2c1) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	/** Configure Analogue filter
+	 */
+	if (HAL_I2CEx_ConfigAnalogFilter(&hi2c1, I2C_ANALOGFILTER_ENABLE) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	/** Configure Digital filter
+	 */
+	if (HAL_I2CEx_ConfigDigitalFilter(&hi2c1, 0) != HAL_OK)
+	{
+		Error_Handler();
+	}
+}
+
+static void Error_Handler(void)
+{
+	/* Turn LED_IMU on */
+	BSP_LED_On(LED_IMU);
+	while (1)
+	{
+	}
+}
+
+#endif
@@ -0,0 +1,465 @@
+/**
+ ******************************************************************************
+ * @file    imu_bus_spi.c
+ * @author 	Marco Rolon
+ * @brief   IMU bus on SPI3
+ *
+ * The HAL SPI driver is not part of the project, the peripheral is driven through
+ * its registers. The asynchronous reads use the HAL DMA driver: the TX stream
+ * repeats the register address, which the sensor ignores after the first byte,
+ * while the RX stream stores the reply.
+ ******************************************************************************
+ */
+
+#include "imu_bus.h"
+
+#if !DEVICE_IMU_REPLAY && DEVICE_IMU_SPI
+
+#include "main.h"
+
+/**
+ * SPI defines
+ */
+#define IMU_SPI					SPI3
+#define IMU_SPI_READ			0x80		/*!< Register address flag of a read */
+#define IMU_SPI_REG_HZ			1000000UL	/*!< Highest clock for the register accesses */
+#define IMU_SPI_DATA_HZ			20000000UL	/*!< Highest clock for the sensor and interrupt registers */
+#define IMU_SPI_MODE			(SPI_CR1_MSTR | SPI_CR1_CPOL | SPI_CR1_CPHA \
+		| SPI_CR1_SSM | SPI_CR1_SSI)		/*!< Master, mode 3, software chip select */
+
+/**
+ * @enum imuSpiTransfer_t
+ * @brief Asynchronous transfer in progress.
+ */
+typedef enum
+{
+	IMU_SPI_IDLE, /*!< No transfer in progress */
+	IMU_SPI_READING, /*!< Register read */
+	IMU_SPI_WRITING /*!< Register write */
+} imuSpiTransfer_t;
+
+/**
+ * @var imuCsPorts
+ * @brief Chip select port of each sensor.
+ */
+static GPIO_TypeDef *const imuCsPorts[] =
+{ IMU_CS0_GPIO_Port, IMU_CS1_GPIO_Port };
+
+/**
+ * @var imuCsPins
+ * @brief Chip select pin of each sensor.
+ */
+static const uint16_t imuCsPins[] =
+{ IMU_CS0_Pin, IMU_CS1_Pin };
+
+/**
+ * @var hdma_spi3_rx
+ * @brief DMA handle for the SPI3 reception.
+ */
+DMA_HandleTypeDef hdma_spi3_rx;
+
+/**
+ * @var hdma_spi3_tx
+ * @brief DMA handle for the SPI3 transmission, paced by the reception.
+ */
+DMA_HandleTypeDef hdma_spi3_tx;
+
+/**
+ * @var dmaBuffer
+ * @brief Destination of the DMA transfers, the register address byte first.
+ */
+static uint8_t dmaBuffer[IMU_BUS_MAX_READ + 1];
+
+/**
+ * @var txBuffer
+ * @brief Source of the DMA transfers: register address, then the written value.
+ */
+static uint8_t txBuffer[2];
+
+/**
+ * @var spiTransfer
+ * @brief Asynchronous transfer in progress.
+ */
+static volatile imuSpiTransfer_t spiTransfer;
+
+/**
+ * @var spiDevice
+ * @brief Sensor selected by the asynchronous transfer.
+ */
+static imuId_t spiDevice;
+
+/**
+ * @var spiRegDivider
+ * @brief Baud rate bits of the register accesses.
+ */
+static uint32_t spiRegDivider;
+
+/**
+ * @var spiDataDivider
+ * @brief Baud rate bits of the sensor data reads.
+ */
+static uint32_t spiDataDivider;
+
+/**
+ * @brief Initializes SPI3, its pins, the chip selects and the DMA streams.
+ */
+static void SPI3_Init(void);
+
+/**
+ * @brief Gets the baud rate bits of the fastest clock up to a frequency.
+ * @param maxHz Highest clock, in Hz.
+ * @return CR1 BR bits.
+ */
+static uint32_t imuBus_divider(uint32_t maxHz);
+
+/**
+ * @brief Sets the clock of the next transfers. The bus must be idle.
+ * @param divider CR1 BR bits.
+ */
+static void imuBus_setClock(uint32_t divider);
+
+/**
+ * @brief Sends and receives a byte.
+ * @param tx Byte sent.
+ * @param rx Byte received, NULL to discard it.
+ * @param tickstart Tick at the start of the access.
+ * @return True if the byte was exchanged, False on timeout.
+ */
+static bool imuBus_exchange(uint8_t tx, uint8_t *rx, uint32_t tickstart);
+
+/**
+ * @brief Starts a DMA transfer, the sensor is selected until it completes.
+ * @param id Sensor.
+ * @param length Number of bytes, the register address included.
+ * @param increment Set to send txBuffer, clear to repeat its first byte.
+ * @return True if the transfer started, False otherwise.
+ */
+static bool imuBus_startDma(imuId_t id, uint16_t length, bool increment);
+
+/**
+ * @brief Stops the DMA requests and deselects the sensor.
+ */
+static void imuBus_stopDma();
+
+/**
+ * @brief DMA reception complete, the last byte was received.
+ * @param hdma DMA handle.
+ */
+static void imuBus_rxComplete(DMA_HandleTypeDef *hdma);
+
+/**
+ * @brief DMA reception failed.
+ * @param hdma DMA handle.
+ */
+static void imuBus_rxError(DMA_HandleTypeDef *hdma);
+
+/**
+ * @brief  This function is executed in case of error occurrence.
+ * @param  None
+ * @retval None
+ */
+static void Error_Handler(void);
+
+/**
+ * IMU Bus Functions
+ */
+
+void imuBus_Init()
+{
+	SPI3_Init();
+}
+
+bool imuBus_Read(imuId_t id, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+	uint32_t tickstart = HAL_GetTick();
+	bool retVal;
+
+	if (spiTransfer != IMU_SPI_IDLE)
+		return false;
+
+	imuBus_setClock(spiRegDivider);
+	HAL_GPIO_WritePin(imuCsPorts[id], imuCsPins[id], GPIO_PIN_RESET);
+	retVal = imuBus_exchange(reg | IMU_SPI_READ, NULL, tickstart);
+	for (uint16_t i = 0; (i < length) && retVal; i++)
+	{
+		retVal = imuBus_exchange(0, &buffer[i], tickstart);
+	}
+	HAL_GPIO_WritePin(imuCsPorts[id], imuCsPins[id], GPIO_PIN_SET);
+
+	return retVal;
+}
+
+bool imuBus_Write(imuId_t id, uint8_t reg, uint8_t value)
+{
+	uint32_t tickstart = HAL_GetTick();
+	bool retVal;
+
+	if (spiTransfer != IMU_SPI_IDLE)
+		return false;
+
+	imuBus_setClock(spiRegDivider);
+	HAL_GPIO_WritePin(imuCsPorts[id], imuCsPins[id], GPIO_PIN_RESET);
+	retVal = imuBus_exchange(reg, NULL, tickstart)
+			&& imuBus_exchange(value, NULL, tickstart);
+	HAL_GPIO_WritePin(imuCsPorts[id], imuCsPins[id], GPIO_PIN_SET);
+
+	return retVal;
+}
+
+bool imuBus_ReadAsync(imuId_t id, uint8_t reg, uint16_t length)
+{
+	if ((spiTransfer != IMU_SPI_IDLE) || (length > IMU_BUS_MAX_READ))
+		return false;
+
+	// the FIFO and the interrupt status are read at the data clock
+	imuBus_setClock(spiDataDivider);
+	txBuffer[0] = reg | IMU_SPI_READ;
+	spiTransfer = IMU_SPI_READING;
+
+	return imuBus_startDma(id, length + 1, false);
+}
+
+bool imuBus_WriteAsync(imuId_t id, uint8_t reg, uint8_t value)
+{
+	if (spiTransfer != IMU_SPI_IDLE)
+		return false;
+
+	imuBus_setClock(spiRegDivider);
+	txBuffer[0] = reg;
+	txBuffer[1] = value;
+	spiTransfer = IMU_SPI_WRITING;
+
+	return imuBus_startDma(id, 2, true);
+}
+
+bool imuBus_Busy()
+{
+	return (spiTransfer != IMU_SPI_IDLE);
+}
+
+bool imuBus_Recover()
+{
+	// Abort the transfer in progress
+	HAL_DMA_Abort(&hdma_spi3_rx);
+	HAL_DMA_Abort(&hdma_spi3_tx);
+	imuBus_stopDma();
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		HAL_GPIO_WritePin(imuCsPorts[i], imuCsPins[i], GPIO_PIN_SET);
+	}
+
+	// Reset the peripheral, an SPI slave cannot hold the bus
+	__HAL_RCC_SPI3_FORCE_RESET();
+	__HAL_RCC_SPI3_RELEASE_RESET();
+	IMU_SPI->CR1 = IMU_SPI_MODE | spiRegDivider;
+	IMU_SPI->CR1 |= SPI_CR1_SPE;
+	spiTransfer = IMU_SPI_IDLE;
+
+	return true;
+}
+
+/**
+ * Private functions
+ */
+
+static uint32_t imuBus_divider(uint32_t maxHz)
+{
+	uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+	uint32_t br = 0;
+
+	// fPCLK / 2^(BR + 1), up to fPCLK / 256
+	while ((br < 7) && ((pclk >> (br + 1)) > maxHz))
+	{
+		br++;
+	}
+
+	return br << SPI_CR1_BR_Pos;
+}
+
+static void imuBus_setClock(uint32_t divider)
+{
+	if ((IMU_SPI->CR1 & SPI_CR1_BR) != divider)
+	{
+		IMU_SPI->CR1 &= ~SPI_CR1_SPE;
+		IMU_SPI->CR1 = (IMU_SPI->CR1 & ~SPI_CR1_BR) | divider;
+		IMU_SPI->CR1 |= SPI_CR1_SPE;
+	}
+}
+
+static bool imuBus_exchange(uint8_t tx, uint8_t *rx, uint32_t tickstart)
+{
+	while (!(IMU_SPI->SR & SPI_SR_TXE))
+	{
+		if ((HAL_GetTick() - tickstart) >= IMU_BUS_TIMEOUT_MS)
+			return false;
+	}
+	*(__IO uint8_t*) &IMU_SPI->DR = tx;
+
+	while (!(IMU_SPI->SR & SPI_SR_RXNE))
+	{
+		if ((HAL_GetTick() - tickstart) >= IMU_BUS_TIMEOUT_MS)
+			return false;
+	}
+	tx = *(__IO uint8_t*) &IMU_SPI->DR;
+	if (rx != NULL)
+	{
+		*rx = tx;
+	}
+
+	return true;
+}
+
+static bool imuBus_startDma(imuId_t id, uint16_t length, bool increment)
+{
+	// the address is repeated while the registers are read
+	if (increment)
+	{
+		hdma_spi3_tx.Instance->CR |= DMA_SxCR_MINC;
+	}
+	else
+	{
+		hdma_spi3_tx.Instance->CR &= ~DMA_SxCR_MINC;
+	}
+
+	// drop a byte left by an aborted transfer
+	(void) IMU_SPI->DR;
+	(void) IMU_SPI->SR;
+
+	spiDevice = id;
+	HAL_GPIO_WritePin(imuCsPorts[id], imuCsPins[id], GPIO_PIN_RESET);
+	if ((HAL_DMA_Start_IT(&hdma_spi3_rx, (uint32_t) &IMU_SPI->DR,
+			(uint32_t) dmaBuffer, length) != HAL_OK)
+			|| (HAL_DMA_Start(&hdma_spi3_tx, (uint32_t) txBuffer,
+					(uint32_t) &IMU_SPI->DR, length) != HAL_OK))
+	{
+		HAL_DMA_Abort(&hdma_spi3_rx);
+		imuBus_stopDma();
+		return false;
+	}
+
+	// the reception is armed first, so no byte is missed
+	IMU_SPI->CR2 |= SPI_CR2_RXDMAEN;
+	IMU_SPI->CR2 |= SPI_CR2_TXDMAEN;
+
+	return true;
+}
+
+static void imuBus_stopDma()
+{
+	IMU_SPI->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+	HAL_GPIO_WritePin(imuCsPorts[spiDevice], imuCsPins[spiDevice],
+			GPIO_PIN_SET);
+	spiTransfer = IMU_SPI_IDLE;
+}
+
+static void imuBus_rxComplete(DMA_HandleTypeDef *hdma)
+{
+	imuSpiTransfer_t transfer = spiTransfer;
+
+	// the transmission ended with the last byte, only its handle is released
+	HAL_DMA_Abort(&hdma_spi3_tx);
+	imuBus_stopDma();
+
+	if (transfer == IMU_SPI_READING)
+	{
+		imuBus_ReadCallback(&dmaBuffer[1]);
+	}
+	else
+	{
+		imuBus_WriteCallback();
+	}
+}
+
+static void imuBus_rxError(DMA_HandleTypeDef *hdma)
+{
+	HAL_DMA_Abort(&hdma_spi3_tx);
+	imuBus_stopDma();
+	imuBus_ErrorCallback();
+}
+
+static void SPI3_Init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct =
+	{ 0 };
+
+	__HAL_RCC_GPIOC_CLK_ENABLE();
+	__HAL_RCC_GPIOD_CLK_ENABLE();
+	__HAL_RCC_SPI3_CLK_ENABLE();
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	/* Chip selects, inactive high */
+	HAL_GPIO_WritePin(IMU_CS0_GPIO_Port, IMU_CS0_Pin | IMU_CS1_Pin,
+			GPIO_PIN_SET);
+	GPIO_InitStruct.Pin = IMU_CS0_Pin | IMU_CS1_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(IMU_CS0_GPIO_Port, &GPIO_InitStruct);
+
+	/**SPI3 GPIO Configuration
+	 PC10     ------> SPI3_SCK
+	 PC11     ------> SPI3_MISO
+	 PC12     ------> SPI3_MOSI
+	 */
+	GPIO_InitStruct.Pin = IMU_SCK_Pin | IMU_MISO_Pin | IMU_MOSI_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	GPIO_InitStruct.Alternate = GPIO_AF6_SPI3;
+	HAL_GPIO_Init(IMU_SCK_GPIO_Port, &GPIO_InitStruct);
+
+	/* SPI3_RX Init */
+	hdma_spi3_rx.Instance = DMA1_Stream2;
+	hdma_spi3_rx.Init.Channel = DMA_CHANNEL_0;
+	hdma_spi3_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	hdma_spi3_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_spi3_rx.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_spi3_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma_spi3_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma_spi3_rx.Init.Mode = DMA_NORMAL;
+	hdma_spi3_rx.Init.Priority = DMA_PRIORITY_HIGH;
+	hdma_spi3_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+	if (HAL_DMA_Init(&hdma_spi3_rx) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	hdma_spi3_rx.XferCpltCallback = imuBus_rxComplete;
+	hdma_spi3_rx.XferErrorCallback = imuBus_rxError;
+
+	/* SPI3_TX Init */
+	hdma_spi3_tx.Instance = DMA1_Stream5;
+	hdma_spi3_tx.Init.Channel = DMA_CHANNEL_0;
+	hdma_spi3_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdma_spi3_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_spi3_tx.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_spi3_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma_spi3_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma_spi3_tx.Init.Mode = DMA_NORMAL;
+	hdma_spi3_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+	hdma_spi3_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+	if (HAL_DMA_Init(&hdma_spi3_tx) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	/* DMA1_Stream2_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Stream2_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Stream2_IRQn);
+
+	/* 8-bit frames, MSB first, registers clock until a data read */
+	spiRegDivider = imuBus_divider(IMU_SPI_REG_HZ);
+	spiDataDivider = imuBus_divider(IMU_SPI_DATA_HZ);
+	IMU_SPI->CR1 = IMU_SPI_MODE | spiRegDivider;
+	IMU_SPI->CR1 |= SPI_CR1_SPE;
+}
+
+static void Error_Handler(void)
+{
+	/* Turn LED_IMU on */
+	BSP_LED_On(LED_IMU);
+	while (1)
+	{
+	}
+}
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ * @file    imu_convert.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU sample conversion
+ ******************************************************************************
+ */
+
+#include "imu_convert.h"
+
+#include <stdlib.h>
+
+/**
+ * @var accScales
+ * @brief Reciprocal scales from raw accelerometer data to milli-g (Q16), per full scale range.
+ */
+static const int32_t accScales[] =
+{ ACC_FSR_2G_SCALE, ACC_FSR_4G_SCALE, ACC_FSR_8G_SCALE, ACC_FSR_16G_SCALE };
+
+/**
+ * @var gyroScales
+ * @brief Reciprocal scales from raw gyroscope data to centi-degrees/s (Q16), per full scale range.
+ */
+static const int32_t gyroScales[] =
+{ GYR_FSR_250DPS_SCALE, GYR_FSR_500DPS_SCALE, GYR_FSR_1000DPS_SCALE,
+		GYR_FSR_2000DPS_SCALE };
+
+int32_t imuConvert_Scale(int32_t value, int32_t scale)
+{
+	// 32x32 -> 64 bit product, a single SMULL on the M4
+	return (int32_t) (((int64_t) value * scale + 0x8000) >> 16);
+}
+
+int32_t imuConvert_ScaleQ8(int32_t value, int32_t scale)
+{
+	return (int32_t) (((int64_t) value * scale + 0x800000) >> 24);
+}
+
+int32_t imuConvert_AccScale(imuAccFsr_t fsr)
+{
+	return (fsr <= ACC_FSR_16G) ? accScales[fsr] : ACC_FSR_4G_SCALE;
+}
+
+int32_t imuConvert_GyroScale(imuGyroFsr_t fsr)
+{
+	return (fsr <= GYR_FSR_2000DPS) ? gyroScales[fsr] : GYR_FSR_500DPS_SCALE;
+}
+
+void imuConvert_Acc(const imuRaw_t *raw, int32_t scale, acc_t *acc)
+{
+	acc->ax = (int16_t) imuConvert_Scale(raw->ax, scale);
+	acc->ay = (int16_t) imuConvert_Scale(raw->ay, scale);
+	acc->az = (int16_t) imuConvert_Scale(raw->az, scale);
+}
+
+int16_t imuConvert_Temp(int16_t raw)
+{
+	return (int16_t) (imuConvert_Scale(raw, TEMP_SCALE) + TEMP_OFFSET_CDEG);
+}
+
+void imuConvert_Gyro(const imuRaw_t *raw, const int32_t *offset, int32_t scale,
+		gyro_t *gyro)
+{
+	gyro->gx = imuConvert_ScaleQ8(
+			(int32_t) raw->gx * (1 << IMU_GYRO_CAL_FRAC_BITS) - offset[0], scale);
+	gyro->gy = imuConvert_ScaleQ8(
+			(int32_t) raw->gy * (1 << IMU_GYRO_CAL_FRAC_BITS) - offset[1], scale);
+	gyro->gz = imuConvert_ScaleQ8(
+			(int32_t) raw->gz * (1 << IMU_GYRO_CAL_FRAC_BITS) - offset[2], scale);
+}
+
+void imuConvert_GyroOffset(const imuGyroBias_t *bias, const int32_t *cal,
+		int16_t temp, int32_t *offset)
+{
+	int32_t dTemp = temp - (bias->refTemp >> 8);
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		offset[i] = cal[i]
+				+ imuConvert_Scale(bias->tempco[i] * dTemp, IMU_Q16(0.01));
+	}
+}
+
+void imuConvert_GyroBiasUpdate(imuGyroBias_t *bias, int32_t *cal,
+		const imuRaw_t *raw, int16_t temp, const int32_t *offset, int32_t scale,
+		uint16_t rateHz)
+{
+	int32_t gyro[3] =
+	{ raw->gx, raw->gy, raw->gz };
+	int32_t still;
+	int32_t dTemp;
+	int32_t tempco;
+	uint8_t i;
+
+	if (!bias->init)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			bias->track[i] = cal[i] * 256;
+			bias->anchorOffset[i] = cal[i];
+			bias->tempco[i] = 0;
+		}
+		bias->refTemp = (int32_t) temp * 256;
+		bias->anchorTemp = temp;
+		bias->still = 0;
+		bias->init = true;
+		return;
+	}
+
+	// Stationary threshold in counts (Q8), for the current full scale range
+	still = ((IMU_BIAS_STILL_CDPS << 16) / scale) << IMU_GYRO_CAL_FRAC_BITS;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (labs(gyro[i] * (1 << IMU_GYRO_CAL_FRAC_BITS) - offset[i]) > still)
+		{
+			bias->still = 0;
+			return;
+		}
+	}
+
+	if (bias->still < IMU_BIAS_STILL_SAMPLES(rateHz))
+	{
+		bias->still++;
+		return;
+	}
+
+	// Slow exponential average of the readings and of the temperature
+	for (i = 0; i < 3; i++)
+	{
+		bias->track[i] += (gyro[i] * 65536 - bias->track[i])
+				>> IMU_BIAS_TRACK_SHIFT;
+		cal[i] = bias->track[i] >> 8;
+	}
+	bias->refTemp += ((int32_t) temp * 256 - bias->refTemp)
+			>> IMU_BIAS_TRACK_SHIFT;
+
+	// Temperature coefficients from the offsets at two temperatures
+	dTemp = (bias->refTemp >> 8) - bias->anchorTemp;
+	if ((dTemp >= IMU_BIAS_TEMPCO_CDEG) || (dTemp <= -IMU_BIAS_TEMPCO_CDEG))
+	{
+		for (i = 0; i < 3; i++)
+		{
+			tempco = ((cal[i] - bias->anchorOffset[i]) * 100) / dTemp;
+			bias->tempco[i] += (tempco - bias->tempco[i])
+					>> IMU_BIAS_TEMPCO_SHIFT;
+			bias->anchorOffset[i] = cal[i];
+		}
+		bias->anchorTemp = (int16_t) (bias->refTemp >> 8);
+	}
+}
+
+void imuConvert_MagnAdjust(const imuRaw_t *raw, const int32_t *asa, int32_t *m)
+{
+	m[0] = imuConvert_Scale(raw->mx, asa[0]);
+	m[1] = imuConvert_Scale(raw->my, asa[1]);
+	m[2] = imuConvert_Scale(raw->mz, asa[2]);
+}
+
+void imuConvert_MagnCorrect(const int32_t *m, const magnCal_t *cal,
+		magn_t *magn)
+{
+	int32_t h[3];
+	int32_t c[3];
+	int32_t v;
+
+	// Hard iron offset, then soft iron correction
+	h[0] = m[0] - cal->offset[0];
+	h[1] = m[1] - cal->offset[1];
+	h[2] = m[2] - cal->offset[2];
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		v = imuConvert_Scale(h[0], cal->matrix[i][0])
+				+ imuConvert_Scale(h[1], cal->matrix[i][1])
+				+ imuConvert_Scale(h[2], cal->matrix[i][2]);
+
+		// Convert to milli-gauss, saturated to the output range
+		v = imuConvert_Scale(v, MAGN_SCALE);
+		c[i] = (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : v);
+	}
+
+	// The AK8963 X and Y axes are swapped and its Z axis is reversed
+	magn->mx = (int16_t) c[1];
+	magn->my = (int16_t) c[0];
+	magn->mz = (int16_t) -c[2];
+}
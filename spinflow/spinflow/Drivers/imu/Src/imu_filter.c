@@ -0,0 +1,184 @@
+/**
+ ******************************************************************************
+ * @file    imu_filter.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU digital filters
+ ******************************************************************************
+ */
+
+#include "imu_filter.h"
+#include <math.h>
+
+/**
+ * @def IMU_FILTER_PI
+ * @brief Pi, single precision.
+ */
+#define IMU_FILTER_PI			3.14159265f
+
+/**
+ * @brief Runs the biquad cascade on one sample.
+ * @param filter Filter.
+ * @param x Input.
+ * @return Output.
+ */
+static float imuFilter_biquad(imuFilter_t *filter, float x);
+
+void imuFilter_Init(imuFilter_t *filter)
+{
+	filter->type = IMU_FILTER_NONE;
+	filter->stages = 0;
+	filter->taps = 0;
+	imuFilter_Reset(filter);
+}
+
+bool imuFilter_SetLowPass(imuFilter_t *filter, float cutoffHz,
+		float sampleRateHz, uint8_t stages)
+{
+	float coeffs[5 * IMU_FILTER_MAX_STAGES];
+	float w0;
+	float alpha;
+	float cosw0;
+	float a0;
+	float q;
+
+	if ((stages == 0) || (stages > IMU_FILTER_MAX_STAGES) || (cutoffHz <= 0.0f)
+			|| (cutoffHz >= sampleRateHz / 2.0f))
+		return false;
+
+	w0 = 2.0f * IMU_FILTER_PI * cutoffHz / sampleRateHz;
+	cosw0 = cosf(w0);
+
+	for (uint8_t k = 0; k < stages; k++)
+	{
+		// Q of each second order section of a Butterworth filter of order 2 * stages
+		q = 1.0f
+				/ (2.0f
+						* cosf(IMU_FILTER_PI * (2 * k + 1) / (4.0f * stages)));
+		alpha = sinf(w0) / (2.0f * q);
+		a0 = 1.0f + alpha;
+
+		// RBJ low-pass, normalised by a0, feedback terms negated
+		coeffs[5 * k + 0] = (1.0f - cosw0) / 2.0f / a0;
+		coeffs[5 * k + 1] = (1.0f - cosw0) / a0;
+		coeffs[5 * k + 2] = (1.0f - cosw0) / 2.0f / a0;
+		coeffs[5 * k + 3] = 2.0f * cosw0 / a0;
+		coeffs[5 * k + 4] = -(1.0f - alpha) / a0;
+	}
+
+	return imuFilter_SetBiquad(filter, coeffs, stages);
+}
+
+bool imuFilter_SetBiquad(imuFilter_t *filter, const float *coeffs,
+		uint8_t stages)
+{
+	if ((stages == 0) || (stages > IMU_FILTER_MAX_STAGES))
+		return false;
+
+	for (uint8_t i = 0; i < 5 * stages; i++)
+	{
+		filter->coeffs[i] = coeffs[i];
+	}
+	filter->stages = stages;
+	filter->type = IMU_FILTER_BIQUAD;
+
+#if IMU_FILTER_CMSIS_DSP
+	arm_biquad_cascade_df1_init_f32(&filter->instance, stages, filter->coeffs,
+			filter->state);
+#endif
+
+	imuFilter_Reset(filter);
+
+	return true;
+}
+
+bool imuFilter_SetAverage(imuFilter_t *filter, uint8_t taps)
+{
+	if ((taps == 0) || (taps > IMU_FILTER_MAX_TAPS))
+		return false;
+
+	filter->taps = taps;
+	filter->type = IMU_FILTER_AVERAGE;
+	imuFilter_Reset(filter);
+
+	return true;
+}
+
+void imuFilter_Reset(imuFilter_t *filter)
+{
+	uint8_t i;
+
+	for (i = 0; i < 4 * IMU_FILTER_MAX_STAGES; i++)
+	{
+		filter->state[i] = 0.0f;
+	}
+
+	for (i = 0; i < IMU_FILTER_MAX_TAPS; i++)
+	{
+		filter->window[i] = 0.0f;
+	}
+	filter->sum = 0.0f;
+	filter->index = 0;
+}
+
+float imuFilter_Apply(imuFilter_t *filter, float x)
+{
+	switch (filter->type)
+	{
+	case IMU_FILTER_BIQUAD:
+		return imuFilter_biquad(filter, x);
+
+	case IMU_FILTER_AVERAGE:
+		filter->sum += x - filter->window[filter->index];
+		filter->window[filter->index] = x;
+		filter->index++;
+		if (filter->index >= filter->taps)
+		{
+			filter->index = 0;
+
+			// rebuild the sum once per window, so rounding errors do not build up
+			filter->sum = 0.0f;
+			for (uint8_t i = 0; i < filter->taps; i++)
+			{
+				filter->sum += filter->window[i];
+			}
+		}
+		return filter->sum / filter->taps;
+
+	default:
+		return x;
+	}
+}
+
+static float imuFilter_biquad(imuFilter_t *filter, float x)
+{
+#if IMU_FILTER_CMSIS_DSP
+	float y;
+
+	arm_biquad_cascade_df1_f32(&filter->instance, &x, &y, 1);
+
+	return y;
+#else
+	const float *c = filter->coeffs;
+	float *s = filter->state;
+	float y;
+
+	for (uint8_t k = 0; k < filter->stages; k++)
+	{
+		y = c[0] * x + c[1] * s[0] + c[2] * s[1] + c[3] * s[2] + c[4] * s[3];
+
+		s[1] = s[0];
+		s[0] = x;
+		s[3] = s[2];
+		s[2] = y;
+
+		// output of a stage is the input of the next one
+		x = y;
+		c += 5;
+		s += 4;
+	}
+
+	return x;
+#endif
+}
@@ -0,0 +1,611 @@
+/**
+ ******************************************************************************
+ * @file    imu_gesture.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU gesture recognition
+ ******************************************************************************
+ */
+
+#include "imu_gesture.h"
+#include <math.h>
+
+/**
+ * @def IMU_GESTURE_INF
+ * @brief Cost of a warping path that does not exist, additions saturate to it.
+ */
+#define IMU_GESTURE_INF			0x3FFFFFFFUL
+
+/**
+ * @def IMU_GESTURE_PI
+ * @brief Pi, single precision.
+ */
+#define IMU_GESTURE_PI			3.14159265f
+
+/**
+ * @brief Queues a detected gesture, dropping the oldest one when the queue is full.
+ * @param g Engine.
+ * @param type Gesture.
+ * @param direction Signed axis, 0 when not applicable.
+ * @param index Template index.
+ * @param score Mean distance per frame of a template match.
+ * @param timestamp Time of the detection, in milliseconds.
+ */
+static void imuGesture_emit(imuGesture_t *g, imuGestureType_t type,
+		int8_t direction, uint8_t index, uint32_t score, uint32_t timestamp);
+
+/**
+ * @brief Detects taps on a sample.
+ * @param g Engine.
+ * @param peakMg Strongest dynamic acceleration of the sample, in milli-g.
+ * @param rateCdps Strongest angular velocity of the sample, in centi-degrees/s.
+ * @param timestamp Acquisition time, in milliseconds.
+ */
+static void imuGesture_tap(imuGesture_t *g, int32_t peakMg, int32_t rateCdps,
+		uint32_t timestamp);
+
+/**
+ * @brief Completes the frame being collected and runs the frame detectors.
+ * @param g Engine.
+ * @param timestamp Acquisition time of the last sample of the frame, in milliseconds.
+ */
+static void imuGesture_frame(imuGesture_t *g, uint32_t timestamp);
+
+/**
+ * @brief Gets the strongest angular velocity of a frame.
+ * @param f Frame.
+ * @param direction Pointer where the signed axis will be stored. Can be NULL.
+ * @return int16_t Angular velocity, in degrees per second.
+ */
+static int16_t imuGesture_rotation(const int16_t *f, int8_t *direction);
+
+/**
+ * @brief Counts the shake stroke reversals of a frame.
+ * @param g Engine.
+ * @param f Frame.
+ * @return uint8_t Reversals, one per axis at most.
+ */
+static uint8_t imuGesture_strokes(imuGesture_t *g, const int16_t *f);
+
+/**
+ * @brief Detects a flick from the strongest angular velocity of a frame.
+ * @param g Engine.
+ * @param rotation Strongest angular velocity, in degrees per second.
+ * @param direction Signed axis of the strongest angular velocity.
+ * @param timestamp Time of the frame, in milliseconds.
+ */
+static void imuGesture_flick(imuGesture_t *g, int16_t rotation,
+		int8_t direction, uint32_t timestamp);
+
+/**
+ * @brief Detects a held tilt from the gravity.
+ * @param g Engine.
+ * @param timestamp Time of the frame, in milliseconds.
+ */
+static void imuGesture_hold(imuGesture_t *g, uint32_t timestamp);
+
+/**
+ * @brief Updates the warping column of a template with a frame, and reports its match.
+ * @param g Engine.
+ * @param index Template index.
+ * @param q Frame, in template units.
+ * @param timestamp Time of the frame, in milliseconds.
+ */
+static void imuGesture_spring(imuGesture_t *g, uint8_t index, const int8_t *q,
+		uint32_t timestamp);
+
+/**
+ * @brief Saturates a value to a template unit.
+ * @param x Value.
+ * @return int8_t Value, from -127 to 127.
+ */
+static inline int8_t imuGesture_clamp8(int32_t x);
+
+bool imuGesture_Init(imuGesture_t *gesture, uint16_t sampleRateHz,
+		const imuGestureTemplate_t *templates, uint8_t count)
+{
+	float c;
+
+	if ((sampleRateHz == 0) || (count > IMU_GESTURE_MAX_TEMPLATES)
+			|| ((count > 0) && (templates == NULL)))
+		return false;
+
+	for (uint8_t k = 0; k < count; k++)
+	{
+		if ((templates[k].length == 0)
+				|| (templates[k].length > IMU_GESTURE_MAX_LENGTH)
+				|| (templates[k].frames == NULL))
+			return false;
+	}
+
+	gesture->decimation = sampleRateHz / IMU_GESTURE_FRAME_HZ;
+	if (gesture->decimation == 0)
+	{
+		gesture->decimation = 1;
+	}
+	gesture->frameMs = (1000UL * gesture->decimation + sampleRateHz / 2)
+			/ sampleRateHz;
+
+	c = cosf((float) IMU_GESTURE_TILT_DEG * IMU_GESTURE_PI / 180.0f);
+	gesture->tiltCos2 = (uint32_t) (c * c * 65536.0f + 0.5f);
+
+	gesture->templates = templates;
+	gesture->templateCount = count;
+	gesture->queueHead = 0;
+	gesture->queueTail = 0;
+	imuGesture_Reset(gesture);
+
+	return true;
+}
+
+void imuGesture_Reset(imuGesture_t *gesture)
+{
+	imuGestureMatch_t *m;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		gesture->accSum[i] = 0;
+		gesture->gyroSum[i] = 0;
+		gesture->gravityQ4[i] = 0;
+		gesture->strokeSign[i] = 0;
+	}
+	gesture->count = 0;
+	gesture->frameCount = 0;
+	gesture->gravityValid = false;
+
+	for (uint16_t n = 0; n < IMU_GESTURE_WINDOW; n++)
+	{
+		for (uint8_t i = 0; i < IMU_GESTURE_CHANNELS; i++)
+		{
+			gesture->ring[n][i] = 0;
+		}
+		gesture->reversals[n] = 0;
+	}
+	gesture->head = 0;
+	gesture->windowReversals = 0;
+	gesture->windowRotation = 0;
+
+	gesture->flickFrames = 0;
+	gesture->flickRest = 0;
+	gesture->flickDirection = 0;
+	gesture->flickPeak = 0;
+	gesture->tapActive = false;
+	gesture->tapPending = false;
+	gesture->holdFrames = 0;
+	gesture->holdReported = false;
+
+	for (uint8_t k = 0; k < gesture->templateCount; k++)
+	{
+		m = &gesture->match[k];
+		m->distance[0] = 0;
+		for (uint8_t i = 1; i <= IMU_GESTURE_MAX_LENGTH; i++)
+		{
+			m->distance[i] = IMU_GESTURE_INF;
+			m->start[i] = 0;
+		}
+		m->pending = false;
+	}
+}
+
+void imuGesture_Add(imuGesture_t *gesture, const acc_t *acc,
+		const gyro_t *gyro, uint32_t timestamp)
+{
+	int32_t a[3] = { acc->ax, acc->ay, acc->az };
+	int32_t w[3] = { gyro->gx, gyro->gy, gyro->gz };
+	int32_t peak = 0;
+	int32_t rate = 0;
+	int32_t x;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		gesture->accSum[i] += a[i];
+		gesture->gyroSum[i] += w[i];
+
+		x = a[i] - (gesture->gravityQ4[i] >> 4);
+		x = (x < 0) ? -x : x;
+		peak = (x > peak) ? x : peak;
+		x = (w[i] < 0) ? -w[i] : w[i];
+		rate = (x > rate) ? x : rate;
+	}
+
+	// a tap is shorter than a frame
+	if (gesture->gravityValid)
+	{
+		imuGesture_tap(gesture, peak, rate, timestamp);
+	}
+
+	if (++gesture->count >= gesture->decimation)
+	{
+		imuGesture_frame(gesture, timestamp);
+	}
+}
+
+bool imuGesture_Get(imuGesture_t *gesture, imuGestureEvent_t *event)
+{
+	if (gesture->queueHead == gesture->queueTail)
+		return false;
+
+	*event = gesture->queue[gesture->queueTail & (IMU_GESTURE_QUEUE - 1)];
+	gesture->queueTail++;
+
+	return true;
+}
+
+static void imuGesture_emit(imuGesture_t *g, imuGestureType_t type,
+		int8_t direction, uint8_t index, uint32_t score, uint32_t timestamp)
+{
+	imuGestureEvent_t *event = &g->queue[g->queueHead
+			& (IMU_GESTURE_QUEUE - 1)];
+
+	event->type = type;
+	event->direction = direction;
+	event->index = index;
+	event->score = (score > UINT16_MAX) ? UINT16_MAX : (uint16_t) score;
+	event->timestamp = timestamp;
+
+	g->queueHead++;
+	if ((uint8_t) (g->queueHead - g->queueTail) > IMU_GESTURE_QUEUE)
+	{
+		g->queueTail = g->queueHead - IMU_GESTURE_QUEUE;
+	}
+}
+
+static void imuGesture_tap(imuGesture_t *g, int32_t peakMg, int32_t rateCdps,
+		uint32_t timestamp)
+{
+	if (g->tapPending
+			&& (timestamp - g->tapLast > IMU_GESTURE_TAP_GAP_MAX_MS))
+	{
+		g->tapPending = false;
+	}
+
+	if (!g->tapActive)
+	{
+		// a spike while turning is a stroke, not a tap
+		if ((peakMg > IMU_GESTURE_TAP_MG)
+				&& (rateCdps < IMU_GESTURE_TAP_MAX_DPS * 100))
+		{
+			g->tapActive = true;
+			g->tapStart = timestamp;
+		}
+		return;
+	}
+
+	if (peakMg >= IMU_GESTURE_TAP_MG / 2)
+		return;
+
+	g->tapActive = false;
+	if (timestamp - g->tapStart > IMU_GESTURE_TAP_MAX_MS)
+		return;
+
+	if (!g->tapPending)
+	{
+		g->tapPending = true;
+		g->tapLast = timestamp;
+	}
+	else if (timestamp - g->tapLast >= IMU_GESTURE_TAP_GAP_MIN_MS)
+	{
+		// a spike closer to the first tap is its rebound
+		g->tapPending = false;
+		imuGesture_emit(g, IMU_GESTURE_DOUBLE_TAP, 0, 0, 0, timestamp);
+	}
+}
+
+static void imuGesture_frame(imuGesture_t *g, uint32_t timestamp)
+{
+	int16_t *f = g->ring[g->head];
+	int8_t q[IMU_GESTURE_CHANNELS];
+	int32_t a;
+	int16_t rotation;
+	int8_t direction;
+
+	// the oldest frame leaves the window
+	g->windowRotation -= imuGesture_rotation(f, NULL);
+	g->windowReversals -= g->reversals[g->head];
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		f[i] = (int16_t) (g->gyroSum[i] / ((int32_t) g->count * 100));
+
+		// dynamic acceleration, then gravity low-pass with a 16 frame time constant
+		a = g->accSum[i] / g->count;
+		if (!g->gravityValid)
+		{
+			g->gravityQ4[i] = a * 16;
+		}
+		f[3 + i] = (int16_t) (a - (g->gravityQ4[i] >> 4));
+		g->gravityQ4[i] += a - (g->gravityQ4[i] >> 4);
+
+		g->accSum[i] = 0;
+		g->gyroSum[i] = 0;
+	}
+	g->count = 0;
+	g->gravityValid = true;
+
+	rotation = imuGesture_rotation(f, &direction);
+	g->windowRotation += rotation;
+	g->reversals[g->head] = imuGesture_strokes(g, f);
+	g->windowReversals += g->reversals[g->head];
+	g->head = (g->head + 1) & (IMU_GESTURE_WINDOW - 1);
+
+	if (g->windowReversals >= IMU_GESTURE_SHAKE_REVERSALS)
+	{
+		imuGesture_emit(g, IMU_GESTURE_SHAKE, 0, 0, 0, timestamp);
+
+		// the same strokes are not counted twice
+		for (uint16_t n = 0; n < IMU_GESTURE_WINDOW; n++)
+		{
+			g->reversals[n] = 0;
+		}
+		g->windowReversals = 0;
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			g->strokeSign[i] = 0;
+		}
+	}
+
+	imuGesture_flick(g, rotation, direction, timestamp);
+	imuGesture_hold(g, timestamp);
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		q[i] = imuGesture_clamp8(f[i] / IMU_GESTURE_GYRO_DPS_LSB);
+		q[3 + i] = imuGesture_clamp8(f[3 + i] / IMU_GESTURE_ACC_MG_LSB);
+	}
+	for (uint8_t k = 0; k < g->templateCount; k++)
+	{
+		imuGesture_spring(g, k, q, timestamp);
+	}
+
+	g->frameCount++;
+}
+
+static int16_t imuGesture_rotation(const int16_t *f, int8_t *direction)
+{
+	int16_t peak = 0;
+	int16_t x;
+
+	if (direction != NULL)
+	{
+		*direction = 0;
+	}
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		x = (f[i] < 0) ? -f[i] : f[i];
+		if (x > peak)
+		{
+			peak = x;
+			if (direction != NULL)
+			{
+				*direction = (f[i] < 0) ? -(int8_t) (i + 1) : (int8_t) (i + 1);
+			}
+		}
+	}
+
+	return peak;
+}
+
+static uint8_t imuGesture_strokes(imuGesture_t *g, const int16_t *f)
+{
+	uint8_t reversals = 0;
+	int8_t sign;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		if (f[3 + i] > IMU_GESTURE_SHAKE_MG)
+		{
+			sign = 1;
+		}
+		else if (f[3 + i] < -IMU_GESTURE_SHAKE_MG)
+		{
+			sign = -1;
+		}
+		else
+		{
+			continue;
+		}
+
+		if (g->strokeSign[i] == -sign)
+		{
+			reversals++;
+		}
+		g->strokeSign[i] = sign;
+	}
+
+	return reversals;
+}
+
+static void imuGesture_flick(imuGesture_t *g, int16_t rotation,
+		int8_t direction, uint32_t timestamp)
+{
+	if ((g->flickFrames == 0) && (rotation <= IMU_GESTURE_FLICK_DPS))
+		return;
+
+	if (g->flickFrames < UINT16_MAX)
+	{
+		g->flickFrames++;
+	}
+
+	if (rotation > IMU_GESTURE_FLICK_DPS)
+	{
+		g->flickRest = 0;
+		if (rotation > g->flickPeak)
+		{
+			g->flickPeak = rotation;
+			g->flickDirection = direction;
+		}
+		return;
+	}
+
+	// the burst ends after a rest, the rotation in between is part of it
+	if (rotation >= IMU_GESTURE_FLICK_END_DPS)
+	{
+		g->flickRest = 0;
+		return;
+	}
+	g->flickRest++;
+	if ((uint32_t) g->flickRest * g->frameMs < IMU_GESTURE_FLICK_REST_MS)
+		return;
+
+	// a longer burst is a turn, and a shake also rotates the sensor
+	if (((uint32_t) (g->flickFrames - g->flickRest) * g->frameMs
+			<= IMU_GESTURE_FLICK_MAX_MS)
+			&& (g->windowReversals < IMU_GESTURE_SHAKE_REVERSALS / 2))
+	{
+		imuGesture_emit(g, IMU_GESTURE_FLICK, g->flickDirection, 0, 0,
+				timestamp);
+	}
+	g->flickFrames = 0;
+	g->flickRest = 0;
+	g->flickPeak = 0;
+}
+
+static void imuGesture_hold(imuGesture_t *g, uint32_t timestamp)
+{
+	int32_t gravity[3];
+	int32_t norm2 = 0;
+	bool tilted;
+	bool still;
+	int8_t direction;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		gravity[i] = g->gravityQ4[i] >> 4;
+		norm2 += gravity[i] * gravity[i];
+	}
+
+	// the angle between Z and the gravity is beyond the tilt when gz^2 < |g|^2 cos^2
+	tilted = (((int64_t) gravity[2] * gravity[2]) << 16)
+			< (int64_t) norm2 * g->tiltCos2;
+	still = (g->windowRotation < IMU_GESTURE_HOLD_DPS * IMU_GESTURE_WINDOW);
+
+	if (!tilted || !still)
+	{
+		g->holdFrames = 0;
+		if (!tilted)
+		{
+			g->holdReported = false;
+		}
+		return;
+	}
+
+	if (g->holdFrames < UINT16_MAX)
+	{
+		g->holdFrames++;
+	}
+	if (g->holdReported
+			|| ((uint32_t) g->holdFrames * g->frameMs < IMU_GESTURE_HOLD_MS))
+		return;
+
+	// the accelerometer reads -1 g along an axis pointing down
+	if ((gravity[0] < 0 ? -gravity[0] : gravity[0])
+			>= (gravity[1] < 0 ? -gravity[1] : gravity[1]))
+	{
+		direction = (gravity[0] < 0) ? 1 : -1;
+	}
+	else
+	{
+		direction = (gravity[1] < 0) ? 2 : -2;
+	}
+	g->holdReported = true;
+	imuGesture_emit(g, IMU_GESTURE_TILT_HOLD, direction, 0, 0, timestamp);
+}
+
+static void imuGesture_spring(imuGesture_t *g, uint8_t index, const int8_t *q,
+		uint32_t timestamp)
+{
+	const imuGestureTemplate_t *tp = &g->templates[index];
+	imuGestureMatch_t *m = &g->match[index];
+	uint8_t length = tp->length;
+	uint32_t frame = g->frameCount;
+	uint32_t oldD;
+	uint32_t oldS;
+	uint32_t diagD = 0;
+	uint32_t diagS = frame - 1;
+	uint32_t prevD = 0;
+	uint32_t prevS = frame;
+	uint32_t bestD;
+	uint32_t bestS;
+	uint32_t d;
+	bool final = true;
+
+	// Column of the subsequence warping matrix at this frame: a match may start
+	// at any frame, so the cost before the first template frame is always 0
+	for (uint8_t i = 1; i <= length; i++)
+	{
+		d = 0;
+		for (uint8_t c = 0; c < IMU_GESTURE_CHANNELS; c++)
+		{
+			d += (q[c] < tp->frames[i - 1][c]) ? tp->frames[i - 1][c] - q[c] :
+					q[c] - tp->frames[i - 1][c];
+		}
+
+		oldD = m->distance[i];
+		oldS = m->start[i];
+
+		bestD = prevD;
+		bestS = prevS;
+		if (oldD < bestD)
+		{
+			bestD = oldD;
+			bestS = oldS;
+		}
+		if (diagD < bestD)
+		{
+			bestD = diagD;
+			bestS = diagS;
+		}
+
+		m->distance[i] = (bestD >= IMU_GESTURE_INF) ? IMU_GESTURE_INF :
+				bestD + d;
+		m->start[i] = bestS;
+
+		diagD = oldD;
+		diagS = oldS;
+		prevD = m->distance[i];
+		prevS = bestS;
+	}
+
+	// the candidate is reported once no path overlapping it can beat it
+	if (m->pending)
+	{
+		for (uint8_t i = 1; i <= length; i++)
+		{
+			if ((m->distance[i] < m->best) && (m->start[i] <= m->end))
+			{
+				final = false;
+			}
+		}
+
+		if (final)
+		{
+			m->pending = false;
+			imuGesture_emit(g, IMU_GESTURE_TEMPLATE, 0, index,
+					m->best / length, timestamp);
+			for (uint8_t i = 1; i <= length; i++)
+			{
+				if (m->start[i] <= m->end)
+				{
+					m->distance[i] = IMU_GESTURE_INF;
+				}
+			}
+		}
+	}
+
+	// a match shorter than half the template is a warping artefact
+	if ((m->distance[length] <= (uint32_t) tp->threshold * length)
+			&& (2 * (frame - m->start[length] + 1) >= length)
+			&& (!m->pending || (m->distance[length] < m->best)))
+	{
+		m->best = m->distance[length];
+		m->end = frame;
+		m->pending = true;
+	}
+}
+
+static inline int8_t imuGesture_clamp8(int32_t x)
+{
+	return (x > 127) ? 127 : (x < -127) ? -127 : (int8_t) x;
+}
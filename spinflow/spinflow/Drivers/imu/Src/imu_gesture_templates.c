@@ -0,0 +1,23 @@
+/**
+ ******************************************************************************
+ * @file    imu_gesture_templates.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU gesture templates
+ *
+ * Generated by Tools/imu_gesture.py train, do not edit.
+ ******************************************************************************
+ */
+
+#include "imu_gesture.h"
+
+/*
+ * No template is shipped until some are trained from labelled recordings,
+ * only the rule based gestures are recognised.
+ */
+const imuGestureTemplate_t imuGestureTemplates[1] =
+{
+{ NULL, 0, 0, NULL } };
+
+const uint8_t imuGestureTemplateCount = 0;
@@ -6,13 +6,22 @@
  ******************************************************************************
  */
 
-#include "imu_port.h"
+#include "imu_bus.h"
+#include "imu_convert.h"
+
+#if !DEVICE_IMU_REPLAY
+
+#include "main.h"
+#include <stdlib.h>
+#include <math.h>
 
 /**
- * I2C defines
+ * Bus defines
  */
-#define MPU_9250_ADDRESS		0x68
-#define IMU_I2C_TIMEOUT_MS		1000
+#define IMU_BUS_MAX_ERRORS		3		/*!< Consecutive bus errors that start a recovery */
+#define IMU_RESET_MS			100		/*!< Sensor start-up time after a reset */
+#define IMU_STALL_MIN_MS		100		/*!< Shortest time without data before the bus is recovered */
+#define IMU_XFER_TIMEOUT_MS		(IMU_BUS_TIMEOUT_MS + IMU_BUS_READ_MS)	/*!< Longest FIFO read, a full FIFO */
 
 /**
  * MPU defines
@@ -20,6 +29,71 @@
 #define WHO_AM_I          		0x75
 #define WHO_AM_I_9250_VALUE		0x71
 #define PWR_MGMT_1        		0x6B
+#define PWR_MGMT_2        		0x6C
+#define SMPLRT_DIV        		0x19
+#define CONFIG            		0x1A
+#define FIFO_EN           		0x23
+#define INT_PIN_CFG       		0x37
+#define INT_ENABLE        		0x38
+#define INT_STATUS        		0x3A
+#define USER_CTRL         		0x6A
+#define I2C_MST_CTRL      		0x24
+#define I2C_SLV0_ADDR     		0x25
+#define I2C_SLV0_REG      		0x26
+#define I2C_SLV0_CTRL     		0x27
+#define I2C_SLV4_CTRL     		0x34
+#define EXT_SENS_DATA_00  		0x49
+#define I2C_SLV0_DO       		0x63
+#define I2C_MST_DELAY_CTRL		0x67
+#define ACCEL_CONFIG2     		0x1D
+#define LP_ACCEL_ODR      		0x1E
+#define WOM_THR           		0x1F
+#define MOT_DETECT_CTRL   		0x69
+#define FIFO_COUNTH       		0x72
+#define FIFO_R_W          		0x74
+
+/**
+ * Data-ready interrupt defines
+ */
+#define INT_PIN_CFG_PULSE		0x00	/*!< 50 us active high pulse, status cleared by reading INT_STATUS */
+#define INT_ENABLE_RAW_RDY		0x01	/*!< Interrupt on raw data ready */
+#define INT_STATUS_FIFO_OFLOW	0x10	/*!< FIFO overflow flag */
+#define IMU_INTERNAL_RATE_HZ	1000
+
+/**
+ * Wake-on-motion defines
+ */
+#define PWR_MGMT_1_CYCLE		0x20	/*!< Accelerometer sampled at LP_ACCEL_ODR, sleeping in between */
+#define PWR_MGMT_1_H_RESET		0x80	/*!< Resets the registers to their defaults */
+#define PWR_MGMT_1_SLEEP		0x40	/*!< Sleep mode, the sensors are off */
+#define PWR_MGMT_2_GYRO_OFF		0x07	/*!< Gyro X, Y and Z disabled */
+#define ACCEL_CONFIG2_184HZ		0x01	/*!< Accelerometer bandwidth 184 Hz */
+#define LP_ACCEL_ODR_31HZ		0x07	/*!< Low power accelerometer rate 31.25 Hz */
+#define INT_ENABLE_WOM			0x40	/*!< Interrupt on wake-on-motion */
+#define MOT_DETECT_CTRL_INTEL	0xC0	/*!< Accelerometer intelligence on, compare with the previous sample */
+#define WOM_THR_LSB_MG			4		/*!< Wake-on-motion threshold resolution, in milli-g */
+
+/**
+ * FIFO defines
+ */
+#define FIFO_EN_TEMP_GYRO_ACCEL	0xF8	/*!< Temperature, gyro X/Y/Z and accelerometer */
+#define FIFO_EN_SLV0			0x01	/*!< EXT_SENS_DATA read by slave 0 */
+#define USER_CTRL_FIFO_EN		0x40
+#define USER_CTRL_I2C_MST_EN	0x20
+#define USER_CTRL_I2C_IF_DIS	0x10
+#define USER_CTRL_FIFO_RST		0x04
+#define FIFO_COUNT_MASK			0x1FFF
+#define IMU_FIFO_SIZE			512
+
+/**
+ * @def IMU_USER_CTRL_BUS
+ * @brief USER_CTRL bits of the transport, on SPI the I2C slave interface is disabled.
+ */
+#if DEVICE_IMU_SPI
+#define IMU_USER_CTRL_BUS		USER_CTRL_I2C_IF_DIS
+#else
+#define IMU_USER_CTRL_BUS		0
+#endif
 
 /**
  * Accelerometer & Gyro defines
@@ -29,12 +103,95 @@
 
 #define ACCEL_XOUT_H      		0x3B
 
+/**
+ * @def IMU_SAMPLE_BYTES
+ * @brief Length of a sample burst, from ACCEL_XOUT_H to GYRO_ZOUT_L.
+ */
+#define IMU_SAMPLE_BYTES		14
+
+/**
+ * @def IMU_MAGN_SAMPLE_BYTES
+ * @brief Length of a sample burst with the magnetometer, from ACCEL_XOUT_H to EXT_SENS_DATA_06.
+ *
+ * FIFO samples have the same layout as a burst from ACCEL_XOUT_H.
+ */
+#define IMU_MAGN_SAMPLE_BYTES	(IMU_SAMPLE_BYTES + AK8963_DATA_BYTES)
+
+/**
+ * @def IMU_FIFO_BATCH
+ * @brief Number of data-ready interrupts between two FIFO reads.
+ */
+#define IMU_FIFO_BATCH			DEVICE_IMU_FIFO_BATCH
+
+/**
+ * @def IMU_RING_SIZE
+ * @brief Number of samples held by the ring buffer. Must be a power of two.
+ */
+#define IMU_RING_SIZE			DEVICE_IMU_RING_SIZE
+
+/**
+ * @def IMU_STAMP_RING
+ * @brief Number of data-ready times kept, more than a full FIFO of samples. Must be a power of two.
+ */
+#define IMU_STAMP_RING			64
+
+/**
+ * @def IMU_TIMER_HZ
+ * @brief Tick rate of the timestamp timer, TIM2.
+ */
+#define IMU_TIMER_HZ			1000000UL
+
+/**
+ * @def IMU_MAX_BATCH
+ * @brief Most samples in a FIFO batch, without the magnetometer.
+ */
+#define IMU_MAX_BATCH			(IMU_FIFO_SIZE / IMU_SAMPLE_BYTES)
+
 /**
  * Magnetometer
  */
 #define AK8963_ADDRESS 			0x0C
 #define AK8963_WHO_AM_I  		0x00
 #define AK8963_WHOAMI_VALUE 	0x48
+#define AK8963_HXL				0x03
+#define AK8963_CNTL1			0x0A
+#define AK8963_CNTL2			0x0B
+#define AK8963_ASAX				0x10
+
+#define AK8963_CNTL1_POWER_DOWN	0x00
+#define AK8963_CNTL1_FUSE_ROM	0x0F
+#define AK8963_CNTL1_CONT2_16B	0x16	/*!< Continuous measurement at 100 Hz, 16-bit output */
+#define AK8963_CNTL2_SRST		0x01
+#define AK8963_ST2_HOFL			0x08	/*!< Magnetic sensor overflow */
+#define AK8963_DATA_BYTES		7		/*!< HXL to ST2, reading ST2 ends the measurement */
+#define AK8963_RATE_HZ			100
+
+/**
+ * Auxiliary I2C master defines
+ */
+#define I2C_MST_CTRL_400KHZ		0x0D
+#define I2C_SLV_READ			0x80	/*!< Slave address flag for reads */
+#define I2C_SLV_EN				0x80	/*!< Slave control enable flag */
+#define I2C_MST_DLY_SLV0		0x01	/*!< Slave 0 accessed every I2C_MST_DLY + 1 samples */
+#define IMU_MAGN_ACCESS_MS		10		/*!< Time for the I2C master to complete a slave access */
+
+/**
+ * @def IMU_MAGN_MAX_DELAY
+ * @brief Largest number of samples skipped between two magnetometer reads (I2C_MST_DLY).
+ */
+#define IMU_MAGN_MAX_DELAY		31
+
+/**
+ * @def IMU_SMPLRT_DIV_MAX
+ * @brief Largest sample rate divider, the lowest rate is IMU_INTERNAL_RATE_HZ / 256.
+ */
+#define IMU_SMPLRT_DIV_MAX		255
+
+/**
+ * @def IMU_MAGN_CAL_MIN_RANGE
+ * @brief Minimum span of every axis for a magnetometer calibration to be accepted, in counts.
+ */
+#define IMU_MAGN_CAL_MIN_RANGE	100
 
 /**
  * @def IMU_GYRO_CAL_POINTS
@@ -42,191 +199,541 @@
  *
  * This defines the total number of readings taken to calculate the average offsets for gyroscope calibration. Using multiple
  * data points helps in averaging out sensor noise and errors to establish a more accurate baseline for sensor readings.
+ * The readings are taken from the acquired samples, one second of them.
  */
-#define IMU_GYRO_CAL_POINTS		10
+#define IMU_GYRO_CAL_POINTS		(imuConfig.rateHz)
 
 /**
- * @brief Scale factor for accelerometer at ±2g, ±4g, ±8g or ±16g full-scale range.
- *
- * This values arre used to convert raw accelerometer outputs to g when the sensor is set to
- * ±2g, ±4g, ±8g or ±16g full-scale range.
+ * @def IMU_GYRO_CAL_SETTLE
+ * @brief Number of samples skipped when the gyroscope calibration starts, while the sensor settles.
  */
-#define ACC_FSR_2G_FACTOR 16384.0
-#define ACC_FSR_4G_FACTOR 8192.0
-#define ACC_FSR_8G_FACTOR 4096.0
-#define ACC_FSR_16G_FACTOR 2048.0
+#define IMU_GYRO_CAL_SETTLE		(imuConfig.rateHz / 10)
 
 /**
- * @brief Scale factor for gyroscope at ±250°/s, ±500°/s, ±1000°/s or ±2000°/s full-scale range.
- *
- * Defines the conversion factor for raw gyroscope data when the sensor is configured to a full-scale range of
- * ±250°/s, ±500°/s, ±1000°/s or ±2000°/s.
+ * @def IMU_GYRO_CAL_MOTION_CDPS
+ * @brief Deviation from the running mean that restarts the gyroscope calibration, in centi-degrees/s.
+ */
+#define IMU_GYRO_CAL_MOTION_CDPS	300
+
+/**
+ * @def IMU_GYRO_CAL_MAX_STD_CDPS
+ * @brief Largest standard deviation of an axis accepted at the end of the gyroscope calibration, in centi-degrees/s.
+ */
+#define IMU_GYRO_CAL_MAX_STD_CDPS	50
+
+/**
+ * @def IMU_SAMPLE_PERIOD_US
+ * @brief Time between two samples at the configured rate, used to timestamp the samples of a FIFO batch.
  */
-#define GYR_FSR_250DPS_FACTOR 131.0
-#define GYR_FSR_500DPS_FACTOR 65.5
-#define GYR_FSR_1000DPS_FACTOR 32.8
-#define GYR_FSR_2000DPS_FACTOR 16.4
+#define IMU_SAMPLE_PERIOD_US	(1000000UL / imuConfig.rateHz)
 
 /**
- * @enum gyroscopeFullScaleRange
- * @brief Enumerations for gyroscope full scale ranges.
+ * @enum imuTransfer_t
+ * @brief Stages of a FIFO batch read, chained from the transfer complete callbacks.
  */
-enum gyroscopeFullScaleRange
+typedef enum
 {
-	GYR_FSR_250DPS, /*!< Full scale range ±250 degrees per second */
-	GYR_FSR_500DPS, /*!< Full scale range ±500 degrees per second */
-	GYR_FSR_1000DPS, /*!< Full scale range ±1000 degrees per second */
-	GYR_FSR_2000DPS /*!< Full scale range ±2000 degrees per second */
-};
+	IMU_XFER_IDLE, /*!< No transfer in progress */
+	IMU_XFER_STATUS, /*!< Reading INT_STATUS to detect a FIFO overflow */
+	IMU_XFER_COUNT, /*!< Reading FIFO_COUNT */
+	IMU_XFER_FIFO, /*!< Reading the samples from FIFO_R_W */
+	IMU_XFER_RESET /*!< Resetting the FIFO after an overflow */
+} imuTransfer_t;
 
 /**
- * @enum accelerometerFullScaleRange
- * @brief Enumerations for accelerometer full scale ranges.
+ * @struct sensorData_t
+ * @brief Structure to store processed sensor data from the IMU.
  */
-enum accelerometerFullScaleRange
+typedef struct
 {
-	ACC_FSR_2G, /*!< Full scale range ±2g */
-	ACC_FSR_4G, /*!< Full scale range ±4g */
-	ACC_FSR_8G, /*!< Full scale range ±8g */
-	ACC_FSR_16G /*!< Full scale range ±16g */
-};
+	acc_t acc; /*!< Processed accelerometer data, in milli-g */
+	gyro_t gyro; /*!< Processed gyroscope data, in centi-degrees/s */
+	magn_t magn; /*!< Processed magnetometer data, in milli-gauss */
+	bool_t magnValid; /*!< Magnetometer data valid */
+	int16_t temp; /*!< Processed temperature data, in centi-degrees Celsius */
+	uint32_t timestamp; /*!< Acquisition tick, in milliseconds */
+	uint32_t timestampUs; /*!< Data-ready time, in microseconds */
+} sensorData_t;
 
 /**
- * @struct rawData_t
- * @brief Structure to store raw data from the IMU sensors.
+ * @struct gyroCal_t
+ * @brief Structure to hold calibration values for the gyroscope.
  */
 typedef struct
 {
-	int16_t ax; /*!< Raw accelerometer x-axis data */
-	int16_t ay; /*!< Raw accelerometer y-axis data */
-	int16_t az; /*!< Raw accelerometer z-axis data */
-	int16_t gx; /*!< Raw gyroscope x-axis data */
-	int16_t gy; /*!< Raw gyroscope y-axis data */
-	int16_t gz; /*!< Raw gyroscope z-axis data */
-	int16_t mx; /*!< Raw magnetometer x-axis data */
-	int16_t my; /*!< Raw magnetometer y-axis data */
-	int16_t mz; /*!< Raw magnetometer z-axis data */
-	int16_t temp; /*!< Raw temperature data */
-} rawData_t;
+	int32_t gx; /*!< Gyroscope x-axis calibration offset, in counts (Q8) */
+	int32_t gy; /*!< Gyroscope y-axis calibration offset, in counts (Q8) */
+	int32_t gz; /*!< Gyroscope z-axis calibration offset, in counts (Q8) */
+} gyroCal_t;
+
+/**
+ * @enum gyroCalState_t
+ * @brief States of the gyroscope calibration.
+ */
+typedef enum
+{
+	GYRO_CAL_DONE, /*!< Not running, the offsets are in use */
+	GYRO_CAL_SETTLE, /*!< Skipping the first samples */
+	GYRO_CAL_COLLECT /*!< Accumulating samples */
+} gyroCalState_t;
 
 /**
- * @var rawData
- * @brief Instance of rawData_t to hold raw sensor readings.
+ * @struct gyroCalData_t
+ * @brief Accumulators of the gyroscope calibration.
  */
-static rawData_t rawData;
+typedef struct
+{
+	gyroCalState_t state; /*!< Current state */
+	uint16_t count; /*!< Samples skipped or accumulated in the current state */
+	int32_t sum[3]; /*!< Sum of the readings of each axis */
+	int64_t sumSq[3]; /*!< Sum of the squared readings of each axis */
+	uint32_t restarts; /*!< Restarts because of motion */
+	bool_t valid; /*!< Set once a calibration completed */
+} gyroCalData_t;
 
 /**
- * @struct sensorData_t
- * @brief Structure to store processed sensor data from the IMU.
+ * @struct imuInstance_t
+ * @brief State of a sensor on the bus: its samples and its own calibration.
  */
 typedef struct
 {
-	int16_t ax; /*!< Processed accelerometer x-axis data */
-	int16_t ay; /*!< Processed accelerometer y-axis data */
-	int16_t az; /*!< Processed accelerometer z-axis data */
-	int16_t gx; /*!< Processed gyroscope x-axis data */
-	int16_t gy; /*!< Processed gyroscope y-axis data */
-	int16_t gz; /*!< Processed gyroscope z-axis data */
-	int16_t mx; /*!< Processed magnetometer x-axis data */
-	int16_t my; /*!< Processed magnetometer y-axis data */
-	int16_t mz; /*!< Processed magnetometer z-axis data */
-	int16_t temp; /*!< Processed temperature data */
-} sensorData_t;
+	imuId_t id; /*!< Sensor, selects its bus address or chip select */
+	bool_t present; /*!< Set when the sensor answered at start-up */
+	imuRaw_t rawData; /*!< Raw readings of the current sample */
+	sensorData_t sensorData; /*!< Processed readings of the current sample */
+	gyroCal_t gyroCal; /*!< Gyroscope offsets */
+	gyroCalData_t gyroCalData; /*!< Running gyroscope calibration */
+	imuGyroBias_t gyroBias; /*!< Gyroscope offset tracking */
+	magnCal_t magnCal; /*!< Magnetometer hard-iron and soft-iron calibration, identity until set */
+	int32_t magnAsaQ16[3]; /*!< Factory sensitivity adjustment of each magnetometer axis (Q16) */
+	int16_t magnMin[3]; /*!< Smallest reading of each magnetometer axis while collecting calibration data */
+	int16_t magnMax[3]; /*!< Largest reading of each magnetometer axis while collecting calibration data */
+	bool_t magnCalibrating; /*!< Set while the magnetometer calibration data is collected */
+	bool_t magnPresent; /*!< Set when the AK8963 answered and is read along every sample */
+	uint16_t sampleBytes; /*!< Length of a sample, with or without the magnetometer */
+	uint8_t userCtrl; /*!< USER_CTRL bits kept on every write to the register */
+	imuRaw_t ring[IMU_RING_SIZE]; /*!< Samples read by DMA, waiting to be consumed */
+	volatile uint16_t ringHead; /*!< Index of the next sample to be written, only written by the bus interrupt */
+	volatile uint16_t ringTail; /*!< Index of the next sample to be consumed, only written by the main loop */
+	uint16_t batchSamples; /*!< Number of samples being read from the FIFO */
+	uint32_t batchStamps[IMU_MAX_BATCH]; /*!< Data-ready time of each sample being read, in microseconds */
+	volatile uint32_t fifoOverflows; /*!< FIFO overflows, each one followed by a FIFO reset */
+	volatile uint32_t droppedSamples; /*!< Samples lost because the ring buffer was full */
+} imuInstance_t;
 
 /**
- * @var sensorData
- * @brief Instance of sensorData_t to hold processed sensor readings.
+ * @var imuDevices
+ * @brief Sensors sharing the bus, IMU_PRIMARY first.
  */
-static sensorData_t sensorData;
+static imuInstance_t imuDevices[IMU_DEVICES];
 
 /**
- * @struct gyroCal_t
- * @brief Structure to hold calibration values for the gyroscope.
+ * @var imuXferDevice
+ * @brief Sensor whose FIFO is being read.
  */
-typedef struct
+static volatile uint8_t imuXferDevice;
+
+/**
+ * @var imuConfig
+ * @brief Sample rate, bandwidth and full scale ranges in use.
+ */
+static imuConfig_t imuConfig =
+{ DEVICE_IMU_SAMPLE_RATE_HZ, DEVICE_IMU_DLPF, DEVICE_IMU_ACC_FSR,
+DEVICE_IMU_GYRO_FSR };
+
+/**
+ * @var imuFifoBatch
+ * @brief Samples read from the FIFO in each burst, scaled with the sample rate.
+ */
+static uint16_t imuFifoBatch = IMU_FIFO_BATCH;
+
+/**
+ * @var accScaleQ16
+ * @brief Reciprocal scale for converting raw accelerometer data to milli-g (Q16).
+ */
+static int32_t accScaleQ16;
+
+/**
+ * @var gyroScaleQ16
+ * @brief Reciprocal scale for converting raw gyroscope data to centi-degrees/s (Q16).
+ */
+static int32_t gyroScaleQ16;
+
+/**
+ * @var imuTransfer
+ * @brief Current stage of the FIFO batch read.
+ */
+static volatile imuTransfer_t imuTransfer;
+
+/**
+ * @var imuReadySamples
+ * @brief Data-ready interrupts since the last FIFO read.
+ */
+static volatile uint16_t imuReadySamples;
+
+/**
+ * @var htim2
+ * @brief Free-running 32-bit timer counting microseconds, timestamps the data-ready interrupts.
+ */
+static TIM_HandleTypeDef htim2;
+
+/**
+ * @var imuStamps
+ * @brief Time of the last data-ready interrupts, in microseconds.
+ */
+static volatile uint32_t imuStamps[IMU_STAMP_RING];
+
+/**
+ * @var imuStampCount
+ * @brief Data-ready interrupts timestamped, the next one goes to imuStamps[imuStampCount % IMU_STAMP_RING].
+ */
+static volatile uint32_t imuStampCount;
+
+/**
+ * @var imuStampValid
+ * @brief Consecutive data-ready times held by imuStamps, none missed in between.
+ */
+static volatile uint16_t imuStampValid;
+
+/**
+ * @var imuTiming
+ * @brief Statistics of the data-ready intervals, except the mean and the jitter.
+ */
+static imuTiming_t imuTiming;
+
+/**
+ * @var imuJitterSum
+ * @brief Sum of the deviations of the intervals from the nominal period, in microseconds.
+ */
+static int64_t imuJitterSum;
+
+/**
+ * @var imuJitterSumSq
+ * @brief Sum of the squared deviations of the intervals from the nominal period.
+ */
+static uint64_t imuJitterSumSq;
+
+/**
+ * @var imuAcquiring
+ * @brief Set while the samples are read on data-ready.
+ */
+static bool_t imuAcquiring;
+
+/**
+ * @var imuWakeOnMotion
+ * @brief Set while the sensor is in wake-on-motion mode.
+ */
+static volatile bool_t imuWakeOnMotion;
+
+/**
+ * @var imuMotionWake
+ * @brief Set by the interrupt when motion is detected in wake-on-motion mode.
+ */
+static volatile bool_t imuMotionWake;
+
+/**
+ * @enum imuRecovery_t
+ * @brief Stages of a bus recovery.
+ */
+typedef enum
 {
-	int16_t gx; /*!< Gyroscope x-axis calibration offset */
-	int16_t gy; /*!< Gyroscope y-axis calibration offset */
-	int16_t gz; /*!< Gyroscope z-axis calibration offset */
-} gyroCal_t;
+	IMU_RECOVERY_IDLE, /*!< No recovery in progress */
+	IMU_RECOVERY_RESET, /*!< Bus cleared, waiting for the sensor to restart */
+	IMU_RECOVERY_MAGN /*!< Sensor configured, waiting for the I2C master to restart the AK8963 */
+} imuRecovery_t;
+
+/**
+ * @var imuRecovery
+ * @brief Bus recovery in progress.
+ */
+static imuRecovery_t imuRecovery;
+
+/**
+ * @var imuRecoveryStart
+ * @brief Tick of the last step of the recovery in progress.
+ */
+static uint32_t imuRecoveryStart;
+
+/**
+ * @var imuLastData
+ * @brief Tick of the last completed FIFO read, or of the start of the acquisition.
+ */
+static volatile uint32_t imuLastData;
+
+/**
+ * @var imuFault
+ * @brief Set when too many consecutive bus errors occurred.
+ */
+static volatile bool_t imuFault;
+
+/**
+ * @var imuConsecutiveErrors
+ * @brief Bus errors since the last successful access.
+ */
+static volatile uint8_t imuConsecutiveErrors;
+
+/**
+ * @var imuBusErrors
+ * @brief Failed or timed out bus accesses.
+ */
+static volatile uint32_t imuBusErrors;
+
+/**
+ * @var imuBusRecoveries
+ * @brief Completed bus recoveries.
+ */
+static uint32_t imuBusRecoveries;
+
+/**
+ * @brief Initializes the EXTI line connected to the IMU INT pin.
+ * @note The interrupt is enabled once the acquisition starts.
+ */
+static void EXTI_Init(void);
+
+/**
+ * @brief Initializes TIM2 as a free-running microsecond counter.
+ */
+static void TIM2_Init(void);
+
+/**
+ * @brief Reads the timestamp timer.
+ * @return Time, in microseconds.
+ */
+static inline uint32_t imuPort_micros();
+
+/**
+ * @brief Records the time of a data-ready interrupt and updates the interval statistics.
+ * @param now Time of the interrupt, in microseconds.
+ * @note Called from interrupt context.
+ */
+static void imuPort_stampReady(uint32_t now);
+
+/**
+ * @brief Assigns a data-ready time to each sample of the FIFO batch about to be read.
+ * @param imu Sensor.
+ * @note Called from interrupt context, once the FIFO count is known.
+ *
+ * The newest sample of the FIFO came with the last data-ready interrupt, the older
+ * ones with the interrupts before it. Samples without a recorded interrupt, and
+ * those of the sensors that have no INT line, are spaced back at the nominal period.
+ */
+static void imuPort_stampBatch(imuInstance_t *imu);
+
+/**
+ * @brief Configures the sample rate and the data-ready interrupt, then starts the acquisition.
+ * @return True if every register was written, False otherwise (a recovery follows).
+ */
+static bool imuPort_startAcquisition();
+
+/**
+ * @brief Stops starting new transfers and waits for the current one, so blocking accesses can be made.
+ */
+static void imuPort_pauseAcquisition();
+
+/**
+ * @brief Resumes the acquisition after imuPort_pauseAcquisition().
+ */
+static void imuPort_resumeAcquisition();
+
+/**
+ * @brief Starts a stage of the FIFO batch read.
+ * @param stage Stage to start.
+ * @note Called from interrupt context.
+ */
+static void imuPort_startTransfer(imuTransfer_t stage);
+
+/**
+ * @brief Starts the FIFO read of the next present sensor, or ends the batch.
+ * @note Called from interrupt context.
+ */
+static void imuPort_nextDevice();
+
+/**
+ * @brief Converts a sample burst into raw data.
+ * @param imu Sensor.
+ * @param buffer Burst read from ACCEL_XOUT_H.
+ * @param raw Raw data.
+ */
+static void imuPort_parseRawData(imuInstance_t *imu, const uint8_t *buffer,
+		imuRaw_t *raw);
+
+/**
+ * @brief Counts the result of a bus access.
+ * @param ok Access result.
+ * @return The access result.
+ * @note Too many consecutive errors set the fault flag, which starts a recovery.
+ */
+static bool imuPort_busResult(bool ok);
+
+/**
+ * @brief Checks the bus and the data flow, and runs the bus recovery.
+ * @return True if the acquisition is running, False while the bus is being recovered.
+ */
+static bool imuPort_watchdog();
+
+/**
+ * @brief Recovers the bus with imuBus_Recover(), and resets the sensors.
+ */
+static void imuPort_startRecovery();
+
+/**
+ * @brief Configures the sensor again after it restarted.
+ * @param magnPending Set if an AK8963 restart was queued on the I2C master.
+ * @return True if the sensors answered and were configured, False otherwise.
+ * @note The acquisition is restarted by imuPort_reconfigureDone().
+ */
+static bool imuPort_reconfigure(bool *magnPending);
+
+/**
+ * @brief Ends a recovery: sets slave 0 to read the AK8963 again and restarts the acquisition.
+ * @return True if the acquisition restarted, False otherwise.
+ * @note Called once the I2C master ran the AK8963 restart queued by imuPort_reconfigure().
+ */
+static bool imuPort_reconfigureDone();
+
+/**
+ * @brief Reads registers of the IMU.
+ * @param imu Sensor.
+ * @param reg First register address.
+ * @param buffer Destination.
+ * @param length Number of registers.
+ * @return true if the read was acknowledged, false otherwise.
+ */
+static bool imuPort_readRegisters(imuInstance_t *imu, uint8_t reg,
+		uint8_t *buffer, uint16_t length);
 
 /**
- * @var gyroCal
- * @brief Instance of gyroCal_t to store gyroscope offset data.
+ * @brief Writes a register of the IMU.
+ * @param imu Sensor.
+ * @param reg Register address.
+ * @param value Value to write.
+ * @return true if the write was acknowledged, false otherwise.
  */
-static gyroCal_t gyroCal;
+static bool imuPort_writeRegister(imuInstance_t *imu, uint8_t reg,
+		uint8_t value);
 
 /**
- * @var accScaleFactor
- * @brief Scale factor for converting raw accelerometer data to g units.
+ * @brief Writes a register of the AK8963 through the auxiliary I2C master.
+ * @param imu Sensor.
+ * @param reg AK8963 register address.
+ * @param value Value to write.
+ * @return true if the access was made, false otherwise.
  */
-static float accScaleFactor;
+static bool imuPort_magnWrite(imuInstance_t *imu, uint8_t reg, uint8_t value);
 
 /**
- * @var gyroScaleFactor
- * @brief Scale factor for converting raw gyroscope data to degrees/s .
+ * @brief Queues a write of an AK8963 register on slave 0, without waiting for it.
+ * @param imu Sensor.
+ * @param reg AK8963 register address.
+ * @param value Value to write.
+ * @return true if slave 0 was set, false otherwise.
+ * @note The I2C master runs the access on the next sample, within IMU_MAGN_ACCESS_MS.
  */
-static float gyroScaleFactor;
+static bool imuPort_magnQueueWrite(imuInstance_t *imu, uint8_t reg,
+		uint8_t value);
 
 /**
- * @var hi2c1
- * @brief Handle for I2C1 used to communicate with the IMU.
+ * @brief Reads registers of the AK8963 through the auxiliary I2C master.
+ * @param imu Sensor.
+ * @param reg First AK8963 register address.
+ * @param buffer Destination.
+ * @param length Number of registers (1 to 15).
+ * @return true if the access was made, false otherwise.
  */
-static I2C_HandleTypeDef hi2c1;
+static bool imuPort_magnRead(imuInstance_t *imu, uint8_t reg, uint8_t *buffer,
+		uint8_t length);
 
 /**
- * @var imu_i2cAddress
- * @brief I2C address of the IMU device.
+ * @brief Initializes the AK8963 and sets slave 0 to read it along every sample.
+ * @param imu Sensor.
+ * @return true if the AK8963 was found, false otherwise.
  */
-static uint8_t imu_i2cAddress = MPU_9250_ADDRESS;
-;
+static bool imuPort_magnBegin(imuInstance_t *imu);
 
 /**
- * @brief Initializes I2C1 interface for IMU communication.
- * @note This function configures the I2C1 hardware settings and must be called before any IMU communication.
- * @param None
- * @retval None
+ * @brief Starts the AK8963 continuous measurement and sets slave 0 to read it along every sample.
+ * @param imu Sensor.
  */
-static void I2C1_Init(void);
+static void imuPort_magnStart(imuInstance_t *imu);
+
+/**
+ * @brief Sets slave 0 to read the AK8963 measurement along every sample.
+ * @param imu Sensor.
+ * @return true if slave 0 was set, false otherwise.
+ */
+static bool imuPort_magnStream(imuInstance_t *imu);
+
+/**
+ * @brief Converts the magnetometer data of the current sample.
+ * @param imu Sensor.
+ * @note Applies the factory sensitivity, the hard-iron and soft-iron calibration,
+ * and aligns the axes with the accelerometer and gyroscope.
+ */
+static void imuPort_processMagnData(imuInstance_t *imu);
 
 /**
  * @brief Initializes the IMU, checks connectivity, resets it, and configures full scale ranges for accelerometer and gyroscope.
+ * @param imu Sensor.
  * @param accScale Accelerometer full scale range selection: 0 for ±2g, 1 for ±4g, 2 for ±8g, 3 for ±16g.
  * @param gyroScale Gyroscope full scale range selection: 0 for ±250°/s, 1 for ±500°/s, 2 for ±1000°/s, 3 for ±2000°/s.
  * @return true if initialization was successful, false otherwise.
  */
-static bool imuPort_begin(uint8_t accScale, uint8_t gyroScale);
+static bool imuPort_begin(imuInstance_t *imu, uint8_t accScale,
+		uint8_t gyroScale);
 
 /**
- * @brief Reads raw sensor data from the IMU.
- * @note This function fetches raw data directly from the IMU registers.
+ * @brief Runs a step of the gyroscope calibration with the current raw sample.
+ * @param imu Sensor.
+ * @note The calibration restarts when the device moves.
  */
-static void imuPort_readRawData();
+static void imuPort_gyroCalUpdate(imuInstance_t *imu);
 
 /**
  * @brief Processes the raw data from the IMU to convert it into usable sensor values.
+ * @param imu Sensor.
  * @note This function calculates sensor values in real-world units, applying necessary scale factors.
  */
-static void imuPort_readProcessedData();
+static void imuPort_processData(imuInstance_t *imu);
 
 /**
  * @brief Writes the accelerometer full scale range to the IMU.
+ * @param imu Sensor.
  * @param accScale Accelerometer full scale range: 0 for ±2g, 1 for ±4g, 2 for ±8g, 3 for ±16g.
+ * @return True if the register was written, False otherwise.
  */
-static void imuPort_writeAccFullScaleRange(uint8_t accScale);
+static bool imuPort_writeAccFullScaleRange(imuInstance_t *imu,
+		uint8_t accScale);
 
 /**
  * @brief Writes the gyroscope full scale range to the IMU.
+ * @param imu Sensor.
  * @param gyroScale Gyroscope full scale range: 0 for ±250°/s, 1 for ±500°/s, 2 for ±1000°/s, 3 for ±2000°/s.
+ * @return True if the register was written, False otherwise.
+ */
+static bool imuPort_writeGyroFullScaleRange(imuInstance_t *imu,
+		uint8_t gyroScale);
+
+/**
+ * @brief Gets the sample rate divider closest to a sample rate.
+ * @param rateHz Sample rate, in Hz.
+ * @return SMPLRT_DIV value.
+ */
+static uint8_t imuPort_rateDivider(uint16_t rateHz);
+
+/**
+ * @brief Gets the number of samples skipped between two magnetometer reads at the current sample rate.
+ * @return I2C_MST_DLY value.
  */
-static void imuPort_writeGyroFullScaleRange(uint8_t gyroScale);
+static uint8_t imuPort_magnDelay();
 
 /**
- * @brief  This function is executed in case of error occurrence.
- * @param  None
- * @retval None
+ * @brief Converts the gyroscope offsets in counts to a new full scale range.
+ * @param imu Sensor.
+ * @param fromScale Previous reciprocal scale (Q16).
+ * @param toScale New reciprocal scale (Q16).
  */
-static void Error_Handler(void);
+static void imuPort_rescaleGyroOffsets(imuInstance_t *imu, int32_t fromScale,
+		int32_t toScale);
 
 /**
  * IMU Port Functions
@@ -234,8 +741,26 @@ static void Error_Handler(void);
 
 bool imuPort_Init()
 {
-	I2C1_Init();
-	if (imuPort_begin(ACC_FSR_4G, GYR_FSR_500DPS))
+	imuInstance_t *imu;
+
+	imuBus_Init();
+	EXTI_Init();
+	TIM2_Init();
+
+	// The other sensors are optional, the primary one paces the acquisition
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		imu = &imuDevices[i];
+		imu->id = (imuId_t) i;
+		imu->userCtrl = IMU_USER_CTRL_BUS;
+		imu->magnCal.matrix[0][0] = 65536;
+		imu->magnCal.matrix[1][1] = 65536;
+		imu->magnCal.matrix[2][2] = 65536;
+		imu->present = imuPort_begin(imu, imuConfig.accFsr,
+				imuConfig.gyroFsr);
+	}
+
+	if (imuDevices[IMU_PRIMARY].present && imuPort_startAcquisition())
 	{
 		BSP_LED_Off(LED_IMU);
 		return true;
@@ -249,262 +774,1476 @@ bool imuPort_Init()
 
 bool imuPort_Check()
 {
-	uint8_t buffer[1];
-
-	// Confirm device
-	HAL_I2C_Mem_Read(&hi2c1, imu_i2cAddress << 1, WHO_AM_I, 1, buffer, 1,
-			IMU_I2C_TIMEOUT_MS);
+	uint8_t buffer[1] =
+	{ 0 };
+	bool retVal = true;
 
-	return (buffer[0] == WHO_AM_I_9250_VALUE) ? true : false;
-}
-
-bool imuPort_AccReadData(acc_t *acc)
-{
-	imuPort_readProcessedData();
+	// the sensor is restarting
+	if (imuRecovery != IMU_RECOVERY_IDLE)
+		return false;
 
-	acc->ax = sensorData.ax;
-	acc->ay = sensorData.ay;
-	acc->az = sensorData.az;
+	// Confirm devices
+	imuPort_pauseAcquisition();
+	for (uint8_t i = 0; (i < IMU_DEVICES) && retVal; i++)
+	{
+		if (imuDevices[i].present)
+		{
+			buffer[0] = 0;
+			retVal = imuPort_readRegisters(&imuDevices[i], WHO_AM_I, buffer, 1)
+					&& (buffer[0] == WHO_AM_I_9250_VALUE);
+		}
+	}
+	imuPort_resumeAcquisition();
 
-	return true;
+	return retVal;
 }
 
-bool imuPort_TempReadData(temp_t *temp)
+bool imuPort_Present(imuId_t id)
 {
-	// todo: not implemented yet
-	return false;
+	return (id < IMU_DEVICES) && imuDevices[id].present;
 }
 
-bool imuPort_GyroReadData(gyro_t *gyro)
+bool imuPort_NextSample(imuId_t id)
 {
-	imuPort_readProcessedData();
+	imuInstance_t *imu;
+	uint16_t tail;
+
+	if (!imuPort_watchdog() || !imuPort_Present(id))
+		return false;
+
+	imu = &imuDevices[id];
+	tail = imu->ringTail;
+	if (tail == imu->ringHead)
+		return false;
+
+	imu->rawData = imu->ring[tail];
+	__DMB();
+	imu->ringTail = (tail + 1) & (IMU_RING_SIZE - 1);
 
-	gyro->gx = sensorData.gx;
-	gyro->gy = sensorData.gy;
-	gyro->gz = sensorData.gz;
+	if (imu->gyroCalData.state != GYRO_CAL_DONE)
+	{
+		imuPort_gyroCalUpdate(imu);
+	}
+	imuPort_processData(imu);
 
 	return true;
 }
 
-bool imuPort_MagnReadData(magn_t *magn)
+bool imuPort_ReadSnapshot(imuId_t id, imuSnapshot_t *snapshot)
 {
-	// todo: not implemented yet
-	return false;
+	if (!imuPort_NextSample(id))
+		return false;
+
+	imuPort_AccReadData(id, &snapshot->acc);
+	imuPort_TempReadData(id, &snapshot->temp);
+	imuPort_GyroReadData(id, &snapshot->gyro);
+	imuPort_MagnReadData(id, &snapshot->magn);
+	snapshot->timestamp = imuDevices[id].sensorData.timestamp;
+	snapshot->timestampUs = imuDevices[id].sensorData.timestampUs;
+
+	return true;
 }
 
-/// @brief Find offsets for each axis of gyroscope.
-void imuPort_calibrateGyro()
+uint16_t imuPort_ReadBatch(imuId_t id, acc_t *acc, gyro_t *gyro,
+		uint16_t max)
 {
-	int32_t gx = 0;
-	int32_t gy = 0;
-	int32_t gz = 0;
+	uint16_t n = 0;
 
-	// Save specified number of points
-	for (uint16_t i = 0; i < IMU_GYRO_CAL_POINTS; i++)
+	while ((n < max) && imuPort_NextSample(id))
 	{
-		imuPort_readRawData();
-
-		gx += rawData.gx;
-		gy += rawData.gy;
-		gz += rawData.gz;
-
-		HAL_Delay(10); // @todo: improve this method
+		if (acc != NULL)
+		{
+			imuPort_AccReadData(id, &acc[n]);
+		}
+		if (gyro != NULL)
+		{
+			imuPort_GyroReadData(id, &gyro[n]);
+		}
+		n++;
 	}
 
-	// Average the saved data points to find the gyroscope offset
-	gyroCal.gx = (int16_t) (gx / IMU_GYRO_CAL_POINTS);
-	gyroCal.gy = (int16_t) (gy / IMU_GYRO_CAL_POINTS);
-	gyroCal.gz = (int16_t) (gz / IMU_GYRO_CAL_POINTS);
+	return n;
 }
 
-static bool imuPort_begin(uint8_t accScale, uint8_t gyroScale)
+uint32_t imuPort_DroppedSamples(imuId_t id)
 {
-	// Initialize variables
-	uint8_t buffer[1];
+	return (id < IMU_DEVICES) ? imuDevices[id].droppedSamples : 0;
+}
 
-	// Confirm device
-	HAL_I2C_Mem_Read(&hi2c1, imu_i2cAddress << 1, WHO_AM_I, 1, buffer, 1,
-			IMU_I2C_TIMEOUT_MS);
+uint32_t imuPort_FifoOverflows(imuId_t id)
+{
+	return (id < IMU_DEVICES) ? imuDevices[id].fifoOverflows : 0;
+}
 
-	if (buffer[0] == WHO_AM_I_9250_VALUE)
+void imuPort_GetTiming(imuTiming_t *timing)
+{
+	uint32_t enabled = NVIC_GetEnableIRQ(IMU_INT_EXTI_IRQn);
+	int64_t sum;
+	uint64_t sumSq;
+	float mean;
+	float variance;
+
+	// consistent copy, the statistics are updated by the data-ready interrupt
+	HAL_NVIC_DisableIRQ(IMU_INT_EXTI_IRQn);
+	*timing = imuTiming;
+	sum = imuJitterSum;
+	sumSq = imuJitterSumSq;
+	if (enabled)
 	{
-		// Startup / reset the sensor
-		buffer[0] = 0x00;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, PWR_MGMT_1, 1, buffer, 1,
-				IMU_I2C_TIMEOUT_MS);
-
-		// Set the full scale ranges
-		imuPort_writeAccFullScaleRange(accScale);
-
-		imuPort_writeGyroFullScaleRange(gyroScale);
-		imuPort_calibrateGyro();
-
-		return true;
+		HAL_NVIC_EnableIRQ(IMU_INT_EXTI_IRQn);
 	}
-	else
+
+	timing->periodUs = IMU_SAMPLE_PERIOD_US;
+	timing->meanUs = 0.0f;
+	timing->jitterUs = 0.0f;
+	if (timing->intervals > 0)
 	{
-		return false;
+		mean = (float) sum / timing->intervals;
+		variance = (float) sumSq / timing->intervals - mean * mean;
+		timing->meanUs = (float) timing->periodUs + mean;
+		timing->jitterUs = (variance > 0.0f) ? sqrtf(variance) : 0.0f;
 	}
 }
 
-static void imuPort_readRawData()
+void imuPort_ResetTiming()
 {
-	uint8_t buffer[14];
-
-	// Subroutine for reading the raw data
-	HAL_I2C_Mem_Read(&hi2c1, imu_i2cAddress << 1, ACCEL_XOUT_H, 1, buffer, 14,
-			IMU_I2C_TIMEOUT_MS);
+	uint32_t enabled = NVIC_GetEnableIRQ(IMU_INT_EXTI_IRQn);
+
+	HAL_NVIC_DisableIRQ(IMU_INT_EXTI_IRQn);
+	imuTiming.intervals = 0;
+	imuTiming.missed = 0;
+	imuTiming.minUs = UINT32_MAX;
+	imuTiming.maxUs = 0;
+	imuJitterSum = 0;
+	imuJitterSumSq = 0;
+	if (enabled)
+	{
+		HAL_NVIC_EnableIRQ(IMU_INT_EXTI_IRQn);
+	}
+}
+
+bool imuPort_RawReadData(imuId_t id, imuRaw_t *raw)
+{
+	if (id >= IMU_DEVICES)
+		return false;
+
+	*raw = imuDevices[id].rawData;
+
+	return true;
+}
+
+void imuPort_GetRawCalibration(imuId_t id, imuRawCal_t *cal)
+{
+	imuInstance_t *imu;
+
+	if (id >= IMU_DEVICES)
+		return;
+
+	imu = &imuDevices[id];
+	cal->gyroOffset[0] = imu->gyroCal.gx;
+	cal->gyroOffset[1] = imu->gyroCal.gy;
+	cal->gyroOffset[2] = imu->gyroCal.gz;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		cal->magnAsa[i] = imu->magnAsaQ16[i];
+	}
+}
+
+uint32_t imuPort_BusErrors()
+{
+	return imuBusErrors;
+}
+
+uint32_t imuPort_BusRecoveries()
+{
+	return imuBusRecoveries;
+}
+
+bool imuPort_Recovering()
+{
+	return (imuRecovery != IMU_RECOVERY_IDLE);
+}
+
+bool imuPort_AccReadData(imuId_t id, acc_t *acc)
+{
+	if (id >= IMU_DEVICES)
+		return false;
+
+	acc->ax = imuDevices[id].sensorData.acc.ax;
+	acc->ay = imuDevices[id].sensorData.acc.ay;
+	acc->az = imuDevices[id].sensorData.acc.az;
+
+	return true;
+}
+
+bool imuPort_TempReadData(imuId_t id, temp_t *temp)
+{
+	if (id >= IMU_DEVICES)
+		return false;
+
+	*temp = imuDevices[id].sensorData.temp;
+
+	return true;
+}
+
+bool imuPort_GyroReadData(imuId_t id, gyro_t *gyro)
+{
+	if (id >= IMU_DEVICES)
+		return false;
+
+	gyro->gx = imuDevices[id].sensorData.gyro.gx;
+	gyro->gy = imuDevices[id].sensorData.gyro.gy;
+	gyro->gz = imuDevices[id].sensorData.gyro.gz;
+
+	return true;
+}
+
+bool imuPort_MagnReadData(imuId_t id, magn_t *magn)
+{
+	if (id >= IMU_DEVICES)
+		return false;
+
+	magn->mx = imuDevices[id].sensorData.magn.mx;
+	magn->my = imuDevices[id].sensorData.magn.my;
+	magn->mz = imuDevices[id].sensorData.magn.mz;
+
+	return imuDevices[id].sensorData.magnValid;
+}
+
+void imuPort_MagnSetCalibration(imuId_t id, const magnCal_t *cal)
+{
+	if (id < IMU_DEVICES)
+	{
+		imuDevices[id].magnCal = *cal;
+	}
+}
+
+void imuPort_MagnGetCalibration(imuId_t id, magnCal_t *cal)
+{
+	if (id < IMU_DEVICES)
+	{
+		*cal = imuDevices[id].magnCal;
+	}
+}
+
+void imuPort_MagnCalibrationStart(imuId_t id)
+{
+	imuInstance_t *imu;
+
+	if (id >= IMU_DEVICES)
+		return;
+
+	imu = &imuDevices[id];
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		imu->magnMin[i] = INT16_MAX;
+		imu->magnMax[i] = INT16_MIN;
+	}
+	imu->magnCalibrating = true;
+}
+
+bool imuPort_MagnCalibrationStop(imuId_t id)
+{
+	imuInstance_t *imu;
+	int32_t radius[3];
+	int32_t average = 0;
+	uint8_t i;
+
+	if (id >= IMU_DEVICES)
+		return false;
+
+	imu = &imuDevices[id];
+	imu->magnCalibrating = false;
+
+	for (i = 0; i < 3; i++)
+	{
+		radius[i] = ((int32_t) imu->magnMax[i] - imu->magnMin[i]) / 2;
+		if (radius[i] < IMU_MAGN_CAL_MIN_RANGE / 2)
+			return false;
+
+		average += radius[i];
+	}
+	average /= 3;
+
+	// hard iron: centre of the readings, soft iron: axes scaled to the average radius
+	for (i = 0; i < 3; i++)
+	{
+		imu->magnCal.offset[i] = (int16_t) (((int32_t) imu->magnMax[i]
+				+ imu->magnMin[i]) / 2);
+		imu->magnCal.matrix[i][0] = 0;
+		imu->magnCal.matrix[i][1] = 0;
+		imu->magnCal.matrix[i][2] = 0;
+		imu->magnCal.matrix[i][i] = (int32_t) (((int64_t) average << 16)
+				/ radius[i]);
+	}
+
+	return true;
+}
+
+void imuPort_calibrateGyro(imuId_t id)
+{
+	if (id >= IMU_DEVICES)
+		return;
+
+	// The offsets in use are kept until the new ones are ready
+	imuDevices[id].gyroCalData.state = GYRO_CAL_SETTLE;
+	imuDevices[id].gyroCalData.count = 0;
+	imuDevices[id].gyroCalData.restarts = 0;
+}
+
+bool imuPort_EnterWakeOnMotion(uint16_t thresholdMg)
+{
+	imuInstance_t *imu = &imuDevices[IMU_PRIMARY];
+	uint16_t threshold = thresholdMg / WOM_THR_LSB_MG;
+	bool retVal = true;
+
+	if (imuRecovery != IMU_RECOVERY_IDLE)
+		return false;
+
+	imuPort_pauseAcquisition();
+	imuAcquiring = false;
+
+	// Stop the magnetometers, the I2C masters and the FIFOs
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		if (!imuDevices[i].present)
+			continue;
+
+		if (imuDevices[i].magnPresent)
+		{
+			imuPort_writeRegister(&imuDevices[i], I2C_SLV0_CTRL, 0);
+			imuPort_magnWrite(&imuDevices[i], AK8963_CNTL1,
+			AK8963_CNTL1_POWER_DOWN);
+		}
+		imuPort_writeRegister(&imuDevices[i], USER_CTRL, IMU_USER_CTRL_BUS);
+
+		// only the primary sensor wakes the MCU, the others sleep
+		if (i != IMU_PRIMARY)
+		{
+			retVal = imuPort_writeRegister(&imuDevices[i], PWR_MGMT_1,
+			PWR_MGMT_1_SLEEP) && retVal;
+		}
+	}
+
+	// Low power accelerometer only, compared with the previous sample
+	retVal = imuPort_writeRegister(imu, PWR_MGMT_1, 0x00)
+			&& imuPort_writeRegister(imu, PWR_MGMT_2, PWR_MGMT_2_GYRO_OFF)
+			&& imuPort_writeRegister(imu, ACCEL_CONFIG2, ACCEL_CONFIG2_184HZ)
+			&& imuPort_writeRegister(imu, INT_ENABLE, INT_ENABLE_WOM)
+			&& imuPort_writeRegister(imu, MOT_DETECT_CTRL,
+			MOT_DETECT_CTRL_INTEL)
+			&& imuPort_writeRegister(imu, WOM_THR,
+					(threshold > 0xFF) ? 0xFF : (uint8_t) threshold)
+			&& imuPort_writeRegister(imu, LP_ACCEL_ODR, LP_ACCEL_ODR_31HZ)
+			&& imuPort_writeRegister(imu, PWR_MGMT_1, PWR_MGMT_1_CYCLE)
+			&& retVal;
+
+	imuMotionWake = false;
+	imuWakeOnMotion = true;
+	__HAL_GPIO_EXTI_CLEAR_IT(IMU_INT_Pin);
+	HAL_NVIC_EnableIRQ(IMU_INT_EXTI_IRQn);
+
+	return retVal;
+}
+
+bool imuPort_MotionWake()
+{
+	return imuMotionWake;
+}
+
+bool imuPort_ExitWakeOnMotion()
+{
+	imuInstance_t *imu;
+	bool retVal = true;
+
+	HAL_NVIC_DisableIRQ(IMU_INT_EXTI_IRQn);
+	imuWakeOnMotion = false;
 
+	// Back to gyro and accelerometer at the sample rate
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		imu = &imuDevices[i];
+		if (!imu->present)
+			continue;
+
+		retVal = imuPort_writeRegister(imu, PWR_MGMT_1, 0x00)
+				&& imuPort_writeRegister(imu, PWR_MGMT_2, 0x00)
+				&& imuPort_writeRegister(imu, MOT_DETECT_CTRL, 0x00) && retVal;
+
+		imuPort_writeRegister(imu, USER_CTRL, imu->userCtrl);
+		if (imu->magnPresent)
+		{
+			imuPort_magnStart(imu);
+		}
+	}
+
+	return imuPort_startAcquisition() && retVal;
+}
+
+bool imuPort_Stationary(imuId_t id)
+{
+	return (id < IMU_DEVICES)
+			&& (imuDevices[id].gyroBias.still
+					>= IMU_BIAS_STILL_SAMPLES(imuConfig.rateHz));
+}
+
+bool imuPort_GyroCalibrated(imuId_t id)
+{
+	return (id < IMU_DEVICES)
+			&& (imuDevices[id].gyroCalData.state == GYRO_CAL_DONE)
+			&& imuDevices[id].gyroCalData.valid;
+}
+
+uint32_t imuPort_GyroCalRestarts(imuId_t id)
+{
+	return (id < IMU_DEVICES) ? imuDevices[id].gyroCalData.restarts : 0;
+}
+
+bool imuPort_SetConfig(const imuConfig_t *config)
+{
+	int32_t gyroScale = gyroScaleQ16;
+	imuInstance_t *imu;
+	bool retVal = true;
+
+	if ((config->rateHz * (IMU_SMPLRT_DIV_MAX + 1) < IMU_INTERNAL_RATE_HZ)
+			|| (config->rateHz > IMU_INTERNAL_RATE_HZ)
+			|| (config->dlpf < IMU_DLPF_184HZ) || (config->dlpf > IMU_DLPF_5HZ)
+			|| (config->accFsr > ACC_FSR_16G)
+			|| (config->gyroFsr > GYR_FSR_2000DPS) || imuWakeOnMotion
+			|| (imuRecovery != IMU_RECOVERY_IDLE))
+		return false;
+
+	// No sample is converted while the registers and the scales change
+	imuPort_pauseAcquisition();
+
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		if (imuDevices[i].present)
+		{
+			retVal = imuPort_writeAccFullScaleRange(&imuDevices[i],
+					config->accFsr)
+					&& imuPort_writeGyroFullScaleRange(&imuDevices[i],
+							config->gyroFsr) && retVal;
+		}
+	}
+
+	imuConfig = *config;
+	imuConfig.rateHz = IMU_INTERNAL_RATE_HZ
+			/ (imuPort_rateDivider(config->rateHz) + 1);
+
+	// Same batch duration as at the default rate
+	imuFifoBatch = (IMU_FIFO_BATCH * imuConfig.rateHz)
+			/ DEVICE_IMU_SAMPLE_RATE_HZ;
+	imuFifoBatch = (imuFifoBatch < 1) ? 1 :
+			((imuFifoBatch > IMU_FIFO_BATCH) ? IMU_FIFO_BATCH : imuFifoBatch);
+
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		imu = &imuDevices[i];
+		if (!imu->present)
+			continue;
+
+		imuPort_rescaleGyroOffsets(imu, gyroScale, gyroScaleQ16);
+		if (imu->gyroCalData.state != GYRO_CAL_DONE)
+		{
+			// the samples collected so far are in the previous range
+			imu->gyroCalData.state = GYRO_CAL_SETTLE;
+			imu->gyroCalData.count = 0;
+		}
+
+		if (imu->magnPresent)
+		{
+			imuPort_writeRegister(imu, I2C_SLV4_CTRL, imuPort_magnDelay());
+		}
+	}
+
+	// Samples queued with the previous configuration are dropped, the intervals
+	// are measured again at the new rate
+	imuPort_ResetTiming();
+	return imuPort_startAcquisition() && retVal;
+}
+
+void imuPort_GetConfig(imuConfig_t *config)
+{
+	*config = imuConfig;
+}
+
+uint16_t imuPort_SampleRate()
+{
+	return imuConfig.rateHz;
+}
+
+static bool imuPort_begin(imuInstance_t *imu, uint8_t accScale,
+		uint8_t gyroScale)
+{
+	// Initialize variables
+	uint8_t buffer[1] =
+	{ 0 };
+
+	// Confirm device
+	if (imuPort_readRegisters(imu, WHO_AM_I, buffer, 1)
+			&& (buffer[0] == WHO_AM_I_9250_VALUE))
+	{
+		// Startup / reset the sensor, then set the full scale ranges
+		if (!imuPort_writeRegister(imu, USER_CTRL, imu->userCtrl)
+				|| !imuPort_writeRegister(imu, PWR_MGMT_1, 0x00)
+				|| !imuPort_writeAccFullScaleRange(imu, accScale)
+				|| !imuPort_writeGyroFullScaleRange(imu, gyroScale))
+			return false;
+
+		// The magnetometer is optional, the IMU works without it
+		imu->magnPresent = imuPort_magnBegin(imu);
+		imu->sampleBytes =
+				imu->magnPresent ? IMU_MAGN_SAMPLE_BYTES : IMU_SAMPLE_BYTES;
+
+		imu->gyroCalData.state = GYRO_CAL_SETTLE;
+		imu->gyroCalData.count = 0;
+		imu->gyroCalData.restarts = 0;
+
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+static void imuPort_parseRawData(imuInstance_t *imu, const uint8_t *buffer,
+		imuRaw_t *raw)
+{
 	// Bit shift the data
-	rawData.ax = buffer[0] << 8 | buffer[1];
-	rawData.ay = buffer[2] << 8 | buffer[3];
-	rawData.az = buffer[4] << 8 | buffer[5];
-	// temperature = buffer[6] << 8 | buffer[7];
-	rawData.gx = buffer[8] << 8 | buffer[9];
-	rawData.gy = buffer[10] << 8 | buffer[11];
-	rawData.gz = buffer[12] << 8 | buffer[13];
+	raw->ax = buffer[0] << 8 | buffer[1];
+	raw->ay = buffer[2] << 8 | buffer[3];
+	raw->az = buffer[4] << 8 | buffer[5];
+	raw->temp = buffer[6] << 8 | buffer[7];
+	raw->gx = buffer[8] << 8 | buffer[9];
+	raw->gy = buffer[10] << 8 | buffer[11];
+	raw->gz = buffer[12] << 8 | buffer[13];
+
+	// AK8963 data is little endian, its overflow flag is in ST2
+	if (imu->magnPresent
+			&& !(buffer[IMU_SAMPLE_BYTES + 6] & AK8963_ST2_HOFL))
+	{
+		raw->mx = buffer[IMU_SAMPLE_BYTES + 1] << 8 | buffer[IMU_SAMPLE_BYTES];
+		raw->my = buffer[IMU_SAMPLE_BYTES + 3] << 8
+				| buffer[IMU_SAMPLE_BYTES + 2];
+		raw->mz = buffer[IMU_SAMPLE_BYTES + 5] << 8
+				| buffer[IMU_SAMPLE_BYTES + 4];
+		raw->magn = true;
+	}
+	else
+	{
+		raw->mx = 0;
+		raw->my = 0;
+		raw->mz = 0;
+		raw->magn = false;
+	}
+}
+
+static void imuPort_processData(imuInstance_t *imu)
+{
+	int32_t cal[3] =
+	{ imu->gyroCal.gx, imu->gyroCal.gy, imu->gyroCal.gz };
+	int32_t offset[3];
+
+	// Convert accelerometer values to milli-g
+	imuConvert_Acc(&imu->rawData, accScaleQ16, &imu->sensorData.acc);
+
+	// Convert temperature to centi-degrees Celsius
+	imu->sensorData.temp = imuConvert_Temp(imu->rawData.temp);
+
+	// Offsets at the current temperature
+	imuConvert_GyroOffset(&imu->gyroBias, cal, imu->sensorData.temp, offset);
+
+	// Offsets are tracked once calibrated
+	if (imu->gyroCalData.valid && (imu->gyroCalData.state == GYRO_CAL_DONE))
+	{
+		imuConvert_GyroBiasUpdate(&imu->gyroBias, cal, &imu->rawData,
+				imu->sensorData.temp, offset, gyroScaleQ16, imuConfig.rateHz);
+		imu->gyroCal.gx = cal[0];
+		imu->gyroCal.gy = cal[1];
+		imu->gyroCal.gz = cal[2];
+	}
+
+	// Compensate offset and convert to centi-deg/s
+	imuConvert_Gyro(&imu->rawData, offset, gyroScaleQ16, &imu->sensorData.gyro);
+
+	imuPort_processMagnData(imu);
+
+	imu->sensorData.timestamp = imu->rawData.timestamp;
+	imu->sensorData.timestampUs = imu->rawData.timestampUs;
+}
+
+static void imuPort_processMagnData(imuInstance_t *imu)
+{
+	int32_t m[3];
+
+	imu->sensorData.magnValid = imu->rawData.magn;
+	if (!imu->rawData.magn)
+	{
+		imu->sensorData.magn.mx = 0;
+		imu->sensorData.magn.my = 0;
+		imu->sensorData.magn.mz = 0;
+		return;
+	}
+
+	// Factory sensitivity adjustment
+	imuConvert_MagnAdjust(&imu->rawData, imu->magnAsaQ16, m);
+
+	if (imu->magnCalibrating)
+	{
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			if (m[i] < imu->magnMin[i])
+				imu->magnMin[i] = (int16_t) m[i];
+			if (m[i] > imu->magnMax[i])
+				imu->magnMax[i] = (int16_t) m[i];
+		}
+	}
+
+	imuConvert_MagnCorrect(m, &imu->magnCal, &imu->sensorData.magn);
+}
+
+static void imuPort_gyroCalUpdate(imuInstance_t *imu)
+{
+	int32_t raw[3] =
+	{ imu->rawData.gx, imu->rawData.gy, imu->rawData.gz };
+	int32_t motion;
+	int64_t variance;
+	int64_t maxVariance;
+	uint8_t i;
+
+	if (imu->gyroCalData.state == GYRO_CAL_SETTLE)
+	{
+		if (++imu->gyroCalData.count >= IMU_GYRO_CAL_SETTLE)
+		{
+			imu->gyroCalData.state = GYRO_CAL_COLLECT;
+			imu->gyroCalData.count = 0;
+			for (i = 0; i < 3; i++)
+			{
+				imu->gyroCalData.sum[i] = 0;
+				imu->gyroCalData.sumSq[i] = 0;
+			}
+		}
+		return;
+	}
+
+	// Motion threshold in counts, for the current full scale range
+	motion = (IMU_GYRO_CAL_MOTION_CDPS << 16) / gyroScaleQ16;
+
+	for (i = 0; i < 3; i++)
+	{
+		// A reading away from the running mean means the device moved
+		if ((imu->gyroCalData.count > 0)
+				&& (labs(raw[i] * imu->gyroCalData.count
+						- imu->gyroCalData.sum[i])
+						> motion * imu->gyroCalData.count))
+		{
+			imu->gyroCalData.restarts++;
+			imu->gyroCalData.state = GYRO_CAL_SETTLE;
+			imu->gyroCalData.count = 0;
+			return;
+		}
+
+		imu->gyroCalData.sum[i] += raw[i];
+		imu->gyroCalData.sumSq[i] += (int64_t) raw[i] * raw[i];
+	}
+
+	if (++imu->gyroCalData.count < IMU_GYRO_CAL_POINTS)
+		return;
+
+	// Noise check: n^2 var = n sum(x^2) - sum(x)^2, limit in counts
+	maxVariance = ((int64_t) IMU_GYRO_CAL_MAX_STD_CDPS << 16) / gyroScaleQ16;
+	maxVariance *= maxVariance * IMU_GYRO_CAL_POINTS * IMU_GYRO_CAL_POINTS;
+	for (i = 0; i < 3; i++)
+	{
+		variance = imu->gyroCalData.sumSq[i] * IMU_GYRO_CAL_POINTS
+				- (int64_t) imu->gyroCalData.sum[i] * imu->gyroCalData.sum[i];
+		if (variance > maxVariance)
+		{
+			imu->gyroCalData.restarts++;
+			imu->gyroCalData.state = GYRO_CAL_SETTLE;
+			imu->gyroCalData.count = 0;
+			return;
+		}
+	}
+
+	// Average the saved data points to find the gyroscope offset
+	imu->gyroCal.gx = (int32_t) ((int64_t) imu->gyroCalData.sum[0]
+			* (1 << IMU_GYRO_CAL_FRAC_BITS) / IMU_GYRO_CAL_POINTS);
+	imu->gyroCal.gy = (int32_t) ((int64_t) imu->gyroCalData.sum[1]
+			* (1 << IMU_GYRO_CAL_FRAC_BITS) / IMU_GYRO_CAL_POINTS);
+	imu->gyroCal.gz = (int32_t) ((int64_t) imu->gyroCalData.sum[2]
+			* (1 << IMU_GYRO_CAL_FRAC_BITS) / IMU_GYRO_CAL_POINTS);
+	imu->gyroCalData.valid = true;
+	imu->gyroCalData.state = GYRO_CAL_DONE;
+
+	// the tracking restarts from the new offsets
+	imu->gyroBias.init = false;
+}
+
+static bool imuPort_writeRegister(imuInstance_t *imu, uint8_t reg,
+		uint8_t value)
+{
+	return imuPort_busResult(imuBus_Write(imu->id, reg, value));
+}
+
+static bool imuPort_readRegisters(imuInstance_t *imu, uint8_t reg,
+		uint8_t *buffer, uint16_t length)
+{
+	return imuPort_busResult(imuBus_Read(imu->id, reg, buffer, length));
+}
+
+static bool imuPort_busResult(bool ok)
+{
+	if (ok)
+	{
+		imuConsecutiveErrors = 0;
+	}
+	else
+	{
+		imuBusErrors++;
+		if (++imuConsecutiveErrors >= IMU_BUS_MAX_ERRORS)
+		{
+			imuFault = true;
+		}
+	}
+
+	return ok;
 }
 
-static void imuPort_readProcessedData()
+static bool imuPort_watchdog()
 {
-	// Get raw values from the IMU
-	imuPort_readRawData();
+	uint32_t lastData = imuLastData;
+	uint32_t stall;
+	bool magnPending;
+
+	if (imuRecovery == IMU_RECOVERY_RESET)
+	{
+		// non-blocking wait for the sensor to restart
+		if ((HAL_GetTick() - imuRecoveryStart) < IMU_RESET_MS)
+			return false;
+
+		if (!imuPort_reconfigure(&magnPending))
+		{
+			// still not responding, try again
+			imuPort_startRecovery();
+			return false;
+		}
+
+		// non-blocking wait for the I2C master to restart the AK8963
+		imuRecovery = IMU_RECOVERY_MAGN;
+		imuRecoveryStart = HAL_GetTick();
+		if (magnPending)
+			return false;
+	}
+
+	if (imuRecovery == IMU_RECOVERY_MAGN)
+	{
+		if ((HAL_GetTick() - imuRecoveryStart) < IMU_MAGN_ACCESS_MS)
+			return false;
+
+		if (!imuPort_reconfigureDone())
+		{
+			imuPort_startRecovery();
+			return false;
+		}
 
-	// Convert accelerometer values to g's
-	sensorData.ax = rawData.ax / accScaleFactor;
-	sensorData.ay = rawData.ay / accScaleFactor;
-	sensorData.az = rawData.az / accScaleFactor;
+		imuRecovery = IMU_RECOVERY_IDLE;
+		imuBusRecoveries++;
+		return true;
+	}
 
-	// Compensate offset and convert to deg/s
-	sensorData.gx = (rawData.gx - gyroCal.gx) / gyroScaleFactor;
-	sensorData.gy = (rawData.gy - gyroCal.gy) / gyroScaleFactor;
-	sensorData.gz = (rawData.gz - gyroCal.gz) / gyroScaleFactor;
+	if (!imuAcquiring)
+		return true;
+
+	// several batches without data: the bus or the INT line hangs
+	stall = IMU_STALL_MIN_MS + (4000UL * imuFifoBatch) / imuConfig.rateHz;
+	if (imuFault || ((HAL_GetTick() - lastData) > stall))
+	{
+		imuPort_startRecovery();
+		return false;
+	}
+
+	return true;
+}
+
+static void imuPort_startRecovery()
+{
+	HAL_NVIC_DisableIRQ(IMU_INT_EXTI_IRQn);
+	imuAcquiring = false;
+	imuTransfer = IMU_XFER_IDLE;
+
+	// Abort the transfer in progress, release the bus and reset the peripheral
+	if (!imuBus_Recover())
+	{
+		imuBusErrors++;
+	}
+
+	// Reset the sensors, their registers are written again once they restarted
+	imuFault = false;
+	imuConsecutiveErrors = 0;
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		if (imuDevices[i].present)
+		{
+			imuPort_writeRegister(&imuDevices[i], PWR_MGMT_1,
+			PWR_MGMT_1_H_RESET);
+		}
+	}
+	imuRecovery = IMU_RECOVERY_RESET;
+	imuRecoveryStart = HAL_GetTick();
 }
 
-static void imuPort_writeAccFullScaleRange(uint8_t accScale)
+static bool imuPort_reconfigure(bool *magnPending)
+{
+	imuInstance_t *imu;
+	uint8_t buffer[1];
+
+	*magnPending = false;
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		imu = &imuDevices[i];
+		if (!imu->present)
+			continue;
+
+		buffer[0] = 0;
+		if (!imuPort_readRegisters(imu, WHO_AM_I, buffer, 1)
+				|| (buffer[0] != WHO_AM_I_9250_VALUE))
+			return false;
+
+		if (!imuPort_writeRegister(imu, USER_CTRL, imu->userCtrl)
+				|| !imuPort_writeRegister(imu, PWR_MGMT_1, 0x00)
+				|| !imuPort_writeAccFullScaleRange(imu, imuConfig.accFsr)
+				|| !imuPort_writeGyroFullScaleRange(imu, imuConfig.gyroFsr))
+			return false;
+
+		// The AK8963 keeps its calibration, only the I2C master is set again and
+		// the continuous measurement restarted
+		if (imu->magnPresent)
+		{
+			if (!imuPort_writeRegister(imu, I2C_MST_CTRL, I2C_MST_CTRL_400KHZ)
+					|| !imuPort_magnQueueWrite(imu, AK8963_CNTL1,
+							AK8963_CNTL1_CONT2_16B))
+				return false;
+			*magnPending = true;
+		}
+	}
+
+	return true;
+}
+
+static bool imuPort_reconfigureDone()
+{
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
+	{
+		// the queued write ran, slave 0 then reads the measurement instead
+		if (imuDevices[i].present && imuDevices[i].magnPresent
+				&& (!imuPort_writeRegister(&imuDevices[i], I2C_SLV0_CTRL, 0)
+						|| !imuPort_magnStream(&imuDevices[i])))
+			return false;
+	}
+
+	// The gyroscope offsets are kept
+	return imuPort_startAcquisition();
+}
+
+static bool imuPort_magnWrite(imuInstance_t *imu, uint8_t reg, uint8_t value)
+{
+	bool retVal;
+
+	retVal = imuPort_magnQueueWrite(imu, reg, value);
+
+	// the I2C master runs the access on the next sample
+	HAL_Delay(IMU_MAGN_ACCESS_MS);
+	imuPort_writeRegister(imu, I2C_SLV0_CTRL, 0);
+
+	return retVal;
+}
+
+static bool imuPort_magnQueueWrite(imuInstance_t *imu, uint8_t reg,
+		uint8_t value)
+{
+	return imuPort_writeRegister(imu, I2C_SLV0_ADDR, AK8963_ADDRESS)
+			&& imuPort_writeRegister(imu, I2C_SLV0_REG, reg)
+			&& imuPort_writeRegister(imu, I2C_SLV0_DO, value)
+			&& imuPort_writeRegister(imu, I2C_SLV0_CTRL, I2C_SLV_EN | 1);
+}
+
+static bool imuPort_magnRead(imuInstance_t *imu, uint8_t reg, uint8_t *buffer,
+		uint8_t length)
+{
+	bool retVal;
+
+	retVal = imuPort_writeRegister(imu, I2C_SLV0_ADDR,
+	I2C_SLV_READ | AK8963_ADDRESS)
+			&& imuPort_writeRegister(imu, I2C_SLV0_REG, reg)
+			&& imuPort_writeRegister(imu, I2C_SLV0_CTRL, I2C_SLV_EN | length);
+
+	HAL_Delay(IMU_MAGN_ACCESS_MS);
+	imuPort_writeRegister(imu, I2C_SLV0_CTRL, 0);
+
+	return retVal && imuPort_readRegisters(imu, EXT_SENS_DATA_00, buffer, length);
+}
+
+static bool imuPort_magnBegin(imuInstance_t *imu)
+{
+	uint8_t buffer[3];
+
+	// Enable the auxiliary I2C master at 400 kHz
+	imu->userCtrl |= USER_CTRL_I2C_MST_EN;
+	if (!imuPort_writeRegister(imu, USER_CTRL, imu->userCtrl)
+			|| !imuPort_writeRegister(imu, I2C_MST_CTRL, I2C_MST_CTRL_400KHZ))
+	{
+		imu->userCtrl &= ~USER_CTRL_I2C_MST_EN;
+		return false;
+	}
+
+	// Reset and confirm device
+	imuPort_magnWrite(imu, AK8963_CNTL2, AK8963_CNTL2_SRST);
+	if (!imuPort_magnRead(imu, AK8963_WHO_AM_I, buffer, 1)
+			|| (buffer[0] != AK8963_WHOAMI_VALUE))
+	{
+		imu->userCtrl &= ~USER_CTRL_I2C_MST_EN;
+		imuPort_writeRegister(imu, USER_CTRL, imu->userCtrl);
+		return false;
+	}
+
+	// Factory sensitivity adjustment: (ASA - 128) / 256 + 1
+	imuPort_magnWrite(imu, AK8963_CNTL1, AK8963_CNTL1_POWER_DOWN);
+	imuPort_magnWrite(imu, AK8963_CNTL1, AK8963_CNTL1_FUSE_ROM);
+	imuPort_magnRead(imu, AK8963_ASAX, buffer, 3);
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		imu->magnAsaQ16[i] = ((int32_t) buffer[i] + 128) << 8;
+	}
+	imuPort_magnWrite(imu, AK8963_CNTL1, AK8963_CNTL1_POWER_DOWN);
+	imuPort_magnStart(imu);
+
+	return true;
+}
+
+static void imuPort_magnStart(imuInstance_t *imu)
+{
+	imuPort_magnWrite(imu, AK8963_CNTL1, AK8963_CNTL1_CONT2_16B);
+	imuPort_magnStream(imu);
+}
+
+static bool imuPort_magnStream(imuInstance_t *imu)
+{
+	// Slave 0 reads the measurement into EXT_SENS_DATA at the magnetometer rate
+	return imuPort_writeRegister(imu, I2C_SLV4_CTRL, imuPort_magnDelay())
+			&& imuPort_writeRegister(imu, I2C_MST_DELAY_CTRL, I2C_MST_DLY_SLV0)
+			&& imuPort_writeRegister(imu, I2C_SLV0_ADDR,
+					I2C_SLV_READ | AK8963_ADDRESS)
+			&& imuPort_writeRegister(imu, I2C_SLV0_REG, AK8963_HXL)
+			&& imuPort_writeRegister(imu, I2C_SLV0_CTRL,
+					I2C_SLV_EN | AK8963_DATA_BYTES);
+}
+
+static bool imuPort_writeAccFullScaleRange(imuInstance_t *imu, uint8_t accScale)
 {
 	// Variable init
+	int32_t scale = imuConvert_AccScale(accScale);
 	uint8_t select;
 
 	// Set the value
 	switch (accScale)
 	{
 	case ACC_FSR_2G:
-		accScaleFactor = ACC_FSR_2G_FACTOR;
 		select = 0x00;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, ACCEL_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 
 	case ACC_FSR_4G:
-		accScaleFactor = ACC_FSR_4G_FACTOR;
 		select = 0x08;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, ACCEL_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 
 	case ACC_FSR_8G:
-		accScaleFactor = ACC_FSR_8G_FACTOR;
 		select = 0x10;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, ACCEL_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 
 	case ACC_FSR_16G:
-		accScaleFactor = ACC_FSR_16G_FACTOR;
 		select = 0x18;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, ACCEL_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 
 	default:
-		accScaleFactor = ACC_FSR_4G_FACTOR;
 		select = 0x08;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, ACCEL_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 	}
+
+	// the scale only follows a range the sensor was set to
+	if (!imuPort_writeRegister(imu, ACCEL_CONFIG, select))
+		return false;
+
+	accScaleQ16 = scale;
+
+	return true;
 }
 
-static void imuPort_writeGyroFullScaleRange(uint8_t gyroScale)
+static bool imuPort_writeGyroFullScaleRange(imuInstance_t *imu,
+		uint8_t gyroScale)
 {
 	// Variable init
+	int32_t scale = imuConvert_GyroScale(gyroScale);
 	uint8_t select;
 
 	// Set the value
 	switch (gyroScale)
 	{
 	case GYR_FSR_250DPS:
-		gyroScaleFactor = GYR_FSR_250DPS_FACTOR;
 		select = 0x00;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, GYRO_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 	case GYR_FSR_500DPS:
-		gyroScaleFactor = GYR_FSR_500DPS_FACTOR;
 		select = 0x08;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, GYRO_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 	case GYR_FSR_1000DPS:
-		gyroScaleFactor = GYR_FSR_1000DPS_FACTOR;
 		select = 0x10;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, GYRO_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 	case GYR_FSR_2000DPS:
-		gyroScaleFactor = GYR_FSR_2000DPS_FACTOR;
 		select = 0x18;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, GYRO_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 	default:
-		gyroScaleFactor = GYR_FSR_500DPS_FACTOR;
 		select = 0x08;
-		HAL_I2C_Mem_Write(&hi2c1, imu_i2cAddress << 1, GYRO_CONFIG, 1, &select,
-				1, IMU_I2C_TIMEOUT_MS);
 		break;
 	}
+
+	// the scale only follows a range the sensor was set to
+	if (!imuPort_writeRegister(imu, GYRO_CONFIG, select))
+		return false;
+
+	gyroScaleQ16 = scale;
+
+	return true;
 }
 
-static void I2C1_Init(void)
+static uint8_t imuPort_rateDivider(uint16_t rateHz)
 {
+	uint16_t div = (IMU_INTERNAL_RATE_HZ + rateHz / 2) / rateHz;
 
-	hi2c1.Instance = I2C1;
-	hi2c1.Init.ClockSpeed = 400000;
-	hi2c1.Init.DutyCycle = I2C_DUTYCYCLE_2;
-	hi2c1.Init.OwnAddress1 = 0;
-	hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
-	hi2c1.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
-	hi2c1.Init.OwnAddress2 = 0;
-	hi2c1.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
-	hi2c1.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
-	if (HAL_I2C_Init(&hi2c1) != HAL_OK)
+	if (div < 1)
 	{
-		Error_Handler();
+		div = 1;
 	}
 
-	/** Configure Analogue filter
-	 */
-	if (HAL_I2CEx_ConfigAnalogFilter(&hi2c1, I2C_ANALOGFILTER_ENABLE) != HAL_OK)
+	return (div > IMU_SMPLRT_DIV_MAX + 1) ? IMU_SMPLRT_DIV_MAX : div - 1;
+}
+
+static uint8_t imuPort_magnDelay()
+{
+	uint16_t ratio = imuConfig.rateHz / AK8963_RATE_HZ;
+
+	if (ratio > IMU_MAGN_MAX_DELAY + 1)
+		return IMU_MAGN_MAX_DELAY;
+
+	return (ratio > 1) ? ratio - 1 : 0;
+}
+
+static void imuPort_rescaleGyroOffsets(imuInstance_t *imu, int32_t fromScale,
+		int32_t toScale)
+{
+	int32_t *cal[3] =
+	{ &imu->gyroCal.gx, &imu->gyroCal.gy, &imu->gyroCal.gz };
+
+	if (fromScale == toScale)
+		return;
+
+	// counts * scale is the same angular velocity in both ranges
+	for (uint8_t i = 0; i < 3; i++)
 	{
-		Error_Handler();
+		*cal[i] = (int32_t) (((int64_t) *cal[i] * fromScale) / toScale);
+		imu->gyroBias.track[i] = (int32_t) (((int64_t) imu->gyroBias.track[i]
+				* fromScale) / toScale);
+		imu->gyroBias.tempco[i] = (int32_t) (((int64_t) imu->gyroBias.tempco[i]
+				* fromScale) / toScale);
+		imu->gyroBias.anchorOffset[i] = (int32_t) (((int64_t)
+				imu->gyroBias.anchorOffset[i] * fromScale) / toScale);
 	}
+	imu->gyroBias.still = 0;
+}
+
+static bool imuPort_startAcquisition()
+{
+	imuInstance_t *imu;
+	bool retVal = true;
 
-	/** Configure Digital filter
-	 */
-	if (HAL_I2CEx_ConfigDigitalFilter(&hi2c1, 0) != HAL_OK)
+	for (uint8_t i = 0; i < IMU_DEVICES; i++)
 	{
-		Error_Handler();
+		imu = &imuDevices[i];
+		if (!imu->present)
+			continue;
+
+		// Sample rate = internal rate / (1 + SMPLRT_DIV), the bandwidth sets the
+		// internal rate to 1 kHz for both the gyro and the accelerometer
+		retVal = retVal && imuPort_writeRegister(imu, CONFIG, imuConfig.dlpf)
+				&& imuPort_writeRegister(imu, ACCEL_CONFIG2, imuConfig.dlpf)
+				&& imuPort_writeRegister(imu, SMPLRT_DIV,
+						imuPort_rateDivider(imuConfig.rateHz));
+
+		// Every sample is queued in the FIFO, starting from an empty one
+		retVal = retVal
+				&& imuPort_writeRegister(imu, USER_CTRL,
+						imu->userCtrl | USER_CTRL_FIFO_RST)
+				&& imuPort_writeRegister(imu, FIFO_EN,
+						FIFO_EN_TEMP_GYRO_ACCEL
+								| (imu->magnPresent ? FIFO_EN_SLV0 : 0))
+				&& imuPort_writeRegister(imu, USER_CTRL,
+						imu->userCtrl | USER_CTRL_FIFO_EN);
+
+		// Data-ready pulses on INT, only wired on the primary sensor. Every pulse
+		// is counted as a sample, so the overflow is not routed to the pin, it is
+		// read from INT_STATUS before each batch
+		retVal = retVal
+				&& imuPort_writeRegister(imu, INT_PIN_CFG, INT_PIN_CFG_PULSE)
+				&& imuPort_writeRegister(imu, INT_ENABLE,
+						(i == IMU_PRIMARY) ? INT_ENABLE_RAW_RDY : 0);
+
+		imu->ringHead = 0;
+		imu->ringTail = 0;
+		imu->droppedSamples = 0;
+		imu->fifoOverflows = 0;
+	}
+
+	imuReadySamples = 0;
+	imuStampValid = 0;
+	imuTransfer = IMU_XFER_IDLE;
+	imuLastData = HAL_GetTick();
+
+	// a failed write is recovered by the watchdog
+	imuFault = imuFault || !retVal;
+	imuAcquiring = true;
+
+	__HAL_GPIO_EXTI_CLEAR_IT(IMU_INT_Pin);
+	HAL_NVIC_EnableIRQ(IMU_INT_EXTI_IRQn);
+
+	return retVal;
+}
+
+static void imuPort_pauseAcquisition()
+{
+	uint32_t tickstart = HAL_GetTick();
+
+	HAL_NVIC_DisableIRQ(IMU_INT_EXTI_IRQn);
+	// the samples queued meanwhile have no data-ready time
+	imuStampValid = 0;
+
+	// let the batch read in progress finish
+	while ((imuTransfer != IMU_XFER_IDLE) || imuBus_Busy())
+	{
+		if ((HAL_GetTick() - tickstart) >= IMU_XFER_TIMEOUT_MS)
+		{
+			// the bus hangs, recovered by the watchdog
+			imuFault = true;
+			break;
+		}
+	}
+}
+
+static void imuPort_resumeAcquisition()
+{
+	// the sensor keeps queueing samples in its FIFO meanwhile
+	if (imuAcquiring)
+	{
+		HAL_NVIC_EnableIRQ(IMU_INT_EXTI_IRQn);
+	}
+}
+
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+	if (GPIO_Pin == IMU_INT_Pin)
+	{
+		// no samples in wake-on-motion mode, the interrupt only wakes the MCU
+		if (imuWakeOnMotion)
+		{
+			imuMotionWake = true;
+			return;
+		}
+
+		imuPort_stampReady(imuPort_micros());
+		imuReadySamples++;
+
+		// read the FIFO once a batch is available
+		if ((imuReadySamples >= imuFifoBatch)
+				&& (imuTransfer == IMU_XFER_IDLE))
+		{
+			imuReadySamples = 0;
+			imuXferDevice = IMU_PRIMARY;
+			imuPort_startTransfer(IMU_XFER_STATUS);
+		}
+	}
+}
+
+void imuBus_ReadCallback(const uint8_t *data)
+{
+	imuInstance_t *imu = &imuDevices[imuXferDevice];
+	uint16_t count;
+	uint32_t now;
+	uint16_t head;
+	uint16_t next;
+
+	switch (imuTransfer)
+	{
+	case IMU_XFER_STATUS:
+		if (data[0] & INT_STATUS_FIFO_OFLOW)
+		{
+			// older samples were overwritten, the FIFO is no longer aligned
+			// to sample boundaries: drop its content
+			imu->fifoOverflows++;
+			imuPort_startTransfer(IMU_XFER_RESET);
+		}
+		else
+		{
+			imuPort_startTransfer(IMU_XFER_COUNT);
+		}
+		break;
+
+	case IMU_XFER_COUNT:
+		count = ((data[0] << 8) | data[1]) & FIFO_COUNT_MASK;
+
+		// whole samples only, the rest is read in the next batch
+		imu->batchSamples = count / imu->sampleBytes;
+		if (imu->batchSamples > IMU_FIFO_SIZE / imu->sampleBytes)
+		{
+			imu->batchSamples = IMU_FIFO_SIZE / imu->sampleBytes;
+		}
+
+		if (imu->batchSamples > 0)
+		{
+			imuPort_stampBatch(imu);
+			imuPort_startTransfer(IMU_XFER_FIFO);
+		}
+		else
+		{
+			imuPort_nextDevice();
+		}
+		break;
+
+	case IMU_XFER_FIFO:
+		// the last sample of the batch is the most recent one
+		now = HAL_GetTick();
+		head = imu->ringHead;
+		for (uint16_t i = 0; i < imu->batchSamples; i++)
+		{
+			next = (head + 1) & (IMU_RING_SIZE - 1);
+			if (next == imu->ringTail)
+			{
+				// ring buffer full, the consumer is late
+				imu->droppedSamples += imu->batchSamples - i;
+				break;
+			}
+
+			imuPort_parseRawData(imu, &data[i * imu->sampleBytes],
+					&imu->ring[head]);
+			imu->ring[head].timestamp = now
+					- ((imu->batchSamples - 1 - i) * IMU_SAMPLE_PERIOD_US) / 1000;
+			imu->ring[head].timestampUs = imu->batchStamps[i];
+			head = next;
+		}
+		__DMB();
+		imu->ringHead = head;
+		imuLastData = now;
+		imuConsecutiveErrors = 0;
+		imuPort_nextDevice();
+		break;
+
+	default:
+		imuTransfer = IMU_XFER_IDLE;
+		break;
+	}
+}
+
+void imuBus_WriteCallback()
+{
+	if (imuTransfer == IMU_XFER_RESET)
+	{
+		imuPort_nextDevice();
+	}
+}
+
+void imuBus_ErrorCallback()
+{
+	// the samples stay in the FIFOs for the next batch
+	imuTransfer = IMU_XFER_IDLE;
+	imuPort_busResult(false);
+}
+
+static void imuPort_startTransfer(imuTransfer_t stage)
+{
+	imuInstance_t *imu = &imuDevices[imuXferDevice];
+	bool started;
+
+	imuTransfer = stage;
+
+	switch (stage)
+	{
+	case IMU_XFER_STATUS:
+		started = imuBus_ReadAsync(imu->id, INT_STATUS, 1);
+		break;
+
+	case IMU_XFER_COUNT:
+		started = imuBus_ReadAsync(imu->id, FIFO_COUNTH, 2);
+		break;
+
+	case IMU_XFER_FIFO:
+		started = imuBus_ReadAsync(imu->id, FIFO_R_W,
+				imu->batchSamples * imu->sampleBytes);
+		break;
+
+	case IMU_XFER_RESET:
+		started = imuBus_WriteAsync(imu->id, USER_CTRL,
+				imu->userCtrl | USER_CTRL_FIFO_EN | USER_CTRL_FIFO_RST);
+		break;
+
+	default:
+		started = true;
+		break;
+	}
+
+	// bus busy or not responding, retried on the next batch
+	if (!started)
+	{
+		imuTransfer = IMU_XFER_IDLE;
+		imuPort_busResult(false);
+	}
+}
+
+static void imuPort_nextDevice()
+{
+	uint8_t i = imuXferDevice + 1;
+
+	while ((i < IMU_DEVICES) && !imuDevices[i].present)
+	{
+		i++;
+	}
+
+	// back to back with the previous sensor, the batch ends after the last one
+	if (i < IMU_DEVICES)
+	{
+		imuXferDevice = i;
+		imuPort_startTransfer(IMU_XFER_STATUS);
+	}
+	else
+	{
+		imuTransfer = IMU_XFER_IDLE;
+	}
+}
+
+static inline uint32_t imuPort_micros()
+{
+	return TIM2->CNT;
+}
+
+static void imuPort_stampReady(uint32_t now)
+{
+	uint32_t period = IMU_SAMPLE_PERIOD_US;
+	uint32_t interval;
+	int32_t deviation;
+
+	if (imuStampValid > 0)
+	{
+		interval = now - imuStamps[(imuStampCount - 1) & (IMU_STAMP_RING - 1)];
+		deviation = (int32_t) interval - (int32_t) period;
+
+		if (interval > period + period / 2)
+		{
+			imuTiming.missed++;
+		}
+		else
+		{
+			imuTiming.intervals++;
+			imuTiming.minUs = (interval < imuTiming.minUs) ?
+					interval : imuTiming.minUs;
+			imuTiming.maxUs = (interval > imuTiming.maxUs) ?
+					interval : imuTiming.maxUs;
+			imuJitterSum += deviation;
+			imuJitterSumSq += (uint64_t) ((int64_t) deviation * deviation);
+		}
+	}
+
+	imuStamps[imuStampCount & (IMU_STAMP_RING - 1)] = now;
+	imuStampCount++;
+	if (imuStampValid < IMU_STAMP_RING)
+	{
+		imuStampValid++;
+	}
+}
+
+static void imuPort_stampBatch(imuInstance_t *imu)
+{
+	bool_t stamped = (imu->id == IMU_PRIMARY);
+	uint32_t stamp = imuPort_micros();
+	uint32_t index = imuStampCount;
+	uint16_t valid = imuStampValid;
+	uint16_t i = imu->batchSamples;
+	bool_t first = true;
+
+	// the data-ready interrupt of the newest sample may still be pending
+	// behind the bus interrupt, the sample arrived just now
+	if (stamped && __HAL_GPIO_EXTI_GET_IT(IMU_INT_Pin))
+	{
+		imu->batchStamps[--i] = stamp;
+		first = false;
+	}
+
+	while (i > 0)
+	{
+		i--;
+		if (stamped && (valid > 0))
+		{
+			valid--;
+			index--;
+			stamp = imuStamps[index & (IMU_STAMP_RING - 1)];
+		}
+		else if (!first)
+		{
+			stamp -= IMU_SAMPLE_PERIOD_US;
+		}
+		imu->batchStamps[i] = stamp;
+		first = false;
 	}
 }
 
-static void Error_Handler(void)
+static void TIM2_Init(void)
 {
-	/* Turn LED_IMU on */
-	BSP_LED_On(LED_IMU);
-	while (1)
+	uint32_t clock = HAL_RCC_GetPCLK1Freq();
+
+	// APB1 timers run at twice the bus clock when the bus is divided
+	if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
 	{
+		clock *= 2;
 	}
+
+	htim2.Instance = TIM2;
+	htim2.Init.Prescaler = clock / IMU_TIMER_HZ - 1;
+	htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim2.Init.Period = 0xFFFFFFFF;
+	htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+	// without the timer, the samples keep their millisecond timestamps only
+	if (HAL_TIM_Base_Init(&htim2) == HAL_OK)
+	{
+		HAL_TIM_Base_Start(&htim2);
+	}
+
+	imuPort_ResetTiming();
+}
+
+static void EXTI_Init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct =
+	{ 0 };
+
+	__HAL_RCC_GPIOE_CLK_ENABLE();
+
+	/*Configure GPIO pin : IMU_INT_Pin */
+	GPIO_InitStruct.Pin = IMU_INT_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+	GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+	HAL_GPIO_Init(IMU_INT_GPIO_Port, &GPIO_InitStruct);
+
+	/* EXTI interrupt init, enabled when the acquisition starts */
+	HAL_NVIC_SetPriority(IMU_INT_EXTI_IRQn, 2, 0);
+	HAL_NVIC_DisableIRQ(IMU_INT_EXTI_IRQn);
 }
 
+#endif
@@ -0,0 +1,467 @@
+/**
+ ******************************************************************************
+ * @file    imu_replay.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU trace replay, built in place of imu_port.c on the host
+ ******************************************************************************
+ */
+
+#include "imu_replay.h"
+#include "imu_convert.h"
+
+#if DEVICE_IMU_REPLAY
+
+#include <string.h>
+
+/**
+ * @var replayTrace
+ * @brief Trace being replayed.
+ */
+static const uint8_t *replayTrace;
+
+/**
+ * @var replayLength
+ * @brief Trace length, in bytes.
+ */
+static uint32_t replayLength;
+
+/**
+ * @var replayOffset
+ * @brief Position of the next record in the trace.
+ */
+static uint32_t replayOffset;
+
+/**
+ * @var replayHeader
+ * @brief Header of the trace.
+ */
+static imuTraceHeader_t replayHeader;
+
+/**
+ * @var replayNext
+ * @brief Next sample of the trace, decoded ahead to know its timestamp.
+ */
+static imuRaw_t replayNext;
+
+/**
+ * @var replayNextValid
+ * @brief Set while replayNext holds a sample.
+ */
+static bool replayNextValid;
+
+/**
+ * @var replayTime
+ * @brief Replay clock, in milliseconds.
+ */
+static uint32_t replayTime;
+
+/**
+ * @var rawData
+ * @brief Current raw sample.
+ */
+static imuRaw_t rawData;
+
+/**
+ * @var snapshot
+ * @brief Current sample, converted.
+ */
+static imuSnapshot_t snapshot;
+
+/**
+ * @var gyroOffset
+ * @brief Gyroscope offsets, in counts (Q8), from the trace header and then tracked.
+ */
+static int32_t gyroOffset[3];
+
+/**
+ * @var gyroBias
+ * @brief Gyroscope offset tracking, as run by the device port.
+ */
+static imuGyroBias_t gyroBias;
+
+/**
+ * @var magnCal
+ * @brief Magnetometer hard-iron and soft-iron calibration, identity until set.
+ */
+static magnCal_t magnCal =
+{
+{ 0, 0, 0 },
+{
+{ 65536, 0, 0 },
+{ 0, 65536, 0 },
+{ 0, 0, 65536 } } };
+
+/**
+ * @var replayWakeOnMotion
+ * @brief Set between imuPort_EnterWakeOnMotion() and imuPort_ExitWakeOnMotion().
+ */
+static bool replayWakeOnMotion;
+
+/**
+ * @brief Decodes the next record of the trace into replayNext.
+ */
+static void imuReplay_decodeNext();
+
+/**
+ * @brief Converts the current raw sample.
+ */
+static void imuReplay_processData();
+
+/**
+ * IMU Replay Functions
+ */
+
+bool imuReplay_Open(const uint8_t *trace, uint32_t length)
+{
+	uint16_t n = imuTrace_DecodeHeader(trace, length, &replayHeader);
+
+	if ((n == 0) || (replayHeader.config.accFsr > ACC_FSR_16G)
+			|| (replayHeader.config.gyroFsr > GYR_FSR_2000DPS))
+		return false;
+
+	replayTrace = trace;
+	replayLength = length;
+	replayOffset = n;
+	replayTime = replayHeader.start;
+	replayWakeOnMotion = false;
+	memset(&rawData, 0, sizeof(rawData));
+	memset(&snapshot, 0, sizeof(snapshot));
+	memset(&gyroBias, 0, sizeof(gyroBias));
+	memcpy(gyroOffset, replayHeader.cal.gyroOffset, sizeof(gyroOffset));
+	replayNext.timestamp = replayHeader.start;
+	replayNext.timestampUs = replayHeader.start * 1000;
+	imuReplay_decodeNext();
+
+	return true;
+}
+
+void imuReplay_Advance(uint32_t ms)
+{
+	replayTime += ms;
+}
+
+uint32_t imuReplay_Time()
+{
+	return replayTime;
+}
+
+bool imuReplay_Done()
+{
+	return !replayNextValid;
+}
+
+void imuReplay_GetHeader(imuTraceHeader_t *header)
+{
+	*header = replayHeader;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return replayTime;
+}
+
+/**
+ * IMU Port Functions
+ */
+
+bool imuPort_Init()
+{
+	return (replayTrace != NULL);
+}
+
+bool imuPort_Check()
+{
+	return (replayTrace != NULL);
+}
+
+bool imuPort_Present(imuId_t id)
+{
+	// the trace holds the samples of a single sensor
+	return (id == IMU_PRIMARY) && (replayTrace != NULL);
+}
+
+bool imuPort_NextSample(imuId_t id)
+{
+	// a sample is only available once the clock reaches it
+	if ((id != IMU_PRIMARY) || !replayNextValid || replayWakeOnMotion
+			|| ((int32_t) (replayTime - replayNext.timestamp) < 0))
+		return false;
+
+	rawData = replayNext;
+	imuReplay_decodeNext();
+	imuReplay_processData();
+
+	return true;
+}
+
+bool imuPort_ReadSnapshot(imuId_t id, imuSnapshot_t *sample)
+{
+	if (!imuPort_NextSample(id))
+		return false;
+
+	*sample = snapshot;
+
+	return true;
+}
+
+uint16_t imuPort_ReadBatch(imuId_t id, acc_t *acc, gyro_t *gyro,
+		uint16_t max)
+{
+	uint16_t n = 0;
+
+	while ((n < max) && imuPort_NextSample(id))
+	{
+		if (acc != NULL)
+		{
+			acc[n] = snapshot.acc;
+		}
+		if (gyro != NULL)
+		{
+			gyro[n] = snapshot.gyro;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+uint32_t imuPort_DroppedSamples(imuId_t id)
+{
+	(void) id;
+
+	return 0;
+}
+
+uint32_t imuPort_FifoOverflows(imuId_t id)
+{
+	(void) id;
+
+	return 0;
+}
+
+void imuPort_GetTiming(imuTiming_t *timing)
+{
+	// no data-ready interrupts, the samples come at the trace ticks
+	timing->intervals = 0;
+	timing->missed = 0;
+	timing->periodUs = (replayHeader.config.rateHz > 0) ?
+			1000000UL / replayHeader.config.rateHz : 0;
+	timing->minUs = 0;
+	timing->maxUs = 0;
+	timing->meanUs = 0.0f;
+	timing->jitterUs = 0.0f;
+}
+
+void imuPort_ResetTiming()
+{
+}
+
+bool imuPort_RawReadData(imuId_t id, imuRaw_t *raw)
+{
+	(void) id;
+
+	*raw = rawData;
+
+	return true;
+}
+
+void imuPort_GetRawCalibration(imuId_t id, imuRawCal_t *cal)
+{
+	(void) id;
+
+	*cal = replayHeader.cal;
+	memcpy(cal->gyroOffset, gyroOffset, sizeof(gyroOffset));
+}
+
+uint32_t imuPort_BusErrors()
+{
+	return 0;
+}
+
+uint32_t imuPort_BusRecoveries()
+{
+	return 0;
+}
+
+bool imuPort_Recovering()
+{
+	return false;
+}
+
+bool imuPort_AccReadData(imuId_t id, acc_t *acc)
+{
+	(void) id;
+
+	*acc = snapshot.acc;
+
+	return true;
+}
+
+bool imuPort_TempReadData(imuId_t id, temp_t *temp)
+{
+	(void) id;
+
+	*temp = snapshot.temp;
+
+	return true;
+}
+
+bool imuPort_GyroReadData(imuId_t id, gyro_t *gyro)
+{
+	(void) id;
+
+	*gyro = snapshot.gyro;
+
+	return true;
+}
+
+bool imuPort_MagnReadData(imuId_t id, magn_t *magn)
+{
+	(void) id;
+
+	*magn = snapshot.magn;
+
+	return rawData.magn;
+}
+
+void imuPort_MagnSetCalibration(imuId_t id, const magnCal_t *cal)
+{
+	(void) id;
+
+	magnCal = *cal;
+}
+
+void imuPort_MagnGetCalibration(imuId_t id, magnCal_t *cal)
+{
+	(void) id;
+
+	*cal = magnCal;
+}
+
+void imuPort_MagnCalibrationStart(imuId_t id)
+{
+	// the calibration is made on the device, its result can be set
+	(void) id;
+}
+
+bool imuPort_MagnCalibrationStop(imuId_t id)
+{
+	(void) id;
+
+	return false;
+}
+
+void imuPort_calibrateGyro(imuId_t id)
+{
+	// the offsets come from the trace header
+	(void) id;
+}
+
+bool imuPort_EnterWakeOnMotion(uint16_t thresholdMg)
+{
+	(void) thresholdMg;
+
+	replayWakeOnMotion = true;
+
+	return true;
+}
+
+bool imuPort_MotionWake()
+{
+	// the trace only holds the samples acquired while awake
+	return replayWakeOnMotion;
+}
+
+bool imuPort_ExitWakeOnMotion()
+{
+	replayWakeOnMotion = false;
+
+	return true;
+}
+
+bool imuPort_Stationary(imuId_t id)
+{
+	(void) id;
+
+	return (gyroBias.still >= IMU_BIAS_STILL_SAMPLES(replayHeader.config.rateHz));
+}
+
+bool imuPort_GyroCalibrated(imuId_t id)
+{
+	(void) id;
+
+	return true;
+}
+
+uint32_t imuPort_GyroCalRestarts(imuId_t id)
+{
+	(void) id;
+
+	return 0;
+}
+
+bool imuPort_SetConfig(const imuConfig_t *config)
+{
+	// the trace was acquired with its own configuration
+	(void) config;
+	return false;
+}
+
+void imuPort_GetConfig(imuConfig_t *config)
+{
+	*config = replayHeader.config;
+}
+
+uint16_t imuPort_SampleRate()
+{
+	return replayHeader.config.rateHz;
+}
+
+/**
+ * Private functions
+ */
+
+static void imuReplay_decodeNext()
+{
+	uint16_t n = imuTrace_DecodeSample(&replayTrace[replayOffset],
+			replayLength - replayOffset, replayNext.timestamp,
+			replayNext.timestampUs, &replayNext);
+
+	replayNextValid = (n > 0);
+	replayOffset += n;
+}
+
+static void imuReplay_processData()
+{
+	int32_t m[3];
+	int32_t offset[3];
+	int32_t gyroScale = imuConvert_GyroScale(replayHeader.config.gyroFsr);
+
+	snapshot.timestamp = rawData.timestamp;
+	snapshot.timestampUs = rawData.timestampUs;
+
+	imuConvert_Acc(&rawData, imuConvert_AccScale(replayHeader.config.accFsr),
+			&snapshot.acc);
+	snapshot.temp = imuConvert_Temp(rawData.temp);
+
+	// the offsets in the header are tracked the same way as on the device
+	imuConvert_GyroOffset(&gyroBias, gyroOffset, snapshot.temp, offset);
+	imuConvert_GyroBiasUpdate(&gyroBias, gyroOffset, &rawData, snapshot.temp,
+			offset, gyroScale, replayHeader.config.rateHz);
+	imuConvert_Gyro(&rawData, offset, gyroScale, &snapshot.gyro);
+
+	if (!rawData.magn)
+	{
+		snapshot.magn.mx = 0;
+		snapshot.magn.my = 0;
+		snapshot.magn.mz = 0;
+		return;
+	}
+
+	imuConvert_MagnAdjust(&rawData, replayHeader.cal.magnAsa, m);
+	imuConvert_MagnCorrect(m, &magnCal, &snapshot.magn);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ ******************************************************************************
+ * @file    imu_rotation.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU rotation estimator
+ ******************************************************************************
+ */
+
+#include "imu_rotation.h"
+#include <stddef.h>
+
+/**
+ * @def IMU_ROTATION_DPS_TO_RPM
+ * @brief Degrees per second to revolutions per minute.
+ */
+#define IMU_ROTATION_DPS_TO_RPM		(60.0f / 360.0f)
+
+void imuRotation_Init(imuRotation_t *rot, float tauS, float deadbandDps)
+{
+	rot->tauS = (tauS > 0.0f) ? tauS : 0.0f;
+	rot->deadbandDps = (deadbandDps > 0.0f) ? deadbandDps : 0.0f;
+	imuRotation_Reset(rot);
+}
+
+void imuRotation_Reset(imuRotation_t *rot)
+{
+	rot->rpm = 0.0f;
+	rot->angle = 0.0f;
+	rot->revolutions = 0;
+	rot->lastTimestampUs = 0;
+	rot->started = false;
+}
+
+void imuRotation_Update(imuRotation_t *rot, float dps, uint32_t timestampUs)
+{
+	uint32_t gapUs = timestampUs - rot->lastTimestampUs;
+	float dt = (float) gapUs * 1e-6f;
+
+	rot->lastTimestampUs = timestampUs;
+	if (!rot->started)
+	{
+		rot->started = true;
+		return;
+	}
+
+	// the rotation during a long gap is unknown
+	if (gapUs > IMU_ROTATION_MAX_GAP_US)
+		return;
+
+	if ((dps < rot->deadbandDps) && (dps > -rot->deadbandDps))
+	{
+		dps = 0.0f;
+	}
+
+	rot->angle += dps * dt;
+	while (rot->angle >= 360.0f)
+	{
+		rot->angle -= 360.0f;
+		rot->revolutions++;
+	}
+	while (rot->angle < 0.0f)
+	{
+		rot->angle += 360.0f;
+		rot->revolutions--;
+	}
+
+	// first-order low-pass, y += (x - y) dt / (tau + dt)
+	rot->rpm += (dps * IMU_ROTATION_DPS_TO_RPM - rot->rpm) * dt
+			/ (rot->tauS + dt);
+}
+
+float imuRotation_Rpm(const imuRotation_t *rot)
+{
+	return rot->rpm;
+}
+
+float imuRotation_Angle(const imuRotation_t *rot, int32_t *revolutions)
+{
+	if (revolutions != NULL)
+	{
+		*revolutions = rot->revolutions;
+	}
+
+	return rot->angle;
+}
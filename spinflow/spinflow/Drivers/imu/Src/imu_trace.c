@@ -0,0 +1,403 @@
+/**
+ ******************************************************************************
+ * @file    imu_trace.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU trace recording
+ ******************************************************************************
+ */
+
+#include "imu_trace.h"
+
+/**
+ * @def IMU_TRACE_TAG_MAGN
+ * @brief Record tag flag of the magnetometer data.
+ */
+#define IMU_TRACE_TAG_MAGN		0x80
+
+/**
+ * @def IMU_TRACE_TAG_LONG
+ * @brief Record tag time meaning the time follows as a uint16.
+ */
+#define IMU_TRACE_TAG_LONG		0x7F
+
+/**
+ * @def IMU_TRACE_US_LONG
+ * @brief Record microsecond time meaning the millisecond time is used instead.
+ */
+#define IMU_TRACE_US_LONG		0xFFFF
+
+/**
+ * @def IMU_TRACE_FLAG_MAGN
+ * @brief Header flag of the magnetometer presence.
+ */
+#define IMU_TRACE_FLAG_MAGN		0x01
+
+/**
+ * @var traceBuffer
+ * @brief Bytes waiting for the sink.
+ */
+static uint8_t traceBuffer[IMU_TRACE_BUFFER_SIZE];
+
+/**
+ * @var traceHead
+ * @brief Index of the next byte to be written.
+ */
+static uint16_t traceHead;
+
+/**
+ * @var traceTail
+ * @brief Index of the next byte to be sent.
+ */
+static uint16_t traceTail;
+
+/**
+ * @var traceSink
+ * @brief Destination of the recording, NULL when not recording.
+ */
+static imuTraceSink_t traceSink;
+
+/**
+ * @var traceChunk
+ * @brief Largest number of bytes passed to the sink at once.
+ */
+static uint16_t traceChunk;
+
+/**
+ * @var tracePrevious
+ * @brief Timestamp of the last recorded sample.
+ */
+static uint32_t tracePrevious;
+
+/**
+ * @var tracePreviousUs
+ * @brief Data-ready time of the last recorded sample.
+ */
+static uint32_t tracePreviousUs;
+
+/**
+ * @var traceFirst
+ * @brief Set until the first sample is recorded.
+ */
+static bool traceFirst;
+
+/**
+ * @var traceDropped
+ * @brief Samples dropped because the buffer was full.
+ */
+static uint32_t traceDropped;
+
+/**
+ * @brief Writes a little endian 16-bit value.
+ * @param buffer Destination.
+ * @param value Value.
+ */
+static inline void imuTrace_put16(uint8_t *buffer, uint16_t value);
+
+/**
+ * @brief Writes a little endian 32-bit value.
+ * @param buffer Destination.
+ * @param value Value.
+ */
+static inline void imuTrace_put32(uint8_t *buffer, uint32_t value);
+
+/**
+ * @brief Reads a little endian 16-bit value.
+ * @param buffer Source.
+ * @return Value.
+ */
+static inline uint16_t imuTrace_get16(const uint8_t *buffer);
+
+/**
+ * @brief Reads a little endian 32-bit value.
+ * @param buffer Source.
+ * @return Value.
+ */
+static inline uint32_t imuTrace_get32(const uint8_t *buffer);
+
+/**
+ * @brief Appends bytes to the recording buffer.
+ * @param data Bytes.
+ * @param length Number of bytes.
+ * @return True if they fit, False otherwise (nothing is written).
+ */
+static bool imuTrace_write(const uint8_t *data, uint16_t length);
+
+uint16_t imuTrace_EncodeHeader(const imuTraceHeader_t *header, uint8_t *buffer)
+{
+	imuTrace_put32(&buffer[0], IMU_TRACE_MAGIC);
+	buffer[4] = IMU_TRACE_VERSION;
+	buffer[5] = header->magn ? IMU_TRACE_FLAG_MAGN : 0;
+	imuTrace_put16(&buffer[6], header->config.rateHz);
+	buffer[8] = (uint8_t) header->config.dlpf;
+	buffer[9] = (uint8_t) header->config.accFsr;
+	buffer[10] = (uint8_t) header->config.gyroFsr;
+	buffer[11] = 0;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		imuTrace_put32(&buffer[12 + 4 * i],
+				(uint32_t) header->cal.gyroOffset[i]);
+		imuTrace_put32(&buffer[24 + 4 * i], (uint32_t) header->cal.magnAsa[i]);
+	}
+	imuTrace_put32(&buffer[36], header->start);
+
+	return IMU_TRACE_HEADER_SIZE;
+}
+
+uint16_t imuTrace_DecodeHeader(const uint8_t *buffer, uint32_t length,
+		imuTraceHeader_t *header)
+{
+	if ((length < IMU_TRACE_HEADER_SIZE)
+			|| (imuTrace_get32(&buffer[0]) != IMU_TRACE_MAGIC)
+			|| (buffer[4] != IMU_TRACE_VERSION))
+		return 0;
+
+	header->version = buffer[4];
+	header->magn = (buffer[5] & IMU_TRACE_FLAG_MAGN) != 0;
+	header->config.rateHz = imuTrace_get16(&buffer[6]);
+	header->config.dlpf = (imuDlpf_t) buffer[8];
+	header->config.accFsr = (imuAccFsr_t) buffer[9];
+	header->config.gyroFsr = (imuGyroFsr_t) buffer[10];
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		header->cal.gyroOffset[i] = (int32_t) imuTrace_get32(
+				&buffer[12 + 4 * i]);
+		header->cal.magnAsa[i] = (int32_t) imuTrace_get32(&buffer[24 + 4 * i]);
+	}
+	header->start = imuTrace_get32(&buffer[36]);
+
+	return IMU_TRACE_HEADER_SIZE;
+}
+
+uint16_t imuTrace_EncodeSample(const imuRaw_t *raw, uint32_t previous,
+		uint32_t previousUs, uint8_t *buffer)
+{
+	uint32_t delta = raw->timestamp - previous;
+	uint32_t deltaUs = raw->timestampUs - previousUs;
+	uint16_t n = 1;
+
+	// Short gaps fit in the tag, longer ones follow it, saturated
+	if (delta < IMU_TRACE_TAG_LONG)
+	{
+		buffer[0] = (uint8_t) delta;
+	}
+	else
+	{
+		buffer[0] = IMU_TRACE_TAG_LONG;
+		imuTrace_put16(&buffer[n], (delta > UINT16_MAX) ? UINT16_MAX : delta);
+		n += 2;
+	}
+	imuTrace_put16(&buffer[n],
+			(deltaUs > IMU_TRACE_US_LONG) ? IMU_TRACE_US_LONG : deltaUs);
+	n += 2;
+
+	imuTrace_put16(&buffer[n + 0], (uint16_t) raw->ax);
+	imuTrace_put16(&buffer[n + 2], (uint16_t) raw->ay);
+	imuTrace_put16(&buffer[n + 4], (uint16_t) raw->az);
+	imuTrace_put16(&buffer[n + 6], (uint16_t) raw->temp);
+	imuTrace_put16(&buffer[n + 8], (uint16_t) raw->gx);
+	imuTrace_put16(&buffer[n + 10], (uint16_t) raw->gy);
+	imuTrace_put16(&buffer[n + 12], (uint16_t) raw->gz);
+	n += 14;
+
+	if (raw->magn)
+	{
+		buffer[0] |= IMU_TRACE_TAG_MAGN;
+		imuTrace_put16(&buffer[n + 0], (uint16_t) raw->mx);
+		imuTrace_put16(&buffer[n + 2], (uint16_t) raw->my);
+		imuTrace_put16(&buffer[n + 4], (uint16_t) raw->mz);
+		n += 6;
+	}
+
+	return n;
+}
+
+uint16_t imuTrace_DecodeSample(const uint8_t *buffer, uint32_t length,
+		uint32_t previous, uint32_t previousUs, imuRaw_t *raw)
+{
+	uint32_t delta;
+	uint32_t deltaUs;
+	uint16_t n = 1;
+	uint16_t size;
+
+	if (length < 1)
+		return 0;
+
+	// Check the whole record is there before decoding it
+	delta = buffer[0] & IMU_TRACE_TAG_LONG;
+	size = 17 + ((delta == IMU_TRACE_TAG_LONG) ? 2 : 0)
+			+ ((buffer[0] & IMU_TRACE_TAG_MAGN) ? 6 : 0);
+	if (length < size)
+		return 0;
+
+	if (delta == IMU_TRACE_TAG_LONG)
+	{
+		delta = imuTrace_get16(&buffer[n]);
+		n += 2;
+	}
+	raw->timestamp = previous + delta;
+
+	// gaps too long for the microsecond time fall back on the ticks
+	deltaUs = imuTrace_get16(&buffer[n]);
+	if (deltaUs == IMU_TRACE_US_LONG)
+	{
+		deltaUs = delta * 1000;
+	}
+	raw->timestampUs = previousUs + deltaUs;
+	n += 2;
+
+	raw->ax = (int16_t) imuTrace_get16(&buffer[n + 0]);
+	raw->ay = (int16_t) imuTrace_get16(&buffer[n + 2]);
+	raw->az = (int16_t) imuTrace_get16(&buffer[n + 4]);
+	raw->temp = (int16_t) imuTrace_get16(&buffer[n + 6]);
+	raw->gx = (int16_t) imuTrace_get16(&buffer[n + 8]);
+	raw->gy = (int16_t) imuTrace_get16(&buffer[n + 10]);
+	raw->gz = (int16_t) imuTrace_get16(&buffer[n + 12]);
+	n += 14;
+
+	raw->magn = (buffer[0] & IMU_TRACE_TAG_MAGN) != 0;
+	if (raw->magn)
+	{
+		raw->mx = (int16_t) imuTrace_get16(&buffer[n + 0]);
+		raw->my = (int16_t) imuTrace_get16(&buffer[n + 2]);
+		raw->mz = (int16_t) imuTrace_get16(&buffer[n + 4]);
+		n += 6;
+	}
+	else
+	{
+		raw->mx = 0;
+		raw->my = 0;
+		raw->mz = 0;
+	}
+
+	return n;
+}
+
+bool imuTrace_Start(const imuTraceHeader_t *header, imuTraceSink_t sink,
+		uint16_t chunk)
+{
+	uint8_t buffer[IMU_TRACE_HEADER_SIZE];
+
+	if ((sink == NULL) || (chunk == 0))
+		return false;
+
+	traceHead = 0;
+	traceTail = 0;
+	traceDropped = 0;
+	traceChunk = chunk;
+	tracePrevious = header->start;
+	traceFirst = true;
+
+	imuTrace_write(buffer, imuTrace_EncodeHeader(header, buffer));
+	traceSink = sink;
+
+	return true;
+}
+
+void imuTrace_Stop()
+{
+	traceSink = NULL;
+	traceHead = 0;
+	traceTail = 0;
+}
+
+bool imuTrace_Recording()
+{
+	return (traceSink != NULL);
+}
+
+bool imuTrace_Record(const imuRaw_t *raw)
+{
+	uint8_t buffer[IMU_TRACE_MAX_RECORD];
+
+	if (traceSink == NULL)
+		return false;
+
+	// the data-ready time of the first sample is counted from the start tick
+	if (traceFirst)
+	{
+		tracePreviousUs = raw->timestampUs
+				- (raw->timestamp - tracePrevious) * 1000;
+	}
+
+	// the next record spans the gap of a dropped one
+	if (!imuTrace_write(buffer, imuTrace_EncodeSample(raw, tracePrevious,
+			tracePreviousUs, buffer)))
+	{
+		traceDropped++;
+		return false;
+	}
+	tracePrevious = raw->timestamp;
+	tracePreviousUs = raw->timestampUs;
+	traceFirst = false;
+
+	return true;
+}
+
+void imuTrace_Flush()
+{
+	uint16_t length;
+
+	while ((traceSink != NULL) && (traceTail != traceHead))
+	{
+		// contiguous bytes up to the end of the buffer
+		length = (traceHead > traceTail) ?
+				traceHead - traceTail : IMU_TRACE_BUFFER_SIZE - traceTail;
+		if (length > traceChunk)
+		{
+			length = traceChunk;
+		}
+
+		if (!traceSink(&traceBuffer[traceTail], length))
+			break;
+
+		traceTail = (traceTail + length) % IMU_TRACE_BUFFER_SIZE;
+	}
+}
+
+uint32_t imuTrace_Dropped()
+{
+	return traceDropped;
+}
+
+static bool imuTrace_write(const uint8_t *data, uint16_t length)
+{
+	uint16_t used = (traceHead + IMU_TRACE_BUFFER_SIZE - traceTail)
+			% IMU_TRACE_BUFFER_SIZE;
+
+	// one byte is kept free to tell a full buffer from an empty one
+	if (used + length >= IMU_TRACE_BUFFER_SIZE)
+		return false;
+
+	for (uint16_t i = 0; i < length; i++)
+	{
+		traceBuffer[traceHead] = data[i];
+		traceHead = (traceHead + 1) % IMU_TRACE_BUFFER_SIZE;
+	}
+
+	return true;
+}
+
+static inline void imuTrace_put16(uint8_t *buffer, uint16_t value)
+{
+	buffer[0] = (uint8_t) value;
+	buffer[1] = (uint8_t) (value >> 8);
+}
+
+static inline void imuTrace_put32(uint8_t *buffer, uint32_t value)
+{
+	imuTrace_put16(&buffer[0], (uint16_t) value);
+	imuTrace_put16(&buffer[2], (uint16_t) (value >> 16));
+}
+
+static inline uint16_t imuTrace_get16(const uint8_t *buffer)
+{
+	return (uint16_t) (buffer[0] | (buffer[1] << 8));
+}
+
+static inline uint32_t imuTrace_get32(const uint8_t *buffer)
+{
+	return imuTrace_get16(&buffer[0])
+			| ((uint32_t) imuTrace_get16(&buffer[2]) << 16);
+}
@@ -0,0 +1,383 @@
+/**
+ ******************************************************************************
+ * @file    imu_vib.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   IMU vibration analysis
+ ******************************************************************************
+ */
+
+#include "imu_vib.h"
+#include <math.h>
+
+/**
+ * @def IMU_VIB_PI
+ * @brief Pi, single precision.
+ */
+#define IMU_VIB_PI				3.14159265f
+
+/**
+ * @brief Gets the periodic Hann window.
+ * @param vib Analyser.
+ * @param n Sample index, below the window length.
+ * @return Window value.
+ */
+static inline float imuVib_hann(const imuVib_t *vib, uint16_t n);
+
+/**
+ * @brief Removes the mean, measures the RMS and applies the Hann window.
+ * @param vib Analyser.
+ * @note The portable FFT input is also put in bit-reversed order.
+ */
+static void imuVib_window(imuVib_t *vib);
+
+/**
+ * @brief Runs one radix-2 stage of the complex FFT of the even and odd samples.
+ * @param vib Analyser.
+ */
+static void imuVib_fftStage(imuVib_t *vib);
+
+/**
+ * @brief Turns the complex FFT into the spectrum of the real window.
+ * @param vib Analyser.
+ *
+ * Same layout as arm_rfft_fast_f32(): the DC and Nyquist bins first, then the
+ * real and imaginary parts of the other bins.
+ */
+static void imuVib_split(imuVib_t *vib);
+
+/**
+ * @brief Extracts the results from the spectrum.
+ * @param vib Analyser.
+ * @param bins Spectrum, arm_rfft_fast_f32() layout. Overwritten with the power of each bin.
+ */
+static void imuVib_spectrum(imuVib_t *vib, float *bins);
+
+bool imuVib_Init(imuVib_t *vib, uint16_t size, float sampleRateHz)
+{
+	if ((size < IMU_VIB_MIN_SIZE) || (size > IMU_VIB_MAX_SIZE)
+			|| ((size & (size - 1)) != 0) || (sampleRateHz <= 0.0f))
+		return false;
+
+#if IMU_VIB_CMSIS_DSP
+	if (arm_rfft_fast_init_f32(&vib->instance, size) != ARM_MATH_SUCCESS)
+		return false;
+#endif
+
+	vib->size = size;
+	vib->sampleRateHz = sampleRateHz;
+	vib->bands = 0;
+
+	for (uint16_t k = 0; k < size / 2; k++)
+	{
+		vib->cosTable[k] = cosf(2.0f * IMU_VIB_PI * k / size);
+		vib->sinTable[k] = sinf(2.0f * IMU_VIB_PI * k / size);
+	}
+
+	vib->result.rms = 0.0f;
+	vib->result.peakHz = 0.0f;
+	vib->result.peakAmplitude = 0.0f;
+	vib->result.bands = 0;
+	vib->result.resolutionHz = sampleRateHz / size;
+	vib->result.windows = 0;
+	vib->result.overruns = 0;
+	imuVib_Reset(vib);
+
+	return true;
+}
+
+bool imuVib_SetBands(imuVib_t *vib, const float *edgesHz, uint8_t bands)
+{
+	if (bands > IMU_VIB_MAX_BANDS)
+		return false;
+
+	for (uint8_t i = 0; i < bands; i++)
+	{
+		if ((edgesHz[i] < 0.0f) || (edgesHz[i + 1] <= edgesHz[i]))
+			return false;
+	}
+
+	for (uint8_t i = 0; (i <= bands) && (bands > 0); i++)
+	{
+		vib->bandEdgesHz[i] = edgesHz[i];
+	}
+	vib->bands = bands;
+
+	return true;
+}
+
+void imuVib_Reset(imuVib_t *vib)
+{
+	vib->collect = vib->buffers[0];
+	vib->analyse = vib->buffers[1];
+	vib->fill = 0;
+	vib->stage = IMU_VIB_IDLE;
+}
+
+void imuVib_Add(imuVib_t *vib, float x)
+{
+	float *full;
+
+	vib->collect[vib->fill++] = x;
+	if (vib->fill < vib->size)
+		return;
+
+	vib->fill = 0;
+	if (vib->stage != IMU_VIB_IDLE)
+	{
+		// the analysis is late, the window is collected again
+		vib->result.overruns++;
+		return;
+	}
+
+	// the full window is analysed while the next one is collected
+	full = vib->collect;
+	vib->collect = vib->analyse;
+	vib->analyse = full;
+	vib->stage = IMU_VIB_WINDOW;
+}
+
+bool imuVib_Step(imuVib_t *vib)
+{
+	switch (vib->stage)
+	{
+	case IMU_VIB_WINDOW:
+		imuVib_window(vib);
+		vib->span = 1;
+		vib->stage = IMU_VIB_FFT;
+		return false;
+
+	case IMU_VIB_FFT:
+#if IMU_VIB_CMSIS_DSP
+		arm_rfft_fast_f32(&vib->instance, vib->analyse, vib->spectrum, 0);
+		vib->stage = IMU_VIB_SPECTRUM;
+#else
+		imuVib_fftStage(vib);
+		vib->span <<= 1;
+		if (vib->span >= vib->size / 2)
+		{
+			vib->stage = IMU_VIB_SPECTRUM;
+		}
+#endif
+		return false;
+
+	case IMU_VIB_SPECTRUM:
+#if IMU_VIB_CMSIS_DSP
+		imuVib_spectrum(vib, vib->spectrum);
+#else
+		imuVib_split(vib);
+		imuVib_spectrum(vib, vib->analyse);
+#endif
+		vib->stage = IMU_VIB_IDLE;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+bool imuVib_Busy(const imuVib_t *vib)
+{
+	return (vib->stage != IMU_VIB_IDLE);
+}
+
+void imuVib_GetResult(const imuVib_t *vib, imuVibResult_t *result)
+{
+	*result = vib->result;
+}
+
+static inline float imuVib_hann(const imuVib_t *vib, uint16_t n)
+{
+	// 0.5 - 0.5 cos(2 pi n / size), symmetric around size / 2
+	if (n == vib->size / 2)
+		return 1.0f;
+
+	if (n > vib->size / 2)
+	{
+		n = vib->size - n;
+	}
+
+	return 0.5f - 0.5f * vib->cosTable[n];
+}
+
+static void imuVib_window(imuVib_t *vib)
+{
+	float *x = vib->analyse;
+	uint16_t size = vib->size;
+	float mean = 0.0f;
+	float power = 0.0f;
+#if !IMU_VIB_CMSIS_DSP
+	float t;
+	uint16_t j = 0;
+	uint16_t bit;
+#endif
+
+	for (uint16_t n = 0; n < size; n++)
+	{
+		mean += x[n];
+	}
+	mean /= size;
+
+	for (uint16_t n = 0; n < size; n++)
+	{
+		x[n] -= mean;
+		power += x[n] * x[n];
+		x[n] *= imuVib_hann(vib, n);
+	}
+	vib->rms = sqrtf(power / size);
+
+#if !IMU_VIB_CMSIS_DSP
+	// Even samples are the real parts and odd samples the imaginary parts of a
+	// complex FFT of half the length, its input is put in bit-reversed order
+	for (uint16_t i = 0; i < size / 2; i++)
+	{
+		if (i < j)
+		{
+			t = x[2 * i];
+			x[2 * i] = x[2 * j];
+			x[2 * j] = t;
+			t = x[2 * i + 1];
+			x[2 * i + 1] = x[2 * j + 1];
+			x[2 * j + 1] = t;
+		}
+
+		bit = size / 4;
+		while ((bit > 0) && (j & bit))
+		{
+			j ^= bit;
+			bit >>= 1;
+		}
+		j |= bit;
+	}
+#endif
+}
+
+static void imuVib_fftStage(imuVib_t *vib)
+{
+	float *x = vib->analyse;
+	uint16_t half = vib->span;
+	uint16_t stride = vib->size / (2 * half);
+	uint16_t p;
+	uint16_t q;
+	float c;
+	float s;
+	float tr;
+	float ti;
+
+	for (uint16_t start = 0; start < vib->size / 2; start += 2 * half)
+	{
+		for (uint16_t j = 0; j < half; j++)
+		{
+			// twiddle exp(-2 pi i j / (2 * half))
+			c = vib->cosTable[j * stride];
+			s = vib->sinTable[j * stride];
+			p = 2 * (start + j);
+			q = p + 2 * half;
+
+			tr = c * x[q] + s * x[q + 1];
+			ti = c * x[q + 1] - s * x[q];
+			x[q] = x[p] - tr;
+			x[q + 1] = x[p + 1] - ti;
+			x[p] += tr;
+			x[p + 1] += ti;
+		}
+	}
+}
+
+static void imuVib_split(imuVib_t *vib)
+{
+	float *x = vib->analyse;
+	uint16_t m = vib->size / 2;
+	uint16_t mk;
+	float evenR;
+	float evenI;
+	float oddR;
+	float oddI;
+	float wr;
+	float wi;
+	float t;
+
+	// DC and Nyquist bins, from the sum and the difference of the two halves
+	t = x[0];
+	x[0] = t + x[1];
+	x[1] = t - x[1];
+
+	// X[k] = E + W^k O and X[m - k] = conj(E - W^k O), with
+	// E = (Z[k] + conj(Z[m - k])) / 2 and O = -i (Z[k] - conj(Z[m - k])) / 2
+	for (uint16_t k = 1; k <= m / 2; k++)
+	{
+		mk = m - k;
+		evenR = 0.5f * (x[2 * k] + x[2 * mk]);
+		evenI = 0.5f * (x[2 * k + 1] - x[2 * mk + 1]);
+		oddR = 0.5f * (x[2 * k + 1] + x[2 * mk + 1]);
+		oddI = -0.5f * (x[2 * k] - x[2 * mk]);
+
+		wr = vib->cosTable[k] * oddR + vib->sinTable[k] * oddI;
+		wi = vib->cosTable[k] * oddI - vib->sinTable[k] * oddR;
+
+		x[2 * k] = evenR + wr;
+		x[2 * k + 1] = evenI + wi;
+		x[2 * mk] = evenR - wr;
+		x[2 * mk + 1] = -(evenI - wi);
+	}
+}
+
+static void imuVib_spectrum(imuVib_t *vib, float *bins)
+{
+	uint16_t m = vib->size / 2;
+	float resolution = vib->sampleRateHz / vib->size;
+	// Hann window power: sum(w^2) = 3 size / 8
+	float scale = 8.0f / (3.0f * vib->size * vib->size);
+	float nyquist = bins[1];
+	float sum;
+	float f;
+	float a;
+	float b;
+	float c;
+	float d;
+	uint16_t peak = 1;
+
+	// Power of each bin, the mean square of the window adds up over the bins:
+	// bins[k] is written after bins[2k] and bins[2k + 1] were read
+	bins[0] = bins[0] * bins[0] * scale;
+	for (uint16_t k = 1; k < m; k++)
+	{
+		bins[k] = 2.0f * (bins[2 * k] * bins[2 * k] + bins[2 * k + 1]
+				* bins[2 * k + 1]) * scale;
+		if (bins[k] > bins[peak])
+		{
+			peak = k;
+		}
+	}
+	bins[m] = nyquist * nyquist * scale;
+
+	for (uint8_t i = 0; i < vib->bands; i++)
+	{
+		sum = 0.0f;
+		for (uint16_t k = 0; k <= m; k++)
+		{
+			f = k * resolution;
+			if ((f >= vib->bandEdgesHz[i]) && (f < vib->bandEdgesHz[i + 1]))
+			{
+				sum += bins[k];
+			}
+		}
+		vib->result.bandRms[i] = sqrtf(sum);
+	}
+	vib->result.bands = vib->bands;
+
+	// Parabolic interpolation of the amplitudes around the strongest bin
+	a = sqrtf(bins[peak - 1]);
+	b = sqrtf(bins[peak]);
+	c = sqrtf(bins[peak + 1]);
+	d = a - 2.0f * b + c;
+	d = (d < 0.0f) ? 0.5f * (a - c) / d : 0.0f;
+
+	vib->result.rms = vib->rms;
+	vib->result.peakHz = (peak + d) * resolution;
+	// a sine of amplitude A at a bin centre gives a power of A^2 / 3 with the Hann window
+	vib->result.peakAmplitude = sqrtf(3.0f * bins[peak]);
+	vib->result.resolutionHz = resolution;
+	vib->result.windows++;
+}
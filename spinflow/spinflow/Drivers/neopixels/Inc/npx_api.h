@@ -11,6 +11,7 @@
 
 #include "device_config.h"
 #include "device_types.h"
+#include "npx_segment.h"
 
 /**
  * @brief Initializes NeoPixels variables.
@@ -28,6 +29,24 @@ void npx_Init();
  */
 void npx_Clear();
 
+/**
+ * @brief Gets the segment used by the idle, positive and negative patterns.
+ *
+ * It covers the whole strip after npx_Init(). It can be shrunk with npxSeg_SetRange()
+ * to make room for other segments created with npxSeg_Add().
+ *
+ * @return npxSeg_t Main segment identifier.
+ */
+npxSeg_t npx_MainSegment();
+
+/**
+ * @brief Renders the segments that changed and sends them to the strip.
+ *
+ * Nothing is rendered while the NeoPixels are being driven by a stream.
+ * This function is called repeatedly within the main loop.
+ */
+void npx_Tasks();
+
 /**
  * @brief Sets NeoPixels to the idle state pattern.
  *
@@ -35,11 +54,19 @@ void npx_Clear();
  */
 void npx_SetIdle();
 
+/**
+ * @brief Switches the idle state pattern to the next one.
+ *
+ * The idle pattern cycles through a solid colour, a breathing colour, a plasma and the
+ * rotation angle. It is shown from the next call to npx_SetIdle().
+ */
+void npx_NextIdleMode();
+
 /**
  * @brief Sets NeoPixels to indicate positive activity.
  *
  * This function sets NeoPixels to indicate positive activity, such as a positive spin direction.
- * Its changes the color or pattern of NeoPixels to indicate this activity visually.
+ * Red particles are emitted at the rate set by npx_SetSpinRate().
  */
 void npx_SetPositive();
 
@@ -47,8 +74,57 @@ void npx_SetPositive();
  * @brief Sets NeoPixels to indicate negative activity.
  *
  * This function sets NeoPixels to indicate negative activity, such as a negative spin direction.
- * Its changes the color or pattern of NeoPixels to indicate this activity visually.
+ * Blue particles are emitted at the rate set by npx_SetSpinRate().
  */
 void npx_SetNegative();
 
+/**
+ * @brief Sets the spin rate shown by the positive and negative patterns.
+ * @param dps Spin rate, in degrees per second.
+ *
+ * Faster spins emit more particles, moving faster. The sign sets the direction.
+ */
+void npx_SetSpinRate(int16_t dps);
+
+/**
+ * @brief Sets the rotation angle shown by the segments with the NPX_EFFECT_ANGLE effect.
+ * @param degrees Angle within the current revolution, from 0 to 359 degrees.
+ *
+ * A full revolution spans the segment, so the lit LED follows the rotation.
+ */
+void npx_SetRotation(uint16_t degrees);
+
+/**
+ * @brief Feeds streamed frame data into the NeoPixels.
+ * @param data Received bytes, framed as described in npx_frame.h.
+ * @param len Number of received bytes.
+ *
+ * Every complete and valid frame is sent to the strip as soon as it is parsed.
+ * If the strip has not taken the previous frame yet, the latest frame is kept
+ * and npx_Tasks() sends it once the strip can take it. While frames
+ * keep arriving, the segments are not rendered.
+ */
+void npx_StreamWrite(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Checks whether the NeoPixels are being driven by a stream.
+ *
+ * @return bool_t Returns true if a frame was received within DEVICE_NEOPIXEL_STREAM_TIMEOUT_MS.
+ */
+bool_t npx_IsStreaming();
+
+/**
+ * @brief Gets the number of frames sent to the strip.
+ *
+ * @return uint32_t Frames sent since power-up.
+ */
+uint32_t npx_FrameCount();
+
+/**
+ * @brief Checks whether the strip shows the last published frame.
+ *
+ * @return bool_t Returns true if no frame is being sent or waiting to be sent.
+ */
+bool_t npx_IsIdle();
+
 #endif
@@ -0,0 +1,144 @@
+/**
+ ******************************************************************************
+ * @file    npx_frame.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels frame codec
+ *
+ * Framing used to stream full pixel frames from a host. The codec only depends
+ * on the C standard library, so the same sources can be built on the host side.
+ *
+ * Frame layout (multi-byte fields are little endian):
+ *
+ *   | 0xA5 | 0x5A | count (2) | count x {green, red, blue} | fletcher16 (2) |
+ *
+ * The checksum covers the count field and the payload.
+ ******************************************************************************
+ */
+
+#ifndef NEOPIXELS_FRAME_H
+#define NEOPIXELS_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @def NPX_FRAME_SYNC_1
+ * @brief First synchronization byte of a frame.
+ */
+#define NPX_FRAME_SYNC_1			0xA5
+
+/**
+ * @def NPX_FRAME_SYNC_2
+ * @brief Second synchronization byte of a frame.
+ */
+#define NPX_FRAME_SYNC_2			0x5A
+
+/**
+ * @def NPX_FRAME_BYTES_PER_PIXEL
+ * @brief Number of payload bytes per pixel (green, red, blue).
+ */
+#define NPX_FRAME_BYTES_PER_PIXEL	3
+
+/**
+ * @def NPX_FRAME_OVERHEAD
+ * @brief Number of non payload bytes in a frame (sync, count and checksum).
+ */
+#define NPX_FRAME_OVERHEAD			6
+
+/**
+ * @def NPX_FRAME_MAX_PIXELS
+ * @brief Maximum number of pixels accepted in a single frame.
+ *
+ * Frames announcing more pixels are discarded by the parser.
+ */
+#ifndef NPX_FRAME_MAX_PIXELS
+#define NPX_FRAME_MAX_PIXELS		256
+#endif
+
+/**
+ * @def NPX_FRAME_MAX_LENGTH
+ * @brief Maximum length in bytes of an encoded frame.
+ */
+#define NPX_FRAME_MAX_LENGTH		(NPX_FRAME_OVERHEAD + NPX_FRAME_BYTES_PER_PIXEL * NPX_FRAME_MAX_PIXELS)
+
+/**
+ * @enum npxFrameState_t
+ * @brief Internal states of the frame parser.
+ */
+typedef enum
+{
+	NPX_FRAME_SYNC_1_WAIT, /**< Waiting for the first sync byte. */
+	NPX_FRAME_SYNC_2_WAIT, /**< Waiting for the second sync byte. */
+	NPX_FRAME_COUNT_L, /**< Receiving the low byte of the pixel count. */
+	NPX_FRAME_COUNT_H, /**< Receiving the high byte of the pixel count. */
+	NPX_FRAME_PAYLOAD, /**< Receiving pixel data. */
+	NPX_FRAME_CHECK_L, /**< Receiving the low byte of the checksum. */
+	NPX_FRAME_CHECK_H /**< Receiving the high byte of the checksum. */
+} npxFrameState_t;
+
+/**
+ * @struct npxFrameParser_t
+ * @brief Incremental frame parser with a double buffered output.
+ *
+ * Incoming bytes are always written to the back buffer. Once a frame is complete
+ * and its checksum is valid, the back buffer becomes the front buffer and the
+ * parser continues on the other one, so the last complete frame stays readable
+ * while the next one is being received.
+ */
+typedef struct
+{
+	uint8_t data[2][NPX_FRAME_BYTES_PER_PIXEL * NPX_FRAME_MAX_PIXELS]; /**< Frame buffers. */
+	uint16_t count[2]; /**< Pixel count of each frame buffer. */
+	uint8_t back; /**< Index of the buffer being written. */
+
+	npxFrameState_t state; /**< Parser state. */
+	uint16_t expected; /**< Payload length of the frame being received. */
+	uint16_t received; /**< Payload bytes received so far. */
+	uint16_t sum1; /**< Fletcher-16 running sum 1. */
+	uint16_t sum2; /**< Fletcher-16 running sum 2. */
+	uint16_t check; /**< Received checksum. */
+
+	uint32_t frames; /**< Number of valid frames received. */
+	uint32_t errors; /**< Number of frames dropped (checksum or length). */
+} npxFrameParser_t;
+
+/**
+ * @brief Initializes a frame parser.
+ * @param parser Pointer to the parser.
+ */
+void npxFrame_Init(npxFrameParser_t *parser);
+
+/**
+ * @brief Feeds bytes into the parser.
+ * @param parser Pointer to the parser.
+ * @param data Received bytes.
+ * @param len Number of received bytes.
+ * @param complete Set to true if a valid frame was completed.
+ * @return Number of bytes consumed.
+ *
+ * Parsing stops right after a frame is completed, so the caller can handle it
+ * before feeding the remaining bytes again.
+ */
+uint16_t npxFrame_Parse(npxFrameParser_t *parser, const uint8_t *data,
+		uint16_t len, bool *complete);
+
+/**
+ * @brief Gets the last complete frame.
+ * @param parser Pointer to the parser.
+ * @param count Set to the number of pixels of the frame.
+ * @return Pointer to the green, red, blue pixel data.
+ */
+const uint8_t* npxFrame_Front(const npxFrameParser_t *parser, uint16_t *count);
+
+/**
+ * @brief Encodes a frame.
+ * @param grb Pixel data, three bytes per pixel in green, red, blue order.
+ * @param count Number of pixels.
+ * @param out Output buffer, at least NPX_FRAME_OVERHEAD + 3 * count bytes long.
+ * @return Number of bytes written, 0 if count exceeds NPX_FRAME_MAX_PIXELS.
+ */
+uint16_t npxFrame_Encode(const uint8_t *grb, uint16_t count, uint8_t *out);
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * @file    npx_noise.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels fixed-point gradient noise
+ *
+ * Integer Perlin noise used by the organic effects (fire, plasma). Only integer
+ * additions, multiplications and shifts are used, with no 64-bit arithmetic.
+ * The module only depends on the C standard library, so the same sources can be
+ * built on the host side.
+ *
+ * The 16-bit kernels take 16.16 fixed point coordinates: the integer part selects
+ * the lattice cell and the fractional part the position inside it. The 8-bit
+ * kernels take 8.8 coordinates. Noise repeats every 256 cells on each axis.
+ ******************************************************************************
+ */
+
+#ifndef NEOPIXELS_NOISE_H
+#define NEOPIXELS_NOISE_H
+
+#include <stdint.h>
+
+/**
+ * @def NPX_NOISE_CELL
+ * @brief Size of a lattice cell in 16.16 coordinates.
+ */
+#define NPX_NOISE_CELL	0x10000UL
+
+/**
+ * @brief 1D noise with 16-bit output.
+ * @param x Coordinate (16.16).
+ * @return uint16_t Noise value, centred around 0x8000.
+ */
+uint16_t npxNoise_Get16_1D(uint32_t x);
+
+/**
+ * @brief 2D noise with 16-bit output.
+ * @param x X coordinate (16.16).
+ * @param y Y coordinate (16.16).
+ * @return uint16_t Noise value, centred around 0x8000.
+ */
+uint16_t npxNoise_Get16_2D(uint32_t x, uint32_t y);
+
+/**
+ * @brief 3D noise with 16-bit output.
+ * @param x X coordinate (16.16).
+ * @param y Y coordinate (16.16).
+ * @param z Z coordinate (16.16).
+ * @return uint16_t Noise value, centred around 0x8000.
+ */
+uint16_t npxNoise_Get16_3D(uint32_t x, uint32_t y, uint32_t z);
+
+/**
+ * @brief 1D noise with 8-bit output.
+ * @param x Coordinate (8.8).
+ * @return uint8_t Noise value, centred around 0x80.
+ */
+uint8_t npxNoise_Get8_1D(uint16_t x);
+
+/**
+ * @brief 2D noise with 8-bit output.
+ * @param x X coordinate (8.8).
+ * @param y Y coordinate (8.8).
+ * @return uint8_t Noise value, centred around 0x80.
+ */
+uint8_t npxNoise_Get8_2D(uint16_t x, uint16_t y);
+
+/**
+ * @brief 3D noise with 8-bit output.
+ * @param x X coordinate (8.8).
+ * @param y Y coordinate (8.8).
+ * @param z Z coordinate (8.8).
+ * @return uint8_t Noise value, centred around 0x80.
+ */
+uint8_t npxNoise_Get8_3D(uint16_t x, uint16_t y, uint16_t z);
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * @file    npx_particle.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels particle system
+ *
+ * Particles live in a fixed pool stored as a structure of arrays, so the update
+ * loops run over contiguous arrays of a single field. Live particles are kept
+ * packed at the start of the arrays.
+ *
+ * Positions are relative to the segment being rendered: 0 is the first LED and
+ * 65536 the end of the segment, where particles wrap around to the start.
+ ******************************************************************************
+ */
+
+#ifndef NEOPIXELS_PARTICLE_H
+#define NEOPIXELS_PARTICLE_H
+
+#include "npx_port.h"
+
+/**
+ * @def NPX_PARTICLE_MAX
+ * @brief Size of the particle pool.
+ */
+#define NPX_PARTICLE_MAX		DEVICE_NEOPIXEL_PARTICLES
+
+/**
+ * @brief Removes every particle and stops the emitter.
+ */
+void npxParticle_Init();
+
+/**
+ * @brief Adds a particle.
+ * @param position Position (0-65535 along the segment).
+ * @param velocity Position increment per step.
+ * @param red Red component (0-255).
+ * @param green Green component (0-255).
+ * @param blue Blue component (0-255).
+ * @param life Initial life, also its brightness. It decreases every step.
+ * @return bool_t Returns true if there was room in the pool, false otherwise.
+ */
+bool_t npxParticle_Emit(uint16_t position, int16_t velocity, uint8_t red,
+		uint8_t green, uint8_t blue, uint8_t life);
+
+/**
+ * @brief Sets the emitter, placed at the start of the segment.
+ * @param perSecond Emission rate, in particles per second. 0 stops the emitter.
+ * @param velocity Mean velocity of the emitted particles, in position increment per step.
+ */
+void npxParticle_SetEmitter(uint16_t perSecond, int16_t velocity);
+
+/**
+ * @brief Emits the due particles, then moves and ages every particle.
+ * @param elapsedMs Time since the previous step, in milliseconds.
+ * @param red Red component of the emitted particles.
+ * @param green Green component of the emitted particles.
+ * @param blue Blue component of the emitted particles.
+ */
+void npxParticle_Step(uint16_t elapsedMs, uint8_t red, uint8_t green,
+		uint8_t blue);
+
+/**
+ * @brief Blends the particles into a range of pixels.
+ * @param p First pixel of the range.
+ * @param length Number of pixels.
+ * @param brightness Brightness (0-255).
+ *
+ * Colours are added with saturation. A particle between two LEDs is split
+ * between both of them.
+ */
+void npxParticle_Render(pixel_t *p, uint16_t length, uint8_t brightness);
+
+/**
+ * @brief Gets the number of live particles.
+ * @return uint16_t Number of live particles.
+ */
+uint16_t npxParticle_Count();
+
+#endif
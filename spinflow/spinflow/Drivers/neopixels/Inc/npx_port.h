@@ -82,12 +82,60 @@ void npxPort_SetGreen(uint8_t bright);
  */
 void npxPort_SetBlue(uint8_t bright);
 
+/**
+ * @brief Sets the NeoPixel LEDs from a buffer and updates the strip.
+ * @param grb Pixel data, three bytes per pixel in green, red, blue order.
+ * @param qty Number of pixels in the buffer.
+ * @return bool_t Returns true if the frame was queued, false if the previous swap is still pending.
+ *
+ * Pixels beyond qty are turned off, pixels beyond NEOPIXEL_LED_QTY are ignored.
+ */
+bool_t npxPort_SetPixels(const uint8_t *grb, uint16_t qty);
+
+/**
+ * @brief Gets the back buffer, where the next frame has to be rendered.
+ * @return Pointer to NEOPIXEL_LED_QTY pixels, or NULL while the previous frame is still waiting to be sent.
+ *
+ * The buffer must not be written after calling npxPort_SwapBuffers().
+ */
+pixel_t* npxPort_GetBackBuffer();
+
+/**
+ * @brief Flags LEDs of the back buffer as changed.
+ * @param start Index of the first LED.
+ * @param length Number of LEDs.
+ *
+ * Only flagged LEDs are encoded again when the back buffer is published, the rest of the
+ * strip keeps its previous encoding. Renderers must flag every LED they modify.
+ */
+void npxPort_MarkDirty(uint16_t start, uint16_t length);
+
+/**
+ * @brief Publishes the back buffer as the next frame.
+ *
+ * The swap itself is done by the output at the next frame boundary: right away if the strip
+ * is idle, or from the DMA transfer complete interrupt otherwise. No pixel data is copied.
+ */
+void npxPort_SwapBuffers();
+
 /**
  * @brief Updates the LED strip to reflect any changes made to their color or state.
  *
- * This function should be called after setting LED colors to send the updated color data
- * to the NeoPixel strip.
+ * Takes a pending swap, encodes the front buffer and starts the DMA transfer.
+ * Prefer npxPort_SwapBuffers(), which does not restart a transfer in progress.
  */
 void npxPort_SetLEDs();
 
+/**
+ * @brief Gets the number of frames sent to the strip.
+ * @return Frames whose DMA transfer completed since power-up.
+ */
+uint32_t npxPort_FrameCount();
+
+/**
+ * @brief Checks whether the strip shows the last published frame.
+ * @return True if no frame is being sent or waiting to be sent.
+ */
+bool_t npxPort_IsIdle();
+
 #endif
@@ -0,0 +1,131 @@
+/**
+ ******************************************************************************
+ * @file    npx_segment.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels segments
+ *
+ * A segment is a range of LEDs of the strip with its own effect, colour,
+ * brightness and update rate. Segments are rendered into the back buffer
+ * only when their content changes, and only their LEDs are encoded again.
+ ******************************************************************************
+ */
+
+#ifndef NEOPIXELS_SEGMENT_H
+#define NEOPIXELS_SEGMENT_H
+
+#include "npx_port.h"
+
+/**
+ * @def NPX_SEG_MAX
+ * @brief Maximum number of segments.
+ */
+#define NPX_SEG_MAX		DEVICE_NEOPIXEL_SEGMENTS
+
+/**
+ * @def NPX_SEG_INVALID
+ * @brief Returned when a segment can not be created.
+ */
+#define NPX_SEG_INVALID	0xFF
+
+/**
+ * @typedef npxSeg_t
+ * @brief Segment identifier.
+ */
+typedef uint8_t npxSeg_t;
+
+/**
+ * @enum npxEffect_t
+ * @brief Effects that can be assigned to a segment.
+ */
+typedef enum
+{
+	NPX_EFFECT_OFF, /**< All LEDs off. */
+	NPX_EFFECT_SOLID, /**< All LEDs on with the segment colour. */
+	NPX_EFFECT_BLINK, /**< All LEDs toggle every period. */
+	NPX_EFFECT_BREATHE, /**< Brightness ramps up and down, one step per period. */
+	NPX_EFFECT_CHASE, /**< A single LED moves along the segment, one LED per period. */
+	NPX_EFFECT_FIRE, /**< Flickering flames from the first LED, black-red-yellow-white palette. The colour is not used. */
+	NPX_EFFECT_PLASMA, /**< Slowly drifting rainbow. The colour is not used. */
+	NPX_EFFECT_PARTICLES, /**< Particles of the segment colour, see npx_particle.h. The particle pool is shared, only one segment should use it. */
+	NPX_EFFECT_ANGLE /**< A single LED at the position set by npxSeg_SetPosition(), e.g. following the rotation angle. */
+} npxEffect_t;
+
+/**
+ * @brief Removes all segments.
+ */
+void npxSeg_Init();
+
+/**
+ * @brief Creates a segment.
+ * @param start Index of the first LED.
+ * @param length Number of LEDs.
+ * @return npxSeg_t Identifier of the new segment, NPX_SEG_INVALID if there is no room or the range is invalid.
+ *
+ * New segments are off. Segments should not overlap.
+ */
+npxSeg_t npxSeg_Add(uint16_t start, uint16_t length);
+
+/**
+ * @brief Moves or resizes a segment.
+ * @param seg Segment identifier.
+ * @param start Index of the first LED.
+ * @param length Number of LEDs.
+ * @return bool_t Returns true if the range is valid, false otherwise.
+ *
+ * LEDs left outside the new range keep their last colour.
+ */
+bool_t npxSeg_SetRange(npxSeg_t seg, uint16_t start, uint16_t length);
+
+/**
+ * @brief Sets the effect and colour of a segment.
+ * @param seg Segment identifier.
+ * @param effect Effect.
+ * @param red Red component (0-255).
+ * @param green Green component (0-255).
+ * @param blue Blue component (0-255).
+ *
+ * Nothing is rendered if the segment already had this effect and colour.
+ */
+void npxSeg_SetEffect(npxSeg_t seg, npxEffect_t effect, uint8_t red,
+		uint8_t green, uint8_t blue);
+
+/**
+ * @brief Sets the brightness of a segment.
+ * @param seg Segment identifier.
+ * @param brightness Brightness (0-255), applied on top of the colour.
+ */
+void npxSeg_SetBrightness(npxSeg_t seg, uint8_t brightness);
+
+/**
+ * @brief Sets the update rate of an animated segment.
+ * @param seg Segment identifier.
+ * @param periodMs Time between animation steps, in milliseconds. 0 stops the animation.
+ */
+void npxSeg_SetPeriod(npxSeg_t seg, uint16_t periodMs);
+
+/**
+ * @brief Sets the position shown by the NPX_EFFECT_ANGLE effect.
+ * @param seg Segment identifier.
+ * @param position Position along the segment, from 0 (first LED) to 65535 (last LED).
+ *
+ * The segment is only rendered again when the lit LED changes.
+ */
+void npxSeg_SetPosition(npxSeg_t seg, uint16_t position);
+
+/**
+ * @brief Forces every segment to be rendered again.
+ *
+ * Must be called after the strip was written without using segments.
+ */
+void npxSeg_Invalidate();
+
+/**
+ * @brief Advances animations and sends the changed segments to the strip.
+ *
+ * This function is called repeatedly within the main loop.
+ */
+void npxSeg_Tasks();
+
+#endif
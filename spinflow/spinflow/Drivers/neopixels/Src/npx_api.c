@@ -10,33 +10,243 @@
 
 #include "npx_api.h"
 #include "npx_port.h"
+#include "npx_frame.h"
+#include "npx_segment.h"
+#include "npx_particle.h"
 
 /**
  * @brief LED brightness
  */
 #define NPX_LED_BRIGHTNESS 50
 
+/**
+ * @brief Animation step of the main segment
+ */
+#define NPX_MAIN_PERIOD_MS 20
+
+/**
+ * @brief Spin rate, in degrees per second, that emits one particle per second
+ */
+#define NPX_PARTICLE_DPS_PER_RATE 4
+
+/**
+ * @brief Particle velocity, in position increment per step, per degree per second
+ */
+#define NPX_PARTICLE_VEL_PER_DPS 8
+
+/**
+ * @brief Stream timeout
+ */
+#define NPX_STREAM_TIMEOUT_MS DEVICE_NEOPIXEL_STREAM_TIMEOUT_MS
+
+/**
+ * @var npxStreamParser
+ * @brief Parser for frames streamed by a host.
+ */
+static npxFrameParser_t npxStreamParser;
+
+/**
+ * @var npxStreamTick
+ * @brief Tick of the last streamed frame.
+ */
+static uint32_t npxStreamTick;
+
+/**
+ * @var npxStreamActive
+ * @brief Set once a frame is received, cleared on timeout.
+ */
+static bool_t npxStreamActive;
+
+/**
+ * @var npxStreamOwned
+ * @brief Set while the strip shows streamed frames instead of the segments.
+ */
+static bool_t npxStreamOwned;
+
+/**
+ * @var npxStreamPending
+ * @brief Set while the last parsed frame waits for the back buffer.
+ */
+static bool_t npxStreamPending;
+
+/**
+ * @var npxMainSegment
+ * @brief Segment covering the whole strip, used by the status patterns.
+ */
+static npxSeg_t npxMainSegment;
+
+/**
+ * @var npxIdleEffects
+ * @brief Idle state patterns, selected by npx_NextIdleMode().
+ */
+static const npxEffect_t npxIdleEffects[] =
+{ NPX_EFFECT_SOLID, NPX_EFFECT_BREATHE, NPX_EFFECT_PLASMA, NPX_EFFECT_ANGLE };
+
+/**
+ * @var npxIdleMode
+ * @brief Index of the idle state pattern.
+ */
+static uint8_t npxIdleMode;
+
+/**
+ * @brief Sends the pending streamed frame to the strip, once the back buffer is free.
+ */
+static void npx_streamShow();
+
 void npx_Init()
 {
 	npxPort_Init();
+	npxFrame_Init(&npxStreamParser);
+	npxStreamActive = false;
+	npxStreamOwned = false;
+	npxStreamPending = false;
+
+	npxSeg_Init();
+	npxMainSegment = npxSeg_Add(0, NEOPIXEL_LED_QTY);
+	npxSeg_SetBrightness(npxMainSegment, NPX_LED_BRIGHTNESS);
+	npxSeg_SetPeriod(npxMainSegment, NPX_MAIN_PERIOD_MS);
+
+	npxParticle_Init();
 }
 
 void npx_Clear()
 {
-	npxPort_ClearLEDs();
+	for (npxSeg_t seg = 0; seg < NPX_SEG_MAX; seg++)
+	{
+		npxSeg_SetEffect(seg, NPX_EFFECT_OFF, 0, 0, 0);
+	}
 }
 
 void npx_SetIdle()
 {
-	npxPort_SetGreen(NPX_LED_BRIGHTNESS);
+	npxParticle_Init();
+	npxSeg_SetEffect(npxMainSegment, npxIdleEffects[npxIdleMode], 0, 255, 0);
+}
+
+void npx_NextIdleMode()
+{
+	npxIdleMode = (npxIdleMode + 1)
+			% (sizeof(npxIdleEffects) / sizeof(npxIdleEffects[0]));
 }
 
 void npx_SetPositive()
 {
-	npxPort_SetRed(NPX_LED_BRIGHTNESS);
+	npxSeg_SetEffect(npxMainSegment, NPX_EFFECT_PARTICLES, 255, 0, 0);
 }
 
 void npx_SetNegative()
 {
-	npxPort_SetBlue(NPX_LED_BRIGHTNESS);
+	npxSeg_SetEffect(npxMainSegment, NPX_EFFECT_PARTICLES, 0, 0, 255);
+}
+
+void npx_SetSpinRate(int16_t dps)
+{
+	int32_t velocity = (int32_t) dps * NPX_PARTICLE_VEL_PER_DPS;
+	uint16_t rate = (uint16_t) (((dps < 0) ? -(int32_t) dps : dps)
+			/ NPX_PARTICLE_DPS_PER_RATE);
+
+	if (velocity > INT16_MAX)
+	{
+		velocity = INT16_MAX;
+	}
+	else if (velocity < -INT16_MAX)
+	{
+		velocity = -INT16_MAX;
+	}
+
+	npxParticle_SetEmitter(rate, (int16_t) velocity);
+}
+
+void npx_SetRotation(uint16_t degrees)
+{
+	uint16_t position = (uint16_t) (((uint32_t) (degrees % 360) << 16) / 360);
+
+	for (npxSeg_t seg = 0; seg < NPX_SEG_MAX; seg++)
+	{
+		npxSeg_SetPosition(seg, position);
+	}
+}
+
+npxSeg_t npx_MainSegment()
+{
+	return npxMainSegment;
+}
+
+void npx_Tasks()
+{
+	if (npx_IsStreaming())
+	{
+		npxStreamOwned = true;
+		npx_streamShow();
+		return;
+	}
+
+	// the stream overwrote the whole strip, render every segment again
+	if (npxStreamOwned)
+	{
+		npxStreamOwned = false;
+		npxStreamPending = false;
+		npxSeg_Invalidate();
+	}
+
+	npxSeg_Tasks();
+}
+
+void npx_StreamWrite(const uint8_t *data, uint16_t len)
+{
+	uint16_t used;
+	bool complete;
+
+	while (len > 0)
+	{
+		used = npxFrame_Parse(&npxStreamParser, data, len, &complete);
+		data += used;
+		len -= used;
+
+		// the parser keeps the latest frame until the strip can take it
+		if (complete)
+		{
+			npxStreamPending = true;
+			npx_streamShow();
+
+			npxStreamTick = HAL_GetTick();
+			npxStreamActive = true;
+		}
+	}
+}
+
+bool_t npx_IsStreaming()
+{
+	if (npxStreamActive
+			&& ((HAL_GetTick() - npxStreamTick) >= NPX_STREAM_TIMEOUT_MS))
+	{
+		npxStreamActive = false;
+	}
+
+	return npxStreamActive;
+}
+
+uint32_t npx_FrameCount()
+{
+	return npxPort_FrameCount();
+}
+
+bool_t npx_IsIdle()
+{
+	return npxPort_IsIdle();
+}
+
+static void npx_streamShow()
+{
+	const uint8_t *frame;
+	uint16_t count;
+
+	if (!npxStreamPending)
+		return;
+
+	frame = npxFrame_Front(&npxStreamParser, &count);
+	if (npxPort_SetPixels(frame, count))
+	{
+		npxStreamPending = false;
+	}
 }
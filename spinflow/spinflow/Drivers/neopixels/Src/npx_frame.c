@@ -0,0 +1,218 @@
+/**
+ ******************************************************************************
+ * @file    npx_frame.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels frame codec
+ ******************************************************************************
+ */
+
+#include "npx_frame.h"
+#include <string.h>
+
+/**
+ * @def NPX_FRAME_SUM_BLOCK
+ * @brief Number of bytes accumulated before reducing the Fletcher sums.
+ *
+ * Reducing once per block instead of once per byte keeps the modulo out of the
+ * inner loop; 256 bytes keep the 32-bit accumulators far from overflowing.
+ */
+#define NPX_FRAME_SUM_BLOCK		256
+
+/**
+ * @brief Adds bytes to the Fletcher-16 running sums.
+ * @param sum1 Running sum 1.
+ * @param sum2 Running sum 2.
+ * @param data Bytes to add.
+ * @param len Number of bytes.
+ */
+static void npxFrame_sum(uint16_t *sum1, uint16_t *sum2, const uint8_t *data,
+		uint16_t len);
+
+void npxFrame_Init(npxFrameParser_t *parser)
+{
+	if (parser == NULL)
+		return;
+
+	memset(parser, 0, sizeof(npxFrameParser_t));
+	parser->state = NPX_FRAME_SYNC_1_WAIT;
+}
+
+uint16_t npxFrame_Parse(npxFrameParser_t *parser, const uint8_t *data,
+		uint16_t len, bool *complete)
+{
+	uint16_t i = 0;
+	uint16_t chunk;
+	uint8_t byte;
+
+	*complete = false;
+
+	if ((parser == NULL) || (data == NULL))
+		return len;
+
+	while (i < len)
+	{
+		// payload is copied in bulk, the rest is handled byte by byte
+		if (parser->state == NPX_FRAME_PAYLOAD)
+		{
+			chunk = parser->expected - parser->received;
+			if (chunk > (len - i))
+			{
+				chunk = len - i;
+			}
+
+			memcpy(&parser->data[parser->back][parser->received], &data[i],
+					chunk);
+			npxFrame_sum(&parser->sum1, &parser->sum2, &data[i], chunk);
+
+			parser->received += chunk;
+			i += chunk;
+
+			if (parser->received == parser->expected)
+			{
+				parser->state = NPX_FRAME_CHECK_L;
+			}
+			continue;
+		}
+
+		byte = data[i++];
+
+		switch (parser->state)
+		{
+		case NPX_FRAME_SYNC_1_WAIT:
+			if (byte == NPX_FRAME_SYNC_1)
+			{
+				parser->state = NPX_FRAME_SYNC_2_WAIT;
+			}
+			break;
+
+		case NPX_FRAME_SYNC_2_WAIT:
+			if (byte == NPX_FRAME_SYNC_2)
+			{
+				parser->sum1 = 0;
+				parser->sum2 = 0;
+				parser->state = NPX_FRAME_COUNT_L;
+			}
+			else if (byte != NPX_FRAME_SYNC_1)
+			{
+				parser->state = NPX_FRAME_SYNC_1_WAIT;
+			}
+			break;
+
+		case NPX_FRAME_COUNT_L:
+			npxFrame_sum(&parser->sum1, &parser->sum2, &byte, 1);
+			parser->expected = byte;
+			parser->state = NPX_FRAME_COUNT_H;
+			break;
+
+		case NPX_FRAME_COUNT_H:
+			npxFrame_sum(&parser->sum1, &parser->sum2, &byte, 1);
+			parser->expected |= (uint16_t) byte << 8;
+
+			if (parser->expected > NPX_FRAME_MAX_PIXELS)
+			{
+				// length out of range, look for the next frame
+				parser->errors++;
+				parser->state = NPX_FRAME_SYNC_1_WAIT;
+			}
+			else
+			{
+				parser->count[parser->back] = parser->expected;
+				parser->expected *= NPX_FRAME_BYTES_PER_PIXEL;
+				parser->received = 0;
+				parser->state =
+						(parser->expected > 0) ?
+								NPX_FRAME_PAYLOAD : NPX_FRAME_CHECK_L;
+			}
+			break;
+
+		case NPX_FRAME_CHECK_L:
+			parser->check = byte;
+			parser->state = NPX_FRAME_CHECK_H;
+			break;
+
+		case NPX_FRAME_CHECK_H:
+			parser->check |= (uint16_t) byte << 8;
+			parser->state = NPX_FRAME_SYNC_1_WAIT;
+
+			if (parser->check == ((parser->sum2 << 8) | parser->sum1))
+			{
+				// publish the frame and continue on the other buffer
+				parser->back ^= 1;
+				parser->frames++;
+				*complete = true;
+				return i;
+			}
+			else
+			{
+				parser->errors++;
+			}
+			break;
+
+		default:
+			parser->state = NPX_FRAME_SYNC_1_WAIT;
+			break;
+		}
+	}
+
+	return i;
+}
+
+const uint8_t* npxFrame_Front(const npxFrameParser_t *parser, uint16_t *count)
+{
+	uint8_t front = parser->back ^ 1;
+
+	*count = parser->count[front];
+	return parser->data[front];
+}
+
+uint16_t npxFrame_Encode(const uint8_t *grb, uint16_t count, uint8_t *out)
+{
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	uint16_t payload = count * NPX_FRAME_BYTES_PER_PIXEL;
+
+	if ((count > NPX_FRAME_MAX_PIXELS) || (out == NULL)
+			|| ((grb == NULL) && (count > 0)))
+		return 0;
+
+	out[0] = NPX_FRAME_SYNC_1;
+	out[1] = NPX_FRAME_SYNC_2;
+	out[2] = (uint8_t) count;
+	out[3] = (uint8_t) (count >> 8);
+	memcpy(&out[4], grb, payload);
+
+	npxFrame_sum(&sum1, &sum2, &out[2], payload + 2);
+
+	out[4 + payload] = (uint8_t) sum1;
+	out[5 + payload] = (uint8_t) sum2;
+
+	return payload + NPX_FRAME_OVERHEAD;
+}
+
+static void npxFrame_sum(uint16_t *sum1, uint16_t *sum2, const uint8_t *data,
+		uint16_t len)
+{
+	uint32_t s1 = *sum1;
+	uint32_t s2 = *sum2;
+	uint16_t block;
+
+	while (len > 0)
+	{
+		block = (len > NPX_FRAME_SUM_BLOCK) ? NPX_FRAME_SUM_BLOCK : len;
+		len -= block;
+
+		while (block--)
+		{
+			s1 += *data++;
+			s2 += s1;
+		}
+
+		s1 %= 255;
+		s2 %= 255;
+	}
+
+	*sum1 = (uint16_t) s1;
+	*sum2 = (uint16_t) s2;
+}
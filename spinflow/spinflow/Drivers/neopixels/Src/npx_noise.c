@@ -0,0 +1,243 @@
+/**
+ ******************************************************************************
+ * @file    npx_noise.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels fixed-point gradient noise
+ ******************************************************************************
+ */
+
+#include "npx_noise.h"
+
+/**
+ * @def NPX_NOISE_FRAC_BITS
+ * @brief Precision of the distances to the lattice corners (Q12).
+ *
+ * Keeps every intermediate product within 32 bits.
+ */
+#define NPX_NOISE_FRAC_BITS	12
+
+/**
+ * @def NPX_NOISE_ONE
+ * @brief 1.0 in the distance format.
+ */
+#define NPX_NOISE_ONE		(1 << NPX_NOISE_FRAC_BITS)
+
+/**
+ * @def NPX_NOISE_HASH
+ * @brief Hashes a lattice coordinate with a previous hash.
+ */
+#define NPX_NOISE_HASH(h, i)	(perm[(uint8_t) ((h) + (i))])
+
+/**
+ * @var perm
+ * @brief Permutation table of the reference implementation of improved Perlin noise.
+ */
+static const uint8_t perm[256] =
+{ 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140,
+		36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247,
+		120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57,
+		177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+		74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229,
+		122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102,
+		143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89,
+		18, 169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198,
+		173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118,
+		126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28,
+		42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153,
+		101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113,
+		224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193,
+		238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239,
+		107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121,
+		50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72,
+		243, 141, 128, 195, 78, 66, 215, 61, 156 };
+
+/**
+ * @brief Smoothstep easing curve, 3t^2 - 2t^3.
+ * @param t Position inside the cell (Q16).
+ * @return Eased position (Q16).
+ */
+static inline uint32_t npxNoise_fade(uint32_t t);
+
+/**
+ * @brief Linear interpolation.
+ * @param a Value at 0.
+ * @param b Value at 1.
+ * @param t Position (Q16).
+ * @return Interpolated value.
+ */
+static inline int32_t npxNoise_lerp(int32_t a, int32_t b, uint32_t t);
+
+/**
+ * @brief Dot product of a pseudo-random 1D gradient and the distance to the corner.
+ */
+static inline int32_t npxNoise_grad1(uint8_t hash, int32_t x);
+
+/**
+ * @brief Dot product of a pseudo-random 2D gradient and the distance to the corner.
+ */
+static inline int32_t npxNoise_grad2(uint8_t hash, int32_t x, int32_t y);
+
+/**
+ * @brief Dot product of a pseudo-random 3D gradient and the distance to the corner.
+ */
+static inline int32_t npxNoise_grad3(uint8_t hash, int32_t x, int32_t y,
+		int32_t z);
+
+/**
+ * @brief Maps a signed noise value to the 16-bit output range.
+ * @param n Noise value.
+ * @param shift Left shift that brings the peak amplitude of n to 0x8000.
+ * @return Saturated output.
+ */
+static inline uint16_t npxNoise_output(int32_t n, uint8_t shift);
+
+uint16_t npxNoise_Get16_1D(uint32_t x)
+{
+	uint8_t X = (uint8_t) (x >> 16);
+	uint32_t u = x & 0xFFFF;
+	int32_t dx = (int32_t) (u >> (16 - NPX_NOISE_FRAC_BITS));
+	int32_t n;
+
+	n = npxNoise_lerp(npxNoise_grad1(perm[X], dx),
+			npxNoise_grad1(perm[(uint8_t) (X + 1)], dx - NPX_NOISE_ONE),
+			npxNoise_fade(u));
+
+	// peak amplitude is 0.5
+	return npxNoise_output(n, 16 - NPX_NOISE_FRAC_BITS);
+}
+
+uint16_t npxNoise_Get16_2D(uint32_t x, uint32_t y)
+{
+	uint8_t X = (uint8_t) (x >> 16);
+	uint8_t Y = (uint8_t) (y >> 16);
+	uint32_t u = x & 0xFFFF;
+	uint32_t v = y & 0xFFFF;
+	int32_t dx = (int32_t) (u >> (16 - NPX_NOISE_FRAC_BITS));
+	int32_t dy = (int32_t) (v >> (16 - NPX_NOISE_FRAC_BITS));
+	uint8_t A = NPX_NOISE_HASH(perm[X], Y);
+	uint8_t B = NPX_NOISE_HASH(perm[(uint8_t) (X + 1)], Y);
+	uint32_t fu = npxNoise_fade(u);
+	int32_t n0, n1;
+
+	n0 = npxNoise_lerp(npxNoise_grad2(perm[A], dx, dy),
+			npxNoise_grad2(perm[B], dx - NPX_NOISE_ONE, dy), fu);
+	n1 = npxNoise_lerp(
+			npxNoise_grad2(perm[(uint8_t) (A + 1)], dx, dy - NPX_NOISE_ONE),
+			npxNoise_grad2(perm[(uint8_t) (B + 1)], dx - NPX_NOISE_ONE,
+					dy - NPX_NOISE_ONE), fu);
+
+	// peak amplitude is about 1.0
+	return npxNoise_output(npxNoise_lerp(n0, n1, npxNoise_fade(v)),
+			15 - NPX_NOISE_FRAC_BITS);
+}
+
+uint16_t npxNoise_Get16_3D(uint32_t x, uint32_t y, uint32_t z)
+{
+	uint8_t X = (uint8_t) (x >> 16);
+	uint8_t Y = (uint8_t) (y >> 16);
+	uint8_t Z = (uint8_t) (z >> 16);
+	uint32_t u = x & 0xFFFF;
+	uint32_t v = y & 0xFFFF;
+	uint32_t w = z & 0xFFFF;
+	int32_t dx = (int32_t) (u >> (16 - NPX_NOISE_FRAC_BITS));
+	int32_t dy = (int32_t) (v >> (16 - NPX_NOISE_FRAC_BITS));
+	int32_t dz = (int32_t) (w >> (16 - NPX_NOISE_FRAC_BITS));
+	uint8_t A = NPX_NOISE_HASH(perm[X], Y);
+	uint8_t AA = NPX_NOISE_HASH(perm[A], Z);
+	uint8_t AB = NPX_NOISE_HASH(perm[(uint8_t) (A + 1)], Z);
+	uint8_t B = NPX_NOISE_HASH(perm[(uint8_t) (X + 1)], Y);
+	uint8_t BA = NPX_NOISE_HASH(perm[B], Z);
+	uint8_t BB = NPX_NOISE_HASH(perm[(uint8_t) (B + 1)], Z);
+	uint32_t fu = npxNoise_fade(u);
+	uint32_t fv = npxNoise_fade(v);
+	int32_t dx1 = dx - NPX_NOISE_ONE;
+	int32_t dy1 = dy - NPX_NOISE_ONE;
+	int32_t dz1 = dz - NPX_NOISE_ONE;
+	int32_t n0, n1;
+
+	n0 = npxNoise_lerp(
+			npxNoise_lerp(npxNoise_grad3(perm[AA], dx, dy, dz),
+					npxNoise_grad3(perm[BA], dx1, dy, dz), fu),
+			npxNoise_lerp(npxNoise_grad3(perm[AB], dx, dy1, dz),
+					npxNoise_grad3(perm[BB], dx1, dy1, dz), fu), fv);
+	n1 = npxNoise_lerp(
+			npxNoise_lerp(
+					npxNoise_grad3(perm[(uint8_t) (AA + 1)], dx, dy, dz1),
+					npxNoise_grad3(perm[(uint8_t) (BA + 1)], dx1, dy, dz1),
+					fu),
+			npxNoise_lerp(
+					npxNoise_grad3(perm[(uint8_t) (AB + 1)], dx, dy1, dz1),
+					npxNoise_grad3(perm[(uint8_t) (BB + 1)], dx1, dy1, dz1),
+					fu), fv);
+
+	// peak amplitude is about 1.0
+	return npxNoise_output(npxNoise_lerp(n0, n1, npxNoise_fade(w)),
+			15 - NPX_NOISE_FRAC_BITS);
+}
+
+uint8_t npxNoise_Get8_1D(uint16_t x)
+{
+	return (uint8_t) (npxNoise_Get16_1D((uint32_t) x << 8) >> 8);
+}
+
+uint8_t npxNoise_Get8_2D(uint16_t x, uint16_t y)
+{
+	return (uint8_t) (npxNoise_Get16_2D((uint32_t) x << 8, (uint32_t) y << 8)
+			>> 8);
+}
+
+uint8_t npxNoise_Get8_3D(uint16_t x, uint16_t y, uint16_t z)
+{
+	return (uint8_t) (npxNoise_Get16_3D((uint32_t) x << 8, (uint32_t) y << 8,
+			(uint32_t) z << 8) >> 8);
+}
+
+static inline uint32_t npxNoise_fade(uint32_t t)
+{
+	uint32_t t2 = (t * t) >> 16;
+	uint32_t t3 = (t2 * t) >> 16;
+
+	return 3 * t2 - 2 * t3;
+}
+
+static inline int32_t npxNoise_lerp(int32_t a, int32_t b, uint32_t t)
+{
+	// |b - a| stays below 2^15, so the product fits in 32 bits
+	return a + (((b - a) * (int32_t) t) >> 16);
+}
+
+static inline int32_t npxNoise_grad1(uint8_t hash, int32_t x)
+{
+	return (hash & 1) ? -x : x;
+}
+
+static inline int32_t npxNoise_grad2(uint8_t hash, int32_t x, int32_t y)
+{
+	// gradients (+-1, +-1)
+	return ((hash & 1) ? -x : x) + ((hash & 2) ? -y : y);
+}
+
+static inline int32_t npxNoise_grad3(uint8_t hash, int32_t x, int32_t y,
+		int32_t z)
+{
+	// the 12 cube edge gradients of improved Perlin noise
+	uint8_t h = hash & 15;
+	int32_t a = (h < 8) ? x : y;
+	int32_t b = (h < 4) ? y : (((h == 12) || (h == 14)) ? x : z);
+
+	return ((h & 1) ? -a : a) + ((h & 2) ? -b : b);
+}
+
+static inline uint16_t npxNoise_output(int32_t n, uint8_t shift)
+{
+	n = 0x8000 + (n << shift);
+
+	if (n < 0)
+		return 0;
+	if (n > 0xFFFF)
+		return 0xFFFF;
+
+	return (uint16_t) n;
+}
@@ -0,0 +1,263 @@
+/**
+ ******************************************************************************
+ * @file    npx_particle.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels particle system
+ ******************************************************************************
+ */
+
+#include "npx_particle.h"
+
+/**
+ * @def NPX_PARTICLE_DECAY
+ * @brief Life lost by a particle every step.
+ */
+#define NPX_PARTICLE_DECAY		4
+
+/**
+ * @def NPX_PARTICLE_JITTER
+ * @brief Maximum random deviation of the emitted velocity, as a right shift of it.
+ */
+#define NPX_PARTICLE_JITTER		2
+
+/**
+ * @var partPos
+ * @brief Particle positions.
+ */
+static uint16_t partPos[NPX_PARTICLE_MAX];
+
+/**
+ * @var partVel
+ * @brief Particle velocities.
+ */
+static int16_t partVel[NPX_PARTICLE_MAX];
+
+/**
+ * @var partRed
+ * @brief Particle red components.
+ */
+static uint8_t partRed[NPX_PARTICLE_MAX];
+
+/**
+ * @var partGreen
+ * @brief Particle green components.
+ */
+static uint8_t partGreen[NPX_PARTICLE_MAX];
+
+/**
+ * @var partBlue
+ * @brief Particle blue components.
+ */
+static uint8_t partBlue[NPX_PARTICLE_MAX];
+
+/**
+ * @var partLife
+ * @brief Particle remaining life.
+ */
+static uint8_t partLife[NPX_PARTICLE_MAX];
+
+/**
+ * @var partCount
+ * @brief Number of live particles, stored in the first positions of the arrays.
+ */
+static uint16_t partCount;
+
+/**
+ * @var emitRate
+ * @brief Emitter rate, in particles per second.
+ */
+static uint16_t emitRate;
+
+/**
+ * @var emitVelocity
+ * @brief Emitter mean velocity.
+ */
+static int16_t emitVelocity;
+
+/**
+ * @var emitAccumulator
+ * @brief Emission credit, in particles per 1000.
+ */
+static uint32_t emitAccumulator;
+
+/**
+ * @var randState
+ * @brief State of the pseudo-random generator.
+ */
+static uint32_t randState = 0x2545F491;
+
+/**
+ * @brief Pseudo-random generator (xorshift32).
+ * @return Next random value.
+ */
+static uint32_t npxParticle_rand();
+
+/**
+ * @brief Adds a colour component with saturation.
+ * @param c Colour component.
+ * @param add Value to add.
+ * @return Saturated sum.
+ */
+static inline uint8_t npxParticle_add(uint8_t c, uint32_t add);
+
+void npxParticle_Init()
+{
+	partCount = 0;
+	emitRate = 0;
+	emitVelocity = 0;
+	emitAccumulator = 0;
+}
+
+bool_t npxParticle_Emit(uint16_t position, int16_t velocity, uint8_t red,
+		uint8_t green, uint8_t blue, uint8_t life)
+{
+	if ((partCount >= NPX_PARTICLE_MAX) || (life == 0))
+		return false;
+
+	partPos[partCount] = position;
+	partVel[partCount] = velocity;
+	partRed[partCount] = red;
+	partGreen[partCount] = green;
+	partBlue[partCount] = blue;
+	partLife[partCount] = life;
+	partCount++;
+
+	return true;
+}
+
+void npxParticle_SetEmitter(uint16_t perSecond, int16_t velocity)
+{
+	emitRate = perSecond;
+	emitVelocity = velocity;
+
+	if (perSecond == 0)
+	{
+		emitAccumulator = 0;
+	}
+}
+
+void npxParticle_Step(uint16_t elapsedMs, uint8_t red, uint8_t green,
+		uint8_t blue)
+{
+	int32_t jitter;
+	uint16_t i;
+
+	// emitter
+	emitAccumulator += (uint32_t) emitRate * elapsedMs;
+	while (emitAccumulator >= 1000)
+	{
+		emitAccumulator -= 1000;
+
+		jitter = emitVelocity >> NPX_PARTICLE_JITTER;
+		if (jitter < 0)
+		{
+			jitter = -jitter;
+		}
+		jitter = (jitter > 0) ?
+				(int32_t) (npxParticle_rand() % (2 * jitter + 1)) - jitter : 0;
+
+		if (!npxParticle_Emit(0, (int16_t) (emitVelocity + jitter), red, green,
+				blue, 255))
+		{
+			emitAccumulator = 0;
+			break;
+		}
+	}
+
+	// move, positions wrap around the segment
+	for (i = 0; i < partCount; i++)
+	{
+		partPos[i] = (uint16_t) (partPos[i] + partVel[i]);
+	}
+
+	// age
+	for (i = 0; i < partCount; i++)
+	{
+		partLife[i] =
+				(partLife[i] > NPX_PARTICLE_DECAY) ?
+						partLife[i] - NPX_PARTICLE_DECAY : 0;
+	}
+
+	// remove the dead ones, the last live particle takes their place
+	i = 0;
+	while (i < partCount)
+	{
+		if (partLife[i] == 0)
+		{
+			partCount--;
+			partPos[i] = partPos[partCount];
+			partVel[i] = partVel[partCount];
+			partRed[i] = partRed[partCount];
+			partGreen[i] = partGreen[partCount];
+			partBlue[i] = partBlue[partCount];
+			partLife[i] = partLife[partCount];
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void npxParticle_Render(pixel_t *p, uint16_t length, uint8_t brightness)
+{
+	uint32_t x;
+	uint32_t level;
+	uint32_t near;
+	uint32_t far;
+	uint16_t led;
+	uint16_t next;
+
+	if (length == 0)
+		return;
+
+	for (uint16_t i = 0; i < partCount; i++)
+	{
+		// position in LEDs (24.8)
+		x = ((uint32_t) partPos[i] * length) >> 8;
+		led = (uint16_t) (x >> 8);
+		next = (led + 1 < length) ? led + 1 : 0;
+
+		// life and brightness (0-65025), split between both LEDs
+		level = (uint32_t) partLife[i] * (brightness + 1);
+		far = (level * (x & 0xFF)) >> 8;
+		near = level - far;
+
+		p[led].colour.red = npxParticle_add(p[led].colour.red,
+				(partRed[i] * near) >> 16);
+		p[led].colour.green = npxParticle_add(p[led].colour.green,
+				(partGreen[i] * near) >> 16);
+		p[led].colour.blue = npxParticle_add(p[led].colour.blue,
+				(partBlue[i] * near) >> 16);
+
+		p[next].colour.red = npxParticle_add(p[next].colour.red,
+				(partRed[i] * far) >> 16);
+		p[next].colour.green = npxParticle_add(p[next].colour.green,
+				(partGreen[i] * far) >> 16);
+		p[next].colour.blue = npxParticle_add(p[next].colour.blue,
+				(partBlue[i] * far) >> 16);
+	}
+}
+
+uint16_t npxParticle_Count()
+{
+	return partCount;
+}
+
+static uint32_t npxParticle_rand()
+{
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+
+	return randState;
+}
+
+static inline uint8_t npxParticle_add(uint8_t c, uint32_t add)
+{
+	add += c;
+
+	return (add > 255) ? 255 : (uint8_t) add;
+}
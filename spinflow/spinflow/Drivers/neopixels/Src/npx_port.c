@@ -35,13 +35,30 @@
  */
 #define NEOPIXELS_BIT_RESET_TIM_COUNTER 29
 
+/**
+ * @def NEOPIXELS_RESET_SLOTS
+ * @brief Number of zero duty bit periods sent after the LED data.
+ *
+ * The strip latches a frame once the data line stays low for the reset time, at least
+ * 280 us on newer WS2812 parts. 240 periods of 1.25 us give 300 us, so a frame can be
+ * sent right after the previous one without being taken as its continuation.
+ */
+#define NEOPIXELS_RESET_SLOTS			240
+
 /**
  * @def NEOPIXELS_DMA_BUFFER_LENGTH
  * @brief Total length of the DMA buffer needed to transmit the complete data for all LEDs.
  *
- * The buffer length is calculated based on the number of bits required for each LED and the total number of LEDs.
+ * The buffer length is calculated based on the number of bits required for each LED and the total number of LEDs,
+ * followed by the reset slots.
+ */
+#define NEOPIXELS_DMA_BUFFER_LENGTH (NEOPIXELS_LED_BIT_QTY * NEOPIXEL_LED_QTY + NEOPIXELS_RESET_SLOTS)
+
+/**
+ * @def NEOPIXELS_DIRTY_WORDS
+ * @brief Number of 32-bit words needed to flag every LED as changed.
  */
-#define NEOPIXELS_DMA_BUFFER_LENGTH (NEOPIXELS_LED_BIT_QTY * NEOPIXEL_LED_QTY)
+#define NEOPIXELS_DIRTY_WORDS ((NEOPIXEL_LED_QTY + 31) / 32)
 
 /**
  * @var htim1
@@ -56,14 +73,42 @@ TIM_HandleTypeDef htim1;
 DMA_HandleTypeDef hdma_tim1_ch1;
 
 /**
- * @var pixels
- * @brief Array to store the color configuration for each NeoPixel LED.
+ * @var pixelBuffer
+ * @brief Front and back buffers with the color configuration for each NeoPixel LED.
+ *
+ * The renderer only writes the back buffer while the output only reads the front one.
+ */
+static pixel_t pixelBuffer[2][NEOPIXEL_LED_QTY];
+
+/**
+ * @var pixelFront
+ * @brief Index of the front buffer. Only changed by the output at a frame boundary.
+ */
+static volatile uint8_t pixelFront;
+
+/**
+ * @var pixelSwapRequest
+ * @brief Set by the renderer when the back buffer holds a new frame, cleared by the output once it is the front.
  */
-static pixel_t pixels[NEOPIXEL_LED_QTY];
+static volatile bool_t pixelSwapRequest;
+
+/**
+ * @var frameCount
+ * @brief Number of frames sent, incremented by the DMA transfer complete interrupt.
+ */
+static volatile uint32_t frameCount;
+
+/**
+ * @var pixelDirty
+ * @brief One bit per LED changed in the back buffer. Only those LEDs are encoded again on the next swap.
+ */
+static uint32_t pixelDirty[NEOPIXELS_DIRTY_WORDS];
 
 /**
  * @var dmaData
  * @brief DMA transfer buffer, populated based on the pixels array and used to send data to the NeoPixels via DMA.
+ *
+ * The reset slots at its end are never encoded and stay at 0.
  */
 static uint16_t dmaData[NEOPIXELS_DMA_BUFFER_LENGTH];
 
@@ -81,6 +126,19 @@ static void DMA_Init(void);
  */
 static void TIM1_Init(void);
 
+/**
+ * @brief Converts a pixel to its PWM representation in the DMA buffer.
+ * @param iPix Index of the pixel.
+ * @param pixel Pixel to encode.
+ */
+static void npxPort_encodePixel(int iPix, const pixel_t *pixel);
+
+/**
+ * @brief Checks whether a frame is being sent to the strip.
+ * @retval True if the DMA transfer is running
+ */
+static bool_t npxPort_isBusy();
+
 /**
  * @brief NeoPixel initial sequence. Only for testing purposes.
  */
@@ -101,73 +159,196 @@ void npxPort_Init()
 	DMA_Init();
 	TIM1_Init();
 
+	// first frame encodes every LED
+	npxPort_MarkDirty(0, NEOPIXEL_LED_QTY);
+
 	npxPort_initialSequence();
 }
 
 void npxPort_ClearLEDs()
 {
+	pixel_t *back = npxPort_GetBackBuffer();
+
+	if (back == NULL)
+		return;
+
 	for (int i = 0; i < NEOPIXEL_LED_QTY; i++)
 	{
-		pixels[i].value = 0;
+		back[i].value = 0;
 	}
-	npxPort_SetLEDs();
+	npxPort_MarkDirty(0, NEOPIXEL_LED_QTY);
+	npxPort_SwapBuffers();
 }
 
 void npxPort_SetRed(uint8_t bright)
 {
+	pixel_t *back = npxPort_GetBackBuffer();
+
+	if (back == NULL)
+		return;
+
 	for (int i = 0; i < NEOPIXEL_LED_QTY; i++)
 	{
-		pixels[i].value = 0;
-		pixels[i].colour.red = bright;
+		back[i].value = 0;
+		back[i].colour.red = bright;
 	}
-	npxPort_SetLEDs();
+	npxPort_MarkDirty(0, NEOPIXEL_LED_QTY);
+	npxPort_SwapBuffers();
 }
 
 void npxPort_SetGreen(uint8_t bright)
 {
+	pixel_t *back = npxPort_GetBackBuffer();
+
+	if (back == NULL)
+		return;
+
 	for (int i = 0; i < NEOPIXEL_LED_QTY; i++)
 	{
-		pixels[i].value = 0;
-		pixels[i].colour.green = bright;
+		back[i].value = 0;
+		back[i].colour.green = bright;
 	}
-	npxPort_SetLEDs();
+	npxPort_MarkDirty(0, NEOPIXEL_LED_QTY);
+	npxPort_SwapBuffers();
 }
 
 void npxPort_SetBlue(uint8_t bright)
 {
+	pixel_t *back = npxPort_GetBackBuffer();
+
+	if (back == NULL)
+		return;
+
+	for (int i = 0; i < NEOPIXEL_LED_QTY; i++)
+	{
+		back[i].value = 0;
+		back[i].colour.blue = bright;
+	}
+	npxPort_MarkDirty(0, NEOPIXEL_LED_QTY);
+	npxPort_SwapBuffers();
+}
+
+bool_t npxPort_SetPixels(const uint8_t *grb, uint16_t qty)
+{
+	pixel_t *back = npxPort_GetBackBuffer();
+
+	if (back == NULL)
+		return false;
+
 	for (int i = 0; i < NEOPIXEL_LED_QTY; i++)
 	{
-		pixels[i].value = 0;
-		pixels[i].colour.blue = bright;
+		if (i < qty)
+		{
+			back[i].value = ((uint32_t) grb[0] << 16)
+					| ((uint32_t) grb[1] << 8) | grb[2];
+			grb += 3;
+		}
+		else
+		{
+			back[i].value = 0;
+		}
+	}
+	npxPort_MarkDirty(0, NEOPIXEL_LED_QTY);
+	npxPort_SwapBuffers();
+
+	return true;
+}
+
+pixel_t* npxPort_GetBackBuffer()
+{
+	// the back buffer is owned by the output until the pending swap is done
+	if (pixelSwapRequest)
+	{
+		return NULL;
+	}
+
+	return pixelBuffer[pixelFront ^ 1];
+}
+
+void npxPort_MarkDirty(uint16_t start, uint16_t length)
+{
+	uint32_t end = (uint32_t) start + length;
+
+	if (end > NEOPIXEL_LED_QTY)
+	{
+		end = NEOPIXEL_LED_QTY;
+	}
+
+	for (uint32_t i = start; i < end; i++)
+	{
+		pixelDirty[i >> 5] |= (1UL << (i & 31));
+	}
+}
+
+void npxPort_SwapBuffers()
+{
+	pixelSwapRequest = true;
+
+	// if a frame is on its way, the transfer complete callback sends this one
+	if (!npxPort_isBusy())
+	{
+		npxPort_SetLEDs();
 	}
-	npxPort_SetLEDs();
 }
 
 void npxPort_SetLEDs(void)
 {
-	uint32_t iPWM = 0;
+	const pixel_t *front;
 
-	// Pixel to bit conversion for serial transmission
-	for (int iPix = 0; iPix < NEOPIXEL_LED_QTY; iPix++)
+	// Frame boundary: the back buffer becomes the front one
+	if (pixelSwapRequest)
 	{
-		for (int iBit = NEOPIXELS_LED_BIT_QTY - 1; iBit >= 0; iBit--)
+		pixelFront ^= 1;
+		front = pixelBuffer[pixelFront];
+
+		// Only the LEDs changed in this frame need a new PWM encoding
+		for (int iPix = 0; iPix < NEOPIXEL_LED_QTY; iPix++)
 		{
-			if (pixels[iPix].value & (1 << iBit))
+			if (pixelDirty[iPix >> 5] & (1UL << (iPix & 31)))
 			{
-				// Logic 1: Set the equivalent to a 68% of PWMs duty cycle
-				dmaData[iPWM] = NEOPIXELS_BIT_SET_TIM_COUNTER;
+				npxPort_encodePixel(iPix, &front[iPix]);
 			}
-			else
-			{
-				// Logic 0: Set the equivalent to a 32% of PWMs duty cycle
-				dmaData[iPWM] = NEOPIXELS_BIT_RESET_TIM_COUNTER;
-			}
-			iPWM++;
+		}
+		for (int i = 0; i < NEOPIXELS_DIRTY_WORDS; i++)
+		{
+			pixelDirty[i] = 0;
+		}
+
+		pixelSwapRequest = false;
+	}
+	else
+	{
+		front = pixelBuffer[pixelFront];
+
+		for (int iPix = 0; iPix < NEOPIXEL_LED_QTY; iPix++)
+		{
+			npxPort_encodePixel(iPix, &front[iPix]);
 		}
 	}
 
 	// Send PWM signal via DMA controller
-	HAL_TIM_PWM_Start_DMA(&htim1, TIM_CHANNEL_1, (uint32_t*) dmaData, iPWM);
+	HAL_TIM_PWM_Start_DMA(&htim1, TIM_CHANNEL_1, (uint32_t*) dmaData,
+	NEOPIXELS_DMA_BUFFER_LENGTH);
+}
+
+static void npxPort_encodePixel(int iPix, const pixel_t *pixel)
+{
+	uint16_t *pwm = &dmaData[iPix * NEOPIXELS_LED_BIT_QTY];
+
+	// Pixel to bit conversion for serial transmission
+	for (int iBit = NEOPIXELS_LED_BIT_QTY - 1; iBit >= 0; iBit--)
+	{
+		if (pixel->value & (1 << iBit))
+		{
+			// Logic 1: Set the equivalent to a 68% of PWMs duty cycle
+			*pwm++ = NEOPIXELS_BIT_SET_TIM_COUNTER;
+		}
+		else
+		{
+			// Logic 0: Set the equivalent to a 32% of PWMs duty cycle
+			*pwm++ = NEOPIXELS_BIT_RESET_TIM_COUNTER;
+		}
+	}
 }
 
 static void TIM1_Init(void)
@@ -300,6 +481,30 @@ static void DMA_Init(void)
 void HAL_TIM_PWM_PulseFinishedCallback(TIM_HandleTypeDef *htim)
 {
 	HAL_TIM_PWM_Stop_DMA(&htim1, TIM_CHANNEL_1);
+	frameCount++;
+
+	// A frame was published while this one was being sent. The reset slots
+	// at the end of the transfer already held the line low for the latch.
+	if (pixelSwapRequest)
+	{
+		npxPort_SetLEDs();
+	}
+}
+
+uint32_t npxPort_FrameCount()
+{
+	return frameCount;
+}
+
+bool_t npxPort_IsIdle()
+{
+	return (!pixelSwapRequest && !npxPort_isBusy()) ? true : false;
+}
+
+static bool_t npxPort_isBusy()
+{
+	return (TIM_CHANNEL_STATE_GET(&htim1, TIM_CHANNEL_1)
+			== HAL_TIM_CHANNEL_STATE_BUSY) ? true : false;
 }
 
 static void Error_Handler(void)
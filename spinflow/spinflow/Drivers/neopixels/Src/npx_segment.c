@@ -0,0 +1,448 @@
+/**
+ ******************************************************************************
+ * @file    npx_segment.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels segments
+ ******************************************************************************
+ */
+
+#include "npx_segment.h"
+#include "npx_noise.h"
+#include "npx_particle.h"
+
+/**
+ * @def NPX_SEG_BREATHE_STEPS
+ * @brief Number of animation steps of a full breathe cycle.
+ */
+#define NPX_SEG_BREATHE_STEPS	64
+
+/**
+ * @def NPX_SEG_NOISE_LED_STEP
+ * @brief Noise coordinate distance between two LEDs (16.16), a quarter of a cell.
+ */
+#define NPX_SEG_NOISE_LED_STEP	(NPX_NOISE_CELL / 4)
+
+/**
+ * @def NPX_SEG_NOISE_TIME_STEP
+ * @brief Noise coordinate distance between two animation steps (16.16).
+ */
+#define NPX_SEG_NOISE_TIME_STEP	(NPX_NOISE_CELL / 16)
+
+/**
+ * @def NPX_SEG_BUFFERS
+ * @brief Number of pixel buffers a change has to be rendered into (front and back).
+ */
+#define NPX_SEG_BUFFERS			2
+
+/**
+ * @struct npxSegment_t
+ * @brief State of a segment.
+ */
+typedef struct
+{
+	bool_t used; /**< Segment in use. */
+	uint16_t start; /**< Index of the first LED. */
+	uint16_t length; /**< Number of LEDs. */
+	npxEffect_t effect; /**< Effect. */
+	uint8_t red; /**< Red component of the colour. */
+	uint8_t green; /**< Green component of the colour. */
+	uint8_t blue; /**< Blue component of the colour. */
+	uint8_t brightness; /**< Brightness applied on top of the colour. */
+	uint16_t periodMs; /**< Time between animation steps, 0 if static. */
+	uint32_t lastTick; /**< Tick of the last animation step. */
+	uint16_t step; /**< Animation step. */
+	uint16_t position; /**< Position of the angle effect, 65536 spans the segment. */
+	uint8_t pending; /**< Number of pixel buffers that still hold an old content. */
+} npxSegment_t;
+
+/**
+ * @var segments
+ * @brief Segment table.
+ */
+static npxSegment_t segments[NPX_SEG_MAX];
+
+/**
+ * @brief Checks a segment identifier.
+ * @param seg Segment identifier.
+ * @return Pointer to the segment, NULL if the identifier is not in use.
+ */
+static npxSegment_t* npxSeg_get(npxSeg_t seg);
+
+/**
+ * @brief Checks whether the effect of a segment changes over time.
+ * @param s Segment.
+ * @return True if the segment has to be stepped.
+ */
+static bool_t npxSeg_isAnimated(const npxSegment_t *s);
+
+/**
+ * @brief Renders a segment into a pixel buffer.
+ * @param s Segment.
+ * @param buffer Pixel buffer of NEOPIXEL_LED_QTY pixels.
+ */
+static void npxSeg_render(const npxSegment_t *s, pixel_t *buffer);
+
+/**
+ * @brief Steps the particle system of a segment.
+ * @param s Segment, with a PARTICLES effect.
+ * @param now Current tick.
+ *
+ * The segment is rendered again only if there were or there are live particles.
+ */
+static void npxSeg_stepParticles(npxSegment_t *s, uint32_t now);
+
+/**
+ * @brief Renders a noise based effect into a pixel buffer.
+ * @param s Segment, with a FIRE or PLASMA effect.
+ * @param p First pixel of the segment.
+ */
+static void npxSeg_renderNoise(const npxSegment_t *s, pixel_t *p);
+
+/**
+ * @brief Scales a colour component.
+ * @param c Colour component.
+ * @param level Level (0-255).
+ * @return Scaled component.
+ */
+static inline uint8_t npxSeg_scale(uint8_t c, uint8_t level);
+
+void npxSeg_Init()
+{
+	for (int i = 0; i < NPX_SEG_MAX; i++)
+	{
+		segments[i].used = false;
+	}
+}
+
+npxSeg_t npxSeg_Add(uint16_t start, uint16_t length)
+{
+	for (npxSeg_t i = 0; i < NPX_SEG_MAX; i++)
+	{
+		if (!segments[i].used)
+		{
+			segments[i].used = true;
+			segments[i].effect = NPX_EFFECT_OFF;
+			segments[i].red = 0;
+			segments[i].green = 0;
+			segments[i].blue = 0;
+			segments[i].brightness = 255;
+			segments[i].periodMs = 0;
+			segments[i].step = 0;
+			segments[i].position = 0;
+
+			if (!npxSeg_SetRange(i, start, length))
+			{
+				segments[i].used = false;
+				return NPX_SEG_INVALID;
+			}
+			return i;
+		}
+	}
+
+	return NPX_SEG_INVALID;
+}
+
+bool_t npxSeg_SetRange(npxSeg_t seg, uint16_t start, uint16_t length)
+{
+	npxSegment_t *s = npxSeg_get(seg);
+
+	if ((s == NULL) || (length == 0)
+			|| (((uint32_t) start + length) > NEOPIXEL_LED_QTY))
+		return false;
+
+	s->start = start;
+	s->length = length;
+	s->pending = NPX_SEG_BUFFERS;
+
+	return true;
+}
+
+void npxSeg_SetEffect(npxSeg_t seg, npxEffect_t effect, uint8_t red,
+		uint8_t green, uint8_t blue)
+{
+	npxSegment_t *s = npxSeg_get(seg);
+
+	if (s == NULL)
+		return;
+
+	if ((s->effect != effect) || (s->red != red) || (s->green != green)
+			|| (s->blue != blue))
+	{
+		s->effect = effect;
+		s->red = red;
+		s->green = green;
+		s->blue = blue;
+		s->step = 0;
+		s->lastTick = HAL_GetTick();
+		s->pending = NPX_SEG_BUFFERS;
+	}
+}
+
+void npxSeg_SetBrightness(npxSeg_t seg, uint8_t brightness)
+{
+	npxSegment_t *s = npxSeg_get(seg);
+
+	if ((s == NULL) || (s->brightness == brightness))
+		return;
+
+	s->brightness = brightness;
+	s->pending = NPX_SEG_BUFFERS;
+}
+
+void npxSeg_SetPeriod(npxSeg_t seg, uint16_t periodMs)
+{
+	npxSegment_t *s = npxSeg_get(seg);
+
+	if (s == NULL)
+		return;
+
+	s->periodMs = periodMs;
+	s->lastTick = HAL_GetTick();
+}
+
+void npxSeg_SetPosition(npxSeg_t seg, uint16_t position)
+{
+	npxSegment_t *s = npxSeg_get(seg);
+
+	if (s == NULL)
+		return;
+
+	if ((s->effect == NPX_EFFECT_ANGLE)
+			&& (((uint32_t) s->position * s->length) >> 16)
+					!= (((uint32_t) position * s->length) >> 16))
+	{
+		s->pending = NPX_SEG_BUFFERS;
+	}
+	s->position = position;
+}
+
+void npxSeg_Invalidate()
+{
+	for (int i = 0; i < NPX_SEG_MAX; i++)
+	{
+		segments[i].pending = NPX_SEG_BUFFERS;
+	}
+}
+
+void npxSeg_Tasks()
+{
+	uint32_t now = HAL_GetTick();
+	bool_t pending = false;
+	bool_t changed = false;
+	pixel_t *back;
+
+	// step the animations that are due
+	for (int i = 0; i < NPX_SEG_MAX; i++)
+	{
+		npxSegment_t *s = &segments[i];
+
+		if (s->used && npxSeg_isAnimated(s) && (s->periodMs > 0)
+				&& ((now - s->lastTick) >= s->periodMs))
+		{
+			if (s->effect == NPX_EFFECT_PARTICLES)
+			{
+				npxSeg_stepParticles(s, now);
+			}
+			else
+			{
+				s->pending = NPX_SEG_BUFFERS;
+			}
+			s->lastTick = now;
+			s->step++;
+		}
+
+		pending |= (s->used && (s->pending > 0));
+	}
+
+	if (!pending)
+		return;
+
+	// retry on the next call if the previous frame is still being sent
+	back = npxPort_GetBackBuffer();
+	if (back == NULL)
+		return;
+
+	for (int i = 0; i < NPX_SEG_MAX; i++)
+	{
+		npxSegment_t *s = &segments[i];
+
+		if (!s->used || (s->pending == 0))
+			continue;
+
+		npxSeg_render(s, back);
+
+		// the first render is a new content, the second one only brings
+		// the other buffer up to date and needs no encoding nor swap
+		if (s->pending == NPX_SEG_BUFFERS)
+		{
+			npxPort_MarkDirty(s->start, s->length);
+			changed = true;
+		}
+		s->pending--;
+	}
+
+	if (changed)
+	{
+		npxPort_SwapBuffers();
+	}
+}
+
+static npxSegment_t* npxSeg_get(npxSeg_t seg)
+{
+	if ((seg >= NPX_SEG_MAX) || !segments[seg].used)
+		return NULL;
+
+	return &segments[seg];
+}
+
+static bool_t npxSeg_isAnimated(const npxSegment_t *s)
+{
+	return (s->effect != NPX_EFFECT_OFF) && (s->effect != NPX_EFFECT_SOLID)
+			&& (s->effect != NPX_EFFECT_ANGLE);
+}
+
+static void npxSeg_render(const npxSegment_t *s, pixel_t *buffer)
+{
+	pixel_t colour;
+	pixel_t *p = &buffer[s->start];
+	uint16_t phase;
+	uint8_t level = s->brightness;
+
+	switch (s->effect)
+	{
+	case NPX_EFFECT_FIRE:
+	case NPX_EFFECT_PLASMA:
+		npxSeg_renderNoise(s, p);
+		return;
+
+	case NPX_EFFECT_PARTICLES:
+		for (uint16_t i = 0; i < s->length; i++)
+		{
+			p[i].value = 0;
+		}
+		npxParticle_Render(p, s->length, s->brightness);
+		return;
+
+	case NPX_EFFECT_BLINK:
+		level = (s->step & 1) ? 0 : level;
+		break;
+
+	case NPX_EFFECT_BREATHE:
+		phase = s->step % NPX_SEG_BREATHE_STEPS;
+		if (phase >= (NPX_SEG_BREATHE_STEPS / 2))
+		{
+			phase = NPX_SEG_BREATHE_STEPS - 1 - phase;
+		}
+		level = npxSeg_scale(level,
+				(uint8_t) (phase * 255 / (NPX_SEG_BREATHE_STEPS / 2 - 1)));
+		break;
+
+	case NPX_EFFECT_OFF:
+		level = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	colour.value = 0;
+	colour.colour.red = npxSeg_scale(s->red, level);
+	colour.colour.green = npxSeg_scale(s->green, level);
+	colour.colour.blue = npxSeg_scale(s->blue, level);
+
+	if (s->effect == NPX_EFFECT_CHASE)
+	{
+		for (uint16_t i = 0; i < s->length; i++)
+		{
+			p[i].value = (i == (s->step % s->length)) ? colour.value : 0;
+		}
+	}
+	else if (s->effect == NPX_EFFECT_ANGLE)
+	{
+		phase = (uint16_t) (((uint32_t) s->position * s->length) >> 16);
+		for (uint16_t i = 0; i < s->length; i++)
+		{
+			p[i].value = (i == phase) ? colour.value : 0;
+		}
+	}
+	else
+	{
+		for (uint16_t i = 0; i < s->length; i++)
+		{
+			p[i].value = colour.value;
+		}
+	}
+}
+
+static void npxSeg_stepParticles(npxSegment_t *s, uint32_t now)
+{
+	uint16_t live = npxParticle_Count();
+
+	npxParticle_Step((uint16_t) (now - s->lastTick), s->red, s->green,
+			s->blue);
+
+	if ((live > 0) || (npxParticle_Count() > 0))
+	{
+		s->pending = NPX_SEG_BUFFERS;
+	}
+}
+
+static void npxSeg_renderNoise(const npxSegment_t *s, pixel_t *p)
+{
+	uint32_t t = (uint32_t) s->step * NPX_SEG_NOISE_TIME_STEP;
+	uint32_t x = 0;
+	uint8_t r, g, b;
+	uint8_t n;
+
+	for (uint16_t i = 0; i < s->length; i++, x += NPX_SEG_NOISE_LED_STEP)
+	{
+		if (s->effect == NPX_EFFECT_FIRE)
+		{
+			// flames rise along the segment and cool down towards its end
+			n = (uint8_t) (npxNoise_Get16_2D(x, t + (x >> 1)) >> 8);
+			n = npxSeg_scale(n, (uint8_t) (255 - (i * 255) / s->length));
+
+			// heat palette: black, red, yellow, white
+			r = (n < 85) ? n * 3 : 255;
+			g = (n < 85) ? 0 : ((n < 170) ? (n - 85) * 3 : 255);
+			b = (n < 170) ? 0 : (n - 170) * 3;
+		}
+		else
+		{
+			// the noise value is the hue of a colour wheel
+			n = (uint8_t) (npxNoise_Get16_3D(x, t, t >> 1) >> 8);
+			n = (uint8_t) (n * 2);
+
+			if (n < 85)
+			{
+				r = 255 - n * 3;
+				g = n * 3;
+				b = 0;
+			}
+			else if (n < 170)
+			{
+				r = 0;
+				g = 255 - (n - 85) * 3;
+				b = (n - 85) * 3;
+			}
+			else
+			{
+				r = (n - 170) * 3;
+				g = 0;
+				b = 255 - (n - 170) * 3;
+			}
+		}
+
+		p[i].value = 0;
+		p[i].colour.red = npxSeg_scale(r, s->brightness);
+		p[i].colour.green = npxSeg_scale(g, s->brightness);
+		p[i].colour.blue = npxSeg_scale(b, s->brightness);
+	}
+}
+
+static inline uint8_t npxSeg_scale(uint8_t c, uint8_t level)
+{
+	return (uint8_t) (((uint16_t) c * (level + 1)) >> 8);
+}
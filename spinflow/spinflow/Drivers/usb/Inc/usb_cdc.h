@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ * @file    usb_cdc.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   USB CDC (virtual COM port) device header
+ ******************************************************************************
+ */
+
+#ifndef USB_CDC_H
+#define USB_CDC_H
+
+#include "device_config.h"
+#include "device_types.h"
+
+/**
+ * @def USB_CDC_PACKET_SIZE
+ * @brief Max packet size of the bulk endpoints (full speed).
+ */
+#define USB_CDC_PACKET_SIZE		64
+
+/**
+ * @def USB_CDC_RX_PACKETS
+ * @brief Number of OUT packets that can be buffered before the host is NAKed.
+ *
+ * Must be a power of two.
+ */
+#define USB_CDC_RX_PACKETS		DEVICE_USB_RX_PACKETS
+
+/**
+ * @brief Initializes the USB OTG FS peripheral as a CDC device and connects it.
+ *
+ * @return bool_t Returns true if initialization was successful, false otherwise.
+ */
+bool_t usbCdc_Init();
+
+/**
+ * @brief Checks whether the host has configured the device.
+ *
+ * @return bool_t Returns true if the device is configured, false otherwise.
+ */
+bool_t usbCdc_IsConfigured();
+
+/**
+ * @brief Gets the oldest received packet without copying it.
+ * @param data Set to the packet data.
+ * @param len Set to the packet length.
+ *
+ * The packet remains valid until usbCdc_ReleasePacket() is called.
+ *
+ * @return bool_t Returns true if a packet is available, false otherwise.
+ */
+bool_t usbCdc_GetPacket(const uint8_t **data, uint16_t *len);
+
+/**
+ * @brief Releases the packet returned by usbCdc_GetPacket().
+ *
+ * Frees the packet slot and resumes reception if the host was being NAKed.
+ */
+void usbCdc_ReleasePacket();
+
+/**
+ * @brief Sends a packet on the bulk IN endpoint.
+ * @param data Packet data, copied before the function returns.
+ * @param len Packet length, up to USB_CDC_PACKET_SIZE.
+ *
+ * Only one packet is in flight at a time.
+ *
+ * @return bool_t Returns true if the packet was queued, false if the device is not
+ * configured, the previous packet is still being sent or the packet is too long.
+ */
+bool_t usbCdc_Send(const uint8_t *data, uint16_t len);
+
+#endif
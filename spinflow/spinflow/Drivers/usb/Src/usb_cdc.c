@@ -0,0 +1,689 @@
+/**
+ ******************************************************************************
+ * @file    usb_cdc.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   USB CDC (virtual COM port) device
+ *
+ * Minimal CDC ACM device built directly on top of the HAL PCD driver. Only the
+ * requests needed for enumeration and a virtual COM port are handled. OUT
+ * packets are stored in a small ring and the endpoint is only re-armed while
+ * there is room left, so a slow consumer throttles the host by NAKing.
+ ******************************************************************************
+ */
+
+#include "usb_cdc.h"
+#include <string.h>
+
+/**
+ * USB defines
+ */
+#define USB_VID					0x0483
+#define USB_PID					0x5740
+#define USB_EP0_SIZE			64
+#define USB_CDC_CMD_PACKET_SIZE	8
+
+#define USB_EP_CDC_OUT			0x01
+#define USB_EP_CDC_IN			0x81
+#define USB_EP_CDC_CMD			0x82
+
+/**
+ * Standard requests
+ */
+#define USB_REQ_GET_STATUS			0x00
+#define USB_REQ_CLEAR_FEATURE		0x01
+#define USB_REQ_SET_FEATURE			0x03
+#define USB_REQ_SET_ADDRESS			0x05
+#define USB_REQ_GET_DESCRIPTOR		0x06
+#define USB_REQ_GET_CONFIGURATION	0x08
+#define USB_REQ_SET_CONFIGURATION	0x09
+#define USB_REQ_GET_INTERFACE		0x0A
+#define USB_REQ_SET_INTERFACE		0x0B
+
+#define USB_REQ_TYPE_MASK			0x60
+#define USB_REQ_TYPE_STANDARD		0x00
+#define USB_REQ_TYPE_CLASS			0x20
+#define USB_REQ_DIR_IN				0x80
+
+#define USB_DESC_DEVICE				0x01
+#define USB_DESC_CONFIGURATION		0x02
+#define USB_DESC_STRING				0x03
+
+/**
+ * CDC class requests
+ */
+#define CDC_SET_LINE_CODING			0x20
+#define CDC_GET_LINE_CODING			0x21
+#define CDC_SET_CONTROL_LINE_STATE	0x22
+
+/**
+ * @def USB_STRING_DESC_SIZE
+ * @brief Size of the buffer used to build string descriptors.
+ */
+#define USB_STRING_DESC_SIZE		64
+
+/**
+ * @struct usbSetup_t
+ * @brief USB setup packet.
+ */
+typedef struct
+{
+	uint8_t bmRequestType; /**< Request characteristics. */
+	uint8_t bRequest; /**< Request code. */
+	uint16_t wValue; /**< Request value. */
+	uint16_t wIndex; /**< Request index. */
+	uint16_t wLength; /**< Number of bytes in the data stage. */
+} usbSetup_t;
+
+/**
+ * @var hpcd_USB_OTG_FS
+ * @brief PCD handle for the USB OTG FS peripheral.
+ */
+PCD_HandleTypeDef hpcd_USB_OTG_FS;
+
+/**
+ * @var usbDeviceDesc
+ * @brief Device descriptor.
+ */
+static const uint8_t usbDeviceDesc[] =
+{ 0x12, USB_DESC_DEVICE, 0x00, 0x02, // bcdUSB 2.00
+		0x02, 0x00, 0x00, // CDC class
+		USB_EP0_SIZE, //
+		(uint8_t) USB_VID, (uint8_t) (USB_VID >> 8), //
+		(uint8_t) USB_PID, (uint8_t) (USB_PID >> 8), //
+		0x00, 0x01, // bcdDevice 1.00
+		0x01, 0x02, 0x03, // manufacturer, product, serial strings
+		0x01 // configurations
+		};
+
+/**
+ * @var usbConfigDesc
+ * @brief Configuration descriptor with a CDC ACM communication and data interface.
+ */
+static const uint8_t usbConfigDesc[] =
+{
+// configuration
+		0x09, USB_DESC_CONFIGURATION, 67, 0x00, 0x02, 0x01, 0x00, 0x80, 0x32,
+		// communication interface
+		0x09, 0x04, 0x00, 0x00, 0x01, 0x02, 0x02, 0x01, 0x00,
+		// header functional descriptor, CDC 1.10
+		0x05, 0x24, 0x00, 0x10, 0x01,
+		// call management functional descriptor
+		0x05, 0x24, 0x01, 0x00, 0x01,
+		// ACM functional descriptor
+		0x04, 0x24, 0x02, 0x02,
+		// union functional descriptor
+		0x05, 0x24, 0x06, 0x00, 0x01,
+		// command endpoint
+		0x07, 0x05, USB_EP_CDC_CMD, 0x03, USB_CDC_CMD_PACKET_SIZE, 0x00, 0x10,
+		// data interface
+		0x09, 0x04, 0x01, 0x00, 0x02, 0x0A, 0x00, 0x00, 0x00,
+		// data OUT endpoint
+		0x07, 0x05, USB_EP_CDC_OUT, 0x02, USB_CDC_PACKET_SIZE, 0x00, 0x00,
+		// data IN endpoint
+		0x07, 0x05, USB_EP_CDC_IN, 0x02, USB_CDC_PACKET_SIZE, 0x00, 0x00 };
+
+/**
+ * @var usbLangDesc
+ * @brief String descriptor zero, US English.
+ */
+static const uint8_t usbLangDesc[] =
+{ 0x04, USB_DESC_STRING, 0x09, 0x04 };
+
+/**
+ * @var usbStrings
+ * @brief Manufacturer, product and serial number strings.
+ */
+static const char *usbStrings[] =
+{ "CESE", DEVICE_NAME, DEVICE_FIRMWARE_VERSION };
+
+/**
+ * @var usbStringDesc
+ * @brief Buffer where the requested string descriptor is built.
+ */
+static uint8_t usbStringDesc[USB_STRING_DESC_SIZE];
+
+/**
+ * @var usbLineCoding
+ * @brief CDC line coding, kept only to answer the host (115200 8N1 by default).
+ */
+static uint8_t usbLineCoding[7] =
+{ 0x00, 0xC2, 0x01, 0x00, 0x00, 0x00, 0x08 };
+
+/**
+ * @var usbEp0Data
+ * @brief Buffer for control transfers with a small data stage.
+ */
+static uint8_t usbEp0Data[8];
+
+/**
+ * @var usbEp0TxData
+ * @brief Next byte of the IN data stage of a control transfer.
+ */
+static const uint8_t *usbEp0TxData;
+
+/**
+ * @var usbEp0TxLeft
+ * @brief Bytes of the IN data stage not sent yet.
+ */
+static uint16_t usbEp0TxLeft;
+
+/**
+ * @var usbEp0TxZlp
+ * @brief Set when the IN data stage ends with a zero length packet.
+ */
+static bool_t usbEp0TxZlp;
+
+/**
+ * @var usbEp0TxActive
+ * @brief Set during the IN data stage of a control transfer.
+ */
+static bool_t usbEp0TxActive;
+
+/**
+ * @var usbPendingRequest
+ * @brief Class request waiting for its OUT data stage, 0 if none.
+ */
+static uint8_t usbPendingRequest;
+
+/**
+ * @var usbConfigured
+ * @brief Set once the host selects the configuration.
+ */
+static volatile bool_t usbConfigured;
+
+/**
+ * @var usbRxData
+ * @brief Ring of received OUT packets.
+ */
+static uint8_t usbRxData[USB_CDC_RX_PACKETS][USB_CDC_PACKET_SIZE];
+
+/**
+ * @var usbRxLength
+ * @brief Length of each received OUT packet.
+ */
+static uint16_t usbRxLength[USB_CDC_RX_PACKETS];
+
+/**
+ * @var usbRxHead
+ * @brief Number of packets received, only written by the USB interrupt.
+ */
+static volatile uint32_t usbRxHead;
+
+/**
+ * @var usbRxTail
+ * @brief Number of packets released, only written by the consumer.
+ */
+static volatile uint32_t usbRxTail;
+
+/**
+ * @var usbRxPaused
+ * @brief Set when the ring is full and the OUT endpoint was not re-armed.
+ */
+static volatile bool_t usbRxPaused;
+
+/**
+ * @var usbTxData
+ * @brief IN packet being sent.
+ */
+static uint8_t usbTxData[USB_CDC_PACKET_SIZE];
+
+/**
+ * @var usbTxBusy
+ * @brief Set while an IN packet is being sent.
+ */
+static volatile bool_t usbTxBusy;
+
+/**
+ * @brief Handles a standard request.
+ * @param req Setup packet.
+ */
+static void usbCdc_standardRequest(const usbSetup_t *req);
+
+/**
+ * @brief Handles a CDC class request.
+ * @param req Setup packet.
+ */
+static void usbCdc_classRequest(const usbSetup_t *req);
+
+/**
+ * @brief Starts the IN data stage of a control transfer.
+ * @param data Data to send.
+ * @param len Data length.
+ * @param maxLen Length requested by the host.
+ */
+static void usbCdc_ctlSend(const uint8_t *data, uint16_t len, uint16_t maxLen);
+
+/**
+ * @brief Sends the next packet of the IN data stage, at most USB_EP0_SIZE bytes.
+ */
+static void usbCdc_ctlSendNext();
+
+/**
+ * @brief Sends a zero length status packet.
+ */
+static void usbCdc_ctlStatus();
+
+/**
+ * @brief Stalls the control endpoint to reject a request.
+ */
+static void usbCdc_ctlError();
+
+/**
+ * @brief Builds a string descriptor from an ASCII string.
+ * @param str String.
+ * @return Length of the descriptor.
+ */
+static uint16_t usbCdc_stringDesc(const char *str);
+
+/**
+ * @brief Arms the OUT endpoint on the next free ring slot.
+ */
+static void usbCdc_armReceive();
+
+/**
+ * @brief  This function is executed in case of error occurrence.
+ * @retval None
+ */
+static void Error_Handler(void);
+
+/**
+ * USB CDC Functions
+ */
+
+bool_t usbCdc_Init()
+{
+	usbConfigured = false;
+	usbRxHead = 0;
+	usbRxTail = 0;
+	usbRxPaused = false;
+
+	hpcd_USB_OTG_FS.Instance = USB_OTG_FS;
+	hpcd_USB_OTG_FS.Init.dev_endpoints = 4;
+	hpcd_USB_OTG_FS.Init.speed = PCD_SPEED_FULL;
+	hpcd_USB_OTG_FS.Init.dma_enable = DISABLE;
+	hpcd_USB_OTG_FS.Init.phy_itface = PCD_PHY_EMBEDDED;
+	hpcd_USB_OTG_FS.Init.Sof_enable = ENABLE;
+	hpcd_USB_OTG_FS.Init.low_power_enable = DISABLE;
+	hpcd_USB_OTG_FS.Init.lpm_enable = DISABLE;
+	hpcd_USB_OTG_FS.Init.vbus_sensing_enable = ENABLE;
+	hpcd_USB_OTG_FS.Init.use_dedicated_ep1 = DISABLE;
+	if (HAL_PCD_Init(&hpcd_USB_OTG_FS) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	// FIFO sizes in words, 320 words available on OTG FS
+	HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x80);
+	HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, 0x40);
+	HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, 0x40);
+	HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 2, 0x10);
+
+	HAL_NVIC_SetPriority(OTG_FS_IRQn, 5, 0);
+	HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+
+	return (HAL_PCD_Start(&hpcd_USB_OTG_FS) == HAL_OK) ? true : false;
+}
+
+bool_t usbCdc_IsConfigured()
+{
+	return usbConfigured;
+}
+
+bool_t usbCdc_GetPacket(const uint8_t **data, uint16_t *len)
+{
+	uint32_t slot;
+
+	if (usbRxTail == usbRxHead)
+	{
+		return false;
+	}
+
+	slot = usbRxTail & (USB_CDC_RX_PACKETS - 1);
+	*data = usbRxData[slot];
+	*len = usbRxLength[slot];
+
+	return true;
+}
+
+bool_t usbCdc_Send(const uint8_t *data, uint16_t len)
+{
+	if (!usbConfigured || usbTxBusy || (len > USB_CDC_PACKET_SIZE))
+	{
+		return false;
+	}
+
+	// the caller buffer can be reused once the packet is copied
+	memcpy(usbTxData, data, len);
+	usbTxBusy = true;
+	HAL_PCD_EP_Transmit(&hpcd_USB_OTG_FS, USB_EP_CDC_IN, usbTxData, len);
+
+	return true;
+}
+
+void usbCdc_ReleasePacket()
+{
+	if (usbRxTail == usbRxHead)
+	{
+		return;
+	}
+
+	usbRxTail++;
+
+	// the interrupt only pauses when the ring is full, resume with the IRQ masked
+	if (usbRxPaused)
+	{
+		HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+		usbRxPaused = false;
+		usbCdc_armReceive();
+		HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+	}
+}
+
+/**
+ * HAL PCD callbacks
+ */
+
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+	usbConfigured = false;
+	usbPendingRequest = 0;
+	usbEp0TxActive = false;
+	usbTxBusy = false;
+
+	HAL_PCD_EP_Open(hpcd, 0x00, USB_EP0_SIZE, EP_TYPE_CTRL);
+	HAL_PCD_EP_Open(hpcd, 0x80, USB_EP0_SIZE, EP_TYPE_CTRL);
+}
+
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+	const uint8_t *setup = (const uint8_t*) hpcd->Setup;
+	usbSetup_t req;
+
+	req.bmRequestType = setup[0];
+	req.bRequest = setup[1];
+	req.wValue = setup[2] | (setup[3] << 8);
+	req.wIndex = setup[4] | (setup[5] << 8);
+	req.wLength = setup[6] | (setup[7] << 8);
+
+	// a new setup packet aborts the previous control transfer
+	usbEp0TxActive = false;
+
+	switch (req.bmRequestType & USB_REQ_TYPE_MASK)
+	{
+	case USB_REQ_TYPE_STANDARD:
+		usbCdc_standardRequest(&req);
+		break;
+
+	case USB_REQ_TYPE_CLASS:
+		usbCdc_classRequest(&req);
+		break;
+
+	default:
+		usbCdc_ctlError();
+		break;
+	}
+}
+
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+	if (epnum == 0)
+	{
+		// data stage of SET_LINE_CODING
+		if (usbPendingRequest == CDC_SET_LINE_CODING)
+		{
+			memcpy(usbLineCoding, usbEp0Data, sizeof(usbLineCoding));
+			usbPendingRequest = 0;
+			usbCdc_ctlStatus();
+		}
+	}
+	else if (epnum == (USB_EP_CDC_OUT & 0x7F))
+	{
+		usbRxLength[usbRxHead & (USB_CDC_RX_PACKETS - 1)] =
+				(uint16_t) HAL_PCD_EP_GetRxCount(hpcd, epnum);
+		usbRxHead++;
+
+		if ((usbRxHead - usbRxTail) < USB_CDC_RX_PACKETS)
+		{
+			usbCdc_armReceive();
+		}
+		else
+		{
+			usbRxPaused = true;
+		}
+	}
+}
+
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+	if (epnum == 0)
+	{
+		// the endpoint sends a packet at a time, the status stage follows the last one
+		if (!usbEp0TxActive)
+			return;
+
+		if (usbEp0TxLeft > 0)
+		{
+			usbCdc_ctlSendNext();
+		}
+		else if (usbEp0TxZlp)
+		{
+			usbEp0TxZlp = false;
+			HAL_PCD_EP_Transmit(hpcd, 0x80, NULL, 0);
+		}
+		else
+		{
+			usbEp0TxActive = false;
+			HAL_PCD_EP_Receive(hpcd, 0x00, NULL, 0);
+		}
+	}
+	else if (epnum == (USB_EP_CDC_IN & 0x7F))
+	{
+		usbTxBusy = false;
+	}
+}
+
+void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
+{
+	// nothing to do, reception resumes when the host wakes up the bus
+}
+
+void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
+{
+	usbConfigured = false;
+}
+
+/**
+ * Private functions
+ */
+
+static void usbCdc_standardRequest(const usbSetup_t *req)
+{
+	uint16_t len;
+
+	switch (req->bRequest)
+	{
+	case USB_REQ_GET_DESCRIPTOR:
+		switch (req->wValue >> 8)
+		{
+		case USB_DESC_DEVICE:
+			usbCdc_ctlSend(usbDeviceDesc, sizeof(usbDeviceDesc), req->wLength);
+			break;
+
+		case USB_DESC_CONFIGURATION:
+			usbCdc_ctlSend(usbConfigDesc, sizeof(usbConfigDesc), req->wLength);
+			break;
+
+		case USB_DESC_STRING:
+			if ((req->wValue & 0xFF) == 0)
+			{
+				usbCdc_ctlSend(usbLangDesc, sizeof(usbLangDesc), req->wLength);
+			}
+			else if ((req->wValue & 0xFF) <= 3)
+			{
+				len = usbCdc_stringDesc(usbStrings[(req->wValue & 0xFF) - 1]);
+				usbCdc_ctlSend(usbStringDesc, len, req->wLength);
+			}
+			else
+			{
+				usbCdc_ctlError();
+			}
+			break;
+
+		default:
+			usbCdc_ctlError();
+			break;
+		}
+		break;
+
+	case USB_REQ_SET_ADDRESS:
+		HAL_PCD_SetAddress(&hpcd_USB_OTG_FS, (uint8_t) (req->wValue & 0x7F));
+		usbCdc_ctlStatus();
+		break;
+
+	case USB_REQ_SET_CONFIGURATION:
+		if ((req->wValue & 0xFF) == 1)
+		{
+			HAL_PCD_EP_Open(&hpcd_USB_OTG_FS, USB_EP_CDC_OUT,
+			USB_CDC_PACKET_SIZE, EP_TYPE_BULK);
+			HAL_PCD_EP_Open(&hpcd_USB_OTG_FS, USB_EP_CDC_IN,
+			USB_CDC_PACKET_SIZE, EP_TYPE_BULK);
+			HAL_PCD_EP_Open(&hpcd_USB_OTG_FS, USB_EP_CDC_CMD,
+			USB_CDC_CMD_PACKET_SIZE, EP_TYPE_INTR);
+
+			usbRxHead = 0;
+			usbRxTail = 0;
+			usbRxPaused = false;
+			usbTxBusy = false;
+			usbCdc_armReceive();
+			usbConfigured = true;
+		}
+		else
+		{
+			usbConfigured = false;
+		}
+		usbCdc_ctlStatus();
+		break;
+
+	case USB_REQ_GET_CONFIGURATION:
+		usbEp0Data[0] = usbConfigured ? 1 : 0;
+		usbCdc_ctlSend(usbEp0Data, 1, req->wLength);
+		break;
+
+	case USB_REQ_GET_STATUS:
+		usbEp0Data[0] = 0;
+		usbEp0Data[1] = 0;
+		usbCdc_ctlSend(usbEp0Data, 2, req->wLength);
+		break;
+
+	case USB_REQ_GET_INTERFACE:
+		usbEp0Data[0] = 0;
+		usbCdc_ctlSend(usbEp0Data, 1, req->wLength);
+		break;
+
+	case USB_REQ_CLEAR_FEATURE:
+	case USB_REQ_SET_FEATURE:
+	case USB_REQ_SET_INTERFACE:
+		usbCdc_ctlStatus();
+		break;
+
+	default:
+		usbCdc_ctlError();
+		break;
+	}
+}
+
+static void usbCdc_classRequest(const usbSetup_t *req)
+{
+	switch (req->bRequest)
+	{
+	case CDC_SET_LINE_CODING:
+		usbPendingRequest = CDC_SET_LINE_CODING;
+		HAL_PCD_EP_Receive(&hpcd_USB_OTG_FS, 0x00, usbEp0Data,
+				sizeof(usbLineCoding));
+		break;
+
+	case CDC_GET_LINE_CODING:
+		usbCdc_ctlSend(usbLineCoding, sizeof(usbLineCoding), req->wLength);
+		break;
+
+	case CDC_SET_CONTROL_LINE_STATE:
+		usbCdc_ctlStatus();
+		break;
+
+	default:
+		usbCdc_ctlError();
+		break;
+	}
+}
+
+static void usbCdc_ctlSend(const uint8_t *data, uint16_t len, uint16_t maxLen)
+{
+	if (len > maxLen)
+	{
+		len = maxLen;
+	}
+
+	// a reply shorter than requested that fills whole packets ends with a zero length one
+	usbEp0TxZlp = (len > 0) && (len < maxLen)
+			&& ((len % USB_EP0_SIZE) == 0);
+	usbEp0TxData = data;
+	usbEp0TxLeft = len;
+	usbEp0TxActive = true;
+
+	usbCdc_ctlSendNext();
+}
+
+static void usbCdc_ctlSendNext()
+{
+	const uint8_t *data = usbEp0TxData;
+	uint16_t len = (usbEp0TxLeft > USB_EP0_SIZE) ? USB_EP0_SIZE : usbEp0TxLeft;
+
+	usbEp0TxData += len;
+	usbEp0TxLeft -= len;
+	HAL_PCD_EP_Transmit(&hpcd_USB_OTG_FS, 0x80, (uint8_t*) data, len);
+}
+
+static void usbCdc_ctlStatus()
+{
+	HAL_PCD_EP_Transmit(&hpcd_USB_OTG_FS, 0x80, NULL, 0);
+}
+
+static void usbCdc_ctlError()
+{
+	HAL_PCD_EP_SetStall(&hpcd_USB_OTG_FS, 0x80);
+	HAL_PCD_EP_SetStall(&hpcd_USB_OTG_FS, 0x00);
+}
+
+static uint16_t usbCdc_stringDesc(const char *str)
+{
+	uint16_t len = 2;
+
+	while ((*str != '\0') && (len < USB_STRING_DESC_SIZE))
+	{
+		usbStringDesc[len++] = (uint8_t) *str++;
+		usbStringDesc[len++] = 0x00;
+	}
+
+	usbStringDesc[0] = (uint8_t) len;
+	usbStringDesc[1] = USB_DESC_STRING;
+
+	return len;
+}
+
+static void usbCdc_armReceive()
+{
+	HAL_PCD_EP_Receive(&hpcd_USB_OTG_FS, USB_EP_CDC_OUT,
+			usbRxData[usbRxHead & (USB_CDC_RX_PACKETS - 1)],
+			USB_CDC_PACKET_SIZE);
+}
+
+static void Error_Handler(void)
+{
+	/* Turn LED_APP on */
+	BSP_LED_On(LED_APP);
+	while (1)
+	{
+	}
+}
@@ -0,0 +1,148 @@
+/**
+ ******************************************************************************
+ * @file    host_replay.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Host replay runner
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @var replayFile
+ * @brief Trace read by hostReplay_Load().
+ */
+static uint8_t *replayFile;
+
+/**
+ * @var eventNames
+ * @brief Names of the application events, as logged by the firmware.
+ */
+static const char *const eventNames[] =
+{ "", "IMU ok", "IMU error", "Idle", "Sleep", "Wake up", "Active",
+		"No spin detected", "Positive spin detected",
+		"Negative spin detected", "Positive spin shown",
+		"Negative spin shown", "Error" };
+
+/**
+ * Host Replay Functions
+ */
+
+bool hostReplay_Load(const char *path)
+{
+	FILE *file;
+	long length;
+
+	file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	free(replayFile);
+	replayFile = malloc((length > 0) ? (size_t) length : 1);
+	if ((replayFile == NULL) || (length <= 0)
+			|| (fread(replayFile, 1, (size_t) length, file) != (size_t) length))
+	{
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+
+	return hostReplay_Start(replayFile, (uint32_t) length);
+}
+
+bool hostReplay_Start(const uint8_t *trace, uint32_t length)
+{
+	if (!imuReplay_Open(trace, length))
+		return false;
+
+	if (!imu_Init())
+		return false;
+
+	appFsm_Init();
+
+	return true;
+}
+
+appEvent_t hostReplay_Step()
+{
+	imuReplay_Advance(1);
+	imu_GetData();
+	imu_VibrationTasks();
+
+	return appFsm_Tasks(imuReplay_Time(), true, true);
+}
+
+const char* hostReplay_EventName(appEvent_t event)
+{
+	if ((uint32_t) event >= sizeof(eventNames) / sizeof(eventNames[0]))
+		return "?";
+
+	return eventNames[event];
+}
+
+uint32_t hostReplay_Synth(uint8_t *trace, uint32_t size, uint32_t ms,
+		hostReplaySample_t sample)
+{
+	imuTraceHeader_t header =
+	{ .version = IMU_TRACE_VERSION, .magn = false, .config =
+	{ .rateHz = 1000, .dlpf = DEVICE_IMU_DLPF, .accFsr = DEVICE_IMU_ACC_FSR,
+			.gyroFsr = DEVICE_IMU_GYRO_FSR }, .cal =
+	{ .gyroOffset =
+	{ 0, 0, 0 }, .magnAsa =
+	{ 65536, 65536, 65536 } }, .start = 1000 };
+	imuRaw_t raw;
+	uint32_t previous = header.start;
+	uint32_t length;
+
+	if (size < IMU_TRACE_HEADER_SIZE)
+		return 0;
+	length = imuTrace_EncodeHeader(&header, trace);
+
+	for (uint32_t i = 0; i < ms; i++)
+	{
+		if ((size - length) < IMU_TRACE_MAX_RECORD)
+			return 0;
+
+		raw = (imuRaw_t)
+		{ 0 };
+		sample(i, &raw);
+		raw.magn = false;
+		raw.timestamp = header.start + i;
+		raw.timestampUs = raw.timestamp * 1000;
+		length += imuTrace_EncodeSample(&raw, previous, previous * 1000,
+				&trace[length]);
+		previous = raw.timestamp;
+	}
+
+	return length;
+}
+
+double hostReplay_Seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+uint64_t hostReplay_Cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
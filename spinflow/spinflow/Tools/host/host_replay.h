@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * @file    host_replay.h
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Host replay runner
+ *
+ * Drives the IMU API and the application FSM on the host from a trace, with
+ * the DEVICE_IMU_REPLAY build of the IMU driver (see imu_replay.h). Each step
+ * advances the replay clock by a millisecond and runs the same tasks as the
+ * main loop of the firmware, without the HAL, log and NeoPixels: the NeoPixels
+ * are always idle and nothing keeps the device awake.
+ *
+ * Traces are read from a file, as recorded with DEVICE_IMU_TRACE_ENABLE, or
+ * synthesised from a sample generator for the tests.
+ ******************************************************************************
+ */
+
+#ifndef HOST_REPLAY_H
+#define HOST_REPLAY_H
+
+#include "app_fsm.h"
+#include "imu_replay.h"
+
+/**
+ * @typedef hostReplaySample_t
+ * @brief Sample generator of a synthetic trace.
+ * @param ms Time from the start of the trace, in milliseconds.
+ * @param raw Raw sample to fill, the timestamp is set by the caller.
+ */
+typedef void (*hostReplaySample_t)(uint32_t ms, imuRaw_t *raw);
+
+/**
+ * @brief Reads a trace file and starts its replay.
+ * @param path Trace file.
+ * @return bool Returns true if the trace was read and is valid, false otherwise.
+ */
+bool hostReplay_Load(const char *path);
+
+/**
+ * @brief Starts the replay of a trace held in memory.
+ * @param trace Trace, it must stay valid during the replay.
+ * @param length Trace length, in bytes.
+ * @return bool Returns true if the trace is valid and the IMU API started, false otherwise.
+ *
+ * The IMU API and the application FSM are initialised.
+ */
+bool hostReplay_Start(const uint8_t *trace, uint32_t length);
+
+/**
+ * @brief Runs a step of the replay.
+ * @return appEvent_t Event of the application FSM.
+ *
+ * Advances the clock by a millisecond, reads the new samples and runs the
+ * vibration analysis and the application FSM.
+ */
+appEvent_t hostReplay_Step();
+
+/**
+ * @brief Gets the name of an application event, as logged by the firmware.
+ * @param event Event.
+ * @return const char* Name.
+ */
+const char* hostReplay_EventName(appEvent_t event);
+
+/**
+ * @brief Synthesises a trace at 1 kHz with the sensor settings of device_config.h.
+ * @param trace Destination.
+ * @param size Destination size, in bytes.
+ * @param ms Trace duration, in milliseconds.
+ * @param sample Sample generator, called every millisecond.
+ * @return uint32_t Trace length, 0 if it does not fit.
+ *
+ * Samples hold no magnetometer data and the gyroscope offsets are 0.
+ */
+uint32_t hostReplay_Synth(uint8_t *trace, uint32_t size, uint32_t ms,
+		hostReplaySample_t sample);
+
+/**
+ * @brief Gets a monotonic time for the benchmarks.
+ * @return double Time, in seconds.
+ */
+double hostReplay_Seconds();
+
+/**
+ * @brief Gets the processor cycle counter for the benchmarks.
+ * @return uint64_t Cycles, 0 where no counter is readable.
+ */
+uint64_t hostReplay_Cycles();
+
+#endif
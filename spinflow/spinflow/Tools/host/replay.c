@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * @file    replay.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Replays an IMU trace through the IMU API and the application FSM
+ *
+ * Usage: replay <trace.bin>
+ *
+ * Prints the application events and the gestures with their time from the
+ * start of the trace, then the rotation, spin latency and vibration results at
+ * the end of the trace. Consecutive idle evaluations are printed once.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+	imuTraceHeader_t header;
+	imuGestureEvent_t gesture;
+	imuVibResult_t vib;
+	appEvent_t event;
+	appEvent_t last = APP_EVENT_NONE;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s <trace.bin>\n", argv[0]);
+		return 2;
+	}
+
+	if (!hostReplay_Load(argv[1]))
+	{
+		fprintf(stderr, "%s: not a valid trace\n", argv[1]);
+		return 1;
+	}
+	imuReplay_GetHeader(&header);
+	printf("trace %s, %u Hz, magnetometer %s\n", argv[1],
+			(unsigned) header.config.rateHz, header.magn ? "yes" : "no");
+
+	while (!imuReplay_Done())
+	{
+		event = hostReplay_Step();
+		// consecutive idle evaluations are printed once
+		if ((event != APP_EVENT_NONE)
+				&& !((event == APP_EVENT_IDLE) && (last == APP_EVENT_IDLE)))
+		{
+			printf("%9.3f s  %s\n", (imuReplay_Time() - header.start) / 1000.0,
+					hostReplay_EventName(event));
+		}
+		if (event != APP_EVENT_NONE)
+			last = event;
+
+		while (imu_GetGesture(&gesture))
+		{
+			printf("%9.3f s  gesture %d, axis %d, %s score %u\n",
+					(gesture.timestamp - header.start) / 1000.0,
+					(int) gesture.type, (int) gesture.direction,
+					(gesture.type == IMU_GESTURE_TEMPLATE) ?
+							imu_GestureName(gesture.index) : "",
+					(unsigned) gesture.score);
+		}
+	}
+
+	printf("duration %.3f s\n", (imuReplay_Time() - header.start) / 1000.0);
+	printf("rotation %ld revolutions, %.1f deg, %.1f rpm\n",
+			(long) imu_Revolutions(), imu_RotationAngle(), imu_Rpm());
+	printf("spin latency %lu ms\n", (unsigned long) imu_SpinLatency());
+
+	if (imu_GetVibration(&vib))
+	{
+		printf("vibration %.1f mg rms, peak %.1f mg at %.1f Hz, %lu windows\n",
+				vib.rms, vib.peakAmplitude, vib.peakHz,
+				(unsigned long) vib.windows);
+	}
+
+	return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ ******************************************************************************
+ * @file    test_ahrs.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Orientation filter test and benchmark
+ *
+ * Usage: test_ahrs [trace.bin ...]
+ *
+ * Checks imu_ahrs.c on synthetic motion: the tilt of a still sensor converges,
+ * the gyroscope integrates a turn, and the rate about the vertical of a tilted
+ * sensor spinning about the vertical is recovered. Then replays a tilted still
+ * trace through the IMU API and checks imu_Orientation(), and measures the
+ * time and cycles of an update on the host.
+ *
+ * Recorded traces given on the command line are replayed too, with the
+ * orientation printed every second, for a visual check.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * @def TEST_DT
+ * @brief Update period, in seconds.
+ */
+#define TEST_DT				0.001f
+
+/**
+ * @def TEST_DEG_TO_RAD
+ * @brief Degrees to radians.
+ */
+#define TEST_DEG_TO_RAD		0.017453292519943f
+
+/**
+ * @def TEST_BENCH_UPDATES
+ * @brief Updates timed by the benchmark.
+ */
+#define TEST_BENCH_UPDATES	2000000
+
+/**
+ * @var trace
+ * @brief Synthetic trace.
+ */
+static uint8_t trace[256 * 1024];
+
+/**
+ * @var sink
+ * @brief Keeps the benchmark results alive.
+ */
+static volatile float sink;
+
+/**
+ * @brief Gets the gravity reaction measured by a tilted sensor.
+ * @param roll Roll, in degrees.
+ * @param pitch Pitch, in degrees.
+ * @param a Acceleration along X, Y and Z, in g.
+ */
+static void test_gravity(float roll, float pitch, float *a)
+{
+	float r = roll * TEST_DEG_TO_RAD;
+	float p = pitch * TEST_DEG_TO_RAD;
+
+	a[0] = -sinf(p);
+	a[1] = sinf(r) * cosf(p);
+	a[2] = cosf(r) * cosf(p);
+}
+
+/**
+ * @brief Checks a value.
+ * @param name Check.
+ * @param value Value.
+ * @param expected Expected value.
+ * @param tolerance Largest accepted error.
+ * @return uint32_t 1 if the value is out of tolerance, 0 otherwise.
+ */
+static uint32_t test_check(const char *name, float value, float expected,
+		float tolerance)
+{
+	bool ok = fabsf(value - expected) <= tolerance;
+
+	printf("%-28s %9.3f, expected %9.3f  %s\n", name, value, expected,
+			ok ? "ok" : "FAIL");
+
+	return ok ? 0 : 1;
+}
+
+/**
+ * @brief Generates a still sample, rolled 30 degrees.
+ * @param ms Time from the start of the trace, in milliseconds.
+ * @param raw Raw sample.
+ */
+static void test_tiltedSample(uint32_t ms, imuRaw_t *raw)
+{
+	float a[3];
+	float oneG = (float) (16384 >> DEVICE_IMU_ACC_FSR);
+
+	(void) ms;
+	test_gravity(30.0f, 0.0f, a);
+	raw->ax = (int16_t) (a[0] * oneG);
+	raw->ay = (int16_t) (a[1] * oneG);
+	raw->az = (int16_t) (a[2] * oneG);
+}
+
+/**
+ * @brief Replays a recorded trace, printing the orientation every second.
+ * @param path Trace file.
+ * @return uint32_t 1 if the trace can not be replayed, 0 otherwise.
+ */
+static uint32_t test_replayFile(const char *path)
+{
+	imuTraceHeader_t header;
+	imuEuler_t euler;
+	uint32_t t;
+
+	if (!hostReplay_Load(path))
+	{
+		printf("FAIL %s: not a valid trace\n", path);
+		return 1;
+	}
+	imuReplay_GetHeader(&header);
+
+	printf("%s\n", path);
+	while (!imuReplay_Done())
+	{
+		hostReplay_Step();
+		t = imuReplay_Time() - header.start;
+		if ((t % 1000) == 0)
+		{
+			imu_Orientation(&euler);
+			printf("%6.1f s  roll %7.2f  pitch %7.2f  yaw %7.2f  rate %4d dps\n",
+					t / 1000.0f, euler.roll, euler.pitch, euler.yaw,
+					(int) imu_SpinRate());
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	imuAhrs_t ahrs;
+	imuEuler_t euler;
+	uint32_t failures = 0;
+	uint32_t length;
+	uint64_t cycles;
+	double start;
+	float a[3];
+	float w[3];
+	float rate;
+	float r;
+
+	// a still tilted sensor converges to its tilt
+	imuAhrs_Init(&ahrs, IMU_AHRS_BETA);
+	test_gravity(30.0f, -20.0f, a);
+	for (uint32_t i = 0; i < 10000; i++)
+		imuAhrs_UpdateImu(&ahrs, 0, 0, 0, a[0], a[1], a[2], TEST_DT);
+	imuAhrs_GetEuler(&ahrs, &euler);
+	failures += test_check("still roll, deg", euler.roll, 30.0f, 0.5f);
+	failures += test_check("still pitch, deg", euler.pitch, -20.0f, 0.5f);
+
+	// without the accelerometer correction, a turn is the integral of the gyroscope
+	imuAhrs_Init(&ahrs, 0.0f);
+	for (uint32_t i = 0; i < 1000; i++)
+		imuAhrs_UpdateImu(&ahrs, 0, 0, 90.0f * TEST_DEG_TO_RAD, 0, 0, 1.0f,
+				TEST_DT);
+	imuAhrs_GetEuler(&ahrs, &euler);
+	failures += test_check("gyro turn, deg", euler.yaw, 90.0f, 0.1f);
+
+	// spin about the vertical, sensor rolled 30 degrees: the vertical rate is
+	// split between the sensor Y and Z axes
+	imuAhrs_Init(&ahrs, IMU_AHRS_BETA);
+	r = 30.0f * TEST_DEG_TO_RAD;
+	test_gravity(30.0f, 0.0f, a);
+	w[0] = 0.0f;
+	w[1] = sinf(r) * 200.0f;
+	w[2] = cosf(r) * 200.0f;
+	for (uint32_t i = 0; i < 5000; i++)
+	{
+		imuAhrs_UpdateImu(&ahrs, w[0] * TEST_DEG_TO_RAD, w[1] * TEST_DEG_TO_RAD,
+				w[2] * TEST_DEG_TO_RAD, a[0], a[1], a[2], TEST_DT);
+	}
+	rate = imuAhrs_AxisRate(&ahrs, w[0], w[1], w[2], 0.0f, 0.0f, 1.0f);
+	failures += test_check("tilted spin rate, dps", rate, 200.0f, 2.0f);
+
+	// the same tilt replayed through the IMU API
+	length = hostReplay_Synth(trace, sizeof(trace), 10000, test_tiltedSample);
+	if ((length == 0) || !hostReplay_Start(trace, length))
+	{
+		printf("FAIL trace\n");
+		return 1;
+	}
+	while (!imuReplay_Done())
+		hostReplay_Step();
+	imu_Orientation(&euler);
+	failures += test_check("replay roll, deg", euler.roll, 30.0f, 0.5f);
+	failures += test_check("replay pitch, deg", euler.pitch, 0.0f, 0.5f);
+
+	for (int i = 1; i < argc; i++)
+		failures += test_replayFile(argv[i]);
+
+	// benchmark, with a slowly changing input so nothing is hoisted
+	imuAhrs_Init(&ahrs, IMU_AHRS_BETA);
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	for (uint32_t i = 0; i < TEST_BENCH_UPDATES; i++)
+	{
+		float g = (float) (i & 1023) * 1e-4f;
+
+		imuAhrs_UpdateImu(&ahrs, g, 0.2f, 1.5f, 0.1f, 0.5f, 0.85f, TEST_DT);
+	}
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	sink = ahrs.q0;
+	printf("bench imu:  %.1f ns, %.1f host cycles per update\n",
+			start * 1e9 / TEST_BENCH_UPDATES,
+			(double) cycles / TEST_BENCH_UPDATES);
+
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	for (uint32_t i = 0; i < TEST_BENCH_UPDATES; i++)
+	{
+		float g = (float) (i & 1023) * 1e-4f;
+
+		imuAhrs_Update(&ahrs, g, 0.2f, 1.5f, 0.1f, 0.5f, 0.85f, 200.0f, 30.0f,
+				-400.0f, TEST_DT);
+	}
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	sink = ahrs.q0;
+	printf("bench marg: %.1f ns, %.1f host cycles per update\n",
+			start * 1e9 / TEST_BENCH_UPDATES,
+			(double) cycles / TEST_BENCH_UPDATES);
+
+	printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+	return (failures == 0) ? 0 : 1;
+}
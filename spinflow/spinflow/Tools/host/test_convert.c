@@ -0,0 +1,245 @@
+/**
+ ******************************************************************************
+ * @file    test_convert.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Fixed-point sample conversion test and benchmark
+ *
+ * Converts every int16 raw value with imuConvert_Acc(), imuConvert_Gyro() and
+ * imuConvert_Temp(), at every full scale range, and compares the results with
+ * the conversion in double precision. Each result must be within half a unit
+ * of the exact value, plus the error of the Q16 scale at that input. A still
+ * trace with a gyroscope offset is replayed, the tracked offsets must reach it
+ * as on the device. Then measures the time and cycles to convert a sample on
+ * the host.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+#include "imu_convert.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * @def TEST_GYRO_OFFSET
+ * @brief Gyroscope offset of the test, in counts (Q8).
+ */
+#define TEST_GYRO_OFFSET	(-((37 << IMU_GYRO_CAL_FRAC_BITS) + 101))
+
+/**
+ * @def TEST_BIAS_COUNTS
+ * @brief Gyroscope offset of the replayed trace, in counts.
+ */
+#define TEST_BIAS_COUNTS	12
+
+/**
+ * @def TEST_BIAS_MS
+ * @brief Length of the replayed trace, in milliseconds, several tracking time constants.
+ */
+#define TEST_BIAS_MS		60000
+
+/**
+ * @def TEST_BIAS_ERROR
+ * @brief Largest tracked offset error, in counts (Q8). The tracking stops an
+ * eighth of a count short, where the step shifts to zero.
+ */
+#define TEST_BIAS_ERROR		(0.15 * 256.0)
+
+/**
+ * @def TEST_BENCH_ROUNDS
+ * @brief Times the full input range is converted in the benchmark.
+ */
+#define TEST_BENCH_ROUNDS	200
+
+/**
+ * @var accFactors
+ * @brief Accelerometer sensitivities, in counts per g, per full scale range.
+ */
+static const double accFactors[] =
+{ ACC_FSR_2G_FACTOR, ACC_FSR_4G_FACTOR, ACC_FSR_8G_FACTOR, ACC_FSR_16G_FACTOR };
+
+/**
+ * @var gyroFactors
+ * @brief Gyroscope sensitivities, in counts per degree/s, per full scale range.
+ */
+static const double gyroFactors[] =
+{ GYR_FSR_250DPS_FACTOR, GYR_FSR_500DPS_FACTOR, GYR_FSR_1000DPS_FACTOR,
+		GYR_FSR_2000DPS_FACTOR };
+
+/**
+ * @var sink
+ * @brief Keeps the benchmark results alive.
+ */
+static volatile int32_t sink;
+
+/**
+ * @var trace
+ * @brief Replayed trace.
+ */
+static uint8_t trace[IMU_TRACE_HEADER_SIZE + TEST_BIAS_MS * IMU_TRACE_MAX_RECORD];
+
+/**
+ * @brief Writes a still sample with a gyroscope offset.
+ * @param ms Time since the start of the trace.
+ * @param raw Raw sample.
+ */
+static void test_still(uint32_t ms, imuRaw_t *raw)
+{
+	(void) ms;
+
+	raw->az = 8192;
+	raw->gx = TEST_BIAS_COUNTS;
+	raw->gy = -TEST_BIAS_COUNTS;
+}
+
+/**
+ * @brief Checks a converted value.
+ * @param name Conversion.
+ * @param raw Raw input.
+ * @param value Converted value.
+ * @param exact Exact value.
+ * @param bound Largest accepted error.
+ * @param maxError Largest error so far, updated.
+ * @return uint32_t 1 if the value is out of bounds, 0 otherwise.
+ */
+static uint32_t test_check(const char *name, int32_t raw, int32_t value,
+		double exact, double bound, double *maxError)
+{
+	double error = fabs((double) value - exact);
+
+	if (error > *maxError)
+		*maxError = error;
+
+	if (error > bound)
+	{
+		printf("FAIL %s raw %d: %d, exact %.4f\n", name, (int) raw, (int) value,
+				exact);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main()
+{
+	int32_t offset[3] =
+	{ TEST_GYRO_OFFSET, 0, -TEST_GYRO_OFFSET };
+	uint32_t failures = 0;
+	double maxError;
+	double scaleError;
+	double exact;
+	double start;
+	uint64_t cycles;
+	imuRaw_t raw =
+	{ 0 };
+	acc_t acc;
+	gyro_t gyro;
+	imuRawCal_t cal;
+	int32_t scale;
+	uint32_t length;
+
+	for (uint8_t fsr = ACC_FSR_2G; fsr <= ACC_FSR_16G; fsr++)
+	{
+		scale = imuConvert_AccScale(fsr);
+		scaleError = fabs(scale / 65536.0 - 1000.0 / accFactors[fsr]);
+		maxError = 0.0;
+		for (int32_t v = INT16_MIN; v <= INT16_MAX; v++)
+		{
+			raw.ax = raw.ay = raw.az = (int16_t) v;
+			imuConvert_Acc(&raw, scale, &acc);
+			exact = v * 1000.0 / accFactors[fsr];
+			failures += test_check("acc", v, acc.ax, exact,
+					0.5 + scaleError * abs(v) + 1e-9, &maxError);
+			if ((acc.ay != acc.ax) || (acc.az != acc.ax))
+				failures++;
+		}
+		printf("acc  fsr %u: max error %.3f mg\n", fsr, maxError);
+	}
+
+	for (uint8_t fsr = GYR_FSR_250DPS; fsr <= GYR_FSR_2000DPS; fsr++)
+	{
+		scale = imuConvert_GyroScale(fsr);
+		scaleError = fabs(scale / 65536.0 - 100.0 / gyroFactors[fsr]);
+		maxError = 0.0;
+		for (int32_t v = INT16_MIN; v <= INT16_MAX; v++)
+		{
+			raw.gx = raw.gy = raw.gz = (int16_t) v;
+			imuConvert_Gyro(&raw, offset, scale, &gyro);
+			for (uint8_t i = 0; i < 3; i++)
+			{
+				double counts = v - offset[i] / 256.0;
+				int32_t value = (i == 0) ? gyro.gx : ((i == 1) ? gyro.gy : gyro.gz);
+
+				exact = counts * 100.0 / gyroFactors[fsr];
+				failures += test_check("gyro", v, value, exact,
+						0.5 + scaleError * fabs(counts) + 1e-9, &maxError);
+			}
+		}
+		printf("gyro fsr %u: max error %.3f cdps\n", fsr, maxError);
+	}
+
+	scaleError = fabs(TEMP_SCALE / 65536.0 - 100.0 / TEMP_SENSITIVITY);
+	maxError = 0.0;
+	for (int32_t v = INT16_MIN; v <= INT16_MAX; v++)
+	{
+		exact = v * 100.0 / TEMP_SENSITIVITY + TEMP_OFFSET * 100.0;
+		failures += test_check("temp", v, imuConvert_Temp((int16_t) v), exact,
+				0.5 + scaleError * abs(v) + 1e-9, &maxError);
+	}
+	printf("temp: max error %.3f cdeg\n", maxError);
+
+	// the replay tracks the offsets from the header, as the device does
+	length = hostReplay_Synth(trace, sizeof(trace), TEST_BIAS_MS, test_still);
+	if ((length == 0) || !hostReplay_Start(trace, length))
+	{
+		printf("FAIL replay\n");
+		failures++;
+	}
+	else
+	{
+		for (uint32_t ms = 0; ms < TEST_BIAS_MS; ms++)
+			hostReplay_Step();
+		imuPort_GetRawCalibration(IMU_PRIMARY, &cal);
+		printf("bias: tracked %.2f %.2f %.2f counts, stationary %u\n",
+				cal.gyroOffset[0] / 256.0, cal.gyroOffset[1] / 256.0,
+				cal.gyroOffset[2] / 256.0, imuPort_Stationary(IMU_PRIMARY));
+		maxError = 0.0;
+		failures += test_check("bias x", TEST_BIAS_COUNTS, cal.gyroOffset[0],
+				TEST_BIAS_COUNTS * 256.0, TEST_BIAS_ERROR, &maxError);
+		failures += test_check("bias y", -TEST_BIAS_COUNTS, cal.gyroOffset[1],
+				-TEST_BIAS_COUNTS * 256.0, TEST_BIAS_ERROR, &maxError);
+		failures += test_check("bias z", 0, cal.gyroOffset[2], 0.0,
+				TEST_BIAS_ERROR, &maxError);
+		failures += !imuPort_Stationary(IMU_PRIMARY);
+	}
+
+	// a sample: accelerometer, temperature and gyroscope
+	scale = imuConvert_GyroScale(DEVICE_IMU_GYRO_FSR);
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	for (uint32_t round = 0; round < TEST_BENCH_ROUNDS; round++)
+	{
+		for (int32_t v = INT16_MIN; v <= INT16_MAX; v++)
+		{
+			raw.ax = raw.gz = (int16_t) v;
+			raw.ay = raw.gx = (int16_t) (v ^ 0x5555);
+			raw.az = raw.gy = raw.temp = (int16_t) (v ^ 0x0F0F);
+			imuConvert_Acc(&raw, ACC_FSR_4G_SCALE, &acc);
+			imuConvert_Gyro(&raw, offset, scale, &gyro);
+			sink = acc.ax + acc.ay + acc.az + gyro.gx + gyro.gy + gyro.gz
+					+ imuConvert_Temp(raw.temp);
+		}
+	}
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	printf("bench: %.1f ns, %.1f host cycles per sample\n",
+			start * 1e9 / (TEST_BENCH_ROUNDS * 65536.0),
+			(double) cycles / (TEST_BENCH_ROUNDS * 65536.0));
+
+	printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+/**
+ ******************************************************************************
+ * @file    test_filter.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Low-pass filter frequency response test and benchmark
+ *
+ * Drives imuFilter_SetLowPass() filters of 1 to IMU_FILTER_MAX_STAGES stages
+ * with swept sinusoids and measures their steady state gain. The gain must be
+ * -3 dB at the cutoff and follow the Butterworth response of order twice the
+ * stage count, prewarped as the bilinear transform does, so the roll-off is
+ * 12 dB per octave per stage. Then measures the time and cycles of a filtered
+ * sample on the host.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * @def TEST_RATE_HZ
+ * @brief Sample rate, in Hz.
+ */
+#define TEST_RATE_HZ		1000.0
+
+/**
+ * @def TEST_SETTLE
+ * @brief Samples dropped before the gain is measured.
+ */
+#define TEST_SETTLE			3000
+
+/**
+ * @def TEST_SAMPLES
+ * @brief Samples of the gain measurement, a whole number of periods of every test frequency.
+ */
+#define TEST_SAMPLES		10000
+
+/**
+ * @def TEST_FLOOR_DB
+ * @brief Gains below this are only checked to be below it, single precision can not resolve them.
+ */
+#define TEST_FLOOR_DB		-90.0
+
+/**
+ * @def TEST_BENCH_SAMPLES
+ * @brief Samples timed by the benchmark.
+ */
+#define TEST_BENCH_SAMPLES	10000000
+
+/**
+ * @var cutoffs
+ * @brief Cutoff frequencies of the test, in Hz, multiples of TEST_RATE_HZ / TEST_SAMPLES.
+ */
+static const double cutoffs[] =
+{ 5.0, 20.0, 100.0 };
+
+/**
+ * @var ratios
+ * @brief Test frequencies, relative to the cutoff.
+ */
+static const double ratios[] =
+{ 0.1, 0.5, 1.0, 2.0, 4.0, 8.0 };
+
+/**
+ * @var sink
+ * @brief Keeps the benchmark results alive.
+ */
+static volatile float sink;
+
+/**
+ * @brief Measures the gain of a filter at a frequency.
+ * @param filter Filter, its history is cleared.
+ * @param hz Frequency, in Hz.
+ * @return double Gain, in dB.
+ *
+ * Correlates the steady state output with the input sine and cosine.
+ */
+static double test_gain(imuFilter_t *filter, double hz)
+{
+	double w = 2.0 * M_PI * hz / TEST_RATE_HZ;
+	double re = 0.0;
+	double im = 0.0;
+	double y;
+
+	imuFilter_Reset(filter);
+	for (uint32_t n = 0; n < TEST_SETTLE + TEST_SAMPLES; n++)
+	{
+		y = imuFilter_Apply(filter, (float) sin(w * n));
+		if (n >= TEST_SETTLE)
+		{
+			re += y * sin(w * n);
+			im += y * cos(w * n);
+		}
+	}
+
+	return 20.0 * log10(2.0 * sqrt(re * re + im * im) / TEST_SAMPLES);
+}
+
+/**
+ * @brief Gets the gain of the digital Butterworth low-pass filter.
+ * @param hz Frequency, in Hz.
+ * @param cutoffHz Cutoff frequency, in Hz.
+ * @param stages Number of biquad stages.
+ * @return double Gain, in dB.
+ */
+static double test_butterworth(double hz, double cutoffHz, uint8_t stages)
+{
+	double ratio = tan(M_PI * hz / TEST_RATE_HZ)
+			/ tan(M_PI * cutoffHz / TEST_RATE_HZ);
+
+	return -10.0 * log10(1.0 + pow(ratio, 4.0 * stages));
+}
+
+int main()
+{
+	imuFilter_t filter;
+	uint32_t failures = 0;
+	double gain;
+	double expected;
+	double previous;
+	double tolerance;
+	double start;
+	uint64_t cycles;
+	bool ok;
+
+	for (uint8_t c = 0; c < sizeof(cutoffs) / sizeof(cutoffs[0]); c++)
+	{
+		for (uint8_t stages = 1; stages <= IMU_FILTER_MAX_STAGES; stages++)
+		{
+			imuFilter_Init(&filter);
+			if (!imuFilter_SetLowPass(&filter, (float) cutoffs[c],
+					(float) TEST_RATE_HZ, stages))
+			{
+				printf("FAIL %.0f Hz, %u stages: not configured\n", cutoffs[c],
+						stages);
+				failures++;
+				continue;
+			}
+
+			printf("%5.0f Hz, %u stages:", cutoffs[c], stages);
+			previous = 0.0;
+			for (uint8_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++)
+			{
+				double hz = cutoffs[c] * ratios[r];
+
+				if (hz >= TEST_RATE_HZ / 2.0)
+					break;
+
+				gain = test_gain(&filter, hz);
+				expected = test_butterworth(hz, cutoffs[c], stages);
+				tolerance = (expected > -40.0) ? 0.05 : 0.5;
+
+				// -3 dB at the cutoff, whatever the order
+				if (ratios[r] == 1.0)
+					expected = -3.01;
+
+				ok = (expected < TEST_FLOOR_DB) ?
+						(gain < TEST_FLOOR_DB) :
+						(fabs(gain - expected) <= tolerance);
+				printf(" %7.2f", gain);
+				if (!ok)
+				{
+					printf(" (FAIL, expected %.2f)", expected);
+					failures++;
+				}
+
+				// roll-off over the octave above twice the cutoff
+				if ((ratios[r] == 4.0) && (expected > TEST_FLOOR_DB))
+					previous = gain;
+				if ((ratios[r] == 8.0) && (previous != 0.0))
+				{
+					expected = test_butterworth(hz, cutoffs[c], stages)
+							- test_butterworth(hz / 2.0, cutoffs[c], stages);
+					printf("  | octave %6.1f dB, analog %d", gain - previous,
+							-12 * stages);
+					if ((expected > TEST_FLOOR_DB)
+							&& (fabs((gain - previous) - expected) > 1.0))
+					{
+						printf(" (FAIL, expected %.1f)", expected);
+						failures++;
+					}
+				}
+			}
+			printf("\n");
+		}
+	}
+
+	// benchmark, one filtered sample
+	for (uint8_t stages = 1; stages <= IMU_FILTER_MAX_STAGES; stages++)
+	{
+		imuFilter_Init(&filter);
+		imuFilter_SetLowPass(&filter, 20.0f, (float) TEST_RATE_HZ, stages);
+		start = hostReplay_Seconds();
+		cycles = hostReplay_Cycles();
+		for (uint32_t n = 0; n < TEST_BENCH_SAMPLES; n++)
+			sink = imuFilter_Apply(&filter, (float) (n & 255));
+		cycles = hostReplay_Cycles() - cycles;
+		start = hostReplay_Seconds() - start;
+		printf("bench %u stages: %.1f ns, %.1f host cycles per sample\n",
+				stages, start * 1e9 / TEST_BENCH_SAMPLES,
+				(double) cycles / TEST_BENCH_SAMPLES);
+	}
+
+	printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+	return (failures == 0) ? 0 : 1;
+}
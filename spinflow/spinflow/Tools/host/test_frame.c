@@ -0,0 +1,306 @@
+/**
+ ******************************************************************************
+ * @file    test_frame.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   NeoPixels frame parser test and benchmark
+ *
+ * Encodes frames with npx_frame.c and feeds them back to its parser in USB
+ * sized packets, as npx_StreamWrite() gets them, and in odd sized ones. The
+ * stream mixes valid frames with a corrupt checksum, a pixel count above
+ * NPX_FRAME_MAX_PIXELS and a sync split between two packets; every valid frame
+ * must come out once and unchanged, and only the two bad ones counted as
+ * errors. Then measures the frames per second of the parser on the host.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+#include "npx_frame.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @def TEST_CHUNK
+ * @brief Packet length of the stream, a full speed USB bulk packet.
+ */
+#define TEST_CHUNK			64
+
+/**
+ * @def TEST_PIXELS
+ * @brief Pixels of the benchmark frames.
+ */
+#define TEST_PIXELS			20
+
+/**
+ * @def TEST_MAX_FRAMES
+ * @brief Frames of the test stream.
+ */
+#define TEST_MAX_FRAMES		32
+
+/**
+ * @def TEST_STREAM_SIZE
+ * @brief Size of the test stream, in bytes.
+ */
+#define TEST_STREAM_SIZE	(TEST_MAX_FRAMES * (NPX_FRAME_MAX_LENGTH + TEST_CHUNK))
+
+/**
+ * @def TEST_BENCH_FRAMES
+ * @brief Frames parsed by the benchmark.
+ */
+#define TEST_BENCH_FRAMES	2000000
+
+/**
+ * @struct testFrame_t
+ * @brief Frame expected out of the parser.
+ */
+typedef struct
+{
+	uint16_t count; /*!< Number of pixels */
+	uint8_t seed; /*!< Seed of the pixel data */
+} testFrame_t;
+
+/**
+ * @var parser
+ * @brief Parser under test.
+ */
+static npxFrameParser_t parser;
+
+/**
+ * @var stream
+ * @brief Encoded test stream.
+ */
+static uint8_t stream[TEST_STREAM_SIZE];
+
+/**
+ * @var streamLength
+ * @brief Length of the test stream.
+ */
+static uint32_t streamLength;
+
+/**
+ * @var expected
+ * @brief Valid frames of the test stream, in order.
+ */
+static testFrame_t expected[TEST_MAX_FRAMES];
+
+/**
+ * @var expectedCount
+ * @brief Number of valid frames of the test stream.
+ */
+static uint32_t expectedCount;
+
+/**
+ * @var pixels
+ * @brief Pixel data of a frame.
+ */
+static uint8_t pixels[NPX_FRAME_BYTES_PER_PIXEL * NPX_FRAME_MAX_PIXELS];
+
+/**
+ * @var sink
+ * @brief Keeps the benchmark results alive.
+ */
+static volatile uint32_t sink;
+
+/**
+ * @brief Fills the pixel data of a frame.
+ * @param count Number of pixels.
+ * @param seed Seed of the pixel data.
+ */
+static void test_pixels(uint16_t count, uint8_t seed)
+{
+	for (uint32_t i = 0; i < count * NPX_FRAME_BYTES_PER_PIXEL; i++)
+		pixels[i] = (uint8_t) (i * 7 + seed * 31);
+}
+
+/**
+ * @brief Appends an encoded frame to the test stream.
+ * @param count Number of pixels.
+ * @param seed Seed of the pixel data.
+ * @param corrupt Set to damage the checksum, the frame is then not expected.
+ */
+static void test_append(uint16_t count, uint8_t seed, bool corrupt)
+{
+	uint16_t length;
+
+	test_pixels(count, seed);
+	length = npxFrame_Encode(pixels, count, &stream[streamLength]);
+	if (corrupt)
+	{
+		stream[streamLength + length - 1] ^= 0x01;
+	}
+	else
+	{
+		expected[expectedCount].count = count;
+		expected[expectedCount].seed = seed;
+		expectedCount++;
+	}
+	streamLength += length;
+}
+
+/**
+ * @brief Appends filler bytes so the next byte is the last one of a packet.
+ */
+static void test_alignSplit()
+{
+	while ((streamLength % TEST_CHUNK) != (TEST_CHUNK - 1))
+		stream[streamLength++] = 0x00;
+}
+
+/**
+ * @brief Feeds the test stream to the parser and checks the frames that come out.
+ * @param chunk Packet length.
+ * @return uint32_t Number of failed checks.
+ */
+static uint32_t test_run(uint16_t chunk)
+{
+	const uint8_t *frame;
+	uint32_t frames = 0;
+	uint32_t failures = 0;
+	uint32_t offset;
+	uint16_t len;
+	uint16_t used;
+	uint16_t count;
+	bool complete;
+
+	npxFrame_Init(&parser);
+	for (offset = 0; offset < streamLength; offset += len)
+	{
+		len = (streamLength - offset < chunk) ? streamLength - offset : chunk;
+
+		// as npx_StreamWrite(), the rest of the packet after each frame
+		for (uint16_t i = 0; i < len; i += used)
+		{
+			used = npxFrame_Parse(&parser, &stream[offset + i], len - i,
+					&complete);
+			if (!complete)
+				continue;
+
+			frame = npxFrame_Front(&parser, &count);
+			if (frames >= expectedCount)
+			{
+				failures++;
+				continue;
+			}
+			test_pixels(expected[frames].count, expected[frames].seed);
+			if ((count != expected[frames].count)
+					|| (memcmp(frame, pixels,
+							count * NPX_FRAME_BYTES_PER_PIXEL) != 0))
+			{
+				printf("    FAIL frame %u\n", frames);
+				failures++;
+			}
+			frames++;
+		}
+	}
+
+	printf("chunk %2u: %u frames, %u errors\n", chunk, parser.frames,
+			parser.errors);
+	if ((frames != expectedCount) || (parser.frames != expectedCount))
+	{
+		printf("    FAIL %u frames, expected %u\n", frames, expectedCount);
+		failures++;
+	}
+	if (parser.errors != 2)
+	{
+		printf("    FAIL %u errors, expected 2\n", parser.errors);
+		failures++;
+	}
+
+	return failures;
+}
+
+int main()
+{
+	static const uint16_t chunks[] =
+	{ TEST_CHUNK, 1, 7, 63, 65, 1000 };
+	uint32_t failures = 0;
+	uint32_t frames;
+	uint32_t offset;
+	uint16_t len;
+	uint16_t used;
+	uint16_t count;
+	bool complete;
+	double start;
+	uint64_t cycles;
+
+	// valid frames, the empty and the longest one included
+	test_append(TEST_PIXELS, 1, false);
+	test_append(0, 2, false);
+	test_append(1, 3, false);
+	test_append(NPX_FRAME_MAX_PIXELS, 4, false);
+
+	// a corrupt checksum, the parser looks for the next frame after it
+	test_append(TEST_PIXELS, 5, true);
+	test_append(TEST_PIXELS, 6, false);
+
+	// a pixel count out of range
+	stream[streamLength++] = NPX_FRAME_SYNC_1;
+	stream[streamLength++] = NPX_FRAME_SYNC_2;
+	stream[streamLength++] = (uint8_t) (NPX_FRAME_MAX_PIXELS + 1);
+	stream[streamLength++] = (uint8_t) ((NPX_FRAME_MAX_PIXELS + 1) >> 8);
+	test_append(TEST_PIXELS, 7, false);
+
+	// the sync split between two packets, then a repeated first sync byte
+	test_alignSplit();
+	test_append(TEST_PIXELS, 8, false);
+	stream[streamLength++] = NPX_FRAME_SYNC_1;
+	test_append(2, 9, false);
+	test_alignSplit();
+	stream[streamLength++] = NPX_FRAME_SYNC_1;
+	test_append(TEST_PIXELS, 10, false);
+
+	for (uint8_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+		failures += test_run(chunks[i]);
+
+	// benchmark, back to back frames in USB packets
+	streamLength = 0;
+	for (uint8_t seed = 0; streamLength + NPX_FRAME_MAX_LENGTH <= sizeof(stream);
+			seed++)
+	{
+		test_pixels(TEST_PIXELS, seed);
+		streamLength += npxFrame_Encode(pixels, TEST_PIXELS,
+				&stream[streamLength]);
+	}
+
+	npxFrame_Init(&parser);
+	frames = 0;
+	offset = 0;
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	while (frames < TEST_BENCH_FRAMES)
+	{
+		len = (streamLength - offset < TEST_CHUNK) ?
+				streamLength - offset : TEST_CHUNK;
+		for (uint16_t i = 0; i < len; i += used)
+		{
+			used = npxFrame_Parse(&parser, &stream[offset + i], len - i,
+					&complete);
+			if (complete)
+			{
+				sink += npxFrame_Front(&parser, &count)[0];
+				frames++;
+			}
+		}
+		offset = (offset + len) % streamLength;
+	}
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	if (parser.errors != 0)
+	{
+		printf("    FAIL %u errors in the benchmark\n", parser.errors);
+		failures++;
+	}
+	printf("bench %u pixels: %.0f frames/s, %.1f MB/s, %.2f host cycles per byte\n",
+			TEST_PIXELS, frames / start,
+			frames * (double) (TEST_PIXELS * NPX_FRAME_BYTES_PER_PIXEL
+					+ NPX_FRAME_OVERHEAD) / start / 1e6,
+			(double) cycles / frames
+					/ (TEST_PIXELS * NPX_FRAME_BYTES_PER_PIXEL
+							+ NPX_FRAME_OVERHEAD));
+
+	printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,375 @@
+/**
+ ******************************************************************************
+ * @file    test_noise.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Fixed-point gradient noise test and benchmark
+ *
+ * Compares the 1D, 2D and 3D kernels of npx_noise.c with the same Perlin noise
+ * computed in double precision, on the same lattice and gradients, over a grid
+ * of coordinates that covers every fractional step of several cells. Checks
+ * that the noise is 0x8000 on the lattice, repeats every 256 cells, and that
+ * the 8-bit kernels are the 16-bit ones on 8.8 coordinates. Then measures the
+ * pixels per second of each kernel on the host.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+#include "npx_noise.h"
+
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * @def TEST_STEP
+ * @brief Coordinate step of the comparison (16.16), prime so every fraction is hit.
+ */
+#define TEST_STEP			0x1B3F
+
+/**
+ * @def TEST_MAX_ERROR
+ * @brief Largest accepted error against the reference, in 16-bit output counts.
+ *
+ * The kernels truncate the corner distances to Q12 and the output is 8 counts
+ * per Q12 unit, so two truncated terms alone reach 16 counts.
+ */
+#define TEST_MAX_ERROR		48.0
+
+/**
+ * @def TEST_BENCH_PIXELS
+ * @brief Pixels computed by each benchmark.
+ */
+#define TEST_BENCH_PIXELS	20000000
+
+/**
+ * @var perm
+ * @brief Permutation table of the reference implementation of improved Perlin noise.
+ */
+static const uint8_t perm[256] =
+{ 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140,
+		36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247,
+		120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57,
+		177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+		74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229,
+		122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102,
+		143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89,
+		18, 169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198,
+		173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118,
+		126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28,
+		42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153,
+		101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113,
+		224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193,
+		238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239,
+		107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121,
+		50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72,
+		243, 141, 128, 195, 78, 66, 215, 61, 156 };
+
+/**
+ * @var sink
+ * @brief Keeps the benchmark results alive.
+ */
+static volatile uint32_t sink;
+
+/**
+ * @brief Hashes a lattice coordinate with a previous hash.
+ * @param h Previous hash.
+ * @param i Lattice coordinate.
+ * @return uint8_t Hash.
+ */
+static uint8_t test_hash(uint32_t h, uint32_t i)
+{
+	return perm[(uint8_t) (h + i)];
+}
+
+/**
+ * @brief Smoothstep easing curve, 3t^2 - 2t^3.
+ * @param t Position inside the cell.
+ * @return double Eased position.
+ */
+static double test_fade(double t)
+{
+	return t * t * (3.0 - 2.0 * t);
+}
+
+/**
+ * @brief Linear interpolation.
+ * @param a Value at 0.
+ * @param b Value at 1.
+ * @param t Position.
+ * @return double Interpolated value.
+ */
+static double test_lerp(double a, double b, double t)
+{
+	return a + (b - a) * t;
+}
+
+/**
+ * @brief Dot product of a 3D cube edge gradient and the distance to the corner.
+ * @param hash Corner hash.
+ * @param x Distance along X.
+ * @param y Distance along Y.
+ * @param z Distance along Z.
+ * @return double Dot product.
+ */
+static double test_grad3(uint8_t hash, double x, double y, double z)
+{
+	uint8_t h = hash & 15;
+	double a = (h < 8) ? x : y;
+	double b = (h < 4) ? y : (((h == 12) || (h == 14)) ? x : z);
+
+	return ((h & 1) ? -a : a) + ((h & 2) ? -b : b);
+}
+
+/**
+ * @brief Maps a noise value to the 16-bit output range, without rounding.
+ * @param n Noise value.
+ * @param peak Peak amplitude of the noise.
+ * @return double Output.
+ */
+static double test_output(double n, double peak)
+{
+	n = 32768.0 + n * 32768.0 / peak;
+
+	return (n < 0.0) ? 0.0 : ((n > 65535.0) ? 65535.0 : n);
+}
+
+/**
+ * @brief 1D reference noise.
+ * @param x Coordinate (16.16).
+ * @return double Output.
+ */
+static double test_noise1(uint32_t x)
+{
+	uint32_t X = x >> 16;
+	double u = (x & 0xFFFF) / 65536.0;
+	double g0 = (perm[(uint8_t) X] & 1) ? -u : u;
+	double g1 = (perm[(uint8_t) (X + 1)] & 1) ? -(u - 1.0) : (u - 1.0);
+
+	return test_output(test_lerp(g0, g1, test_fade(u)), 0.5);
+}
+
+/**
+ * @brief 2D reference noise, diagonal gradients.
+ * @param x X coordinate (16.16).
+ * @param y Y coordinate (16.16).
+ * @return double Output.
+ */
+static double test_noise2(uint32_t x, uint32_t y)
+{
+	uint32_t X = x >> 16;
+	uint32_t Y = y >> 16;
+	double u = (x & 0xFFFF) / 65536.0;
+	double v = (y & 0xFFFF) / 65536.0;
+	double g[4];
+
+	for (uint8_t c = 0; c < 4; c++)
+	{
+		uint8_t i = c & 1;
+		uint8_t j = c >> 1;
+		uint8_t h = test_hash(test_hash(perm[(uint8_t) (X + i)], Y), j);
+
+		g[c] = ((h & 1) ? -(u - i) : (u - i)) + ((h & 2) ? -(v - j) : (v - j));
+	}
+
+	return test_output(
+			test_lerp(test_lerp(g[0], g[1], test_fade(u)),
+					test_lerp(g[2], g[3], test_fade(u)), test_fade(v)), 1.0);
+}
+
+/**
+ * @brief 3D reference noise, cube edge gradients.
+ * @param x X coordinate (16.16).
+ * @param y Y coordinate (16.16).
+ * @param z Z coordinate (16.16).
+ * @return double Output.
+ */
+static double test_noise3(uint32_t x, uint32_t y, uint32_t z)
+{
+	uint32_t X = x >> 16;
+	uint32_t Y = y >> 16;
+	uint32_t Z = z >> 16;
+	double u = (x & 0xFFFF) / 65536.0;
+	double v = (y & 0xFFFF) / 65536.0;
+	double w = (z & 0xFFFF) / 65536.0;
+	double g[8];
+
+	for (uint8_t c = 0; c < 8; c++)
+	{
+		uint8_t i = c & 1;
+		uint8_t j = (c >> 1) & 1;
+		uint8_t k = c >> 2;
+		uint8_t h = test_hash(
+				test_hash(test_hash(test_hash(perm[(uint8_t) (X + i)], Y), j),
+						Z), k);
+
+		g[c] = test_grad3(h, u - i, v - j, w - k);
+	}
+
+	return test_output(
+			test_lerp(
+					test_lerp(test_lerp(g[0], g[1], test_fade(u)),
+							test_lerp(g[2], g[3], test_fade(u)), test_fade(v)),
+					test_lerp(test_lerp(g[4], g[5], test_fade(u)),
+							test_lerp(g[6], g[7], test_fade(u)), test_fade(v)),
+					test_fade(w)), 1.0);
+}
+
+/**
+ * @brief Accumulates the error of a kernel output.
+ * @param value Kernel output.
+ * @param exact Reference output.
+ * @param maxError Largest error so far, updated.
+ * @param sum Sum of the errors, updated.
+ */
+static void test_error(uint16_t value, double exact, double *maxError,
+		double *sum)
+{
+	double error = fabs(value - exact);
+
+	*sum += error;
+	if (error > *maxError)
+		*maxError = error;
+}
+
+/**
+ * @brief Prints the error of a kernel.
+ * @param name Kernel.
+ * @param maxError Largest error.
+ * @param sum Sum of the errors.
+ * @param count Number of outputs.
+ * @return uint32_t 1 if the largest error is out of tolerance, 0 otherwise.
+ */
+static uint32_t test_report(const char *name, double maxError, double sum,
+		uint32_t count)
+{
+	bool ok = maxError <= TEST_MAX_ERROR;
+
+	printf("%s: %u points, max error %.1f (%.3f %%), mean %.2f  %s\n", name,
+			count, maxError, maxError * 100.0 / 65536.0, sum / count,
+			ok ? "ok" : "FAIL");
+
+	return ok ? 0 : 1;
+}
+
+int main()
+{
+	uint32_t failures = 0;
+	uint32_t count;
+	uint32_t acc;
+	double maxError;
+	double sum;
+	double start;
+	uint64_t cycles;
+
+	// against the reference, over the first cells and cells 254 to 257
+	maxError = sum = 0.0;
+	count = 0;
+	for (uint32_t x = 0; x < 300 * NPX_NOISE_CELL; x += TEST_STEP / 8)
+	{
+		test_error(npxNoise_Get16_1D(x), test_noise1(x), &maxError, &sum);
+		count++;
+	}
+	failures += test_report("1D", maxError, sum, count);
+
+	maxError = sum = 0.0;
+	count = 0;
+	for (uint32_t y = 0; y < 6 * NPX_NOISE_CELL; y += TEST_STEP)
+	{
+		for (uint32_t x = 250 * NPX_NOISE_CELL; x < 260 * NPX_NOISE_CELL;
+				x += TEST_STEP)
+		{
+			test_error(npxNoise_Get16_2D(x, y), test_noise2(x, y), &maxError,
+					&sum);
+			count++;
+		}
+	}
+	failures += test_report("2D", maxError, sum, count);
+
+	maxError = sum = 0.0;
+	count = 0;
+	for (uint32_t z = 0; z < 3 * NPX_NOISE_CELL; z += 3 * TEST_STEP)
+	{
+		for (uint32_t y = 100 * NPX_NOISE_CELL; y < 104 * NPX_NOISE_CELL;
+				y += TEST_STEP)
+		{
+			for (uint32_t x = 254 * NPX_NOISE_CELL; x < 258 * NPX_NOISE_CELL;
+					x += TEST_STEP)
+			{
+				test_error(npxNoise_Get16_3D(x, y, z), test_noise3(x, y, z),
+						&maxError, &sum);
+				count++;
+			}
+		}
+	}
+	failures += test_report("3D", maxError, sum, count);
+
+	// lattice, period and 8-bit kernels
+	count = 0;
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i * NPX_NOISE_CELL;
+		uint32_t f = c + i * 0xFF;
+		uint16_t e = (uint16_t) ((i << 8) | i);
+
+		if ((npxNoise_Get16_1D(c) != 0x8000) || (npxNoise_Get16_2D(c, c) != 0x8000)
+				|| (npxNoise_Get16_3D(c, c, c) != 0x8000))
+			count++;
+		if ((npxNoise_Get16_1D(f) != npxNoise_Get16_1D(f + 256 * NPX_NOISE_CELL))
+				|| (npxNoise_Get16_2D(f, f)
+						!= npxNoise_Get16_2D(f + 256 * NPX_NOISE_CELL, f))
+				|| (npxNoise_Get16_3D(f, f, f)
+						!= npxNoise_Get16_3D(f, f, f + 256 * NPX_NOISE_CELL)))
+			count++;
+		if ((npxNoise_Get8_1D(e) != (npxNoise_Get16_1D((uint32_t) e << 8) >> 8))
+				|| (npxNoise_Get8_2D(e, e)
+						!= (npxNoise_Get16_2D((uint32_t) e << 8,
+								(uint32_t) e << 8) >> 8))
+				|| (npxNoise_Get8_3D(e, e, e)
+						!= (npxNoise_Get16_3D((uint32_t) e << 8,
+								(uint32_t) e << 8, (uint32_t) e << 8) >> 8)))
+			count++;
+	}
+	printf("lattice, period and 8-bit: %u mismatches  %s\n", count,
+			(count == 0) ? "ok" : "FAIL");
+	failures += (count == 0) ? 0 : 1;
+
+	// benchmark, pixels along a strip as the effects step them
+	acc = 0;
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	for (uint32_t i = 0; i < TEST_BENCH_PIXELS; i++)
+		acc += npxNoise_Get16_1D(i * 0x3000);
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	sink = acc;
+	printf("bench 1D: %.1f Mpixel/s, %.1f host cycles per pixel\n",
+			TEST_BENCH_PIXELS / start * 1e-6,
+			(double) cycles / TEST_BENCH_PIXELS);
+
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	for (uint32_t i = 0; i < TEST_BENCH_PIXELS; i++)
+		acc += npxNoise_Get16_2D((i & 63) * 0x3000, (i >> 6) * 0x800);
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	sink = acc;
+	printf("bench 2D: %.1f Mpixel/s, %.1f host cycles per pixel\n",
+			TEST_BENCH_PIXELS / start * 1e-6,
+			(double) cycles / TEST_BENCH_PIXELS);
+
+	start = hostReplay_Seconds();
+	cycles = hostReplay_Cycles();
+	for (uint32_t i = 0; i < TEST_BENCH_PIXELS; i++)
+		acc += npxNoise_Get16_3D((i & 63) * 0x3000, 0x48000, (i >> 6) * 0x800);
+	cycles = hostReplay_Cycles() - cycles;
+	start = hostReplay_Seconds() - start;
+	sink = acc;
+	printf("bench 3D: %.1f Mpixel/s, %.1f host cycles per pixel\n",
+			TEST_BENCH_PIXELS / start * 1e-6,
+			(double) cycles / TEST_BENCH_PIXELS);
+
+	printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+/**
+ ******************************************************************************
+ * @file    test_spin.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Spin detection test on a labelled synthetic trace
+ *
+ * Replays a trace of still, spinning and reversing segments through the IMU API
+ * and the application FSM. Each change of imu_SpinDirection() must match a
+ * label change, in the labelled direction, within TEST_SPIN_MAX_DELAY_MS, and
+ * no other change may happen: the segment close to the exit threshold must not
+ * make the direction flicker. The FSM must report every spin segment in its
+ * direction and nothing else. The latency of each change, as reported by
+ * imu_SpinLatency(), is printed.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @def TEST_SPIN_MAX_DELAY_MS
+ * @brief Longest time from a label change to the direction change, in milliseconds.
+ *
+ * Dwell time plus the delay of the gyroscope low-pass filter.
+ */
+#define TEST_SPIN_MAX_DELAY_MS	(IMU_SPIN_DWELL_MS + 60)
+
+/**
+ * @def TEST_SPIN_DPS
+ * @brief Rate of the spinning segments, in degrees per second.
+ */
+#define TEST_SPIN_DPS			200
+
+/**
+ * @def TEST_HOLD_DPS
+ * @brief Rate of the segment held between the exit and the start thresholds, in degrees per second.
+ */
+#define TEST_HOLD_DPS			((IMU_SPIN_THRESHOLD + IMU_SPIN_EXIT_THRESHOLD) / 2)
+
+/**
+ * @def TEST_NOISE_DPS
+ * @brief Peak gyroscope noise, in degrees per second.
+ */
+#define TEST_NOISE_DPS			8
+
+/**
+ * @struct testSegment_t
+ * @brief Labelled segment of the trace.
+ */
+typedef struct
+{
+	uint32_t endMs; /*!< End of the segment, in milliseconds from the start of the trace */
+	float dps; /*!< Rate around the spin axis, in degrees per second */
+	imuSpin_t label; /*!< Expected spin direction */
+} testSegment_t;
+
+/**
+ * @var segments
+ * @brief Segments of the trace. A rate between the exit and the start thresholds
+ * holds a started spin, from 10.3 s, and does not start one, from 21 s.
+ */
+static const testSegment_t segments[] =
+{
+{ 2000, 0, IMU_NO_SPIN },
+{ 4000, TEST_SPIN_DPS, IMU_POS_SPIN },
+{ 6000, 0, IMU_NO_SPIN },
+{ 8000, -TEST_SPIN_DPS, IMU_NEG_SPIN },
+{ 10000, 0, IMU_NO_SPIN },
+{ 10300, TEST_SPIN_DPS, IMU_POS_SPIN },
+{ 13000, TEST_HOLD_DPS, IMU_POS_SPIN },
+{ 15000, 0, IMU_NO_SPIN },
+{ 17000, TEST_SPIN_DPS, IMU_POS_SPIN },
+{ 19000, -TEST_SPIN_DPS, IMU_NEG_SPIN },
+{ 21000, 0, IMU_NO_SPIN },
+{ 23000, TEST_HOLD_DPS, IMU_NO_SPIN } };
+
+/**
+ * @def TEST_SEGMENTS
+ * @brief Number of segments.
+ */
+#define TEST_SEGMENTS	(sizeof(segments) / sizeof(segments[0]))
+
+/**
+ * @var trace
+ * @brief Synthetic trace.
+ */
+static uint8_t trace[512 * 1024];
+
+/**
+ * @var noise
+ * @brief State of the noise generator.
+ */
+static uint32_t noise = 1;
+
+/**
+ * @brief Gets the segment of a time.
+ * @param ms Time from the start of the trace, in milliseconds.
+ * @return uint32_t Segment index.
+ */
+static uint32_t test_segment(uint32_t ms)
+{
+	uint32_t i = 0;
+
+	while ((i < TEST_SEGMENTS - 1) && (ms >= segments[i].endMs))
+		i++;
+
+	return i;
+}
+
+/**
+ * @brief Gets a uniform noise sample.
+ * @param peak Peak amplitude.
+ * @return int32_t Noise, between -peak and peak.
+ */
+static int32_t test_noise(int32_t peak)
+{
+	noise = noise * 1664525UL + 1013904223UL;
+
+	return (int32_t) ((noise >> 8) % (uint32_t) (2 * peak + 1)) - peak;
+}
+
+/**
+ * @brief Generates a sample: level with gravity on +Z, turning around Z.
+ * @param ms Time from the start of the trace, in milliseconds.
+ * @param raw Raw sample.
+ */
+static void test_sample(uint32_t ms, imuRaw_t *raw)
+{
+	float dps = segments[test_segment(ms)].dps;
+	float lsbPerDps = 32768.0f / (250.0f * (1 << DEVICE_IMU_GYRO_FSR));
+	int16_t oneG = (int16_t) (16384 >> DEVICE_IMU_ACC_FSR);
+
+	raw->ax = (int16_t) test_noise(20);
+	raw->ay = (int16_t) test_noise(20);
+	raw->az = (int16_t) (oneG + test_noise(20));
+	raw->gx = (int16_t) (test_noise(TEST_NOISE_DPS) * lsbPerDps);
+	raw->gy = (int16_t) (test_noise(TEST_NOISE_DPS) * lsbPerDps);
+	raw->gz = (int16_t) ((dps + test_noise(TEST_NOISE_DPS)) * lsbPerDps);
+}
+
+/**
+ * @brief Gets the name of a spin direction.
+ * @param spin Spin direction.
+ * @return const char* Name.
+ */
+static const char* test_spinName(imuSpin_t spin)
+{
+	return (spin == IMU_POS_SPIN) ? "positive" :
+			((spin == IMU_NEG_SPIN) ? "negative" : "none");
+}
+
+int main()
+{
+	imuSpin_t spin = IMU_NO_SPIN;
+	imuSpin_t expected = IMU_NO_SPIN;
+	imuSpin_t previous = IMU_NO_SPIN;
+	uint32_t labelMs = 0;
+	uint32_t changes = 0;
+	uint32_t expectedChanges = 0;
+	uint32_t reported[TEST_SEGMENTS] =
+	{ 0 };
+	uint32_t failures = 0;
+	uint32_t length;
+	uint32_t ms;
+	uint32_t i;
+	appEvent_t event;
+	imuSpin_t reportedSpin;
+
+	length = hostReplay_Synth(trace, sizeof(trace),
+			segments[TEST_SEGMENTS - 1].endMs, test_sample);
+	if ((length == 0) || !hostReplay_Start(trace, length))
+	{
+		printf("FAIL trace\n");
+		return 1;
+	}
+
+	for (i = 1; i < TEST_SEGMENTS; i++)
+	{
+		if (segments[i].label != segments[i - 1].label)
+			expectedChanges++;
+	}
+
+	while (!imuReplay_Done())
+	{
+		event = hostReplay_Step();
+		ms = imuReplay_Time() - 1000;
+		i = test_segment(ms);
+
+		if (segments[i].label != expected)
+		{
+			// a label change that was not detected in time
+			if (spin != expected)
+			{
+				printf("FAIL %6u ms: no change to %s\n", labelMs,
+						test_spinName(expected));
+				failures++;
+			}
+			previous = expected;
+			expected = segments[i].label;
+			labelMs = ms;
+		}
+
+		if (imu_SpinDirection() != spin)
+		{
+			spin = imu_SpinDirection();
+			changes++;
+
+			printf("%6u ms  %-8s  %3u ms after the label, latency %u ms\n", ms,
+					test_spinName(spin), ms - labelMs,
+					(unsigned) imu_SpinLatency());
+			if ((spin != expected) || (ms - labelMs > TEST_SPIN_MAX_DELAY_MS))
+			{
+				printf("FAIL %6u ms: expected %s from %u ms\n", ms,
+						test_spinName(expected), labelMs);
+				failures++;
+			}
+		}
+
+		// the FSM reports the labelled direction, or the previous one until it is detected
+		if ((event == APP_EVENT_POS_SPIN) || (event == APP_EVENT_NEG_SPIN))
+		{
+			reportedSpin =
+					(event == APP_EVENT_POS_SPIN) ? IMU_POS_SPIN : IMU_NEG_SPIN;
+			if ((reportedSpin != expected)
+					&& ((reportedSpin != previous)
+							|| (ms - labelMs > TEST_SPIN_MAX_DELAY_MS)))
+			{
+				printf("FAIL %6u ms: FSM %s\n", ms, hostReplay_EventName(event));
+				failures++;
+			}
+			reported[i]++;
+		}
+	}
+
+	for (i = 0; i < TEST_SEGMENTS; i++)
+	{
+		if ((segments[i].label != IMU_NO_SPIN) && (reported[i] == 0))
+		{
+			printf("FAIL segment %u: FSM did not report the %s spin\n", i,
+					test_spinName(segments[i].label));
+			failures++;
+		}
+	}
+
+	if (changes != expectedChanges)
+	{
+		printf("FAIL %u direction changes, %u labelled\n", changes,
+				expectedChanges);
+		failures++;
+	}
+
+	printf("%s: %u direction changes, %u labelled\n",
+			(failures == 0) ? "PASS" : "FAIL", changes, expectedChanges);
+
+	return (failures == 0) ? 0 : 1;
+}
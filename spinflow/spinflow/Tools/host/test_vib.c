@@ -0,0 +1,353 @@
+/**
+ ******************************************************************************
+ * @file    test_vib.c
+ *
+ * @author 	Marco Rolon
+ *
+ * @brief   Vibration analysis test and benchmark
+ *
+ * Feeds synthetic sinusoids to imu_vib.c at every window size and checks the
+ * RMS, band RMS and strongest component against the signal and against a
+ * Hann windowed DFT computed in double precision, so an error in the FFT stages
+ * or in the split of the real FFT shows up as a mismatch. Then measures the
+ * time and cycles to analyse a window, and of the longest step, on the host.
+ ******************************************************************************
+ */
+
+#include "host_replay.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @def TEST_RATE_HZ
+ * @brief Sample rate, in Hz.
+ */
+#define TEST_RATE_HZ		1000.0f
+
+/**
+ * @def TEST_TOLERANCE
+ * @brief Largest relative error against the double precision reference.
+ */
+#define TEST_TOLERANCE		1e-3
+
+/**
+ * @def TEST_BENCH_WINDOWS
+ * @brief Windows timed by the benchmark.
+ */
+#define TEST_BENCH_WINDOWS	20000
+
+/**
+ * @struct testTone_t
+ * @brief Sinusoid of a test signal.
+ */
+typedef struct
+{
+	float hz; /*!< Frequency, in Hz */
+	float amplitude; /*!< Amplitude */
+} testTone_t;
+
+/**
+ * @struct testSignal_t
+ * @brief Test signal, up to three sinusoids over an offset.
+ */
+typedef struct
+{
+	const char *name; /*!< Description */
+	float offset; /*!< Constant offset, removed by the analysis */
+	testTone_t tones[3]; /*!< Sinusoids, the strongest first */
+} testSignal_t;
+
+/**
+ * @var signals
+ * @brief Test signals. The first one is centred on bin 25 of the 256 sample window.
+ */
+static const testSignal_t signals[] =
+{
+{ "bin centred", 500.0f,
+{
+{ 97.65625f, 100.0f } } },
+{ "between bins", -200.0f,
+{
+{ 123.4f, 100.0f } } },
+{ "two bands", 1000.0f,
+{
+{ 30.0f, 80.0f },
+{ 200.0f, 40.0f } } },
+{ "three tones", 0.0f,
+{
+{ 333.0f, 60.0f },
+{ 12.0f, 25.0f },
+{ 450.0f, 10.0f } } } };
+
+/**
+ * @var edges
+ * @brief Band limits, in Hz.
+ */
+static const float edges[] =
+{ 0.0f, 100.0f, 300.0f, 500.1f };
+
+/**
+ * @def TEST_BANDS
+ * @brief Number of bands.
+ */
+#define TEST_BANDS	(sizeof(edges) / sizeof(edges[0]) - 1)
+
+/**
+ * @var vib
+ * @brief Analyser.
+ */
+static imuVib_t vib;
+
+/**
+ * @var window
+ * @brief Copy of the analysed window, for the reference.
+ */
+static double window[IMU_VIB_MAX_SIZE];
+
+/**
+ * @brief Gets a sample of a test signal.
+ * @param signal Signal.
+ * @param n Sample index.
+ * @return float Sample.
+ */
+static float test_sample(const testSignal_t *signal, uint32_t n)
+{
+	double x = signal->offset;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		x += signal->tones[i].amplitude
+				* sin(2.0 * M_PI * signal->tones[i].hz * n / TEST_RATE_HZ);
+	}
+
+	return (float) x;
+}
+
+/**
+ * @brief Computes the results of a window in double precision.
+ * @param size Window length.
+ * @param result Reference results: RMS, band RMS and strongest bin.
+ * @param peakBin Strongest bin.
+ */
+static void test_reference(uint16_t size, imuVibResult_t *result,
+		uint16_t *peakBin)
+{
+	double mean = 0.0;
+	double power = 0.0;
+	double bands[TEST_BANDS] =
+	{ 0 };
+	double peak = 0.0;
+	double resolution = TEST_RATE_HZ / size;
+
+	for (uint16_t n = 0; n < size; n++)
+		mean += window[n];
+	mean /= size;
+	for (uint16_t n = 0; n < size; n++)
+		power += (window[n] - mean) * (window[n] - mean);
+	result->rms = (float) sqrt(power / size);
+
+	// one-sided power spectrum of the Hann windowed signal
+	for (uint16_t k = 0; k <= size / 2; k++)
+	{
+		double re = 0.0;
+		double im = 0.0;
+		double bin;
+
+		for (uint16_t n = 0; n < size; n++)
+		{
+			double w = 0.5 - 0.5 * cos(2.0 * M_PI * n / size);
+
+			re += (window[n] - mean) * w * cos(2.0 * M_PI * k * n / size);
+			im -= (window[n] - mean) * w * sin(2.0 * M_PI * k * n / size);
+		}
+		bin = (re * re + im * im) * 8.0 / (3.0 * size * size);
+		if ((k > 0) && (k < size / 2))
+			bin *= 2.0;
+
+		for (uint8_t i = 0; i < TEST_BANDS; i++)
+		{
+			if ((k * resolution >= edges[i]) && (k * resolution < edges[i + 1]))
+				bands[i] += bin;
+		}
+		if ((k > 0) && (k < size / 2) && (bin > peak))
+		{
+			peak = bin;
+			*peakBin = k;
+		}
+	}
+
+	for (uint8_t i = 0; i < TEST_BANDS; i++)
+		result->bandRms[i] = (float) sqrt(bands[i]);
+	result->peakAmplitude = (float) sqrt(3.0 * peak);
+}
+
+/**
+ * @brief Checks a value against a reference.
+ * @param name Check.
+ * @param value Value.
+ * @param expected Expected value.
+ * @param tolerance Largest accepted error.
+ * @return uint32_t 1 if the value is out of tolerance, 0 otherwise.
+ */
+static uint32_t test_check(const char *name, double value, double expected,
+		double tolerance)
+{
+	if (fabs(value - expected) <= tolerance)
+		return 0;
+
+	printf("    FAIL %s %.4f, expected %.4f\n", name, value, expected);
+
+	return 1;
+}
+
+/**
+ * @brief Analyses a window of a test signal.
+ * @param signal Signal.
+ * @param size Window length.
+ * @param result Results.
+ * @return uint32_t Number of steps, 0 if the window was not analysed.
+ */
+static uint32_t test_analyse(const testSignal_t *signal, uint16_t size,
+		imuVibResult_t *result)
+{
+	uint32_t steps = 0;
+
+	imuVib_Init(&vib, size, TEST_RATE_HZ);
+	imuVib_SetBands(&vib, edges, TEST_BANDS);
+	for (uint16_t n = 0; n < size; n++)
+	{
+		window[n] = test_sample(signal, n);
+		imuVib_Add(&vib, (float) window[n]);
+	}
+
+	while (imuVib_Busy(&vib))
+	{
+		steps++;
+		if (imuVib_Step(&vib))
+			break;
+	}
+	imuVib_GetResult(&vib, result);
+
+	return (result->windows == 1) ? steps : 0;
+}
+
+int main()
+{
+	const testSignal_t *signal;
+	imuVibResult_t result;
+	imuVibResult_t reference;
+	uint16_t peakBin = 0;
+	uint32_t failures = 0;
+	uint32_t steps;
+	uint64_t cycles;
+	uint64_t step;
+	uint64_t longest;
+	uint64_t slowest;
+	double start;
+	double exact;
+	float resolution;
+
+	for (uint16_t size = IMU_VIB_MIN_SIZE; size <= IMU_VIB_MAX_SIZE; size *= 2)
+	{
+		resolution = TEST_RATE_HZ / size;
+		for (uint8_t s = 0; s < sizeof(signals) / sizeof(signals[0]); s++)
+		{
+			signal = &signals[s];
+			steps = test_analyse(signal, size, &result);
+			test_reference(size, &reference, &peakBin);
+
+			printf("%3u %-13s rms %7.2f  peak %6.2f Hz %7.2f  bands", size,
+					signal->name, result.rms, result.peakHz,
+					result.peakAmplitude);
+			for (uint8_t i = 0; i < TEST_BANDS; i++)
+				printf(" %6.2f", result.bandRms[i]);
+			printf("  %u steps\n", steps);
+
+			if (steps == 0)
+			{
+				printf("    FAIL no result\n");
+				failures++;
+				continue;
+			}
+
+			// against the double precision reference of the same window
+			failures += test_check("rms", result.rms, reference.rms,
+					TEST_TOLERANCE * reference.rms + 1e-3);
+			for (uint8_t i = 0; i < TEST_BANDS; i++)
+			{
+				failures += test_check("band rms", result.bandRms[i],
+						reference.bandRms[i],
+						TEST_TOLERANCE * reference.rms + 1e-3);
+			}
+			failures += test_check("peak amplitude", result.peakAmplitude,
+					reference.peakAmplitude,
+					TEST_TOLERANCE * reference.peakAmplitude + 1e-3);
+			failures += test_check("peak bin", floorf(result.peakHz / resolution + 0.5f),
+					peakBin, 1.0);
+
+			// against the signal: the strongest tone, within the resolution
+			failures += test_check("peak Hz", result.peakHz,
+					signal->tones[0].hz, 0.5 * resolution);
+			if (size >= 128)
+			{
+				exact = 0.0;
+				for (uint8_t i = 0; i < 3; i++)
+					exact += signal->tones[i].amplitude
+							* signal->tones[i].amplitude / 2.0;
+				failures += test_check("signal rms", result.rms, sqrt(exact),
+						0.03 * sqrt(exact));
+				// the Hann window loses up to 1.42 dB between bins
+				failures += test_check("signal amplitude",
+						result.peakAmplitude, signal->tones[0].amplitude,
+						0.16 * signal->tones[0].amplitude);
+			}
+		}
+	}
+
+	// windows filled while the first one waits to be analysed are dropped
+	imuVib_Init(&vib, 64, TEST_RATE_HZ);
+	for (uint16_t n = 0; n < 3 * 64; n++)
+		imuVib_Add(&vib, test_sample(&signals[0], n));
+	imuVib_GetResult(&vib, &result);
+	failures += test_check("overruns", result.overruns, 2, 0);
+
+	// benchmark, a whole window and its longest step; the longest step is the
+	// smallest over the windows, so preemption of the host does not count
+	for (uint16_t size = IMU_VIB_MIN_SIZE; size <= IMU_VIB_MAX_SIZE; size *= 2)
+	{
+		imuVib_Init(&vib, size, TEST_RATE_HZ);
+		imuVib_SetBands(&vib, edges, TEST_BANDS);
+		longest = UINT64_MAX;
+		cycles = 0;
+		start = 0.0;
+		for (uint32_t w = 0; w < TEST_BENCH_WINDOWS; w++)
+		{
+			for (uint16_t n = 0; n < size; n++)
+				imuVib_Add(&vib, test_sample(&signals[2], n + w));
+
+			start -= hostReplay_Seconds();
+			slowest = 0;
+			while (imuVib_Busy(&vib))
+			{
+				step = hostReplay_Cycles();
+				imuVib_Step(&vib);
+				step = hostReplay_Cycles() - step;
+				cycles += step;
+				if (step > slowest)
+					slowest = step;
+			}
+			start += hostReplay_Seconds();
+			if (slowest < longest)
+				longest = slowest;
+		}
+		printf("bench %3u: %.2f us, %.0f host cycles per window, longest step %lu\n",
+				size, start * 1e6 / TEST_BENCH_WINDOWS,
+				(double) cycles / TEST_BENCH_WINDOWS, (unsigned long) longest);
+	}
+
+	printf("%s\n", (failures == 0) ? "PASS" : "FAIL");
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,517 @@
+#!/usr/bin/env python3
+"""
+SpinFlow IMU gestures - host side template training and evaluation.
+
+Mirrors Drivers/imu/Src/imu_gesture.c on recorded traces (Drivers/imu/Inc/imu_trace.h):
+the raw samples are converted as imu_replay.c does, averaged into frames at
+50 Hz with the gravity removed, then matched against the templates with the
+same streaming subsequence dynamic time warping (SPRING), in the same integer
+arithmetic, so the scores and thresholds carry over to the firmware.
+
+Labels are CSV files with one gesture per line, times in seconds from the
+first sample of the trace:
+
+    start,end,name
+    1.20,1.75,twist
+
+Usage:
+    imu_gesture.py train --trace walk.bin:walk.csv [--trace ...] [--out templates.json]
+                         [--c Drivers/imu/Src/imu_gesture_templates.c]
+    imu_gesture.py eval --templates templates.json --trace walk.bin[:walk.csv] [...]
+    imu_gesture.py synth --out demo.bin --labels demo.csv [--seconds 60] [--rate 200]
+
+`train` builds one template per gesture name, the medoid of its examples, with
+the threshold set between the scores of the examples and the best scores
+elsewhere in the traces (other gestures included). It writes the templates as
+JSON and, optionally, as the C source compiled into the firmware.
+`eval` streams the traces through the templates and prints the detections and,
+when labelled, the hits, misses and false detections of each gesture.
+`synth` writes a labelled trace of wrist twists among other moves, to try the
+pipeline without hardware.
+"""
+
+import argparse
+import csv
+import json
+import math
+import random
+import struct
+import sys
+
+# Trace format, as in imu_trace.h
+MAGIC = b"SFTR"
+VERSION = 2
+HEADER_SIZE = 40
+TAG_MAGN = 0x80
+TAG_LONG = 0x7F
+GYRO_CAL_FRAC_BITS = 8
+
+# Engine settings, as in imu_gesture.h
+FRAME_HZ = 50
+CHANNELS = 6
+MAX_TEMPLATES = 8
+MAX_LENGTH = 32
+GYRO_DPS_LSB = 8
+ACC_MG_LSB = 16
+INF = 0x3FFFFFFF
+
+
+def q16(x):
+    return int(x * 65536.0 + 0.5)
+
+
+ACC_SCALES = [q16(1000.0 / 16384.0), q16(1000.0 / 8192.0),
+              q16(1000.0 / 4096.0), q16(1000.0 / 2048.0)]
+GYRO_SCALES = [q16(100.0 / 131.0), q16(100.0 / 65.5),
+               q16(100.0 / 32.8), q16(100.0 / 16.4)]
+ACC_LSB_PER_G = [16384, 8192, 4096, 2048]
+GYRO_LSB_PER_DPS = [131.0, 65.5, 32.8, 16.4]
+
+
+def cdiv(a, b):
+    """Integer division truncated toward zero, as in C."""
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+
+def int16(x):
+    return ((x + 0x8000) & 0xFFFF) - 0x8000
+
+
+def read_trace(path):
+    """Read a trace, return the sample rate and the (ms, acc mg, gyro cdps) samples."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER_SIZE or data[:4] != MAGIC or data[4] != VERSION:
+        raise ValueError("%s: not a version %d trace" % (path, VERSION))
+    rate = struct.unpack_from("<H", data, 6)[0]
+    acc_fsr = data[9] & 3
+    gyro_fsr = data[10] & 3
+    offsets = struct.unpack_from("<3i", data, 12)
+    t = struct.unpack_from("<I", data, 36)[0]
+
+    samples = []
+    n = HEADER_SIZE
+    while n < len(data):
+        tag = data[n]
+        size = 17 + (2 if (tag & TAG_LONG) == TAG_LONG else 0) + (6 if tag & TAG_MAGN else 0)
+        if len(data) - n < size:
+            break
+        delta = tag & TAG_LONG
+        p = n + 1
+        if delta == TAG_LONG:
+            delta = struct.unpack_from("<H", data, p)[0]
+            p += 2
+        p += 2  # microsecond time, the frames only need the ticks
+        t = (t + delta) & 0xFFFFFFFF
+        ax, ay, az, _, gx, gy, gz = struct.unpack_from("<7h", data, p)
+        acc = [int16((v * ACC_SCALES[acc_fsr] + 0x8000) >> 16) for v in (ax, ay, az)]
+        gyro = [((((v << GYRO_CAL_FRAC_BITS) - o) * GYRO_SCALES[gyro_fsr] + 0x800000) >> 24)
+                for v, o in zip((gx, gy, gz), offsets)]
+        samples.append((t, acc, gyro))
+        n += size
+    return rate, samples
+
+
+def read_labels(path):
+    """Read a label file, return the (start ms, end ms, name) gestures."""
+    labels = []
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if not row or row[0].strip().startswith("#") or row[0].strip() == "start":
+                continue
+            labels.append((int(round(float(row[0]) * 1000)),
+                           int(round(float(row[1]) * 1000)), row[2].strip()))
+    return labels
+
+
+class Frames:
+    """Frame builder, same arithmetic as imuGesture_Add() and imuGesture_frame()."""
+
+    def __init__(self, rate):
+        self.decimation = max(1, rate // FRAME_HZ)
+        self.acc = [0, 0, 0]
+        self.gyro = [0, 0, 0]
+        self.count = 0
+        self.gravity = [0, 0, 0]
+        self.valid = False
+
+    def add(self, acc, gyro):
+        """Add a sample, return the completed frame or None."""
+        for i in range(3):
+            self.acc[i] += acc[i]
+            self.gyro[i] += gyro[i]
+        self.count += 1
+        if self.count < self.decimation:
+            return None
+
+        f = [0] * CHANNELS
+        for i in range(3):
+            f[i] = cdiv(self.gyro[i], self.count * 100)
+            a = cdiv(self.acc[i], self.count)
+            if not self.valid:
+                self.gravity[i] = a * 16
+            f[3 + i] = a - (self.gravity[i] >> 4)
+            self.gravity[i] += a - (self.gravity[i] >> 4)
+        self.acc = [0, 0, 0]
+        self.gyro = [0, 0, 0]
+        self.count = 0
+        self.valid = True
+        return f
+
+
+def quantize(f):
+    """Frame in template units, as matched by the firmware."""
+    q = [cdiv(x, GYRO_DPS_LSB) for x in f[:3]] + [cdiv(x, ACC_MG_LSB) for x in f[3:]]
+    return [max(-127, min(127, x)) for x in q]
+
+
+def trace_frames(path):
+    """Frames of a trace, as (ms of the last sample, frame in template units)."""
+    rate, samples = read_trace(path)
+    frames = Frames(rate)
+    out = []
+    t0 = samples[0][0] if samples else 0
+    for t, acc, gyro in samples:
+        f = frames.add(acc, gyro)
+        if f is not None:
+            out.append((t - t0, quantize(f)))
+    return out
+
+
+def distance(q, y):
+    return sum(abs(a - b) for a, b in zip(q, y))
+
+
+class Spring:
+    """Streaming subsequence warping of a template, same as imuGesture_spring()."""
+
+    def __init__(self, frames, threshold):
+        self.frames = frames
+        self.threshold = threshold
+        self.length = len(frames)
+        self.d = [0] + [INF] * self.length
+        self.s = [0] * (self.length + 1)
+        self.best = 0
+        self.end = 0
+        self.pending = False
+
+    def column(self, q, frame):
+        diag_d, diag_s = 0, frame - 1
+        prev_d, prev_s = 0, frame
+        for i in range(1, self.length + 1):
+            d = distance(q, self.frames[i - 1])
+            old_d, old_s = self.d[i], self.s[i]
+            best_d, best_s = prev_d, prev_s
+            if old_d < best_d:
+                best_d, best_s = old_d, old_s
+            if diag_d < best_d:
+                best_d, best_s = diag_d, diag_s
+            self.d[i] = INF if best_d >= INF else best_d + d
+            self.s[i] = best_s
+            diag_d, diag_s = old_d, old_s
+            prev_d, prev_s = self.d[i], best_s
+
+    def step(self, q, frame):
+        """Add a frame, return the reported (score, start, end) match or None."""
+        length = self.length
+        self.column(q, frame)
+        match = None
+        if self.pending:
+            if all(not (self.d[i] < self.best and self.s[i] <= self.end)
+                   for i in range(1, length + 1)):
+                self.pending = False
+                match = (self.best // length, self.start, self.end)
+                for i in range(1, length + 1):
+                    if self.s[i] <= self.end:
+                        self.d[i] = INF
+        if (self.d[length] <= self.threshold * length
+                and 2 * (frame - self.s[length] + 1) >= length
+                and (not self.pending or self.d[length] < self.best)):
+            self.best = self.d[length]
+            self.start = self.s[length]
+            self.end = frame
+            self.pending = True
+        return match
+
+
+def dtw(a, b):
+    """Whole sequence warping distance, per frame of both sequences."""
+    prev = [0] + [INF] * len(b)
+    for x in a:
+        cur = [INF] * (len(b) + 1)
+        for j, y in enumerate(b, 1):
+            cur[j] = distance(x, y) + min(prev[j - 1], prev[j], cur[j - 1])
+        prev = cur
+    return prev[len(b)] / (len(a) + len(b))
+
+
+def resample(frames, length):
+    if len(frames) <= length:
+        return frames
+    return [frames[int(round(i * (len(frames) - 1) / (length - 1)))] for i in range(length)]
+
+
+def parse_trace_arg(arg):
+    path, _, labels = arg.partition(":")
+    return path, (read_labels(labels) if labels else None)
+
+
+def cmd_train(args):
+    traces = []
+    examples = {}
+    for arg in args.trace:
+        path, labels = parse_trace_arg(arg)
+        if labels is None:
+            print("%s: labels are required to train" % path, file=sys.stderr)
+            return 1
+        frames = trace_frames(path)
+        traces.append((frames, labels))
+        for start, end, name in labels:
+            example = [q for t, q in frames if start <= t <= end]
+            if len(example) >= 2:
+                examples.setdefault(name, []).append(example)
+
+    if not examples or len(examples) > MAX_TEMPLATES:
+        print("1 to %d gestures are needed, %d labelled" % (MAX_TEMPLATES, len(examples)),
+              file=sys.stderr)
+        return 1
+
+    templates = []
+    for name in sorted(examples):
+        group = examples[name]
+        # the medoid is the example closest to all the others
+        costs = [sum(dtw(a, b) for b in group if b is not a) for a in group]
+        medoid = resample(group[costs.index(min(costs))], MAX_LENGTH)
+        length = len(medoid)
+
+        # best score of a path ending at each frame, inside and outside the examples
+        positives = []
+        negative = INF
+        slack = 10 * 1000 // FRAME_HZ
+        for frames, labels in traces:
+            spring = Spring(medoid, 0)
+            best = {}
+            for k, (t, q) in enumerate(frames):
+                spring.column(q, k)
+                d, s = spring.d[length], spring.s[length]
+                if d >= INF or 2 * (k - s + 1) < length:
+                    continue
+                score = d // length
+                inside = [i for i, (start, end, label) in enumerate(labels)
+                          if label == name and frames[s][0] >= start - slack
+                          and t <= end + slack]
+                overlaps = any(frames[s][0] <= end and t >= start
+                               for start, end, label in labels if label == name)
+                for i in inside:
+                    best[i] = min(best.get(i, INF), score)
+                if not overlaps:
+                    negative = min(negative, score)
+            positives += [best.get(i, INF) for i, (_, _, label) in enumerate(labels)
+                          if label == name]
+
+        worst = max(positives)
+        if worst >= INF:
+            print("%s: an example is shorter than half the template" % name, file=sys.stderr)
+            worst = max(p for p in positives if p < INF)
+        if negative > worst:
+            threshold = (worst + min(negative, 2 * worst + 1)) // 2
+        else:
+            threshold = worst
+            print("%s: examples and other moves overlap, closest other move %d"
+                  % (name, negative), file=sys.stderr)
+        templates.append({"name": name, "threshold": threshold, "frames": medoid,
+                          "examples": len(group)})
+        print("%-12s %2d examples, %2d frames, worst example %d, closest other move %s, "
+              "threshold %d" % (name, len(group), length, worst,
+                                "-" if negative >= INF else negative, threshold))
+
+    with open(args.out, "w") as f:
+        json.dump(templates, f, indent=1)
+    if args.c:
+        write_c(templates, args.c)
+    return 0
+
+
+def write_c(templates, path):
+    """Write the templates as imu_gesture_templates.c.
+
+    Without templates the table keeps a single zeroed entry, as C has no empty
+    arrays, and the count is 0.
+    """
+    out = ["/**",
+           " " + "*" * 78,
+           " * @file    imu_gesture_templates.c",
+           " *",
+           " * @author \tMarco Rolon",
+           " *",
+           " * @brief   IMU gesture templates",
+           " *",
+           " * Generated by Tools/imu_gesture.py train, do not edit.",
+           " " + "*" * 78,
+           " */",
+           "",
+           "#include \"imu_gesture.h\"",
+           ""]
+    for tp in templates:
+        ident = "".join(c if c.isalnum() else "_" for c in tp["name"]) + "Frames"
+        tp["ident"] = ident
+        out += ["/**",
+                " * @var %s" % ident,
+                " * @brief Frames of the \"%s\" template, medoid of %d examples."
+                % (tp["name"], tp["examples"]),
+                " */",
+                "static const int8_t %s[%d][IMU_GESTURE_CHANNELS] =" % (ident, len(tp["frames"])),
+                "{"]
+        out += ["{ %s }," % ", ".join("%d" % x for x in q) for q in tp["frames"]]
+        out += ["};", ""]
+    if not templates:
+        out += ["/*",
+                " * No template is shipped until some are trained from labelled recordings,",
+                " * only the rule based gestures are recognised.",
+                " */",
+                "const imuGestureTemplate_t imuGestureTemplates[1] =",
+                "{",
+                "{ NULL, 0, 0, NULL } };",
+                "",
+                "const uint8_t imuGestureTemplateCount = 0;",
+                ""]
+        with open(path, "w") as f:
+            f.write("\n".join(out))
+        return
+    out += ["const imuGestureTemplate_t imuGestureTemplates[] =", "{"]
+    out += ["{ \"%s\", %d, %d, %s }," % (tp["name"], len(tp["frames"]), tp["threshold"],
+                                        tp["ident"]) for tp in templates]
+    out += ["};", "",
+            "const uint8_t imuGestureTemplateCount = sizeof(imuGestureTemplates)",
+            "\t\t/ sizeof(imuGestureTemplates[0]);", ""]
+    with open(path, "w") as f:
+        f.write("\n".join(out))
+
+
+def cmd_eval(args):
+    with open(args.templates) as f:
+        templates = json.load(f)
+    totals = {tp["name"]: [0, 0, 0] for tp in templates}
+
+    for arg in args.trace:
+        path, labels = parse_trace_arg(arg)
+        frames = trace_frames(path)
+        springs = [Spring(tp["frames"], tp["threshold"]) for tp in templates]
+        found = [set() for _ in templates]
+        print("%s: %d frames" % (path, len(frames)))
+        for k, (t, q) in enumerate(frames):
+            for j, spring in enumerate(springs):
+                match = spring.step(q, k)
+                if match is None:
+                    continue
+                score, start, end = match
+                name = templates[j]["name"]
+                hit = None
+                for i, (ls, le, label) in enumerate(labels or []):
+                    if label == name and frames[start][0] <= le and frames[end][0] >= ls:
+                        hit = i
+                        break
+                if labels is not None:
+                    if hit is None or hit in found[j]:
+                        totals[name][2] += 1
+                    else:
+                        found[j].add(hit)
+                print("  %8.3f s %-12s score %3d, %.3f to %.3f s%s"
+                      % (t / 1000.0, name, score, frames[start][0] / 1000.0,
+                         frames[end][0] / 1000.0,
+                         "" if labels is None else ("" if hit is not None else "  false")))
+        for j, tp in enumerate(templates):
+            labelled = sum(1 for _, _, label in labels or [] if label == tp["name"])
+            totals[tp["name"]][0] += len(found[j])
+            totals[tp["name"]][1] += labelled - len(found[j])
+
+    if any(":" in arg for arg in args.trace):
+        print("%-12s %5s %7s %6s %9s %7s" % ("gesture", "hits", "misses", "false",
+                                             "precision", "recall"))
+        for name, (hits, misses, false) in sorted(totals.items()):
+            precision = hits / (hits + false) if hits + false else 0.0
+            recall = hits / (hits + misses) if hits + misses else 0.0
+            print("%-12s %5d %7d %6d %9.2f %7.2f" % (name, hits, misses, false,
+                                                      precision, recall))
+    return 0
+
+
+def cmd_synth(args):
+    rng = random.Random(args.seed)
+    rate = args.rate
+    acc_fsr, gyro_fsr = 1, 3
+    n = int(args.seconds * rate)
+    acc = [[0.0, 0.0, 1.0] for _ in range(n)]
+    gyro = [[0.0, 0.0, 0.0] for _ in range(n)]
+    labels = []
+
+    # a move every 1.5 to 3 s: mostly twists about X, with turns and swings about Z
+    t = 1.0
+    while t < args.seconds - 2.0:
+        kind = rng.choice(["twist", "twist", "twist", "turn", "swing"])
+        length = rng.uniform(0.4, 0.6) if kind == "twist" else rng.uniform(0.5, 1.0)
+        amplitude = rng.uniform(320.0, 480.0)
+        axis = 0 if kind == "twist" else 2
+        first = int(t * rate)
+        count = int(length * rate)
+        for k in range(count):
+            phase = k / count
+            if kind == "turn":
+                w = amplitude * 0.5 * math.sin(math.pi * phase)
+            else:
+                w = amplitude * math.sin(2.0 * math.pi * phase)
+            gyro[first + k][axis] = w
+            if kind == "swing":
+                acc[first + k][1] += 0.3 * math.sin(2.0 * math.pi * phase)
+        if kind == "twist":
+            labels.append((t, t + length, kind))
+        t += length + rng.uniform(1.0, 2.5)
+
+    data = bytearray(MAGIC + struct.pack("<BBHBBBB", VERSION, 0, rate, 1, acc_fsr,
+                                         gyro_fsr, 0))
+    data += struct.pack("<3i3iI", 0, 0, 0, 65536, 65536, 65536, 0)
+    step = 1000 // rate
+    for a, w in zip(acc, gyro):
+        raw = [int(round((x + rng.gauss(0.0, 0.005)) * ACC_LSB_PER_G[acc_fsr])) for x in a]
+        raw += [int(round(2500 + rng.gauss(0.0, 5.0)))]
+        raw += [int(round((x + rng.gauss(0.0, 1.0)) * GYRO_LSB_PER_DPS[gyro_fsr])) for x in w]
+        data += struct.pack("<BH7h", step, step * 1000, *raw)
+
+    with open(args.out, "wb") as f:
+        f.write(data)
+    with open(args.labels, "w") as f:
+        f.write("start,end,name\n")
+        for start, end, name in labels:
+            f.write("%.3f,%.3f,%s\n" % (start, end, name))
+    print("%d samples, %d labelled gestures" % (n, len(labels)))
+    return 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    t = sub.add_parser("train")
+    t.add_argument("--trace", action="append", required=True, help="trace.bin:labels.csv")
+    t.add_argument("--out", default="templates.json")
+    t.add_argument("--c", help="C source to write, e.g. Drivers/imu/Src/imu_gesture_templates.c")
+
+    e = sub.add_parser("eval")
+    e.add_argument("--templates", required=True)
+    e.add_argument("--trace", action="append", required=True, help="trace.bin[:labels.csv]")
+
+    s = sub.add_parser("synth")
+    s.add_argument("--out", required=True)
+    s.add_argument("--labels", required=True)
+    s.add_argument("--seconds", type=float, default=60)
+    s.add_argument("--rate", type=int, default=200)
+    s.add_argument("--seed", type=int, default=1)
+
+    args = ap.parse_args()
+    return {"train": cmd_train, "eval": cmd_eval, "synth": cmd_synth}[args.cmd](args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+SpinFlow NeoPixels streaming - host side framing library.
+
+Mirrors Drivers/neopixels/Src/npx_frame.c:
+
+    | 0xA5 | 0x5A | count (u16 LE) | count x (G, R, B) | fletcher16 (u16 LE) |
+
+The checksum covers the count field and the payload.
+
+Usage:
+    npx_stream.py send --port /dev/ttyACM0 [--pixels 20] [--fps 200] [--seconds 5]
+    npx_stream.py bench [--pixels 20] [--frames 20000] [--chunk 64]
+
+`send` streams a moving rainbow to the board (requires pyserial).
+`bench` measures the throughput of this Python encoder and parser through an
+in-memory loopback that chops the stream into USB sized packets, without any
+hardware. The firmware parser itself is tested and timed by Tools/host/test_frame.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+SYNC = b"\xA5\x5A"
+OVERHEAD = 6
+MAX_PIXELS = 256
+
+
+def fletcher16(data):
+    sum1 = 0
+    sum2 = 0
+    for b in data:
+        sum1 = (sum1 + b) % 255
+        sum2 = (sum2 + sum1) % 255
+    return (sum2 << 8) | sum1
+
+
+def encode_frame(grb):
+    """Encode a frame from a bytes-like object holding G, R, B triplets."""
+    if len(grb) % 3 or len(grb) // 3 > MAX_PIXELS:
+        raise ValueError("payload must hold at most %d pixels" % MAX_PIXELS)
+    body = struct.pack("<H", len(grb) // 3) + bytes(grb)
+    return SYNC + body + struct.pack("<H", fletcher16(body))
+
+
+class FrameParser:
+    """Incremental parser with the states and resync of npxFrame_Parse().
+
+    After a bad pixel count the search for the next sync starts after the count
+    field, after a bad checksum it starts after the whole frame.
+    """
+
+    SYNC_1, SYNC_2, COUNT_L, COUNT_H, PAYLOAD, CHECK_L, CHECK_H = range(7)
+
+    def __init__(self):
+        self.state = self.SYNC_1
+        self.payload = bytearray()
+        self.count = 0
+        self.expected = 0
+        self.check = 0
+        self.frames = 0
+        self.errors = 0
+
+    def feed(self, data):
+        """Feed bytes, return the list of complete G, R, B payloads."""
+        out = []
+        i = 0
+        while i < len(data):
+            if self.state == self.PAYLOAD:
+                # payload is copied in bulk, the rest is handled byte by byte
+                chunk = data[i:i + self.expected - len(self.payload)]
+                self.payload += chunk
+                i += len(chunk)
+                if len(self.payload) == self.expected:
+                    self.state = self.CHECK_L
+                continue
+
+            byte = data[i]
+            i += 1
+            if self.state == self.SYNC_1:
+                if byte == SYNC[0]:
+                    self.state = self.SYNC_2
+            elif self.state == self.SYNC_2:
+                if byte == SYNC[1]:
+                    self.state = self.COUNT_L
+                elif byte != SYNC[0]:
+                    self.state = self.SYNC_1
+            elif self.state == self.COUNT_L:
+                self.expected = byte
+                self.state = self.COUNT_H
+            elif self.state == self.COUNT_H:
+                self.expected |= byte << 8
+                if self.expected > MAX_PIXELS:
+                    self.errors += 1
+                    self.state = self.SYNC_1
+                else:
+                    self.count = self.expected
+                    self.expected *= 3
+                    self.payload = bytearray()
+                    self.state = self.PAYLOAD if self.expected else self.CHECK_L
+            elif self.state == self.CHECK_L:
+                self.check = byte
+                self.state = self.CHECK_H
+            else:
+                self.check |= byte << 8
+                self.state = self.SYNC_1
+                if self.check == fletcher16(struct.pack("<H", self.count) + self.payload):
+                    out.append(bytes(self.payload))
+                    self.frames += 1
+                else:
+                    self.errors += 1
+        return out
+
+
+def rainbow(pixels, phase):
+    grb = bytearray()
+    for i in range(pixels):
+        h = (i * 256 // max(pixels, 1) + phase) & 0xFF
+        if h < 85:
+            r, g, b = 255 - h * 3, h * 3, 0
+        elif h < 170:
+            h -= 85
+            r, g, b = 0, 255 - h * 3, h * 3
+        else:
+            h -= 170
+            r, g, b = h * 3, 0, 255 - h * 3
+        grb += bytes((g // 4, r // 4, b // 4))
+    return grb
+
+
+def cmd_send(args):
+    import serial  # pyserial
+
+    period = 1.0 / args.fps
+    with serial.Serial(args.port, timeout=1) as port:
+        end = time.monotonic() + args.seconds
+        sent = 0
+        while time.monotonic() < end:
+            t = time.monotonic()
+            port.write(encode_frame(rainbow(args.pixels, sent)))
+            sent += 1
+            delay = period - (time.monotonic() - t)
+            if delay > 0:
+                time.sleep(delay)
+    print("sent %d frames" % sent)
+
+
+def cmd_bench(args):
+    frames = [encode_frame(rainbow(args.pixels, i)) for i in range(256)]
+    parser = FrameParser()
+    total = 0
+    t = time.perf_counter()
+    pending = bytearray()
+    for i in range(args.frames):
+        pending += frames[i & 0xFF]
+        # loopback: deliver the stream in USB sized packets
+        while len(pending) >= args.chunk:
+            parser.feed(bytes(pending[:args.chunk]))
+            total += args.chunk
+            del pending[:args.chunk]
+    parser.feed(bytes(pending))
+    total += len(pending)
+    elapsed = time.perf_counter() - t
+
+    print("frames ok %d, errors %d" % (parser.frames, parser.errors))
+    print("%.0f frames/s, %.2f MB/s" % (parser.frames / elapsed, total / elapsed / 1e6))
+    # full speed bulk tops out around 1 MB/s, 9600 baud UART around 960 B/s
+    length = len(frames[0])
+    print("frame length %d bytes: USB FS ~%.0f frames/s, UART 9600 ~%.1f frames/s"
+          % (length, 1.0e6 / length, 960.0 / length))
+    return 0 if parser.frames == args.frames and parser.errors == 0 else 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    s = sub.add_parser("send")
+    s.add_argument("--port", required=True)
+    s.add_argument("--pixels", type=int, default=20)
+    s.add_argument("--fps", type=float, default=200)
+    s.add_argument("--seconds", type=float, default=5)
+
+    b = sub.add_parser("bench")
+    b.add_argument("--pixels", type=int, default=20)
+    b.add_argument("--frames", type=int, default=20000)
+    b.add_argument("--chunk", type=int, default=64)
+
+    args = ap.parse_args()
+    return cmd_send(args) if args.cmd == "send" else cmd_bench(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())